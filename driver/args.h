@@ -33,6 +33,7 @@
 #include <string>
 #include <unordered_map>
 #include <vector>
+#include <algorithm>
 #include "common.h"
 
 typedef struct {
@@ -154,6 +155,18 @@ class args_t {
         return value;
     }
 
+    // every value, default or parsed, in a fixed order. two command lines of the same problem give the same string
+    std::string canonical() const {
+        std::vector<char> names;
+        for (auto &it : input_map)
+            names.push_back(it.first);
+        std::sort(names.begin(), names.end());
+        std::string s;
+        for (char name : names)
+            s += std::string(1, name) + "=" + input_map.at(name).value + " ";
+        return s;
+    }
+
   private:
     std::unordered_map<char, args_input_t> input_map;
 };
@@ -237,6 +250,8 @@ static inline args_t create_conv_args(int argc, char *argv[]) {
     args.insert_arg("iter", 'i', "10", "Number of Iterations (Default=10)",
                     "int");
     args.insert_arg("verify", 'V', "1", "Verify Each Layer (Default=1)", "int");
+    args.insert_arg("seed", 'R', "0",
+                    "Seed of the random tensor init (Default=0)", "int");
     args.insert_arg(
         "verification_cache", 'C', "",
         "Use specified directory to cache verification data. Off by default.",
@@ -0,0 +1,306 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _BLOCKED_CONV_3D_CPU_H
+#define _BLOCKED_CONV_3D_CPU_H
+
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <vector>
+#include "thread_pool_cpu.h"
+#include "naive_conv.h"
+#include "conv_geometry_cpu.h"
+#include "sgemm_cpu.h"
+
+/*
+ * blocked host convolution for ncdhw/ndhwc, the 3d counterpart of the naive_conv loop nests.
+ * every fwd/bwd task owns one (d, h) row of the output (fwd) or input (bwd) of a group, and walks it in runs of
+ * columns that share their x taps (conv_geometry_cpu_dim_t), so there is no bounds check per element.
+ * one (z, y, x) tap of a run is a small sgemm over strided views, without any copy:
+ *   fwd : dst[k][run] += filter[k][c] x src[c][run]          ncdhw, ndhwc is the transpose
+ *   bwd : src_grad[c][run] += filter[k][c]^T x dst_grad[k][run]
+ *   wrw : filter_grad[k][c] += dst_grad[k][run] x src[c][run]^T, for every tap over n * od * oh rows
+ * so the input rows under the filter window stay in cache while all filters of the group reuse them.
+ * wrw reduces through naive_conv_wrw_split_reduce, so the result does not depend on the thread count.
+ * the products are the ones of naive_conv in another grouping, so the result matches it within rounding.
+ */
+
+// consecutive columns that read the same taps along x
+struct blocked_conv_3d_cpu_run_t{
+    size_t first;       // first column, output (fwd) or input (bwd)
+    size_t len;
+    size_t step;        // column distance inside the run, 1 (fwd) or the stride (bwd)
+    size_t base;        // fwd: input column of the first tap, bwd: output column of the q == 0 tap, for the first column
+    size_t tap_begin, tap_end;                              // fwd: taps [tap_begin, tap_end)
+    const conv_geometry_cpu_dim_t::tap_t *taps, *taps_end;  // bwd: taps of the stride phase
+};
+
+// fwd: output o + j reads input base + j * s for the tap tap_begin
+static inline std::vector<blocked_conv_3d_cpu_run_t> blocked_conv_3d_cpu_fwd_runs(const conv_geometry_cpu_dim_t & dim)
+{
+    std::vector<blocked_conv_3d_cpu_run_t> runs;
+    for(size_t o = 0; o < dim.out(); o++){
+        size_t tb = dim.tap_begin(o), te = dim.tap_end(o);
+        if(!runs.empty() && runs.back().tap_begin == tb && runs.back().tap_end == te){
+            runs.back().len++;
+            continue;
+        }
+        runs.push_back({o, 1, 1, tb < te ? dim.in_first(o) : 0, tb, te, nullptr, nullptr});
+    }
+    return runs;
+}
+
+// bwd: columns i, i + s, ... of one stride phase read consecutive outputs, a run is a stretch of them with the same taps
+static inline std::vector<blocked_conv_3d_cpu_run_t> blocked_conv_3d_cpu_bwd_runs(const conv_geometry_cpu_dim_t & dim, size_t s)
+{
+    std::vector<blocked_conv_3d_cpu_run_t> runs;
+    for(size_t i0 = 0; i0 < s && i0 < dim.in(); i0++){
+        size_t phase_first = runs.size();
+        for(size_t i = i0; i < dim.in(); i += s){
+            const conv_geometry_cpu_dim_t::tap_t *tb, *te;
+            size_t base;
+            dim.bwd_taps(i, &tb, &te, &base);
+            if(runs.size() > phase_first && runs.back().taps == tb && runs.back().taps_end == te){
+                runs.back().len++;
+                continue;
+            }
+            runs.push_back({i, 1, s, base, 0, 0, tb, te});
+        }
+    }
+    return runs;
+}
+
+// element strides of the tensors of one group, so both layouts share the kernels
+struct blocked_conv_3d_cpu_layout_t{
+    size_t src_n, src_c, src_d, src_h, src_w;
+    size_t dst_n, dst_k, dst_d, dst_h, dst_w;
+    size_t filter_k, filter_c, filter_tap;
+    size_t src_g, dst_g;        // offset of the next group
+};
+
+static inline blocked_conv_3d_cpu_layout_t blocked_conv_3d_cpu_get_layout(const conv_geometry_cpu_t & geo, bool ndhwc)
+{
+    size_t d = geo.z.in(), h = geo.y.in(), w = geo.x.in(), od = geo.z.out(), oh = geo.y.out(), ow = geo.x.out();
+    size_t c = geo.c, k = geo.k, taps = geo.z.f() * geo.y.f() * geo.x.f();
+    blocked_conv_3d_cpu_layout_t l;
+    if(ndhwc){
+        l = {d * h * w * c, 1, h * w * c, w * c, c,
+             od * oh * ow * k, 1, oh * ow * k, ow * k, k,
+             taps * geo.c_per_group, 1, geo.c_per_group, geo.c_per_group, geo.k_per_group};
+    }else{
+        l = {c * d * h * w, d * h * w, h * w, w, 1,
+             k * od * oh * ow, od * oh * ow, oh * ow, ow, 1,
+             geo.c_per_group * taps, taps, 1, geo.c_per_group * d * h * w, geo.k_per_group * od * oh * ow};
+    }
+    return l;
+}
+
+static inline void blocked_conv_3d_cpu_fwd(const float *src, const float *filter, float *dst,
+                                           const conv_geometry_cpu_t & geo, const blocked_conv_3d_cpu_layout_t & l,
+                                           size_t sx, size_t dx)
+{
+    size_t od = geo.z.out(), oh = geo.y.out(), ow = geo.x.out();
+    size_t c_per_group = geo.c_per_group, k_per_group = geo.k_per_group;
+    size_t fy = geo.y.f(), fx = geo.x.f();
+    std::vector<blocked_conv_3d_cpu_run_t> runs = blocked_conv_3d_cpu_fwd_runs(geo.x);
+
+    auto conv_row = [&](size_t in, size_t ig, size_t iod, size_t ioh){
+        const float *src_g = src + in * l.src_n + ig * l.src_g;
+        const float *filter_g = filter + ig * k_per_group * l.filter_k;
+        float *dst_row = dst + in * l.dst_n + ig * l.dst_g + iod * l.dst_d + ioh * l.dst_h;
+        for(size_t ik = 0; ik < k_per_group; ik++)
+            for(size_t iow = 0; iow < ow; iow++)
+                dst_row[ik * l.dst_k + iow * l.dst_w] = .0f;
+        for(size_t iz = geo.z.tap_begin(iod); iz < geo.z.tap_end(iod); iz++){
+            for(size_t ir = geo.y.tap_begin(ioh); ir < geo.y.tap_end(ioh); ir++){
+                const float *src_r = src_g + geo.z.in_of(iod, iz) * l.src_d + geo.y.in_of(ioh, ir) * l.src_h;
+                for(const blocked_conv_3d_cpu_run_t & run : runs){
+                    for(size_t is = run.tap_begin; is < run.tap_end; is++)
+                        sgemm_cpu(k_per_group, run.len, c_per_group,
+                                  filter_g + ((iz * fy + ir) * fx + is) * l.filter_tap, l.filter_k, l.filter_c,
+                                  src_r + (run.base + (is - run.tap_begin) * dx) * l.src_w, l.src_c, sx * l.src_w,
+                                  dst_row + run.first * l.dst_w, l.dst_k, l.dst_w, true);
+                }
+            }
+        }
+    };
+
+    size_t rows = geo.n * geo.group * od * oh;
+    thread_pool_cpu_parallel_for(rows, [&](size_t begin, size_t end){
+        for(size_t row = begin; row < end; row++){
+            size_t ioh = row % oh;
+            size_t iod = (row / oh) % od;
+            size_t ig = (row / (oh * od)) % geo.group;
+            size_t in = row / (oh * od * geo.group);
+            conv_row(in, ig, iod, ioh);
+        }
+    });
+}
+
+static inline void blocked_conv_3d_cpu_bwd(float *src_grad, const float *filter, const float *dst_grad,
+                                           const conv_geometry_cpu_t & geo, const blocked_conv_3d_cpu_layout_t & l,
+                                           size_t sx)
+{
+    typedef conv_geometry_cpu_dim_t::tap_t tap_t;
+    size_t d = geo.z.in(), h = geo.y.in(), w = geo.x.in();
+    size_t c_per_group = geo.c_per_group, k_per_group = geo.k_per_group;
+    size_t fy = geo.y.f(), fx = geo.x.f();
+    std::vector<blocked_conv_3d_cpu_run_t> runs = blocked_conv_3d_cpu_bwd_runs(geo.x, sx);
+
+    auto conv_row = [&](size_t in, size_t ig, size_t id, size_t ih){
+        const tap_t *tz, *tz_begin, *tz_end, *ty, *ty_begin, *ty_end, *tx;
+        size_t base_d, base_h;
+        geo.z.bwd_taps(id, &tz_begin, &tz_end, &base_d);
+        geo.y.bwd_taps(ih, &ty_begin, &ty_end, &base_h);
+        const float *dst_grad_g = dst_grad + in * l.dst_n + ig * l.dst_g;
+        const float *filter_g = filter + ig * k_per_group * l.filter_k;
+        float *src_grad_row = src_grad + in * l.src_n + ig * l.src_g + id * l.src_d + ih * l.src_h;
+        for(size_t ic = 0; ic < c_per_group; ic++)
+            for(size_t iw = 0; iw < w; iw++)
+                src_grad_row[ic * l.src_c + iw * l.src_w] = .0f;
+        for(tz = tz_begin; tz < tz_end; tz++){
+            for(ty = ty_begin; ty < ty_end; ty++){
+                const float *dst_grad_r = dst_grad_g + (base_d - tz->q) * l.dst_d + (base_h - ty->q) * l.dst_h;
+                for(const blocked_conv_3d_cpu_run_t & run : runs){
+                    for(tx = run.taps; tx < run.taps_end; tx++)
+                        sgemm_cpu(c_per_group, run.len, k_per_group,
+                                  filter_g + ((tz->r * fy + ty->r) * fx + tx->r) * l.filter_tap, l.filter_c, l.filter_k,
+                                  dst_grad_r + (run.base - tx->q) * l.dst_w, l.dst_k, l.dst_w,
+                                  src_grad_row + run.first * l.src_w, l.src_c, run.step * l.src_w, true);
+                }
+            }
+        }
+    };
+
+    size_t rows = geo.n * geo.group * d * h;
+    thread_pool_cpu_parallel_for(rows, [&](size_t begin, size_t end){
+        for(size_t row = begin; row < end; row++){
+            size_t ih = row % h;
+            size_t id = (row / h) % d;
+            size_t ig = (row / (h * d)) % geo.group;
+            size_t in = row / (h * d * geo.group);
+            conv_row(in, ig, id, ih);
+        }
+    });
+}
+
+static inline void blocked_conv_3d_cpu_wrw(const float *src, float *filter_grad, const float *dst_grad,
+                                           const conv_geometry_cpu_t & geo, const blocked_conv_3d_cpu_layout_t & l,
+                                           size_t sx)
+{
+    size_t od = geo.z.out(), oh = geo.y.out();
+    size_t c_per_group = geo.c_per_group, k_per_group = geo.k_per_group;
+    size_t fz = geo.z.f(), fy = geo.y.f(), fx = geo.x.f(), taps = fz * fy * fx;
+    size_t rows = geo.n * od * oh;
+
+    // tasks [begin, end) of (ig, iz, ir, is), every one a k_per_group x c_per_group gemm summed over rows [r_begin, r_end)
+    auto range_func = [&](size_t r_begin, size_t r_end, float *grad, size_t begin, size_t end){
+        for(size_t t = begin; t < end; t++){
+            size_t tap = t % taps, ig = t / taps;
+            size_t is = tap % fx, ir = (tap / fx) % fy, iz = tap / (fx * fy);
+            size_t ow_begin = geo.x.out_begin(is), nw = geo.x.out_end(is) - ow_begin;
+            float *grad_t = grad + ig * k_per_group * l.filter_k + tap * l.filter_tap;
+            for(size_t ik = 0; ik < k_per_group; ik++)
+                for(size_t ic = 0; ic < c_per_group; ic++)
+                    grad_t[ik * l.filter_k + ic * l.filter_c] = .0f;
+            for(size_t row = r_begin; row < r_end && nw != 0; row++){
+                size_t ioh = row % oh, iod = (row / oh) % od, in = row / (oh * od);
+                if(iod < geo.z.out_begin(iz) || iod >= geo.z.out_end(iz) || ioh < geo.y.out_begin(ir) || ioh >= geo.y.out_end(ir))
+                    continue;
+                const float *src_r = src + in * l.src_n + ig * l.src_g + geo.z.in_of(iod, iz) * l.src_d +
+                                     geo.y.in_of(ioh, ir) * l.src_h + geo.x.in_of(ow_begin, is) * l.src_w;
+                const float *dst_grad_r = dst_grad + in * l.dst_n + ig * l.dst_g + iod * l.dst_d + ioh * l.dst_h +
+                                          ow_begin * l.dst_w;
+                sgemm_cpu(k_per_group, c_per_group, nw, dst_grad_r, l.dst_k, l.dst_w, src_r, sx * l.src_w, l.src_c,
+                          grad_t, l.filter_k, l.filter_c, true);
+            }
+        }
+    };
+    size_t tasks = geo.group * taps;
+    naive_conv_wrw_split_reduce(range_func, filter_grad, geo.k * c_per_group * taps, tasks, rows,
+                                naive_conv_wrw_get_splits(tasks, rows));
+}
+
+// entry points with the argument order of naive_conv_*_ncdhw/ndhwc
+#define BLOCKED_CONV_3D_CPU_GEOMETRY conv_geometry_cpu_t geo(n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group)
+
+static inline void blocked_conv_fwd_ncdhw(const float *src, const float *filter, float *dst,
+                                          size_t n, size_t w, size_t h, size_t d, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t fz, size_t px, size_t py, size_t pz,
+                                          size_t sx, size_t sy, size_t sz, size_t dx, size_t dy, size_t dz, size_t group)
+{
+    BLOCKED_CONV_3D_CPU_GEOMETRY;
+    blocked_conv_3d_cpu_fwd(src, filter, dst, geo, blocked_conv_3d_cpu_get_layout(geo, false), sx, dx);
+}
+
+static inline void blocked_conv_bwd_ncdhw(float *src_grad, const float *filter, const float *dst_grad,
+                                          size_t n, size_t w, size_t h, size_t d, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t fz, size_t px, size_t py, size_t pz,
+                                          size_t sx, size_t sy, size_t sz, size_t dx, size_t dy, size_t dz, size_t group)
+{
+    BLOCKED_CONV_3D_CPU_GEOMETRY;
+    blocked_conv_3d_cpu_bwd(src_grad, filter, dst_grad, geo, blocked_conv_3d_cpu_get_layout(geo, false), sx);
+}
+
+static inline void blocked_conv_wrw_ncdhw(const float *src, float *filter_grad, const float *dst_grad,
+                                          size_t n, size_t w, size_t h, size_t d, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t fz, size_t px, size_t py, size_t pz,
+                                          size_t sx, size_t sy, size_t sz, size_t dx, size_t dy, size_t dz, size_t group)
+{
+    BLOCKED_CONV_3D_CPU_GEOMETRY;
+    blocked_conv_3d_cpu_wrw(src, filter_grad, dst_grad, geo, blocked_conv_3d_cpu_get_layout(geo, false), sx);
+}
+
+static inline void blocked_conv_fwd_ndhwc(const float *src, const float *filter, float *dst,
+                                          size_t n, size_t w, size_t h, size_t d, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t fz, size_t px, size_t py, size_t pz,
+                                          size_t sx, size_t sy, size_t sz, size_t dx, size_t dy, size_t dz, size_t group)
+{
+    BLOCKED_CONV_3D_CPU_GEOMETRY;
+    blocked_conv_3d_cpu_fwd(src, filter, dst, geo, blocked_conv_3d_cpu_get_layout(geo, true), sx, dx);
+}
+
+static inline void blocked_conv_bwd_ndhwc(float *src_grad, const float *filter, const float *dst_grad,
+                                          size_t n, size_t w, size_t h, size_t d, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t fz, size_t px, size_t py, size_t pz,
+                                          size_t sx, size_t sy, size_t sz, size_t dx, size_t dy, size_t dz, size_t group)
+{
+    BLOCKED_CONV_3D_CPU_GEOMETRY;
+    blocked_conv_3d_cpu_bwd(src_grad, filter, dst_grad, geo, blocked_conv_3d_cpu_get_layout(geo, true), sx);
+}
+
+static inline void blocked_conv_wrw_ndhwc(const float *src, float *filter_grad, const float *dst_grad,
+                                          size_t n, size_t w, size_t h, size_t d, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t fz, size_t px, size_t py, size_t pz,
+                                          size_t sx, size_t sy, size_t sz, size_t dx, size_t dy, size_t dz, size_t group)
+{
+    BLOCKED_CONV_3D_CPU_GEOMETRY;
+    blocked_conv_3d_cpu_wrw(src, filter_grad, dst_grad, geo, blocked_conv_3d_cpu_get_layout(geo, true), sx);
+}
+
+#undef BLOCKED_CONV_3D_CPU_GEOMETRY
+
+#endif
@@ -0,0 +1,177 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _BUFFER_ARENA_CPU_H
+#define _BUFFER_ARENA_CPU_H
+
+#include <stddef.h>
+#include <assert.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * caching arena of size-class buffers, over any allocator given as a pair of functions, so the same code hands out
+ * host (pageable or pinned) and device memory, and can be tested with a mock allocator.
+ *
+ * acquire() rounds the request up to its size class (a quarter of its power of two, at least BUFFER_ARENA_CPU_MIN_BLOCK)
+ * and hands out the smallest cached block that holds it. when none is large enough a new block is allocated and the
+ * cache is left alone, as the other cached blocks are likely the other tensors of the same problem, so a problem
+ * that grows one tensor costs one allocation. outgrown blocks stay cached until trim(), or until the allocator fails,
+ * then the cache is given back and the allocation retried once. once every tensor has met its largest size the arena
+ * stops calling the allocator. release() puts a block back in the cache, trim() frees the cache.
+ */
+#ifndef BUFFER_ARENA_CPU_MIN_BLOCK
+#define BUFFER_ARENA_CPU_MIN_BLOCK 4096
+#endif
+
+class buffer_arena_cpu_t {
+public:
+    // kind is an opaque tag set by the allocator and handed back to its free, e.g. to tell pinned from pageable memory
+    using alloc_func_t = std::function<void *(size_t bytes, int *kind)>;
+    using free_func_t  = std::function<void(void *ptr, size_t bytes, int kind)>;
+
+    typedef struct {
+        size_t in_use;          // bytes of the blocks handed out
+        size_t peak_in_use;
+        size_t reserved;        // bytes taken from the allocator, in use or cached
+        size_t peak_reserved;
+        size_t num_allocs;      // calls to the allocator
+        size_t num_reuses;      // acquires served from the cache
+    } stats_t;
+
+    buffer_arena_cpu_t(alloc_func_t alloc_func_, free_func_t free_func_) : alloc_func(alloc_func_), free_func(free_func_), stats{} {}
+    ~buffer_arena_cpu_t()
+    {
+        trim();
+        for(auto & it : in_use)
+            free_func(it.second.ptr, it.second.bytes, it.second.kind);
+    }
+
+    static size_t size_class(size_t bytes)
+    {
+        if(bytes <= BUFFER_ARENA_CPU_MIN_BLOCK)
+            return BUFFER_ARENA_CPU_MIN_BLOCK;
+        size_t pow2 = BUFFER_ARENA_CPU_MIN_BLOCK;
+        while(pow2 <= (bytes - 1) / 2)
+            pow2 *= 2;
+        size_t step = pow2 / 4;
+        return (bytes + step - 1) / step * step;
+    }
+
+    // nullptr for 0 bytes, or if the allocator fails
+    void *acquire(size_t bytes)
+    {
+        if(bytes == 0)
+            return nullptr;
+        std::lock_guard<std::mutex> lk(mutex);
+        block_t block;
+        auto it = cached.lower_bound(bytes);
+        if(it != cached.end()){
+            block = it->second;
+            cached.erase(it);
+            stats.num_reuses++;
+        }else{
+            block.bytes = size_class(bytes);
+            block.kind = 0;
+            block.ptr = alloc_func(block.bytes, &block.kind);
+            if(!block.ptr && !cached.empty()){
+                free_cached();
+                block.ptr = alloc_func(block.bytes, &block.kind);
+            }
+            if(!block.ptr)
+                return nullptr;
+            stats.num_allocs++;
+            stats.reserved += block.bytes;
+            stats.peak_reserved = std::max(stats.peak_reserved, stats.reserved);
+        }
+        in_use[block.ptr] = block;
+        stats.in_use += block.bytes;
+        stats.peak_in_use = std::max(stats.peak_in_use, stats.in_use);
+        return block.ptr;
+    }
+
+    void release(void *ptr)
+    {
+        if(!ptr)
+            return;
+        std::lock_guard<std::mutex> lk(mutex);
+        auto it = in_use.find(ptr);
+        assert(it != in_use.end());
+        stats.in_use -= it->second.bytes;
+        cached.emplace(it->second.bytes, it->second);
+        in_use.erase(it);
+    }
+
+    // get blocks for all these sizes at once into the cache, e.g. for the largest problem of a batch
+    void reserve(const std::vector<size_t> & sizes)
+    {
+        std::vector<void *> ptrs;
+        for(size_t bytes : sizes)
+            ptrs.push_back(acquire(bytes));
+        for(void *ptr : ptrs)
+            release(ptr);
+    }
+
+    void trim()
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        free_cached();
+    }
+
+    stats_t get_stats()
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        return stats;
+    }
+
+private:
+    typedef struct {
+        void *ptr;
+        size_t bytes;
+        int kind;
+    } block_t;
+
+    void free_cached()
+    {
+        for(auto & it : cached){
+            free_func(it.second.ptr, it.second.bytes, it.second.kind);
+            stats.reserved -= it.second.bytes;
+        }
+        cached.clear();
+    }
+
+    alloc_func_t alloc_func;
+    free_func_t free_func;
+    std::multimap<size_t, block_t> cached;          // by capacity
+    std::unordered_map<void *, block_t> in_use;
+    std::mutex mutex;
+    stats_t stats;
+};
+
+#endif
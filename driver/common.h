@@ -43,6 +43,7 @@ typedef struct {
     float duration_ms   {FLT_MAX};
     float gflops        {0};
     float efficiency    {0};
+    bool is_valid       {true};  // false if the host validation after the run failed
     std::string kernel_name;
 } result_t;
 
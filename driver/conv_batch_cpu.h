@@ -0,0 +1,185 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _CONV_BATCH_CPU_H
+#define _CONV_BATCH_CPU_H
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+/*
+ * batch mode of conv_driver.exe, "conv_driver.exe --batch <file> [--batch_out <file.csv|file.json>]".
+ * every line of the batch file is one MIOpenDriver style command line, e.g. "convfp16 -n 64 -c 256 ... -F 1", as in
+ * the script/gtc_conv_*.sh scripts. '#' starts a comment, and a leading "./out/conv_driver.exe" is dropped, so
+ * script lines can be pasted as they are. all the lines are parsed before any kernel is run, identical problems are
+ * run once, and the fastest kernel of each (problem, direction) goes to one result file.
+ * this header only holds the host side parsing, dedup and result writing, the driver loop is in conv_driver.cpp.
+ */
+
+typedef struct {
+    int line;                           // 1 based line number in the batch file
+    std::vector<std::string> tokens;    // tokens[0] is the base arg, e.g. "conv", "convfp16"
+} conv_batch_cpu_cmd_t;
+
+typedef struct {
+    std::string cmd;                    // command line of the first occurrence
+    std::vector<int> lines;             // every line this problem appears on
+    std::string direction;
+    std::string kernel_name;            // empty if no kernel is applicable
+    int gks;
+    double duration_ms;
+    double tflops;
+    double efficiency;
+    int verified;
+    int num_invalid;                    // kernels that failed validation, of all those run
+} conv_batch_cpu_result_t;
+
+static inline bool conv_batch_cpu_ends_with(const std::string &s, const std::string &suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// split one line into tokens, false if nothing is left to run
+static inline bool conv_batch_cpu_tokenize(const std::string &line, std::vector<std::string> *tokens)
+{
+    tokens->clear();
+    std::istringstream ss(line.substr(0, line.find('#')));
+    std::string token;
+    while(ss >> token)
+        tokens->push_back(token);
+    if(!tokens->empty() && (conv_batch_cpu_ends_with((*tokens)[0], "conv_driver.exe") ||
+                            conv_batch_cpu_ends_with((*tokens)[0], "MIOpenDriver")))
+        tokens->erase(tokens->begin());
+    return !tokens->empty();
+}
+
+static inline bool conv_batch_cpu_parse(const char *path, std::vector<conv_batch_cpu_cmd_t> *cmds)
+{
+    std::ifstream fs(path);
+    if(!fs.is_open())
+        return false;
+    cmds->clear();
+    std::string line;
+    for(int line_no = 1; std::getline(fs, line); line_no++){
+        conv_batch_cpu_cmd_t cmd;
+        cmd.line = line_no;
+        if(conv_batch_cpu_tokenize(line, &cmd.tokens))
+            cmds->push_back(cmd);
+    }
+    return true;
+}
+
+static inline std::string conv_batch_cpu_join(const std::vector<std::string> &tokens)
+{
+    std::string s;
+    for(size_t i = 0; i < tokens.size(); i++)
+        s += (i ? " " : "") + tokens[i];
+    return s;
+}
+
+// keys are the canonical forms of the parsed problems. returns the index of the first occurrence of every distinct
+// key, in order, and sets unique_of[i] to the position of key i in that list
+static inline std::vector<size_t> conv_batch_cpu_dedupe(const std::vector<std::string> &keys, std::vector<size_t> *unique_of)
+{
+    std::vector<size_t> unique;
+    std::unordered_map<std::string, size_t> seen;
+    unique_of->resize(keys.size());
+    for(size_t i = 0; i < keys.size(); i++){
+        auto it = seen.find(keys[i]);
+        if(it == seen.end()){
+            it = seen.emplace(keys[i], unique.size()).first;
+            unique.push_back(i);
+        }
+        (*unique_of)[i] = it->second;
+    }
+    return unique;
+}
+
+static inline std::string conv_batch_cpu_json_str(const std::string &s)
+{
+    std::string r = "\"";
+    for(char ch : s){
+        if(ch == '"' || ch == '\\')
+            r += '\\';
+        r += ch;
+    }
+    return r + "\"";
+}
+
+static inline void conv_batch_cpu_write_csv(FILE *fp, const std::vector<conv_batch_cpu_result_t> &results)
+{
+    fprintf(fp, "lines,direction,cost_ms,tflops,efficiency,kernel,gks,verified,num_invalid,cmd\n");
+    for(const auto &r : results){
+        std::string lines;
+        for(size_t i = 0; i < r.lines.size(); i++)
+            lines += (i ? ";" : "") + std::to_string(r.lines[i]);
+        if(r.kernel_name.empty())
+            fprintf(fp, "%s,%s,,,,,,%d,%d,%s\n", lines.c_str(), r.direction.c_str(), r.verified, r.num_invalid, r.cmd.c_str());
+        else
+            fprintf(fp, "%s,%s,%.3f,%.3f,%.2f%%,%s,%d,%d,%d,%s\n", lines.c_str(), r.direction.c_str(), r.duration_ms,
+                    r.tflops, r.efficiency, r.kernel_name.c_str(), r.gks, r.verified, r.num_invalid, r.cmd.c_str());
+    }
+}
+
+static inline void conv_batch_cpu_write_json(FILE *fp, const std::vector<conv_batch_cpu_result_t> &results)
+{
+    fprintf(fp, "[\n");
+    for(size_t j = 0; j < results.size(); j++){
+        const auto &r = results[j];
+        std::string lines;
+        for(size_t i = 0; i < r.lines.size(); i++)
+            lines += (i ? ", " : "") + std::to_string(r.lines[i]);
+        fprintf(fp, "  {\"lines\": [%s], \"direction\": %s, \"cmd\": %s, ", lines.c_str(),
+                conv_batch_cpu_json_str(r.direction).c_str(), conv_batch_cpu_json_str(r.cmd).c_str());
+        if(r.kernel_name.empty())
+            fprintf(fp, "\"kernel\": null, ");
+        else
+            fprintf(fp, "\"kernel\": %s, \"gks\": %d, \"cost_ms\": %.3f, \"tflops\": %.3f, \"efficiency\": %.2f, ",
+                    conv_batch_cpu_json_str(r.kernel_name).c_str(), r.gks, r.duration_ms, r.tflops, r.efficiency);
+        fprintf(fp, "\"verified\": %s, \"num_invalid\": %d}%s\n", r.verified ? "true" : "false", r.num_invalid,
+                j + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "]\n");
+}
+
+// json if path ends with ".json", csv otherwise
+static inline bool conv_batch_cpu_write(const char *path, const std::vector<conv_batch_cpu_result_t> &results)
+{
+    FILE *fp = fopen(path, "w");
+    if(!fp)
+        return false;
+    if(conv_batch_cpu_ends_with(path, ".json"))
+        conv_batch_cpu_write_json(fp, results);
+    else
+        conv_batch_cpu_write_csv(fp, results);
+    return fclose(fp) == 0;
+}
+
+#endif
@@ -58,7 +58,11 @@
 #else
 #   define NAIVE_CONV_THREADED
 #   include "naive_conv.h"
+#   include "conv_ref_cpu.h"
+#   include "conv_native_cpu.h"
+#   include "conv_sample_cpu.h"
 #endif
+#include "convert_cpu.h"
 
 #ifndef USE_MIOPEN_NRMS
 #define USE_MIOPEN_NRMS 1
@@ -69,8 +73,14 @@
 #include "config_parser.h"
 #include "perf.h"
 #include "tensor_transpose.h"
+#include "transpose_cpu.h"
+#include "thread_pool_cpu.h"
 #include "tensor_copy_cpu.h"
+#include "rand_cpu.h"
 #include "tensor_validation_cpu.h"
+#include "valid_stream_cpu.h"
+#include "find_db_cpu.h"
+#include "conv_batch_cpu.h"
 #include "igemm_gtc_base.h"
 #include "igemm_fwd_gtc_driver.h"
 #include "igemm_bwd_gtc_driver.h"
@@ -176,6 +186,17 @@ static inline double get_theoritical_gpu_gflops(int sclk_mhz, driverDataType_t d
     return theoritical_gflops(((double)sclk_mhz) / 1000.0, num_cu, num_simd * fp_factor);
 }
 
+static inline convert_cpu_dtype_t get_convert_cpu_dtype(driverDataType_t data_type)
+{
+    switch(data_type){
+        case driverHalf: return convert_cpu_fp16;
+        case driverBFloat16: return convert_cpu_bf16;
+        case driverInt8: return convert_cpu_int8;
+        case driverInt4: return convert_cpu_int4;
+        default: return convert_cpu_fp32;
+    }
+}
+
 #ifndef IGEMM_HSACO
 #define IGEMM_HSACO "igemm_gtc.hsaco"
 #endif
@@ -194,51 +215,26 @@ static inline double get_theoritical_gpu_gflops(int sclk_mhz, driverDataType_t d
 #define REPEAT 8
 #define SCLK_MHZ 1283
 
-template <typename T>
-struct distribution_t{
-};
-
-template <>
-struct distribution_t<int>{
-    distribution_t(int min, int max) : distribution(min, max) {}
-    template<class URNG>
-    int operator()(URNG & rng){ return distribution(rng);}
-    std::uniform_int_distribution<int> distribution;
-};
-template <>
-struct distribution_t<float>{
-    distribution_t(float min, float max) : distribution(min, max) {}
-    template<class URNG>
-    float operator()(URNG & rng){ return distribution(rng);}
-    std::uniform_real_distribution<float> distribution;
-};
-
+// tensor init keyed by (seed, tensor, element), see rand_cpu.h
 template <typename Dst_T, typename Src_T>
-void block_wise_rand_generator(Dst_T *p, int tid, int block_size, size_t total_size, Src_T min, Src_T max, Src_T scale)
-{
-    std::mt19937 rng(std::chrono::system_clock::now()
-                        .time_since_epoch()
-                        .count() +
-                    std::hash<std::thread::id>()(std::this_thread::get_id()));
-    distribution_t<Src_T> distribution(min,max);
-    for (size_t i = tid; i < total_size; i += block_size) {
-        p[i] = static_cast<Dst_T>(scale * distribution(rng));
-    }
+void gen_rand_vector(Dst_T *vec, size_t vec_size, Src_T fmin, Src_T fmax, uint64_t seed, rand_cpu_tensor_t tensor, Src_T scale = 1) {
+    rand_cpu_uniform<Dst_T, Src_T>(vec, vec_size, fmin, fmax, seed, tensor, scale);
 }
 
-template <typename Dst_T, typename Src_T>
-void gen_rand_vector(Dst_T *vec, size_t vec_size, Src_T fmin, Src_T fmax, Src_T scale = 1) {
-    int num_threads = std::thread::hardware_concurrency();
-    if (num_threads < 4)
-        num_threads = 4;
-    // printf("total threads:%d\n",num_threads);
-    std::vector<std::thread> threads;
-    for (int t = 0; t < num_threads; t++) {
-        threads.push_back(std::thread(block_wise_rand_generator<Dst_T, Src_T>,
-            vec, t, num_threads, vec_size, fmin, fmax, scale));
+// tensor init fused with the conversion to the driver dtype. the fp32 copy is only written when the host side reads it,
+// i.e. for fp32 and for the gpu naive reference, the cpu references and the validation work on the dtype tensor
+template <typename Src_T>
+void gen_rand_tensor(driverDataType_t data_type, float *vec, void *vec_dtype, size_t vec_size, Src_T fmin, Src_T fmax, uint64_t seed, rand_cpu_tensor_t tensor) {
+    if(data_type == driverFloat){
+        rand_cpu_uniform_dtype<Src_T>(convert_cpu_fp32, vec, NULL, vec_size, fmin, fmax, seed, tensor);
+        return;
     }
-    for (auto &th : threads)
-        th.join();
+#ifdef USE_GPU_NAIVE_CONV
+    float *vec_f32 = vec;
+#else
+    float *vec_f32 = NULL;
+#endif
+    rand_cpu_uniform_dtype<Src_T>(get_convert_cpu_dtype(data_type), vec_dtype, vec_f32, vec_size, fmin, fmax, seed, tensor);
 }
 
 void dump_arg(const args_t *arg) {
@@ -338,6 +334,34 @@ std::string log_cmd(const args_t *arg, driverDataType_t driver_data_type, std::s
     return ss.str();
 }
 
+find_db_cpu_key_t get_find_db_key(const args_t *arg, driverDataType_t driver_data_type, std::string direction)
+{
+    hipDeviceProp_t dev_prop;
+    hipDevice_t dev;
+    HIP_CALL(hipGetDevice(&dev));
+    HIP_CALL(hipGetDeviceProperties(&dev_prop, dev));
+
+    find_db_cpu_key_t key;
+    find_db_cpu_key_init(&key, direction.c_str(), arg->get_str("in_layout").c_str(), arg->get_str("fil_layout").c_str(),
+                        arg->get_str("out_layout").c_str(), static_cast<int>(driver_data_type),
+                        dev_prop.gcnArchName, dev_prop.multiProcessorCount);
+    key.n = arg->get_int("batchsize");
+    key.c = arg->get_int("in_channels");
+    key.hi = arg->get_int("in_h");
+    key.wi = arg->get_int("in_w");
+    key.k = arg->get_int("out_channels");
+    key.y = arg->get_int("fil_h");
+    key.x = arg->get_int("fil_w");
+    key.pad_h = arg->get_int("pad_h");
+    key.pad_w = arg->get_int("pad_w");
+    key.stride_h = arg->get_int("conv_stride_h");
+    key.stride_w = arg->get_int("conv_stride_w");
+    key.dilation_h = arg->get_int("dilation_h");
+    key.dilation_w = arg->get_int("dilation_w");
+    key.group = arg->get_int("group_count");
+    return key;
+}
+
 template<typename driver_t>
 std::string get_tiling_string(driver_t * driver, const args_t *conv_args)
 {
@@ -366,7 +390,7 @@ std::string get_tiling_string(driver_t * driver, const args_t *conv_args)
 }
 
 template<typename driver_t, typename pre_func_t, typename post_func_t>
-void launch_conv_driver(driver_t * driver, const args_t *conv_args, const std::vector<igemm_gtc_tunable_t> & tunables, std::string direction,
+result_t launch_conv_driver(driver_t * driver, const args_t *conv_args, const std::vector<igemm_gtc_tunable_t> & tunables, std::string direction,
                     driverDataType_t driver_data_type, FILE * p_bcsv,
                     void* device_input, void* device_weight, void* device_output,
                     pre_func_t && pre_func, post_func_t && post_func)
@@ -382,6 +406,8 @@ void launch_conv_driver(driver_t * driver, const args_t *conv_args, const std::v
     int max_kpb = env_get_int("IGEMM_MAX_KPB", -1);
     int max_gks = env_get_int("IGEMM_MAX_GKS", -1);
     int silent_not_applicable_level0 = env_get_int("IGEMM_SILENT_NA_L0", 1);  // ignore kernel that has different direction & layout
+    std::string find_db_path = env_get_str("IGEMM_FIND_DB", (char *)"");
+    int find_db_retune = env_get_int("IGEMM_FIND_DB_RETUNE", 0);
     std::string in_layout = conv_args->get_str("in_layout");
     std::string fil_layout = conv_args->get_str("fil_layout");
 
@@ -451,7 +477,7 @@ void launch_conv_driver(driver_t * driver, const args_t *conv_args, const std::v
         printf("cost:%.3fms, tflops:%.3f(%.2f%%)", result.duration_ms,
                 gflops / 1000 , (gflops / theo_gpu_gflops) * 100);
 
-        post_func();
+        result.is_valid = post_func();
 
         printf("\n");
         result.gflops = gflops;
@@ -477,9 +503,52 @@ void launch_conv_driver(driver_t * driver, const args_t *conv_args, const std::v
     fastest_result.duration_ms = FLT_MAX;
     int fastest_id = -1;
     if(driver->driver_mode == driver_mode_normal){
+        bool use_find_db = !find_db_path.empty();
+        find_db_cpu_key_t find_db_key{};
+        std::vector<find_db_cpu_entry_t> find_db_candidates;
+        auto add_find_db_candidate = [&](const igemm_gtc_tunable_t * tunable, const result_t & result){
+            if(!use_find_db || result.return_code != 0 || !result.is_valid)
+                return;
+            igemm_spatial_tiling_t tiling = driver->get_spatial_tiling(conv_args);
+            find_db_cpu_entry_t entry;
+            find_db_cpu_set_str(entry.kernel_name, FIND_DB_CPU_NAME_LEN, driver->get_kernel_name(tunable).c_str());
+            entry.gks = result.gks;
+            entry.tile_h = tiling.tile_h;
+            entry.tile_w = tiling.tile_w;
+            entry.duration_ms = result.duration_ms;
+            entry.gflops = result.gflops;
+            find_db_candidates.push_back(entry);
+        };
+
+        bool find_db_hit = false;
+        if(use_find_db){
+            find_db_key = get_find_db_key(conv_args, driver_data_type, direction);
+            find_db_cpu_t db;
+            if(!find_db_cpu_open(&db, find_db_path.c_str()))
+                printf("find-db %s is not valid, ignored\n", find_db_path.c_str());
+            const find_db_cpu_record_t * record = find_db_retune ? nullptr : find_db_cpu_find(&db, &find_db_key);
+            // run the stored winners in rank order, the first one still in the config and applicable is taken
+            for(int e = 0; record && e < record->num_entries && !find_db_hit; e++){
+                for(int i=0; i<tunables.size(); i++){
+                    if(need_skip_due_to_macro_tile_boundary(&tunables[i]))
+                        continue;
+                    if(driver->get_kernel_name(&tunables[i]) != record->entries[e].kernel_name)
+                        continue;
+                    result_t result = launch(&tunables[i], e, record->entries[e].gks);
+                    if(result.return_code != 0 || !result.is_valid)
+                        continue;
+                    fastest_result = result;
+                    fastest_id = e;
+                    find_db_hit = true;
+                    break;
+                }
+            }
+            find_db_cpu_close(&db);
+        }
+
         int unique_index = 0;
         std::vector<igemm_gtc_tunable_t> unique_tunables;
-        for(int i=0; i<tunables.size(); i++){
+        for(int i=0; i<tunables.size() && !find_db_hit; i++){
             if(need_skip_due_to_macro_tile_boundary(&tunables[i]))
                 continue;
             if(gks_iterative){
@@ -488,6 +557,7 @@ void launch_conv_driver(driver_t * driver, const args_t *conv_args, const std::v
                     for(int gks : gks_list){
                         result_t result = launch(&tunables[i], unique_index, gks);
                         if(result.return_code == -2) continue;
+                        add_find_db_candidate(&tunables[i], result);
                         unique_tunables.push_back(tunables[i]);
                         unique_tunables.back().gemm_k_global_split = gks;
                         if(result.duration_ms < fastest_result.duration_ms){
@@ -499,6 +569,7 @@ void launch_conv_driver(driver_t * driver, const args_t *conv_args, const std::v
                 }else{
                     result_t result = launch(&tunables[i], unique_index, 0);
                     if(result.return_code == -2) continue;
+                    add_find_db_candidate(&tunables[i], result);
                     unique_tunables.push_back(tunables[i]);
                     unique_tunables.back().gemm_k_global_split = 0;
                     if(result.duration_ms < fastest_result.duration_ms){
@@ -511,6 +582,7 @@ void launch_conv_driver(driver_t * driver, const args_t *conv_args, const std::v
             else{
                 result_t result = launch(&tunables[i], unique_index, -1);
                 if(result.return_code == -2) continue;
+                add_find_db_candidate(&tunables[i], result);
                 unique_tunables.push_back(tunables[i]);
                 unique_tunables.back().gemm_k_global_split = result.gks;
                 if(result.duration_ms < fastest_result.duration_ms){
@@ -521,6 +593,18 @@ void launch_conv_driver(driver_t * driver, const args_t *conv_args, const std::v
             }
         }
 
+        if(use_find_db && !find_db_hit && find_db_candidates.size() != 0){
+            find_db_cpu_record_t record;
+            memset(&record, 0, sizeof(record));
+            record.key = find_db_key;
+            find_db_cpu_rank(&record, find_db_candidates);
+            // a sweep narrowed by kernel name or tile/gks bounds only saw part of the config, merge it with what is stored
+            bool find_db_partial = run_only_kernel != IGEMM_RUN_ONLY_KERNEL_DEFAULT ||
+                                    max_mpb != -1 || max_npb != -1 || max_kpb != -1 || max_gks != -1;
+            if(!find_db_cpu_store(find_db_path.c_str(), &record, find_db_partial))
+                printf("fail to store find-db %s\n", find_db_path.c_str());
+        }
+
         if(log_fastest_config){
             dump_arg(conv_args);
             if(fastest_id == -1)
@@ -545,7 +629,7 @@ void launch_conv_driver(driver_t * driver, const args_t *conv_args, const std::v
         if(run_only_kernel != IGEMM_RUN_ONLY_KERNEL_DEFAULT)
             if(run_only_kernel != driver->get_kernel_name(&selected_tunable)){
                 printf("heuristic selected tunable not match your request\n");
-                return;
+                return result_t{};
             }
 
         result_t result = launch(&selected_tunable, 0, -1);
@@ -566,75 +650,151 @@ void launch_conv_driver(driver_t * driver, const args_t *conv_args, const std::v
 
     if(sleep_ms != 0)
         usleep(1000 * sleep_ms);
+    return fastest_result;
 }
 
-int main(int argc, char **argv) {
-    char *hsaco = env_get_str("IGEMM_HSACO", IGEMM_HSACO);
-    char *config_file = env_get_str("IGEMM_CONFIG_FILE", IGEMM_CONFIG_FILE);
+static driverDataType_t get_driver_data_type(const std::string & base_arg)
+{
+    auto vec_found = base_arg.find("x");
+    std::string base_type = base_arg.substr(0, vec_found);
+
+    if(base_type == "conv")
+        return driverFloat;
+    else if(base_type == "convfp16")
+        return driverHalf;
+    else if(base_type == "convbfp16")
+        return driverBFloat16;
+    else if(base_type == "convint8")
+        return driverInt8;
+    else if(base_type == "convint4")
+        return driverInt4;
+    printf("invalid base type:%s\n", base_type.c_str());
+    exit(0);
+}
+
+// host and device tensors of one problem, taken from the host and device arenas, so a sweep of problems reuses them
+typedef struct {
+    float *host_input, *host_weight, *host_output;
+    float *device_input, *device_weight, *device_output;
+    void *host_input_dtype, *host_weight_dtype, *host_output_dtype;
+    void *device_input_dtype, *device_weight_dtype, *device_output_dtype;
+} conv_driver_buffers_t;
+
+// the fp32 host tensors are left null when nothing reads them, i.e. for other data types, unless the gpu naive
+// reference or the sampled validation works on fp32 copies
+static void conv_driver_buffers_alloc(conv_driver_buffers_t * buffers, size_t input_elems, size_t weight_elems, size_t output_elems,
+                    size_t data_byte, bool need_host_f32)
+{
+    buffer_arena_cpu_t * host_arena = igemm_host_arena_get();
+    memset(buffers, 0, sizeof(conv_driver_buffers_t));
+    if(need_host_f32){
+        buffers->host_input = (float *)host_arena->acquire(input_elems * sizeof(float));
+        buffers->host_weight = (float *)host_arena->acquire(weight_elems * sizeof(float));
+        buffers->host_output = (float *)host_arena->acquire(output_elems * sizeof(float));
+    }
+
+    buffers->device_input = (float *)igemm_device_arena_acquire(input_elems * sizeof(float));
+    buffers->device_weight = (float *)igemm_device_arena_acquire(weight_elems * sizeof(float));
+    buffers->device_output = (float *)igemm_device_arena_acquire(output_elems * sizeof(float));
+
+#if defined(USE_HALF) || defined(USE_INT8) || defined(USE_BF16) || defined(USE_INT4)
+    buffers->host_input_dtype  = host_arena->acquire(input_elems * data_byte);
+    buffers->host_weight_dtype = host_arena->acquire(weight_elems * data_byte);
+    buffers->host_output_dtype = host_arena->acquire(output_elems * data_byte);
+
+    buffers->device_input_dtype  = igemm_device_arena_acquire(input_elems * data_byte);
+    buffers->device_weight_dtype = igemm_device_arena_acquire(weight_elems * data_byte);
+    buffers->device_output_dtype = igemm_device_arena_acquire(output_elems * data_byte);
+#endif
+}
+
+static void conv_driver_buffers_free(conv_driver_buffers_t * buffers)
+{
+    buffer_arena_cpu_t * host_arena = igemm_host_arena_get();
+    buffer_arena_cpu_t * device_arena = igemm_device_arena_get();
+    host_arena->release(buffers->host_input);
+    host_arena->release(buffers->host_weight);
+    host_arena->release(buffers->host_output);
+
+    device_arena->release(buffers->device_input);
+    device_arena->release(buffers->device_weight);
+    device_arena->release(buffers->device_output);
+
+    host_arena->release(buffers->host_input_dtype);
+    host_arena->release(buffers->host_weight_dtype);
+    host_arena->release(buffers->host_output_dtype);
+
+    device_arena->release(buffers->device_input_dtype);
+    device_arena->release(buffers->device_weight_dtype);
+    device_arena->release(buffers->device_output_dtype);
+}
+
+static bool conv_driver_need_host_f32(driverDataType_t driver_data_type, double sample_rate)
+{
+#ifdef USE_GPU_NAIVE_CONV
+    return true;
+#else
+    return driver_data_type == driverFloat || sample_rate > 0;
+#endif
+}
+
+// fill the arenas with the blocks the largest tensors of a batch need, so no later problem grows them
+static void conv_driver_buffers_reserve(size_t input_elems, size_t weight_elems, size_t output_elems, size_t data_byte, bool need_host_f32)
+{
+    conv_driver_buffers_t buffers;
+    conv_driver_buffers_alloc(&buffers, input_elems, weight_elems, output_elems, data_byte, need_host_f32);
+    conv_driver_buffers_free(&buffers);
+}
+
+static void get_conv_tensor_elems(const args_t * conv_args, size_t * input_elems, size_t * weight_elems, size_t * output_elems)
+{
+    int hi = conv_args->get_int("in_h");
+    int wi = conv_args->get_int("in_w");
+    int n = conv_args->get_int("batchsize");
+    int k = conv_args->get_int("out_channels");
+    int c = conv_args->get_int("in_channels");
+    int y = conv_args->get_int("fil_h");
+    int x = conv_args->get_int("fil_w");
+    int ho = conv_out_size(hi, conv_args->get_int("pad_h"), conv_args->get_int("dilation_h"), y, conv_args->get_int("conv_stride_h"));
+    int wo = conv_out_size(wi, conv_args->get_int("pad_w"), conv_args->get_int("dilation_w"), x, conv_args->get_int("conv_stride_w"));
+    *input_elems = static_cast<size_t>(n) * c * hi * wi;
+    *weight_elems = static_cast<size_t>(k) * c * y * x;
+    *output_elems = static_cast<size_t>(n) * k * ho * wo;
+}
+
+// run every requested direction of the problem on argv. the fastest kernel of each direction is appended to
+// batch_results, if not null
+static void run_conv_problem(int argc, char **argv, const std::vector<igemm_gtc_tunable_t> & tunables,
+                    hipModule_t module, hipModule_t module_tensor_cast, FILE * p_bcsv,
+                    std::vector<conv_batch_cpu_result_t> * batch_results)
+{
     std::string run_only_kernel = env_get_str("IGEMM_RUN_ONLY_KERNEL", IGEMM_RUN_ONLY_KERNEL_DEFAULT);
     int warmup = env_get_int("IGEMM_WARMUP", WARMUP);
     int repeat = env_get_int("IGEMM_REPEAT", REPEAT);
     int assert_when_invalid = env_get_int("IGEMM_ASSERT_WHEN_INVALID", 0);
     int verbose     = env_get_int("IGEMM_VERBOSE", 0);
     int igemm_rand_int = env_get_int("IGEMM_RAND_INT", 0);
-    int igemm_bench_csv = env_get_int("IGEMM_BENCH_CSV", 0);
     driver_mode_t driver_mode = static_cast<driver_mode_t>(env_get_int("IGEMM_MODE", 0));
-    config_parser_t config_parser(config_file);
-    auto unexpanded_content = config_parser.parse();
-    auto content = igemm_try_expand_tunable_content(unexpanded_content);
-    //content.dump();
-    FILE * p_bcsv = nullptr;
-    if(igemm_bench_csv){
-        p_bcsv = fopen ("bench_model.csv", "a");
-        assert(p_bcsv);
-    }
-
+    double sample_rate = atof(env_get_str("IGEMM_CPU_SAMPLE_RATE", (char *)"0"));    // host reference on a sample only
+    uint64_t sample_seed = static_cast<uint64_t>(env_get_int("IGEMM_CPU_SAMPLE_SEED", 0));
 #ifdef USE_GPU_NAIVE_CONV
-    char *gpu_naive_conv_hsaco = env_get_str("IGEMM_GPU_NAIVE_CONV_HSACO", IGEMM_GPU_NAIVE_CONV_HSACO);
-    gpu_naive_conv_init(gpu_naive_conv_hsaco);
-#endif
-
-    auto tunables = igemm_gtc_tunable_from_config(content);
-    if(tunables.size() == 0){
-        printf("no tunable specified, may not work\n");
-        return 0;
+    int valid_stream = 0;
+#else
+    int valid_stream = env_get_int("IGEMM_CPU_VALID_STREAM", 0) && !(sample_rate > 0);    // see valid_stream_cpu.h
+    static bool valid_stream_warned = false;
+    if(valid_stream && !valid_stream_warned && (env_get_int("PER_PIXEL_CHECK", 0) || env_get_int("DUMP_PRED", 0))){
+        printf("IGEMM_CPU_VALID_STREAM ignores PER_PIXEL_CHECK and DUMP_PRED for fwd/bwd, unset it to get them\n");
+        valid_stream_warned = true;
     }
-    // printf("tunables:%d, hsaco:%s\n", tunables.size(), hsaco);
-
-    hipModule_t module;
-#ifndef IGEMM_SPLIT_KERNEL
-    HIP_CALL(hipModuleLoad(&module, hsaco));
 #endif
 
     std::string base_arg = create_base_args(argc, argv);
     args_t conv_args = create_conv_args(argc, argv);
     // dump_arg(&conv_args);
-    driverDataType_t driver_data_type;
-    auto vec_found = base_arg.find("x");
-    std::string base_type = base_arg.substr(0, vec_found);
+    driverDataType_t driver_data_type = get_driver_data_type(base_arg);
     int vector_c = find_vector_c_from_base_arg(base_arg);
     vector_c = env_get_int("VECTOR_C", vector_c);
 
-    if(base_type == "conv"){
-        driver_data_type = driverFloat;
-    }
-    else if(base_type == "convfp16"){
-        driver_data_type = driverHalf;
-    }
-    else if(base_type == "convbfp16") {
-        driver_data_type = driverBFloat16;
-    }
-    else if(base_type == "convint8") {
-        driver_data_type = driverInt8;
-    }
-    else if(base_type == "convint4") {
-        driver_data_type = driverInt4;
-    }
-    else{
-        printf("invalid base type:%s\n", base_type.c_str());
-        exit(0);
-    }
-
     size_t data_byte = get_data_byte(driver_data_type);
 
     int hi = conv_args.get_int("in_h");
@@ -671,37 +831,28 @@ int main(int argc, char **argv) {
            (in_layout == "NCHWC" && tunables[0].tensor_layout.compare(0, 5, "nchwc") == 0));  // check pairs
 
     // init host side
-    float *host_input = (float *)malloc(static_cast<size_t>(n) * c * hi * wi * sizeof(float));
-    float *host_weight = (float *)malloc(static_cast<size_t>(k) * c * y * x * sizeof(float));
-    float *host_output = (float *)malloc(static_cast<size_t>(n) * k * ho * wo * sizeof(float));
-
-    float *device_input;
-    float *device_weight;
-    float *device_output;
-
-    HIP_CALL(hipMalloc(&device_input, static_cast<size_t>(n) * c * hi * wi * sizeof(float)));
-    HIP_CALL(hipMalloc(&device_weight, static_cast<size_t>(k) * c * y * x * sizeof(float)));
-    HIP_CALL(hipMalloc(&device_output, static_cast<size_t>(n) * k * ho * wo * sizeof(float)));
+    conv_driver_buffers_t problem_buffers;
+    conv_driver_buffers_alloc(&problem_buffers, static_cast<size_t>(n) * c * hi * wi, static_cast<size_t>(k) * c * y * x,
+                        static_cast<size_t>(n) * k * ho * wo, data_byte, conv_driver_need_host_f32(driver_data_type, sample_rate));
+    float *host_input = problem_buffers.host_input;
+    float *host_weight = problem_buffers.host_weight;
+    float *host_output = problem_buffers.host_output;
 
-    void *host_input_dtype;
-    void *host_weight_dtype;
-    void *host_output_dtype;
+    float *device_input = problem_buffers.device_input;
+    float *device_weight = problem_buffers.device_weight;
+    float *device_output = problem_buffers.device_output;
 
-    void *device_input_dtype;
-    void *device_weight_dtype;
-    void *device_output_dtype;
-#if defined(USE_HALF) || defined(USE_INT8) || defined(USE_BF16) || defined(USE_INT4)
-    host_input_dtype  = malloc(n * c * hi * wi * data_byte);
-    host_weight_dtype = malloc(k * c * y * x * data_byte);
-    host_output_dtype = malloc(n * k * ho * wo * data_byte);
+    void *host_input_dtype = problem_buffers.host_input_dtype;
+    void *host_weight_dtype = problem_buffers.host_weight_dtype;
+    void *host_output_dtype = problem_buffers.host_output_dtype;
 
-    HIP_CALL(hipMalloc(&device_input_dtype, n * c * hi * wi * data_byte));
-    HIP_CALL(hipMalloc(&device_weight_dtype, k * c * y * x * data_byte));
-    HIP_CALL(hipMalloc(&device_output_dtype, n * k * ho * wo * data_byte));
-#endif
+    void *device_input_dtype = problem_buffers.device_input_dtype;
+    void *device_weight_dtype = problem_buffers.device_weight_dtype;
+    void *device_output_dtype = problem_buffers.device_output_dtype;
 
 
     int need_verify = conv_args.get_int("verify");
+    uint64_t rand_seed = conv_args.get_uint64("seed");    // same seed, same tensors, for any IGEMM_CPU_THREADS
     if(p_bcsv){
         //               N   C   H   W   K   Y   X   P   Q   U   V   L   J   G
         fprintf(p_bcsv, "%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,",
@@ -714,45 +865,43 @@ int main(int argc, char **argv) {
     if(driver_data_type == driverInt8 || driver_data_type == driverInt4)
         igemm_rand_int = 1;
 
-    // launch tensor cast module
-    hipModule_t module_tensor_cast;
-    char *hsaco_tensor_cast = env_get_str("IGEMM_TENSOR_CAST_HSACO", IGEMM_TENSOR_CAST_HSACO);
-    HIP_CALL(hipModuleLoad(&module_tensor_cast, hsaco_tensor_cast));
+    int num_invalid = 0;    // kernels of the current direction that failed validation
+    auto add_batch_result = [&](std::string direction, const result_t & result){
+        if(batch_results){
+            conv_batch_cpu_result_t r;
+            r.direction   = direction;
+            r.kernel_name = result.return_code == 0 ? result.kernel_name : "";
+            r.gks         = result.gks;
+            r.duration_ms = result.duration_ms;
+            r.tflops      = result.gflops / 1000;
+            r.efficiency  = result.efficiency;
+            r.verified    = need_verify;
+            r.num_invalid = num_invalid;
+            batch_results->push_back(r);
+        }
+        num_invalid = 0;
+    };
 
     if (need_fwd){
+        double ref_nrms_scale = 1.0;     // extra tolerance for a less accurate host reference
+        std::vector<size_t> sample_index;   // sampled validation, see conv_sample_cpu.h
+        std::vector<float> sample_ref;
         int fastest_id = -1;
         void *device_output_to_host = NULL;
         if (need_verify) {
             // gen rand
             if(!igemm_rand_int){
-                gen_rand_vector<float, float>(host_input, static_cast<size_t>(n) * c * hi * wi, 0.0, 1.0);
-                gen_rand_vector<float, float>(host_weight, static_cast<size_t>(k) * c * y * x, -0.5, 0.5);
+                gen_rand_tensor<float>(driver_data_type, host_input, host_input_dtype, static_cast<size_t>(n) * c * hi * wi, 0.0, 1.0, rand_seed, rand_cpu_tensor_input);
+                gen_rand_tensor<float>(driver_data_type, host_weight, host_weight_dtype, static_cast<size_t>(k) * c * y * x, -0.5, 0.5, rand_seed, rand_cpu_tensor_weight);
             }else{
-                gen_rand_vector<float, int>(host_input, static_cast<size_t>(n) * c * hi * wi, -5, 5);
-                gen_rand_vector<float, int>(host_weight, static_cast<size_t>(k) * c * y * x, -5, 5);
+                gen_rand_tensor<int>(driver_data_type, host_input, host_input_dtype, static_cast<size_t>(n) * c * hi * wi, -5, 5, rand_seed, rand_cpu_tensor_input);
+                gen_rand_tensor<int>(driver_data_type, host_weight, host_weight_dtype, static_cast<size_t>(k) * c * y * x, -5, 5, rand_seed, rand_cpu_tensor_weight);
             }
 
             //gen_rand_vector<float, int>(host_input, static_cast<size_t>(n) * c * hi * wi, -5, 5);
             //gen_rand_vector<float, int>(host_weight, static_cast<size_t>(k) * c * y * x, -5, 5);
             //gen_rand_vector<float, int>(host_input, static_cast<size_t>(n) * c * hi * wi, 1, 1);
             //gen_rand_vector<float, int>(host_weight, static_cast<size_t>(k) * c * y * x, 1, 1);
-            if(driver_data_type == driverHalf){
-                tensor_copy<float16, float>(static_cast<float16*>(host_input_dtype), host_input, static_cast<size_t>(n) * c * hi * wi);
-                tensor_copy<float16, float>(static_cast<float16*>(host_weight_dtype), host_weight, static_cast<size_t>(k) * c * y * x);
-            }
-            else if(driver_data_type == driverBFloat16){
-                tensor_copy<bfloat16, float>(static_cast<bfloat16*>(host_input_dtype), host_input, static_cast<size_t>(n) * c * hi * wi);
-                tensor_copy<bfloat16, float>(static_cast<bfloat16*>(host_weight_dtype), host_weight, static_cast<size_t>(k) * c * y * x);
-            }
-            else if(driver_data_type == driverInt8){
-                tensor_copy<int8_t, float>(static_cast<int8_t*>(host_input_dtype), host_input, static_cast<size_t>(n) * c * hi * wi);
-                tensor_copy<int8_t, float>(static_cast<int8_t*>(host_weight_dtype), host_weight, static_cast<size_t>(k) * c * y * x);
-            }
-            else if(driver_data_type == driverInt4)
-            {
-                tensor_copy<int4x2_t, float>(static_cast<int4x2_t*>(host_input_dtype), host_input, static_cast<size_t>(n) * c * hi * wi);
-                tensor_copy<int4x2_t, float>(static_cast<int4x2_t*>(host_weight_dtype), host_weight, static_cast<size_t>(k) * c * y * x);
-            }
 
 #ifdef USE_GPU_NAIVE_CONV
             HIP_CALL(hipMemcpy(device_input, host_input,
@@ -781,22 +930,23 @@ int main(int argc, char **argv) {
                     }
                     exit(-1);
                 }
-                float* aux_in = (float*)malloc(static_cast<size_t>(n) * c * hi * wi * sizeof(float));
-                float* aux_wei = (float*)malloc(static_cast<size_t>(k) * c * y * x * sizeof(float));
-                float* aux_out = (float*)malloc(static_cast<size_t>(n) * k * ho * wo * sizeof(float));
+                float* aux_in = (float*)igemm_host_arena_get()->acquire(static_cast<size_t>(n) * c * hi * wi * sizeof(float));
+                float* aux_wei = (float*)igemm_host_arena_get()->acquire(static_cast<size_t>(k) * c * y * x * sizeof(float));
+                float* aux_out = (float*)igemm_host_arena_get()->acquire(static_cast<size_t>(n) * k * ho * wo * sizeof(float));
 
-                tensor_transpose_nchwc_2_nchw<float*>(aux_in, host_input, n, c, hi, wi, vector_c);
+                transpose_cpu_nchwc_2_nchw(aux_in, host_input, n, c, hi, wi, vector_c);
                 for(int i_groups = 0; i_groups < ngroups; i_groups++){
                     int group_offset = i_groups * (k / ngroups) * (c / ngroups) * y * x;
                     if(fil_layout == "CHWNC")
-                        tensor_transpose_chwnc_2_nchw<float*>(aux_wei + group_offset, host_weight + group_offset, k / ngroups, c / ngroups, y, x, vector_c);
+                        transpose_cpu_chwnc_2_nchw(aux_wei + group_offset, host_weight + group_offset, k / ngroups, c / ngroups, y, x, vector_c);
                     else if(fil_layout == "NCHWC")
-                        tensor_transpose_nchwc_2_nchw<float*>(aux_wei + group_offset, host_weight + group_offset, k / ngroups, c / ngroups, y, x, vector_c);
+                        transpose_cpu_nchwc_2_nchw(aux_wei + group_offset, host_weight + group_offset, k / ngroups, c / ngroups, y, x, vector_c);
                 }
 
                 if(env_get_int("IGEMM_CHECK_TRNASPOSE", 0)){
-                    float* aux_wei_check = (float*)malloc(static_cast<size_t>(k) * c * y * x * sizeof(float));
-                    float* aux_in_check = (float*)malloc(static_cast<size_t>(n) * c * hi * wi * sizeof(float));
+                    // round trip through the reference loops of tensor_transpose.h
+                    float* aux_wei_check = (float*)igemm_host_arena_get()->acquire(static_cast<size_t>(k) * c * y * x * sizeof(float));
+                    float* aux_in_check = (float*)igemm_host_arena_get()->acquire(static_cast<size_t>(n) * c * hi * wi * sizeof(float));
 
                     tensor_transpose_nchw_2_nchwc<float*>(aux_in_check, aux_in, n, c, hi, wi, vector_c);
                     if(fil_layout == "CHWNC")
@@ -808,8 +958,8 @@ int main(int argc, char **argv) {
                     valid_vector<float>(host_input, aux_in_check, static_cast<size_t>(n) * c * hi * wi, transpose_nrms);
                     valid_vector<float>(host_weight, aux_wei_check, static_cast<size_t>(k) * c * y * x, transpose_nrms);
 
-                    free(aux_in_check);
-                    free(aux_wei_check);
+                    igemm_host_arena_get()->release(aux_in_check);
+                    igemm_host_arena_get()->release(aux_wei_check);
                 }
                 
                 HIP_CALL(hipMemcpy(device_input, aux_in,
@@ -826,7 +976,7 @@ int main(int argc, char **argv) {
                                    static_cast<size_t>(n) * k * ho * wo * sizeof(float),
                                    hipMemcpyDeviceToHost));
 
-                tensor_transpose_nchw_2_nchwc<float*>(aux_out, host_output, n, k, ho, wo, vector_c);
+                transpose_cpu_nchw_2_nchwc(aux_out, host_output, n, k, ho, wo, vector_c);
 
                 HIP_CALL(hipMemcpy(device_input, host_input,
                        static_cast<size_t>(n) * c * hi * wi * sizeof(float), hipMemcpyHostToDevice));
@@ -836,9 +986,9 @@ int main(int argc, char **argv) {
                 HIP_CALL(hipMemcpy(device_output, aux_out,
                        static_cast<size_t>(n) * k * ho * wo * sizeof(float), hipMemcpyHostToDevice));
 
-                free(aux_in);
-                free(aux_wei);
-                free(aux_out);
+                igemm_host_arena_get()->release(aux_in);
+                igemm_host_arena_get()->release(aux_wei);
+                igemm_host_arena_get()->release(aux_out);
                 // exit(1);
             }
             else
@@ -847,23 +997,57 @@ int main(int argc, char **argv) {
             HIP_CALL(hipMemcpy(host_output, device_output,
                                    static_cast<size_t>(n) * k * ho * wo * sizeof(float),
                                    hipMemcpyDeviceToHost));
+            if(driver_data_type != driverFloat)
+                convert_cpu_narrow_f32(get_convert_cpu_dtype(driver_data_type), host_output_dtype, 0, host_output,
+                                static_cast<size_t>(n) * k * ho * wo);
 #else
-            if(in_layout == "NCHW")
-                naive_conv_fwd_nchw(host_input, host_weight, host_output, n, wi, hi, c,
-                                k, x, y, pad_w, pad_h, stride_w, stride_h,
-                                dilation_w, dilation_h, ngroups);
-            else if(in_layout == "NHWC")
-                naive_conv_fwd_nhwc(host_input, host_weight, host_output, n, wi, hi, c,
+            if(sample_rate > 0){
+                assert(in_layout == "NCHW" || in_layout == "NHWC");
+                // the sample is computed in fp32, on the inputs as rounded to the data type under test
+                if(driver_data_type != driverFloat){
+                    convert_cpu_widen_f32(get_convert_cpu_dtype(driver_data_type), host_input, host_input_dtype, 0,
+                                    static_cast<size_t>(n) * c * hi * wi);
+                    convert_cpu_widen_f32(get_convert_cpu_dtype(driver_data_type), host_weight, host_weight_dtype, 0,
+                                    static_cast<size_t>(k) * c * y * x);
+                }
+                conv_sample_cpu_fwd(in_layout == "NHWC", host_input, host_weight, &sample_index, &sample_ref, n, wi, hi, c,
                                 k, x, y, pad_w, pad_h, stride_w, stride_h,
-                                dilation_w, dilation_h, ngroups);
-            else
-                assert(0);
+                                dilation_w, dilation_h, ngroups, sample_rate, sample_seed);
+            } else if(valid_stream) {
+                // computed chunk by chunk at each validation, only its tolerance is needed here
+                assert(in_layout == "NCHW" || in_layout == "NHWC");
+                ref_nrms_scale = conv_ref_cpu_nrms_scale(conv_ref_cpu_select("fwd", n, wi, hi, c, k, x, y, pad_w, pad_h, stride_w, stride_h,
+                                    dilation_w, dilation_h, ngroups, driver_data_type == driverInt8 || driver_data_type == driverInt4),
+                                    driver_data_type == driverFloat);
+            } else {
+                // the host reference reads and writes the tensors in the data type under test
+                conv_ref_cpu_algo_t ref_algo = conv_ref_cpu_select("fwd", n, wi, hi, c, k, x, y, pad_w, pad_h, stride_w, stride_h,
+                                    dilation_w, dilation_h, ngroups, driver_data_type == driverInt8 || driver_data_type == driverInt4);
+                ref_nrms_scale = conv_ref_cpu_nrms_scale(ref_algo, driver_data_type == driverFloat);
+                convert_cpu_dtype_t ref_dtype = get_convert_cpu_dtype(driver_data_type);
+                void *ref_input  = driver_data_type == driverFloat ? host_input  : host_input_dtype;
+                void *ref_weight = driver_data_type == driverFloat ? host_weight : host_weight_dtype;
+                void *ref_output = driver_data_type == driverFloat ? host_output : host_output_dtype;
+                if(in_layout == "NCHW")
+                    conv_native_cpu_fwd_nchw(ref_algo, ref_dtype, ref_input, ref_weight, ref_output, n, wi, hi, c,
+                                    k, x, y, pad_w, pad_h, stride_w, stride_h,
+                                    dilation_w, dilation_h, ngroups);
+                else if(in_layout == "NHWC")
+                    conv_native_cpu_fwd_nhwc(ref_algo, ref_dtype, ref_input, ref_weight, ref_output, n, wi, hi, c,
+                                    k, x, y, pad_w, pad_h, stride_w, stride_h,
+                                    dilation_w, dilation_h, ngroups);
+                else
+                    assert(0);
+            }
 #endif
-            if(driver_data_type != driverHalf){
-                device_output_to_host = malloc((static_cast<size_t>(n) * k * ho * wo * data_byte + 3) / 4 * 4);
+            if(valid_stream){
+                device_output_to_host = NULL;   // fetched chunk by chunk
+            }
+            else if(driver_data_type != driverHalf){
+                device_output_to_host = igemm_host_arena_get()->acquire((static_cast<size_t>(n) * k * ho * wo * data_byte + 3) / 4 * 4);
             }
             else{
-                device_output_to_host = malloc(static_cast<size_t>(n) * k * ho * wo * sizeof(float));
+                device_output_to_host = igemm_host_arena_get()->acquire(static_cast<size_t>(n) * k * ho * wo * sizeof(float));
             }
         }
 
@@ -898,11 +1082,39 @@ int main(int argc, char **argv) {
                     0, static_cast<size_t>(n) * k * ho * wo * data_byte));
         };
 
-        auto fwd_post = [&](){
+        auto fwd_post = [&]() -> bool {
             if (need_verify) {
-                double nrms = get_nrms("fwd", driver_data_type);
+                double nrms = get_nrms("fwd", driver_data_type) * ref_nrms_scale;
                 bool is_valid = false;
-                if(driver_data_type == driverFloat){
+#ifndef USE_GPU_NAIVE_CONV
+                if(valid_stream){
+                    conv_ref_cpu_algo_t ref_algo = conv_ref_cpu_select("fwd", n, wi, hi, c, k, x, y, pad_w, pad_h, stride_w, stride_h,
+                                    dilation_w, dilation_h, ngroups, driver_data_type == driverInt8 || driver_data_type == driverInt4);
+                    convert_cpu_dtype_t ref_dtype = get_convert_cpu_dtype(driver_data_type);
+                    const uint8_t *ref_input = (const uint8_t *)(driver_data_type == driverFloat ? host_input : host_input_dtype);
+                    const void *ref_weight   = driver_data_type == driverFloat ? host_weight : host_weight_dtype;
+                    const uint8_t *result    = (const uint8_t *)(driver_data_type == driverFloat ? device_output : device_output_dtype);
+                    size_t image = static_cast<size_t>(k) * ho * wo;
+                    is_valid = valid_stream_cpu_images(ref_dtype, n, image, nrms,
+                        [&](size_t i_n, size_t cn, void *ref){
+                            conv_native_cpu_fwd(ref_algo, ref_dtype, in_layout == "NHWC",
+                                    ref_input + convert_cpu_bytes(ref_dtype, i_n * c * hi * wi), ref_weight, ref, cn, wi, hi, c,
+                                    k, x, y, pad_w, pad_h, stride_w, stride_h,
+                                    dilation_w, dilation_h, ngroups);
+                        },
+                        [&](size_t i_n, size_t cn, void *pred){
+                            HIP_CALL(hipMemcpy(pred, result + convert_cpu_bytes(ref_dtype, i_n * image),
+                                   convert_cpu_bytes(ref_dtype, cn * image), hipMemcpyDeviceToHost));
+                        });
+                }else
+#endif
+                if(!sample_index.empty()){
+                    HIP_CALL(hipMemcpy(device_output_to_host, driver_data_type == driverFloat ? device_output : device_output_dtype,
+                                   static_cast<size_t>(n) * k * ho * wo * data_byte,
+                                   hipMemcpyDeviceToHost));
+                    is_valid = valid_vector_sampled(get_convert_cpu_dtype(driver_data_type), sample_index, sample_ref.data(),
+                                            device_output_to_host, nrms);
+                }else if(driver_data_type == driverFloat){
                     HIP_CALL(hipMemcpy(device_output_to_host, device_output,
                                    static_cast<size_t>(n) * k * ho * wo * data_byte,
                                    hipMemcpyDeviceToHost));
@@ -913,33 +1125,41 @@ int main(int argc, char **argv) {
                                    static_cast<size_t>(n) * k * ho * wo * data_byte,
                                    hipMemcpyDeviceToHost));
                     if(driver_data_type == driverHalf)
-                        is_valid = valid_vector<float16>(host_output, static_cast<float16*>(device_output_to_host),
+                        is_valid = valid_vector_native<float16>(static_cast<float16*>(host_output_dtype), static_cast<float16*>(device_output_to_host),
                                             static_cast<size_t>(n) * k * ho * wo, nrms);
                     else if(driver_data_type == driverBFloat16)
-                        is_valid = valid_vector<bfloat16>(host_output, static_cast<bfloat16*>(device_output_to_host),
+                        is_valid = valid_vector_native<bfloat16>(static_cast<bfloat16*>(host_output_dtype), static_cast<bfloat16*>(device_output_to_host),
                                             static_cast<size_t>(n) * k * ho * wo, nrms);
                     else if (driver_data_type == driverInt8)
-                        is_valid = valid_vector<int8_t>(host_output, static_cast<int8_t*>(device_output_to_host),
+                        is_valid = valid_vector_native<int8_t>(static_cast<int8_t*>(host_output_dtype), static_cast<int8_t*>(device_output_to_host),
                                             static_cast<size_t>(n) * k * ho * wo, nrms);
                     else if (driver_data_type == driverInt4)
-                        is_valid = valid_vector<int4x2_t>(host_output, static_cast<int4x2_t*>(device_output_to_host),
+                        is_valid = valid_vector_native<int4x2_t>(static_cast<int4x2_t*>(host_output_dtype), static_cast<int4x2_t*>(device_output_to_host),
                                             static_cast<size_t>(n) * k * ho * wo, nrms);
                 }
                 printf(", valid:%s", is_valid ? "y" : "n");
+                if(!is_valid) num_invalid++;
                 if(assert_when_invalid) assert(is_valid);
+                return is_valid;
             }
+            return true;
         };
 
+        result_t fwd_result;
         if(driver_data_type == driverFloat)
-            launch_conv_driver(&conv_fwd_driver, &conv_args, tunables, "fwd", driver_data_type, p_bcsv, device_input, device_weight, device_output, fwd_pre, fwd_post);
+            fwd_result = launch_conv_driver(&conv_fwd_driver, &conv_args, tunables, "fwd", driver_data_type, p_bcsv, device_input, device_weight, device_output, fwd_pre, fwd_post);
         else
-            launch_conv_driver(&conv_fwd_driver, &conv_args, tunables, "fwd", driver_data_type, p_bcsv, device_input_dtype, device_weight_dtype, device_output_dtype, fwd_pre, fwd_post);
+            fwd_result = launch_conv_driver(&conv_fwd_driver, &conv_args, tunables, "fwd", driver_data_type, p_bcsv, device_input_dtype, device_weight_dtype, device_output_dtype, fwd_pre, fwd_post);
+        add_batch_result("fwd", fwd_result);
 
         if (need_verify)
-            free(device_output_to_host);
+            igemm_host_arena_get()->release(device_output_to_host);
     }
 
     if (need_bwd){
+        double ref_nrms_scale = 1.0;     // extra tolerance for a less accurate host reference
+        std::vector<size_t> sample_index;   // sampled validation, see conv_sample_cpu.h
+        std::vector<float> sample_ref;
         void *device_input_to_host = NULL;
         result_t fastest_result_bwd;
         fastest_result_bwd.duration_ms = FLT_MAX;
@@ -947,30 +1167,18 @@ int main(int argc, char **argv) {
         if (need_verify) {
             // gen rand
             if(!igemm_rand_int){
-                gen_rand_vector<float, float>(host_output, static_cast<size_t>(n) * k * ho * wo, 0.0, 1.0);
-                gen_rand_vector<float, float>(host_weight, static_cast<size_t>(k) * c * y * x, -0.5, 0.5);
+                gen_rand_tensor<float>(driver_data_type, host_output, host_output_dtype, static_cast<size_t>(n) * k * ho * wo, 0.0, 1.0, rand_seed, rand_cpu_tensor_output);
+                gen_rand_tensor<float>(driver_data_type, host_weight, host_weight_dtype, static_cast<size_t>(k) * c * y * x, -0.5, 0.5, rand_seed, rand_cpu_tensor_weight);
             }
             else{
-                gen_rand_vector<float, int>(host_output, static_cast<size_t>(n) * k * ho * wo, -5, 5);
-                gen_rand_vector<float, int>(host_weight, static_cast<size_t>(k) * c * y * x, -5, 5);
+                gen_rand_tensor<int>(driver_data_type, host_output, host_output_dtype, static_cast<size_t>(n) * k * ho * wo, -5, 5, rand_seed, rand_cpu_tensor_output);
+                gen_rand_tensor<int>(driver_data_type, host_weight, host_weight_dtype, static_cast<size_t>(k) * c * y * x, -5, 5, rand_seed, rand_cpu_tensor_weight);
             }
-            gen_rand_vector<float, float>(host_input, static_cast<size_t>(n) * c * hi * wi, 999999., 9999999.);  // manually input value to a very large number
+            if(driver_data_type == driverFloat)
+                gen_rand_vector<float, float>(host_input, static_cast<size_t>(n) * c * hi * wi, 999999., 9999999., rand_seed, rand_cpu_tensor_input);  // manually input value to a very large number
             // gen_rand_vector<float, int>(host_output, static_cast<size_t>(n) * k * ho * wo,1, 1);
             // gen_rand_vector<float, int>(host_weight, static_cast<size_t>(k) * c * y * x, 1, 1);
 
-            if(driver_data_type == driverHalf){
-                tensor_copy<float16, float>(static_cast<float16*>(host_output_dtype), host_output, static_cast<size_t>(n) * k * ho * wo);
-                tensor_copy<float16, float>(static_cast<float16*>(host_weight_dtype), host_weight, static_cast<size_t>(k) * c * y * x);
-            }
-            else if(driver_data_type == driverBFloat16){
-                tensor_copy<bfloat16, float>(static_cast<bfloat16*>(host_output_dtype), host_output, static_cast<size_t>(n) * k * ho * wo);
-                tensor_copy<bfloat16, float>(static_cast<bfloat16*>(host_weight_dtype), host_weight, static_cast<size_t>(k) * c * y * x);
-            }
-            else if(driver_data_type == driverInt8){
-                tensor_copy<int8_t, float>(static_cast<int8_t*>(host_output_dtype), host_output, static_cast<size_t>(n) * k * ho * wo);
-                tensor_copy<int8_t, float>(static_cast<int8_t*>(host_weight_dtype), host_weight, static_cast<size_t>(k) * c * y * x);
-            }
-
 #ifdef USE_GPU_NAIVE_CONV
             HIP_CALL(hipMemcpy(device_output, host_output,
                        static_cast<size_t>(n) * k * ho * wo * sizeof(float), hipMemcpyHostToDevice));
@@ -992,23 +1200,55 @@ int main(int argc, char **argv) {
             HIP_CALL(hipMemcpy(host_input, device_input,
                                    static_cast<size_t>(n) * c * hi * wi * sizeof(float),
                                    hipMemcpyDeviceToHost));
+            if(driver_data_type != driverFloat)
+                convert_cpu_narrow_f32(get_convert_cpu_dtype(driver_data_type), host_input_dtype, 0, host_input,
+                                static_cast<size_t>(n) * c * hi * wi);
 #else
-            if(in_layout == "NCHW")
-                naive_conv_bwd_nchw(host_input, host_weight, host_output, n,
-                                         wi, hi, c, k, x, y, pad_w,
-                                         pad_h, stride_w, stride_h, dilation_w, dilation_h, ngroups);
-            else if(in_layout == "NHWC")
-                naive_conv_bwd_nhwc(host_input, host_weight, host_output, n,
-                                         wi, hi, c, k, x, y, pad_w,
-                                         pad_h, stride_w, stride_h, dilation_w, dilation_h, ngroups);
-            else
-                assert(0);
+            if(sample_rate > 0){
+                assert(in_layout == "NCHW" || in_layout == "NHWC");
+                if(driver_data_type != driverFloat){
+                    convert_cpu_widen_f32(get_convert_cpu_dtype(driver_data_type), host_output, host_output_dtype, 0,
+                                    static_cast<size_t>(n) * k * ho * wo);
+                    convert_cpu_widen_f32(get_convert_cpu_dtype(driver_data_type), host_weight, host_weight_dtype, 0,
+                                    static_cast<size_t>(k) * c * y * x);
+                }
+                conv_sample_cpu_bwd(in_layout == "NHWC", host_weight, host_output, &sample_index, &sample_ref, n, wi, hi, c,
+                                k, x, y, pad_w, pad_h, stride_w, stride_h,
+                                dilation_w, dilation_h, ngroups, sample_rate, sample_seed);
+            } else if(valid_stream) {
+                // computed chunk by chunk at each validation, only its tolerance is needed here
+                assert(in_layout == "NCHW" || in_layout == "NHWC");
+                ref_nrms_scale = conv_ref_cpu_nrms_scale(conv_ref_cpu_select("bwd", n, wi, hi, c, k, x, y, pad_w, pad_h, stride_w, stride_h,
+                                    dilation_w, dilation_h, ngroups, driver_data_type == driverInt8 || driver_data_type == driverInt4),
+                                    driver_data_type == driverFloat);
+            } else {
+                conv_ref_cpu_algo_t ref_algo = conv_ref_cpu_select("bwd", n, wi, hi, c, k, x, y, pad_w, pad_h, stride_w, stride_h,
+                                    dilation_w, dilation_h, ngroups, driver_data_type == driverInt8 || driver_data_type == driverInt4);
+                ref_nrms_scale = conv_ref_cpu_nrms_scale(ref_algo, driver_data_type == driverFloat);
+                convert_cpu_dtype_t ref_dtype = get_convert_cpu_dtype(driver_data_type);
+                void *ref_input  = driver_data_type == driverFloat ? host_input  : host_input_dtype;
+                void *ref_weight = driver_data_type == driverFloat ? host_weight : host_weight_dtype;
+                void *ref_output = driver_data_type == driverFloat ? host_output : host_output_dtype;
+                if(in_layout == "NCHW")
+                    conv_native_cpu_bwd_nchw(ref_algo, ref_dtype, ref_input, ref_weight, ref_output, n,
+                                             wi, hi, c, k, x, y, pad_w,
+                                             pad_h, stride_w, stride_h, dilation_w, dilation_h, ngroups);
+                else if(in_layout == "NHWC")
+                    conv_native_cpu_bwd_nhwc(ref_algo, ref_dtype, ref_input, ref_weight, ref_output, n,
+                                             wi, hi, c, k, x, y, pad_w,
+                                             pad_h, stride_w, stride_h, dilation_w, dilation_h, ngroups);
+                else
+                    assert(0);
+            }
 #endif
-            if(driver_data_type != driverFloat){
-                device_input_to_host = malloc((static_cast<size_t>(n) * c * hi * wi * data_byte + 3) / 4 * 4 );
+            if(valid_stream){
+                device_input_to_host = NULL;    // fetched chunk by chunk
+            }
+            else if(driver_data_type != driverFloat){
+                device_input_to_host = igemm_host_arena_get()->acquire((static_cast<size_t>(n) * c * hi * wi * data_byte + 3) / 4 * 4 );
             }
             else{
-                device_input_to_host = malloc(static_cast<size_t>(n) * c * hi * wi * sizeof(float));
+                device_input_to_host = igemm_host_arena_get()->acquire(static_cast<size_t>(n) * c * hi * wi * sizeof(float));
             }
             // printf("len:%d\n", n * c * hi * wi * sizeof(float) );
         }
@@ -1034,11 +1274,39 @@ int main(int argc, char **argv) {
                     0x7f, static_cast<size_t>(n) * c * hi * wi * data_byte)); // 0x7f7f7f7f ~= 7.41e+28, a very large number
         };
 
-        auto bwd_post = [&](){
+        auto bwd_post = [&]() -> bool {
             if (need_verify) {
-                double nrms = get_nrms("bwd", driver_data_type);
+                double nrms = get_nrms("bwd", driver_data_type) * ref_nrms_scale;
                 bool is_valid = false;
-                if(driver_data_type == driverFloat){
+#ifndef USE_GPU_NAIVE_CONV
+                if(valid_stream){
+                    conv_ref_cpu_algo_t ref_algo = conv_ref_cpu_select("bwd", n, wi, hi, c, k, x, y, pad_w, pad_h, stride_w, stride_h,
+                                    dilation_w, dilation_h, ngroups, driver_data_type == driverInt8 || driver_data_type == driverInt4);
+                    convert_cpu_dtype_t ref_dtype = get_convert_cpu_dtype(driver_data_type);
+                    const uint8_t *ref_output = (const uint8_t *)(driver_data_type == driverFloat ? host_output : host_output_dtype);
+                    const void *ref_weight    = driver_data_type == driverFloat ? host_weight : host_weight_dtype;
+                    const uint8_t *result     = (const uint8_t *)(driver_data_type == driverFloat ? device_input : device_input_dtype);
+                    size_t image = static_cast<size_t>(c) * hi * wi;
+                    is_valid = valid_stream_cpu_images(ref_dtype, n, image, nrms,
+                        [&](size_t i_n, size_t cn, void *ref){
+                            conv_native_cpu_bwd(ref_algo, ref_dtype, in_layout == "NHWC", ref, ref_weight,
+                                    ref_output + convert_cpu_bytes(ref_dtype, i_n * k * ho * wo), cn,
+                                    wi, hi, c, k, x, y, pad_w,
+                                    pad_h, stride_w, stride_h, dilation_w, dilation_h, ngroups);
+                        },
+                        [&](size_t i_n, size_t cn, void *pred){
+                            HIP_CALL(hipMemcpy(pred, result + convert_cpu_bytes(ref_dtype, i_n * image),
+                                    convert_cpu_bytes(ref_dtype, cn * image), hipMemcpyDeviceToHost));
+                        });
+                }else
+#endif
+                if(!sample_index.empty()){
+                    HIP_CALL(hipMemcpy(device_input_to_host, driver_data_type == driverFloat ? device_input : device_input_dtype,
+                                    static_cast<size_t>(n) * c * hi * wi * data_byte,
+                                    hipMemcpyDeviceToHost));
+                    is_valid = valid_vector_sampled(get_convert_cpu_dtype(driver_data_type), sample_index, sample_ref.data(),
+                                                device_input_to_host, nrms);
+                }else if(driver_data_type == driverFloat){
                     HIP_CALL(hipMemcpy(device_input_to_host, device_input,
                                     static_cast<size_t>(n) * c * hi * wi * data_byte,
                                     hipMemcpyDeviceToHost));
@@ -1049,54 +1317,54 @@ int main(int argc, char **argv) {
                                     static_cast<size_t>(n) * c * hi * wi * data_byte,
                                     hipMemcpyDeviceToHost));
                     if(driver_data_type == driverHalf)
-                        is_valid = valid_vector<float16>(host_input, static_cast<float16*>(device_input_to_host),
+                        is_valid = valid_vector_native<float16>(static_cast<float16*>(host_input_dtype), static_cast<float16*>(device_input_to_host),
                                                 static_cast<size_t>(n) * c * hi * wi, nrms);
                     else if (driver_data_type == driverBFloat16)
-                        is_valid = valid_vector<bfloat16>(host_input, static_cast<bfloat16*>(device_input_to_host),
+                        is_valid = valid_vector_native<bfloat16>(static_cast<bfloat16*>(host_input_dtype), static_cast<bfloat16*>(device_input_to_host),
                                                 static_cast<size_t>(n) * c * hi * wi, nrms);
                     else if (driver_data_type == driverInt8)
-                        is_valid = valid_vector<int8_t>(host_input, static_cast<int8_t*>(device_input_to_host),
+                        is_valid = valid_vector_native<int8_t>(static_cast<int8_t*>(host_input_dtype), static_cast<int8_t*>(device_input_to_host),
                                                 static_cast<size_t>(n) * c * hi * wi, nrms);
                 }
                 printf(", valid:%s", is_valid ? "y" : "n");
+                if(!is_valid) num_invalid++;
                 if(assert_when_invalid) assert(is_valid);
+                return is_valid;
             }
+            return true;
         };
 
+        result_t bwd_result;
         if(driver_data_type == driverFloat)
-            launch_conv_driver(&conv_bwd_driver, &conv_args, tunables, "bwd",  driver_data_type, p_bcsv, device_input, device_weight, device_output, bwd_pre, bwd_post);
+            bwd_result = launch_conv_driver(&conv_bwd_driver, &conv_args, tunables, "bwd",  driver_data_type, p_bcsv, device_input, device_weight, device_output, bwd_pre, bwd_post);
         else
-            launch_conv_driver(&conv_bwd_driver, &conv_args, tunables, "bwd",  driver_data_type, p_bcsv, device_input_dtype, device_weight_dtype, device_output_dtype, bwd_pre, bwd_post);
+            bwd_result = launch_conv_driver(&conv_bwd_driver, &conv_args, tunables, "bwd",  driver_data_type, p_bcsv, device_input_dtype, device_weight_dtype, device_output_dtype, bwd_pre, bwd_post);
+        add_batch_result("bwd", bwd_result);
 
         if (need_verify) 
-            free(device_input_to_host);
+            igemm_host_arena_get()->release(device_input_to_host);
     }
 
     if (need_wrw){
+        double ref_nrms_scale = 1.0;     // extra tolerance for a less accurate host reference
+        std::vector<size_t> sample_index;   // sampled validation, see conv_sample_cpu.h
+        std::vector<float> sample_ref;
         void *device_weight_to_host = NULL;
 
         // begin wrw
         if (need_verify) {
             // gen rand
             if(!igemm_rand_int){
-                gen_rand_vector<float, float>(host_input, static_cast<size_t>(n) * c * hi * wi, 0.0, 1.0);
-                gen_rand_vector<float, float>(host_output, static_cast<size_t>(n) * k * ho * wo, -0.5, 0.5);
+                gen_rand_tensor<float>(driver_data_type, host_input, host_input_dtype, static_cast<size_t>(n) * c * hi * wi, 0.0, 1.0, rand_seed, rand_cpu_tensor_input);
+                gen_rand_tensor<float>(driver_data_type, host_output, host_output_dtype, static_cast<size_t>(n) * k * ho * wo, -0.5, 0.5, rand_seed, rand_cpu_tensor_output);
             }else{
-                gen_rand_vector<float, int>(host_input, static_cast<size_t>(n) * c * hi * wi, -5, 5);
-                gen_rand_vector<float, int>(host_output, static_cast<size_t>(n) * k * ho * wo, -5, 5);
+                gen_rand_tensor<int>(driver_data_type, host_input, host_input_dtype, static_cast<size_t>(n) * c * hi * wi, -5, 5, rand_seed, rand_cpu_tensor_input);
+                gen_rand_tensor<int>(driver_data_type, host_output, host_output_dtype, static_cast<size_t>(n) * k * ho * wo, -5, 5, rand_seed, rand_cpu_tensor_output);
             }
             //gen_rand_vector<float, int>(host_input, static_cast<size_t>(n) * c * hi * wi, 1, 1);
             //gen_rand_vector<float, int>(host_output, static_cast<size_t>(n) * k * ho * wo, 1, 1);
             //gen_rand_vector<float, int>(host_input, static_cast<size_t>(n) * c * hi * wi, -1, 1);
             //gen_rand_vector<float, int>(host_output, static_cast<size_t>(n) * k * ho * wo, -1, 1);
-            if(driver_data_type == driverHalf){
-                tensor_copy<float16, float>(static_cast<float16*>(host_input_dtype), host_input, static_cast<size_t>(n) * c * hi * wi);
-                tensor_copy<float16, float>(static_cast<float16*>(host_output_dtype), host_output, static_cast<size_t>(n) * k * ho * wo);
-            }
-            else if(driver_data_type == driverBFloat16){
-                tensor_copy<bfloat16, float>(static_cast<bfloat16*>(host_input_dtype), host_input, static_cast<size_t>(n) * c * hi * wi);
-                tensor_copy<bfloat16, float>(static_cast<bfloat16*>(host_output_dtype), host_output, static_cast<size_t>(n) * k * ho * wo);
-            }
 #ifdef USE_GPU_NAIVE_CONV
             HIP_CALL(hipMemcpy(device_input, host_input,
                        static_cast<size_t>(n) * c * hi * wi * sizeof(float), hipMemcpyHostToDevice));
@@ -1118,23 +1386,46 @@ int main(int argc, char **argv) {
             HIP_CALL(hipMemcpy(host_weight, device_weight,
                                    static_cast<size_t>(ngroups) * (k / ngroups) * (c / ngroups) * y * x * sizeof(float),
                                    hipMemcpyDeviceToHost));
+            if(driver_data_type != driverFloat)
+                convert_cpu_narrow_f32(get_convert_cpu_dtype(driver_data_type), host_weight_dtype, 0, host_weight,
+                                static_cast<size_t>(ngroups) * (k / ngroups) * (c / ngroups) * y * x);
 #else
-            if(in_layout == "NCHW")
-                naive_conv_wrw_nchw(host_input, host_weight, host_output, n,
-                                         wi, hi, c, k, x, y, pad_w,
-                                         pad_h, stride_w, stride_h, dilation_w, dilation_h, ngroups);
-            else if(in_layout == "NHWC")
-                naive_conv_wrw_nhwc(host_input, host_weight, host_output, n,
-                                         wi, hi, c, k, x, y, pad_w,
-                                         pad_h, stride_w, stride_h, dilation_w, dilation_h, ngroups);
-            else
-                assert(0);
+            if(sample_rate > 0){
+                assert(in_layout == "NCHW" || in_layout == "NHWC");
+                if(driver_data_type != driverFloat){
+                    convert_cpu_widen_f32(get_convert_cpu_dtype(driver_data_type), host_input, host_input_dtype, 0,
+                                    static_cast<size_t>(n) * c * hi * wi);
+                    convert_cpu_widen_f32(get_convert_cpu_dtype(driver_data_type), host_output, host_output_dtype, 0,
+                                    static_cast<size_t>(n) * k * ho * wo);
+                }
+                conv_sample_cpu_wrw(in_layout == "NHWC", host_input, host_output, &sample_index, &sample_ref, n, wi, hi, c,
+                                k, x, y, pad_w, pad_h, stride_w, stride_h,
+                                dilation_w, dilation_h, ngroups, sample_rate, sample_seed);
+            } else {
+                conv_ref_cpu_algo_t ref_algo = conv_ref_cpu_select("wrw", n, wi, hi, c, k, x, y, pad_w, pad_h, stride_w, stride_h,
+                                    dilation_w, dilation_h, ngroups, driver_data_type == driverInt8 || driver_data_type == driverInt4);
+                ref_nrms_scale = conv_ref_cpu_nrms_scale(ref_algo, driver_data_type == driverFloat);
+                convert_cpu_dtype_t ref_dtype = get_convert_cpu_dtype(driver_data_type);
+                void *ref_input  = driver_data_type == driverFloat ? host_input  : host_input_dtype;
+                void *ref_weight = driver_data_type == driverFloat ? host_weight : host_weight_dtype;
+                void *ref_output = driver_data_type == driverFloat ? host_output : host_output_dtype;
+                if(in_layout == "NCHW")
+                    conv_native_cpu_wrw_nchw(ref_algo, ref_dtype, ref_input, ref_weight, ref_output, n,
+                                             wi, hi, c, k, x, y, pad_w,
+                                             pad_h, stride_w, stride_h, dilation_w, dilation_h, ngroups);
+                else if(in_layout == "NHWC")
+                    conv_native_cpu_wrw_nhwc(ref_algo, ref_dtype, ref_input, ref_weight, ref_output, n,
+                                             wi, hi, c, k, x, y, pad_w,
+                                             pad_h, stride_w, stride_h, dilation_w, dilation_h, ngroups);
+                else
+                    assert(0);
+            }
 #endif
             if(driver_data_type == driverHalf){
-                device_weight_to_host = malloc((static_cast<size_t>(k) * c * y * x * data_byte + 3) / 4 * 4);
+                device_weight_to_host = igemm_host_arena_get()->acquire((static_cast<size_t>(k) * c * y * x * data_byte + 3) / 4 * 4);
             }
             else{
-                device_weight_to_host = malloc(static_cast<size_t>(k) * c * y * x * sizeof(float));
+                device_weight_to_host = igemm_host_arena_get()->acquire(static_cast<size_t>(k) * c * y * x * sizeof(float));
             }
         }
 
@@ -1184,11 +1475,17 @@ int main(int argc, char **argv) {
                     0, static_cast<size_t>(k) * c * y * x * data_byte));
         };
 
-        auto wrw_post = [&](){
+        auto wrw_post = [&]() -> bool {
             if (need_verify) {
-                double nrms = get_nrms("wrw", driver_data_type);
+                double nrms = get_nrms("wrw", driver_data_type) * ref_nrms_scale;
                 bool is_valid;
-                if(driver_data_type == driverFloat){
+                if(!sample_index.empty()){
+                    HIP_CALL(hipMemcpy(device_weight_to_host, driver_data_type == driverFloat ? device_weight : device_weight_dtype,
+                                   static_cast<size_t>(ngroups) * (k / ngroups) * (c / ngroups) * y * x * data_byte,
+                                   hipMemcpyDeviceToHost));
+                    is_valid = valid_vector_sampled(get_convert_cpu_dtype(driver_data_type), sample_index, sample_ref.data(),
+                                    device_weight_to_host, nrms);
+                }else if(driver_data_type == driverFloat){
                     HIP_CALL(hipMemcpy(device_weight_to_host, device_weight,
                                    static_cast<size_t>(ngroups) * (k / ngroups) * (c / ngroups) * y * x * sizeof(float),
                                    hipMemcpyDeviceToHost));
@@ -1199,44 +1496,172 @@ int main(int argc, char **argv) {
                                    static_cast<size_t>(ngroups) * (k / ngroups) * (c / ngroups) * y * x * data_byte,
                                    hipMemcpyDeviceToHost));
                     if(driver_data_type == driverHalf)
-                        is_valid = valid_vector<float16>(host_weight, static_cast<float16*>(device_weight_to_host),
+                        is_valid = valid_vector_native<float16>(static_cast<float16*>(host_weight_dtype), static_cast<float16*>(device_weight_to_host),
                                     static_cast<size_t>(ngroups) * (k / ngroups) * (c / ngroups) * y * x, nrms);
                     else if(driver_data_type == driverBFloat16)
-                        is_valid = valid_vector<bfloat16>(host_weight, static_cast<bfloat16*>(device_weight_to_host),
+                        is_valid = valid_vector_native<bfloat16>(static_cast<bfloat16*>(host_weight_dtype), static_cast<bfloat16*>(device_weight_to_host),
                                     static_cast<size_t>(ngroups) * (k / ngroups) * (c / ngroups) * y * x, nrms);
                 }
                 printf(", valid:%s", is_valid ? "y" : "n");
+                if(!is_valid) num_invalid++;
                 if(assert_when_invalid) assert(is_valid);
+                return is_valid;
             }
+            return true;
         };
 
+        result_t wrw_result;
         if(driver_data_type == driverFloat)
-            launch_conv_driver(&conv_wrw_driver, &conv_args, tunables, "wrw", driver_data_type, p_bcsv, device_input, device_weight, device_output, wrw_pre, wrw_post);
+            wrw_result = launch_conv_driver(&conv_wrw_driver, &conv_args, tunables, "wrw", driver_data_type, p_bcsv, device_input, device_weight, device_output, wrw_pre, wrw_post);
         else
-            launch_conv_driver(&conv_wrw_driver, &conv_args, tunables, "wrw", driver_data_type, p_bcsv, device_input_dtype, device_weight_dtype, device_output_dtype, wrw_pre, wrw_post);
+            wrw_result = launch_conv_driver(&conv_wrw_driver, &conv_args, tunables, "wrw", driver_data_type, p_bcsv, device_input_dtype, device_weight_dtype, device_output_dtype, wrw_pre, wrw_post);
+        add_batch_result("wrw", wrw_result);
 
         if (need_verify) 
-            free(device_weight_to_host);
+            igemm_host_arena_get()->release(device_weight_to_host);
     }
 
-    if(p_bcsv)
-        fclose(p_bcsv);
+    conv_driver_buffers_free(&problem_buffers);
+}
 
-    free(host_input);
-    free(host_weight);
-    free(host_output);
+// parse every line of the batch file up front, then run each distinct problem once, the arenas sized for the largest
+static void run_conv_batch(const char * batch_file, const char * batch_out, const std::vector<igemm_gtc_tunable_t> & tunables,
+                    hipModule_t module, hipModule_t module_tensor_cast, FILE * p_bcsv)
+{
+    std::vector<conv_batch_cpu_cmd_t> cmds;
+    if(!conv_batch_cpu_parse(batch_file, &cmds)){
+        printf("fail to open batch file %s\n", batch_file);
+        exit(-1);
+    }
 
-    hipFree(device_input);
-    hipFree(device_weight);
-    hipFree(device_output);
+    std::vector<std::vector<char *>> cmd_argv(cmds.size());
+    std::vector<std::string> keys;
+    size_t max_input = 0, max_weight = 0, max_output = 0, max_data_byte = 0;
+    bool need_host_f32 = false;
+    double sample_rate = atof(env_get_str("IGEMM_CPU_SAMPLE_RATE", (char *)"0"));
+    for(size_t i = 0; i < cmds.size(); i++){
+        cmd_argv[i].push_back(const_cast<char *>("conv_driver.exe"));
+        for(auto & token : cmds[i].tokens)
+            cmd_argv[i].push_back(const_cast<char *>(token.c_str()));
+        int cmd_argc = static_cast<int>(cmd_argv[i].size());
+        std::string base_arg = create_base_args(cmd_argc, cmd_argv[i].data());
+        args_t conv_args = create_conv_args(cmd_argc, cmd_argv[i].data());
+        keys.push_back(base_arg + " " + conv_args.canonical());
+
+        size_t input_elems, weight_elems, output_elems;
+        get_conv_tensor_elems(&conv_args, &input_elems, &weight_elems, &output_elems);
+        max_input = std::max(max_input, input_elems);
+        max_weight = std::max(max_weight, weight_elems);
+        max_output = std::max(max_output, output_elems);
+        max_data_byte = std::max(max_data_byte, get_data_byte(get_driver_data_type(base_arg)));
+        need_host_f32 = need_host_f32 || conv_driver_need_host_f32(get_driver_data_type(base_arg), sample_rate);
+    }
 
-#if defined(USE_HALF) || defined(USE_INT8) || defined(USE_BF16) || defined(USE_INT4)
-    free(host_input_dtype);
-    free(host_weight_dtype);
-    free(host_output_dtype);
+    std::vector<size_t> unique_of;
+    std::vector<size_t> unique = conv_batch_cpu_dedupe(keys, &unique_of);
+    printf("batch %s, %zu problems, %zu unique\n", batch_file, cmds.size(), unique.size());
+    if(unique.size() == 0)
+        return;
+
+    conv_driver_buffers_reserve(max_input, max_weight, max_output, max_data_byte, need_host_f32);
+
+    std::vector<conv_batch_cpu_result_t> results;
+    for(size_t u = 0; u < unique.size(); u++){
+        size_t i = unique[u];
+        size_t first = results.size();
+        run_conv_problem(static_cast<int>(cmd_argv[i].size()), cmd_argv[i].data(), tunables, module, module_tensor_cast,
+                    p_bcsv, &results);
+        std::vector<int> lines;
+        for(size_t j = 0; j < cmds.size(); j++)
+            if(unique_of[j] == u)
+                lines.push_back(cmds[j].line);
+        for(size_t r = first; r < results.size(); r++){
+            results[r].cmd = conv_batch_cpu_join(cmds[i].tokens);
+            results[r].lines = lines;
+        }
+    }
+
+    if(!conv_batch_cpu_write(batch_out, results))
+        printf("fail to write batch result %s\n", batch_out);
+    else
+        printf("batch result written to %s\n", batch_out);
+}
+
+int main(int argc, char **argv) {
+    // --batch <file> [--batch_out <file>], in any position
+    const char *batch_file = nullptr;
+    const char *batch_out = "batch_result.csv";
+    bool has_batch_out = false;
+    for(int i = 1; i < argc; i++){
+        std::string flag = argv[i];
+        if(flag != "--batch" && flag != "--batch_out")
+            continue;
+        if(i + 1 >= argc){
+            printf("%s needs a file name\n", flag.c_str());
+            return -1;
+        }
+        if(flag == "--batch")
+            batch_file = argv[++i];
+        else{
+            batch_out = argv[++i];
+            has_batch_out = true;
+        }
+    }
+    if(has_batch_out && !batch_file){
+        printf("--batch_out is only valid with --batch\n");
+        return -1;
+    }
+
+    char *hsaco = env_get_str("IGEMM_HSACO", IGEMM_HSACO);
+    char *config_file = env_get_str("IGEMM_CONFIG_FILE", IGEMM_CONFIG_FILE);
+    int igemm_bench_csv = env_get_int("IGEMM_BENCH_CSV", 0);
+    config_parser_t config_parser(config_file);
+    auto unexpanded_content = config_parser.parse();
+    auto content = igemm_try_expand_tunable_content(unexpanded_content);
+    //content.dump();
+    FILE * p_bcsv = nullptr;
+    if(igemm_bench_csv){
+        p_bcsv = fopen ("bench_model.csv", "a");
+        assert(p_bcsv);
+    }
 
-    hipFree(device_input_dtype);
-    hipFree(device_weight_dtype);
-    hipFree(device_output_dtype);
+#ifdef USE_GPU_NAIVE_CONV
+    char *gpu_naive_conv_hsaco = env_get_str("IGEMM_GPU_NAIVE_CONV_HSACO", IGEMM_GPU_NAIVE_CONV_HSACO);
+    gpu_naive_conv_init(gpu_naive_conv_hsaco);
 #endif
+
+    auto tunables = igemm_gtc_tunable_from_config(content);
+    if(tunables.size() == 0){
+        printf("no tunable specified, may not work\n");
+        return 0;
+    }
+    // printf("tunables:%d, hsaco:%s\n", tunables.size(), hsaco);
+
+    hipModule_t module;
+#ifndef IGEMM_SPLIT_KERNEL
+    HIP_CALL(hipModuleLoad(&module, hsaco));
+#endif
+
+    // launch tensor cast module
+    hipModule_t module_tensor_cast;
+    char *hsaco_tensor_cast = env_get_str("IGEMM_TENSOR_CAST_HSACO", IGEMM_TENSOR_CAST_HSACO);
+    HIP_CALL(hipModuleLoad(&module_tensor_cast, hsaco_tensor_cast));
+
+    if(batch_file)
+        run_conv_batch(batch_file, batch_out, tunables, module, module_tensor_cast, p_bcsv);
+    else
+        run_conv_problem(argc, argv, tunables, module, module_tensor_cast, p_bcsv, nullptr);
+
+    if(env_get_int("IGEMM_ARENA_STATS", 0)){
+        for(int is_device : {0, 1}){
+            buffer_arena_cpu_t::stats_t stats = (is_device ? igemm_device_arena_get() : igemm_host_arena_get())->get_stats();
+            printf("%s arena: peak in use %.1fMB, peak reserved %.1fMB, %zu allocs, %zu reuses\n", is_device ? "device" : "host",
+                stats.peak_in_use / 1048576.0, stats.peak_reserved / 1048576.0, stats.num_allocs, stats.num_reuses);
+        }
+    }
+    igemm_host_arena_get()->trim();
+    igemm_device_arena_get()->trim();
+
+    if(p_bcsv)
+        fclose(p_bcsv);
 }
@@ -0,0 +1,161 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _CONV_GEOMETRY_CPU_H
+#define _CONV_GEOMETRY_CPU_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <vector>
+
+/*
+ * precomputed index ranges of a convolution, shared by the host side conv paths, so their inner loops need
+ * no bounds check and walk the input from a base pointer with a fixed stride.
+ *
+ * along one spatial dim, output position o and filter tap r read input position i = o * s - p + d * r.
+ *  fwd : for output o, taps [tap_begin(o), tap_end(o)) are inside the input, the first one reads in_first(o)
+ *  wrw : for tap r, outputs [out_begin(r), out_end(r)) read inside the input
+ *  bwd : for input i, the taps that reach it are the ones of its stride phase, (d * r) % s == (i + p) % s.
+ *        they are kept ascending with q = (d * r) / s, so the output is (i + p) / s - q with no modulo,
+ *        and bwd_taps(i) is the contiguous run of them whose output is in range.
+ *        this is the host side counterpart of the per-phase dtile split of the gpu bwd kernels.
+ */
+static inline size_t conv_geometry_cpu_out_size(size_t in, size_t f, size_t p, size_t s, size_t d)
+{
+    return (in + 2 * p - d * (f - 1) - 1) / s + 1;
+}
+
+class conv_geometry_cpu_dim_t{
+public:
+    struct tap_t{
+        size_t r;       // filter tap
+        size_t q;       // (d * r) / s
+    };
+
+    conv_geometry_cpu_dim_t() : conv_geometry_cpu_dim_t(1, 1, 1, 0, 1, 1) {}
+    conv_geometry_cpu_dim_t(size_t in, size_t f, size_t p, size_t s, size_t d)
+        : conv_geometry_cpu_dim_t(in, conv_geometry_cpu_out_size(in, f, p, s, d), f, p, s, d) {}
+    // an explicit output size, e.g. for a tile of a larger conv
+    conv_geometry_cpu_dim_t(size_t in, size_t out, size_t f, size_t p, size_t s, size_t d)
+        : m_in(in), m_out(out), m_f(f), m_p(p), m_s(s), m_d(d),
+          m_tap_begin(out), m_tap_end(out), m_out_begin(f), m_out_end(f),
+          m_phase_offset(s + 1, 0), m_phase_taps(f), m_bwd_begin(in), m_bwd_end(in), m_bwd_base(in)
+    {
+        assert(s >= 1 && d >= 1 && f >= 1);
+        for(size_t o = 0; o < out; o++){
+            size_t r = 0;
+            while(r < f && !valid(o, r))
+                r++;
+            m_tap_begin[o] = r;
+            while(r < f && valid(o, r))
+                r++;
+            m_tap_end[o] = r;
+        }
+        for(size_t r = 0; r < f; r++){
+            size_t o = 0;
+            while(o < out && !valid(o, r))
+                o++;
+            m_out_begin[r] = o;
+            while(o < out && valid(o, r))
+                o++;
+            m_out_end[r] = o;
+        }
+        // counting sort of the taps by phase, stable so each phase stays ascending
+        for(size_t r = 0; r < f; r++)
+            m_phase_offset[(d * r) % s + 1]++;
+        for(size_t phase = 0; phase < s; phase++)
+            m_phase_offset[phase + 1] += m_phase_offset[phase];
+        std::vector<size_t> fill(m_phase_offset.begin(), m_phase_offset.end() - 1);
+        for(size_t r = 0; r < f; r++)
+            m_phase_taps[fill[(d * r) % s]++] = {r, (d * r) / s};
+        for(size_t i = 0; i < in; i++){
+            size_t phase = (i + p) % s;
+            size_t base = (i + p) / s;
+            size_t t = m_phase_offset[phase];
+            size_t t_end = m_phase_offset[phase + 1];
+            while(t < t_end && m_phase_taps[t].q <= base && base - m_phase_taps[t].q >= out)
+                t++;
+            m_bwd_begin[i] = t;
+            while(t < t_end && m_phase_taps[t].q <= base)
+                t++;
+            m_bwd_end[i] = t;
+            m_bwd_base[i] = base;
+        }
+    }
+
+    size_t in() const { return m_in; }
+    size_t out() const { return m_out; }
+    size_t f() const { return m_f; }
+
+    size_t tap_begin(size_t o) const { return m_tap_begin[o]; }
+    size_t tap_end(size_t o) const { return m_tap_end[o]; }
+    size_t in_first(size_t o) const { return o * m_s - m_p + m_d * m_tap_begin[o]; }   // only if the range is not empty
+
+    size_t out_begin(size_t r) const { return m_out_begin[r]; }
+    size_t out_end(size_t r) const { return m_out_end[r]; }
+    size_t in_of(size_t o, size_t r) const { return o * m_s - m_p + m_d * r; }
+
+    // taps [*begin, *end) reach input i, each from output *base - q, which is always in range
+    void bwd_taps(size_t i, const tap_t **begin, const tap_t **end, size_t *base) const
+    {
+        *begin = m_phase_taps.data() + m_bwd_begin[i];
+        *end = m_phase_taps.data() + m_bwd_end[i];
+        *base = m_bwd_base[i];
+    }
+
+private:
+    bool valid(size_t o, size_t r) const
+    {
+        return o * m_s + m_d * r >= m_p && o * m_s + m_d * r - m_p < m_in;
+    }
+
+    size_t m_in, m_out, m_f, m_p, m_s, m_d;
+    std::vector<size_t> m_tap_begin, m_tap_end;
+    std::vector<size_t> m_out_begin, m_out_end;
+    std::vector<size_t> m_phase_offset;
+    std::vector<tap_t> m_phase_taps;
+    std::vector<size_t> m_bwd_begin, m_bwd_end, m_bwd_base;
+};
+
+/*
+ * geometry of a grouped 2d or 3d convolution, with the argument order of naive_conv.h. a 2d conv has a trivial z
+ */
+class conv_geometry_cpu_t{
+public:
+    conv_geometry_cpu_t(size_t n_, size_t w, size_t h, size_t c_, size_t k_, size_t fx, size_t fy,
+                        size_t px, size_t py, size_t sx, size_t sy, size_t dx, size_t dy, size_t group_)
+        : n(n_), c(c_), k(k_), group(group_), c_per_group(c_ / group_), k_per_group(k_ / group_),
+          x(w, fx, px, sx, dx), y(h, fy, py, sy, dy), z() {}
+    conv_geometry_cpu_t(size_t n_, size_t w, size_t h, size_t d, size_t c_, size_t k_, size_t fx, size_t fy, size_t fz,
+                        size_t px, size_t py, size_t pz, size_t sx, size_t sy, size_t sz, size_t dx, size_t dy,
+                        size_t dz, size_t group_)
+        : n(n_), c(c_), k(k_), group(group_), c_per_group(c_ / group_), k_per_group(k_ / group_),
+          x(w, fx, px, sx, dx), y(h, fy, py, sy, dy), z(d, fz, pz, sz, dz) {}
+
+    size_t n, c, k, group, c_per_group, k_per_group;
+    conv_geometry_cpu_dim_t x, y, z;
+};
+
+#endif
@@ -0,0 +1,378 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _CONV_NATIVE_CPU_H
+#define _CONV_NATIVE_CPU_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include "conv_ref_cpu.h"
+#include "convert_cpu.h"
+#include "simd_cpu.h"
+#include "thread_pool_cpu.h"
+
+/*
+ * host reference convolution on tensors in their storage data type, src/filter/dst are typed by "dtype".
+ *
+ * fp16/bf16 : the filter is widened once, then the batch is walked in chunks, each chunk widened to fp32,
+ *             computed by conv_ref_cpu_* with the given algo, and the result rounded back to the storage type.
+ *             wrw accumulates the fp32 filter grad across chunks and rounds once at the end.
+ *             so the fp32 copy is bounded by CONV_NATIVE_CPU_CHUNK_FLOATS, not by the tensor size.
+ * int8/int4 : direct convolution on int16 widened, channels last copies with exact int32 accumulation,
+ *             the result keeps the low 8/4 bits, as the int8/int4 validation expects. fwd and bwd only,
+ *             there is no integer wrw. algo is ignored, integer results must be exact.
+ * fp32      : forwarded to conv_ref_cpu_*.
+ */
+#ifndef CONV_NATIVE_CPU_CHUNK_FLOATS
+#define CONV_NATIVE_CPU_CHUNK_FLOATS (1 << 24)
+#endif
+
+// images per chunk, at least 1
+static inline size_t conv_native_cpu_chunk(size_t n, size_t floats_per_image)
+{
+    size_t nb = CONV_NATIVE_CPU_CHUNK_FLOATS / (floats_per_image ? floats_per_image : 1);
+    if(nb < 1)
+        nb = 1;
+    return nb < n ? nb : n;
+}
+
+static inline int16_t conv_native_cpu_get_s16(convert_cpu_dtype_t dtype, const void *p, size_t i)
+{
+    return dtype == convert_cpu_int8 ? (int16_t)((const int8_t *)p)[i] : convert_cpu_s4_get((const uint8_t *)p, i);
+}
+
+/*
+ * widen images [i_n, i_n + cn) of an integer activation tensor to int16, [cn][h][w][c]
+ */
+static inline void conv_native_cpu_widen_act_s16(convert_cpu_dtype_t dtype, bool nhwc, int16_t *dst, const void *src,
+                                                 size_t i_n, size_t cn, size_t h, size_t w, size_t c)
+{
+    if(nhwc){
+        convert_cpu_widen_s16(dtype, dst, src, i_n * h * w * c, cn * h * w * c);
+        return;
+    }
+    thread_pool_cpu_parallel_for(cn * h, [&](size_t begin, size_t end){
+        for(size_t r = begin; r < end; r++){
+            size_t in = r / h;
+            size_t ih = r % h;
+            int16_t *d = dst + r * w * c;
+            size_t base = (i_n + in) * c * h * w + ih * w;
+            for(size_t iw = 0; iw < w; iw++)
+                for(size_t ic = 0; ic < c; ic++)
+                    d[iw * c + ic] = conv_native_cpu_get_s16(dtype, src, base + ic * h * w + iw);
+        }
+    });
+}
+
+/*
+ * widen an integer filter to int16, [k][fy][fx][c_per_group] when transpose is false,
+ * otherwise [group][c_per_group][fy][fx][k_per_group], the layout bwd reduces over
+ */
+static inline void conv_native_cpu_widen_filter_s16(convert_cpu_dtype_t dtype, bool nhwc, bool transpose, int16_t *dst,
+                                                    const void *filter, size_t k, size_t c_per_group, size_t fy, size_t fx,
+                                                    size_t group)
+{
+    size_t k_per_group = k / group;
+    thread_pool_cpu_parallel_for(k, [&](size_t begin, size_t end){
+        for(size_t ik = begin; ik < end; ik++){
+            size_t ig = ik / k_per_group;
+            size_t ikg = ik % k_per_group;
+            for(size_t ir = 0; ir < fy; ir++)
+                for(size_t is = 0; is < fx; is++)
+                    for(size_t ic = 0; ic < c_per_group; ic++){
+                        size_t s_idx = nhwc ? ((ik * fy + ir) * fx + is) * c_per_group + ic
+                                            : ((ik * c_per_group + ic) * fy + ir) * fx + is;
+                        size_t d_idx = transpose ? (((ig * c_per_group + ic) * fy + ir) * fx + is) * k_per_group + ikg
+                                                 : ((ik * fy + ir) * fx + is) * c_per_group + ic;
+                        dst[d_idx] = conv_native_cpu_get_s16(dtype, filter, s_idx);
+                    }
+        }
+    });
+}
+
+static inline void conv_native_cpu_fwd_int(convert_cpu_dtype_t dtype, bool nhwc, const void *src, const void *filter,
+                                           void *dst, size_t n, size_t w, size_t h, size_t c, size_t k, size_t fx,
+                                           size_t fy, size_t px, size_t py, size_t sx, size_t sy, size_t dx,
+                                           size_t dy, size_t group)
+{
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    size_t c_per_group = c / group;
+    size_t k_per_group = k / group;
+    std::unique_ptr<int16_t[]> filter16(new int16_t[k * fy * fx * c_per_group]);
+    conv_native_cpu_widen_filter_s16(dtype, nhwc, false, filter16.get(), filter, k, c_per_group, fy, fx, group);
+
+    size_t nb = conv_native_cpu_chunk(n, h * w * c + oh * ow * k);
+    std::unique_ptr<int16_t[]> src16(new int16_t[nb * h * w * c]);
+    std::unique_ptr<int32_t[]> dst32(new int32_t[nb * oh * ow * k]);
+    for(size_t i_n = 0; i_n < n; i_n += nb){
+        size_t cn = nb < n - i_n ? nb : n - i_n;
+        conv_native_cpu_widen_act_s16(dtype, nhwc, src16.get(), src, i_n, cn, h, w, c);
+        thread_pool_cpu_parallel_for(cn * oh, [&](size_t begin, size_t end){
+            for(size_t r = begin; r < end; r++){
+                size_t in = r / oh;
+                size_t ioh = r % oh;
+                const int16_t *src_n = src16.get() + in * h * w * c;
+                for(size_t iow = 0; iow < ow; iow++){
+                    for(size_t ik = 0; ik < k; ik++){
+                        const int16_t *src_g = src_n + (ik / k_per_group) * c_per_group;
+                        const int16_t *filter_k = filter16.get() + ik * fy * fx * c_per_group;
+                        int32_t acc = 0;
+                        for(size_t ir = 0; ir < fy; ir++){
+                            size_t cur_h = sy * ioh - py + dy * ir;
+                            if(cur_h >= h)      // also covers the wrapped negative
+                                continue;
+                            for(size_t is = 0; is < fx; is++){
+                                size_t cur_w = sx * iow - px + dx * is;
+                                if(cur_w >= w)
+                                    continue;
+                                acc += simd_cpu_dot_s16(src_g + (cur_h * w + cur_w) * c,
+                                                        filter_k + (ir * fx + is) * c_per_group, c_per_group);
+                            }
+                        }
+                        size_t o_idx = nhwc ? ((in * oh + ioh) * ow + iow) * k + ik
+                                            : ((in * k + ik) * oh + ioh) * ow + iow;
+                        dst32[o_idx] = acc;
+                    }
+                }
+            }
+        });
+        convert_cpu_narrow_s32(dtype, dst, i_n * oh * ow * k, dst32.get(), cn * oh * ow * k);
+    }
+}
+
+static inline void conv_native_cpu_bwd_int(convert_cpu_dtype_t dtype, bool nhwc, void *src_grad, const void *filter,
+                                           const void *dst_grad, size_t n, size_t w, size_t h, size_t c, size_t k,
+                                           size_t fx, size_t fy, size_t px, size_t py, size_t sx, size_t sy,
+                                           size_t dx, size_t dy, size_t group)
+{
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    size_t c_per_group = c / group;
+    size_t k_per_group = k / group;
+    std::unique_ptr<int16_t[]> filter16(new int16_t[k * fy * fx * c_per_group]);
+    conv_native_cpu_widen_filter_s16(dtype, nhwc, true, filter16.get(), filter, k, c_per_group, fy, fx, group);
+
+    size_t nb = conv_native_cpu_chunk(n, h * w * c + oh * ow * k);
+    std::unique_ptr<int16_t[]> dst16(new int16_t[nb * oh * ow * k]);
+    std::unique_ptr<int32_t[]> src32(new int32_t[nb * h * w * c]);
+    for(size_t i_n = 0; i_n < n; i_n += nb){
+        size_t cn = nb < n - i_n ? nb : n - i_n;
+        conv_native_cpu_widen_act_s16(dtype, nhwc, dst16.get(), dst_grad, i_n, cn, oh, ow, k);
+        thread_pool_cpu_parallel_for(cn * h, [&](size_t begin, size_t end){
+            for(size_t r = begin; r < end; r++){
+                size_t in = r / h;
+                size_t ih = r % h;
+                const int16_t *dst_n = dst16.get() + in * oh * ow * k;
+                for(size_t iw = 0; iw < w; iw++){
+                    for(size_t ic = 0; ic < c; ic++){
+                        size_t ig = ic / c_per_group;
+                        const int16_t *dst_g = dst_n + ig * k_per_group;
+                        const int16_t *filter_c = filter16.get() + ic * fy * fx * k_per_group;
+                        int32_t acc = 0;
+                        for(size_t ir = 0; ir < fy; ir++){
+                            if(ih + py < dy * ir)
+                                continue;
+                            size_t cur_oh = ih + py - dy * ir;   // ih = sy * ioh - py + dy * ir
+                            if(cur_oh % sy != 0 || cur_oh / sy >= oh)
+                                continue;
+                            for(size_t is = 0; is < fx; is++){
+                                if(iw + px < dx * is)
+                                    continue;
+                                size_t cur_ow = iw + px - dx * is;
+                                if(cur_ow % sx != 0 || cur_ow / sx >= ow)
+                                    continue;
+                                acc += simd_cpu_dot_s16(dst_g + (cur_oh / sy * ow + cur_ow / sx) * k,
+                                                        filter_c + (ir * fx + is) * k_per_group, k_per_group);
+                            }
+                        }
+                        size_t i_idx = nhwc ? ((in * h + ih) * w + iw) * c + ic
+                                            : ((in * c + ic) * h + ih) * w + iw;
+                        src32[i_idx] = acc;
+                    }
+                }
+            }
+        });
+        convert_cpu_narrow_s32(dtype, src_grad, i_n * h * w * c, src32.get(), cn * h * w * c);
+    }
+}
+
+static inline void conv_native_cpu_fwd(conv_ref_cpu_algo_t algo, convert_cpu_dtype_t dtype, bool nhwc, const void *src,
+                                       const void *filter, void *dst, size_t n, size_t w, size_t h, size_t c,
+                                       size_t k, size_t fx, size_t fy, size_t px, size_t py, size_t sx,
+                                       size_t sy, size_t dx, size_t dy, size_t group)
+{
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    if(convert_cpu_is_int(dtype)){
+        conv_native_cpu_fwd_int(dtype, nhwc, src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+        return;
+    }
+    auto conv = nhwc ? conv_ref_cpu_fwd_nhwc : conv_ref_cpu_fwd_nchw;
+    if(dtype == convert_cpu_fp32){
+        conv(algo, (const float *)src, (const float *)filter, (float *)dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+        return;
+    }
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    size_t src_image = c * h * w;
+    size_t dst_image = k * oh * ow;
+    size_t filter_size = k * (c / group) * fy * fx;
+    std::unique_ptr<float[]> filter32(new float[filter_size]);
+    convert_cpu_widen_f32(dtype, filter32.get(), filter, 0, filter_size);
+
+    size_t nb = conv_native_cpu_chunk(n, src_image + dst_image);
+    std::unique_ptr<float[]> src32(new float[nb * src_image]);
+    std::unique_ptr<float[]> dst32(new float[nb * dst_image]);
+    for(size_t i_n = 0; i_n < n; i_n += nb){
+        size_t cn = nb < n - i_n ? nb : n - i_n;
+        convert_cpu_widen_f32(dtype, src32.get(), src, i_n * src_image, cn * src_image);
+        conv(algo, src32.get(), filter32.get(), dst32.get(), cn, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+        convert_cpu_narrow_f32(dtype, dst, i_n * dst_image, dst32.get(), cn * dst_image);
+    }
+}
+
+static inline void conv_native_cpu_bwd(conv_ref_cpu_algo_t algo, convert_cpu_dtype_t dtype, bool nhwc, void *src_grad,
+                                       const void *filter, const void *dst_grad, size_t n, size_t w, size_t h,
+                                       size_t c, size_t k, size_t fx, size_t fy, size_t px, size_t py,
+                                       size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    if(convert_cpu_is_int(dtype)){
+        conv_native_cpu_bwd_int(dtype, nhwc, src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+        return;
+    }
+    auto conv = nhwc ? conv_ref_cpu_bwd_nhwc : conv_ref_cpu_bwd_nchw;
+    if(dtype == convert_cpu_fp32){
+        conv(algo, (float *)src_grad, (const float *)filter, (const float *)dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+        return;
+    }
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    size_t src_image = c * h * w;
+    size_t dst_image = k * oh * ow;
+    size_t filter_size = k * (c / group) * fy * fx;
+    std::unique_ptr<float[]> filter32(new float[filter_size]);
+    convert_cpu_widen_f32(dtype, filter32.get(), filter, 0, filter_size);
+
+    size_t nb = conv_native_cpu_chunk(n, src_image + dst_image);
+    std::unique_ptr<float[]> src32(new float[nb * src_image]);
+    std::unique_ptr<float[]> dst32(new float[nb * dst_image]);
+    for(size_t i_n = 0; i_n < n; i_n += nb){
+        size_t cn = nb < n - i_n ? nb : n - i_n;
+        convert_cpu_widen_f32(dtype, dst32.get(), dst_grad, i_n * dst_image, cn * dst_image);
+        conv(algo, src32.get(), filter32.get(), dst32.get(), cn, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+        convert_cpu_narrow_f32(dtype, src_grad, i_n * src_image, src32.get(), cn * src_image);
+    }
+}
+
+static inline void conv_native_cpu_wrw(conv_ref_cpu_algo_t algo, convert_cpu_dtype_t dtype, bool nhwc, const void *src,
+                                       void *filter_grad, const void *dst_grad, size_t n, size_t w, size_t h,
+                                       size_t c, size_t k, size_t fx, size_t fy, size_t px, size_t py,
+                                       size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    assert(!convert_cpu_is_int(dtype));
+    auto conv = nhwc ? conv_ref_cpu_wrw_nhwc : conv_ref_cpu_wrw_nchw;
+    if(dtype == convert_cpu_fp32){
+        conv(algo, (const float *)src, (float *)filter_grad, (const float *)dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+        return;
+    }
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    size_t src_image = c * h * w;
+    size_t dst_image = k * oh * ow;
+    size_t filter_size = k * (c / group) * fy * fx;
+    size_t nb = conv_native_cpu_chunk(n, src_image + dst_image);
+    std::unique_ptr<float[]> src32(new float[nb * src_image]);
+    std::unique_ptr<float[]> dst32(new float[nb * dst_image]);
+    std::unique_ptr<float[]> filter32(new float[filter_size]);
+    std::unique_ptr<float[]> filter32_chunk(nb < n ? new float[filter_size] : nullptr);
+    for(size_t i_n = 0; i_n < n; i_n += nb){
+        size_t cn = nb < n - i_n ? nb : n - i_n;
+        convert_cpu_widen_f32(dtype, src32.get(), src, i_n * src_image, cn * src_image);
+        convert_cpu_widen_f32(dtype, dst32.get(), dst_grad, i_n * dst_image, cn * dst_image);
+        if(i_n == 0)
+            conv(algo, src32.get(), filter32.get(), dst32.get(), cn, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+        else{
+            conv(algo, src32.get(), filter32_chunk.get(), dst32.get(), cn, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+            thread_pool_cpu_parallel_for(filter_size, [&](size_t begin, size_t end){
+                simd_cpu_axpy_f32(filter32.get() + begin, 1.0f, filter32_chunk.get() + begin, end - begin);
+            });
+        }
+    }
+    convert_cpu_narrow_f32(dtype, filter_grad, 0, filter32.get(), filter_size);
+}
+
+static inline void conv_native_cpu_fwd_nchw(conv_ref_cpu_algo_t algo, convert_cpu_dtype_t dtype, const void *src,
+                                            const void *filter, void *dst, size_t n, size_t w, size_t h, size_t c,
+                                            size_t k, size_t fx, size_t fy, size_t px, size_t py, size_t sx,
+                                            size_t sy, size_t dx, size_t dy, size_t group)
+{
+    conv_native_cpu_fwd(algo, dtype, false, src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+}
+
+static inline void conv_native_cpu_fwd_nhwc(conv_ref_cpu_algo_t algo, convert_cpu_dtype_t dtype, const void *src,
+                                            const void *filter, void *dst, size_t n, size_t w, size_t h, size_t c,
+                                            size_t k, size_t fx, size_t fy, size_t px, size_t py, size_t sx,
+                                            size_t sy, size_t dx, size_t dy, size_t group)
+{
+    conv_native_cpu_fwd(algo, dtype, true, src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+}
+
+static inline void conv_native_cpu_bwd_nchw(conv_ref_cpu_algo_t algo, convert_cpu_dtype_t dtype, void *src_grad,
+                                            const void *filter, const void *dst_grad, size_t n, size_t w, size_t h,
+                                            size_t c, size_t k, size_t fx, size_t fy, size_t px, size_t py,
+                                            size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    conv_native_cpu_bwd(algo, dtype, false, src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+}
+
+static inline void conv_native_cpu_bwd_nhwc(conv_ref_cpu_algo_t algo, convert_cpu_dtype_t dtype, void *src_grad,
+                                            const void *filter, const void *dst_grad, size_t n, size_t w, size_t h,
+                                            size_t c, size_t k, size_t fx, size_t fy, size_t px, size_t py,
+                                            size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    conv_native_cpu_bwd(algo, dtype, true, src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+}
+
+static inline void conv_native_cpu_wrw_nchw(conv_ref_cpu_algo_t algo, convert_cpu_dtype_t dtype, const void *src,
+                                            void *filter_grad, const void *dst_grad, size_t n, size_t w, size_t h,
+                                            size_t c, size_t k, size_t fx, size_t fy, size_t px, size_t py,
+                                            size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    conv_native_cpu_wrw(algo, dtype, false, src, filter_grad, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+}
+
+static inline void conv_native_cpu_wrw_nhwc(conv_ref_cpu_algo_t algo, convert_cpu_dtype_t dtype, const void *src,
+                                            void *filter_grad, const void *dst_grad, size_t n, size_t w, size_t h,
+                                            size_t c, size_t k, size_t fx, size_t fy, size_t px, size_t py,
+                                            size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    conv_native_cpu_wrw(algo, dtype, true, src, filter_grad, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+}
+
+#endif
@@ -0,0 +1,295 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _CONV_REF_CPU_H
+#define _CONV_REF_CPU_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "naive_conv.h"
+#include "spec_conv_cpu.h"
+#include "depthwise_conv_cpu.h"
+#include "gemm_conv_cpu.h"
+#include "winograd_conv_cpu.h"
+#include "fft_conv_cpu.h"
+#include "blocked_conv_3d_cpu.h"
+#include "naive_tiled_conv.h"
+
+/*
+ * host reference convolution. the algorithm is picked per problem by conv_ref_cpu_select(),
+ * from IGEMM_CPU_CONV_ALGO:
+ *   auto     : naive for depthwise, winograd for 3x3 stride 1 dilation 1 fwd/bwd, fft where fft_conv_cpu_preferred()
+ *              estimates it cheaper than a direct conv (large or dilated filters), gemm where gemm_conv_cpu_preferred()
+ *              finds the problem large enough, naive otherwise (default). an unknown value warns and runs auto
+ *   naive    : direct loop nest of naive_conv.h, or its bit identical filter/stride specialization in spec_conv_cpu.h,
+ *              or depthwise_conv_cpu.h when c == group
+ *   gemm     : im2col + packed sgemm of gemm_conv_cpu.h
+ *   winograd : winograd_conv_cpu.h where applicable, naive otherwise
+ *   fft      : fft_conv_cpu.h, for any shape
+ *   tiled    : naive_tiled_conv.h, the spatial tiles of the gpu, with l2 sized tiles run in parallel
+ * callers that compare bitwise (int8/int4) ask for an exact algorithm, which rules out winograd and fft.
+ * 3d problems (conv_ref_cpu_*_ncdhw/ndhwc) run blocked_conv_3d_cpu.h, or the naive loop nest for naive.
+ */
+typedef enum {
+    conv_ref_cpu_algo_naive     = 0,
+    conv_ref_cpu_algo_gemm      = 1,
+    conv_ref_cpu_algo_winograd  = 2,
+    conv_ref_cpu_algo_fft       = 3,
+    conv_ref_cpu_algo_tiled     = 4,
+} conv_ref_cpu_algo_t;
+
+static inline conv_ref_cpu_algo_t conv_ref_cpu_select(std::string direction, size_t n, size_t w, size_t h,
+                                                      size_t c, size_t k, size_t fx, size_t fy, size_t px, size_t py,
+                                                      size_t sx, size_t sy, size_t dx, size_t dy, size_t group,
+                                                      bool need_exact)
+{
+    char *v = getenv("IGEMM_CPU_CONV_ALGO");
+    std::string algo = v ? v : "auto";
+    if(algo != "auto" && algo != "naive" && algo != "gemm" && algo != "winograd" && algo != "fft" && algo != "tiled"){
+        static bool warned = false;
+        if(!warned)
+            fprintf(stderr, "unknown IGEMM_CPU_CONV_ALGO=%s, auto is used\n", algo.c_str());
+        warned = true;
+        algo = "auto";
+    }
+    if(algo == "naive")
+        return conv_ref_cpu_algo_naive;
+    if(algo == "gemm")
+        return conv_ref_cpu_algo_gemm;
+    if(algo == "tiled")
+        return conv_ref_cpu_algo_tiled;
+    if(need_exact)
+        return conv_ref_cpu_algo_naive;
+    if(algo == "fft")
+        return conv_ref_cpu_algo_fft;
+    if(algo == "auto" && depthwise_conv_cpu_applicable(c, k, group))
+        return conv_ref_cpu_algo_naive;     // a per group gemm of one channel leaves winograd/fft nothing to win
+    if(direction != "wrw" && winograd_conv_cpu_applicable(fx, fy, px, py, sx, sy, dx, dy))
+        return conv_ref_cpu_algo_winograd;
+    if(algo != "winograd" && fft_conv_cpu_preferred(n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group))
+        return conv_ref_cpu_algo_fft;
+    if(algo == "auto" && gemm_conv_cpu_preferred(n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group))
+        return conv_ref_cpu_algo_gemm;
+    return conv_ref_cpu_algo_naive;
+}
+
+static inline const char * conv_ref_cpu_algo_name(conv_ref_cpu_algo_t algo)
+{
+    switch(algo){
+        case conv_ref_cpu_algo_gemm: return "gemm";
+        case conv_ref_cpu_algo_winograd: return "winograd";
+        case conv_ref_cpu_algo_fft: return "fft";
+        case conv_ref_cpu_algo_tiled: return "tiled";
+        default: return "naive";
+    }
+}
+
+// factor to apply on the validation nrms, for algorithms less accurate than direct conv. only fp32 needs it,
+// fp16/bf16 have a tolerance ~5000x larger and their reference is rounded to the data type anyway
+static inline double conv_ref_cpu_nrms_scale(conv_ref_cpu_algo_t algo, bool is_fp32)
+{
+    if(!is_fp32)
+        return 1.0;
+    if(algo == conv_ref_cpu_algo_winograd)
+        return winograd_conv_cpu_nrms_scale();
+    if(algo == conv_ref_cpu_algo_fft)
+        return fft_conv_cpu_nrms_scale();
+    return 1.0;
+}
+
+static inline void conv_ref_cpu_fwd_nchw(conv_ref_cpu_algo_t algo, const float *src, const float *filter,
+                                         float *dst, size_t n, size_t w, size_t h,
+                                         size_t c, size_t k, size_t fx, size_t fy,
+                                         size_t px, size_t py, size_t sx,
+                                         size_t sy, size_t dx, size_t dy, size_t group) {
+    if(algo == conv_ref_cpu_algo_gemm)
+        gemm_conv_fwd_nchw(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_winograd)
+        winograd_conv_fwd_nchw(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_fft)
+        fft_conv_fwd_nchw(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_tiled)
+        naive_tiled_conv_fwd_nchw(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group, 0, 0);
+    else if(!depthwise_conv_fwd_nchw(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group) &&
+            !spec_conv_fwd_nchw(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group))
+        naive_conv_fwd_nchw(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+}
+
+static inline void conv_ref_cpu_fwd_nhwc(conv_ref_cpu_algo_t algo, const float *src, const float *filter,
+                                         float *dst, size_t n, size_t w, size_t h,
+                                         size_t c, size_t k, size_t fx, size_t fy,
+                                         size_t px, size_t py, size_t sx,
+                                         size_t sy, size_t dx, size_t dy, size_t group) {
+    if(algo == conv_ref_cpu_algo_gemm)
+        gemm_conv_fwd_nhwc(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_winograd)
+        winograd_conv_fwd_nhwc(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_fft)
+        fft_conv_fwd_nhwc(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_tiled)
+        naive_tiled_conv_fwd_nhwc(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group, 0, 0);
+    else if(!depthwise_conv_fwd_nhwc(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group) &&
+            !spec_conv_fwd_nhwc(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group))
+        naive_conv_fwd_nhwc(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+}
+
+static inline void conv_ref_cpu_bwd_nchw(conv_ref_cpu_algo_t algo, float *src_grad, const float *filter,
+                                         const float *dst_grad, size_t n,
+                                         size_t w, size_t h, size_t c, size_t k,
+                                         size_t fx, size_t fy, size_t px,
+                                         size_t py, size_t sx, size_t sy,
+                                         size_t dx, size_t dy, size_t group) {
+    if(algo == conv_ref_cpu_algo_gemm)
+        gemm_conv_bwd_nchw(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_winograd)
+        winograd_conv_bwd_nchw(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_fft)
+        fft_conv_bwd_nchw(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_tiled)
+        naive_tiled_conv_bwd_nchw(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group, 0, 0);
+    else if(!depthwise_conv_bwd_nchw(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group) &&
+            !spec_conv_bwd_nchw(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group))
+        naive_conv_bwd_nchw(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+}
+
+static inline void conv_ref_cpu_bwd_nhwc(conv_ref_cpu_algo_t algo, float *src_grad, const float *filter,
+                                         const float *dst_grad, size_t n,
+                                         size_t w, size_t h, size_t c, size_t k,
+                                         size_t fx, size_t fy, size_t px,
+                                         size_t py, size_t sx, size_t sy,
+                                         size_t dx, size_t dy, size_t group) {
+    if(algo == conv_ref_cpu_algo_gemm)
+        gemm_conv_bwd_nhwc(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_winograd)
+        winograd_conv_bwd_nhwc(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_fft)
+        fft_conv_bwd_nhwc(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_tiled)
+        naive_tiled_conv_bwd_nhwc(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group, 0, 0);
+    else if(!depthwise_conv_bwd_nhwc(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group))
+        naive_conv_bwd_nhwc(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+}
+
+static inline void conv_ref_cpu_wrw_nchw(conv_ref_cpu_algo_t algo, const float *src, float *filter_grad,
+                                         const float *dst_grad, size_t n,
+                                         size_t w, size_t h, size_t c, size_t k,
+                                         size_t fx, size_t fy, size_t px,
+                                         size_t py, size_t sx, size_t sy,
+                                         size_t dx, size_t dy, size_t group) {
+    if(algo == conv_ref_cpu_algo_gemm)
+        gemm_conv_wrw_nchw(src, filter_grad, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_fft)
+        fft_conv_wrw_nchw(src, filter_grad, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_tiled)
+        naive_tiled_conv_wrw_nchw(src, filter_grad, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group, 0, 0);
+    else if(!depthwise_conv_wrw_nchw(src, filter_grad, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group))
+        naive_conv_wrw_nchw(src, filter_grad, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+}
+
+static inline void conv_ref_cpu_wrw_nhwc(conv_ref_cpu_algo_t algo, const float *src, float *filter_grad,
+                                         const float *dst_grad, size_t n,
+                                         size_t w, size_t h, size_t c, size_t k,
+                                         size_t fx, size_t fy, size_t px,
+                                         size_t py, size_t sx, size_t sy,
+                                         size_t dx, size_t dy, size_t group) {
+    if(algo == conv_ref_cpu_algo_gemm)
+        gemm_conv_wrw_nhwc(src, filter_grad, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_fft)
+        fft_conv_wrw_nhwc(src, filter_grad, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    else if(algo == conv_ref_cpu_algo_tiled)
+        naive_tiled_conv_wrw_nhwc(src, filter_grad, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group, 0, 0);
+    else if(!depthwise_conv_wrw_nhwc(src, filter_grad, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group))
+        naive_conv_wrw_nhwc(src, filter_grad, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+}
+
+static inline bool conv_ref_cpu_3d_naive()
+{
+    char *v = getenv("IGEMM_CPU_CONV_ALGO");
+    return v && std::string(v) == "naive";
+}
+
+static inline void conv_ref_cpu_fwd_ncdhw(const float *src, const float *filter, float *dst,
+                                          size_t n, size_t w, size_t h, size_t d, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t fz, size_t px, size_t py, size_t pz,
+                                          size_t sx, size_t sy, size_t sz, size_t dx, size_t dy, size_t dz, size_t group) {
+    if(conv_ref_cpu_3d_naive())
+        naive_conv_fwd_ncdhw(src, filter, dst, n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+    else
+        blocked_conv_fwd_ncdhw(src, filter, dst, n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+}
+
+static inline void conv_ref_cpu_bwd_ncdhw(float *src_grad, const float *filter, const float *dst_grad,
+                                          size_t n, size_t w, size_t h, size_t d, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t fz, size_t px, size_t py, size_t pz,
+                                          size_t sx, size_t sy, size_t sz, size_t dx, size_t dy, size_t dz, size_t group) {
+    if(conv_ref_cpu_3d_naive())
+        naive_conv_bwd_ncdhw(src_grad, filter, dst_grad, n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+    else
+        blocked_conv_bwd_ncdhw(src_grad, filter, dst_grad, n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+}
+
+static inline void conv_ref_cpu_wrw_ncdhw(const float *src, float *filter_grad, const float *dst_grad,
+                                          size_t n, size_t w, size_t h, size_t d, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t fz, size_t px, size_t py, size_t pz,
+                                          size_t sx, size_t sy, size_t sz, size_t dx, size_t dy, size_t dz, size_t group) {
+    if(conv_ref_cpu_3d_naive())
+        naive_conv_wrw_ncdhw(src, filter_grad, dst_grad, n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+    else
+        blocked_conv_wrw_ncdhw(src, filter_grad, dst_grad, n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+}
+
+static inline void conv_ref_cpu_fwd_ndhwc(const float *src, const float *filter, float *dst,
+                                          size_t n, size_t w, size_t h, size_t d, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t fz, size_t px, size_t py, size_t pz,
+                                          size_t sx, size_t sy, size_t sz, size_t dx, size_t dy, size_t dz, size_t group) {
+    if(conv_ref_cpu_3d_naive())
+        naive_conv_fwd_ndhwc(src, filter, dst, n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+    else
+        blocked_conv_fwd_ndhwc(src, filter, dst, n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+}
+
+static inline void conv_ref_cpu_bwd_ndhwc(float *src_grad, const float *filter, const float *dst_grad,
+                                          size_t n, size_t w, size_t h, size_t d, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t fz, size_t px, size_t py, size_t pz,
+                                          size_t sx, size_t sy, size_t sz, size_t dx, size_t dy, size_t dz, size_t group) {
+    if(conv_ref_cpu_3d_naive())
+        naive_conv_bwd_ndhwc(src_grad, filter, dst_grad, n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+    else
+        blocked_conv_bwd_ndhwc(src_grad, filter, dst_grad, n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+}
+
+static inline void conv_ref_cpu_wrw_ndhwc(const float *src, float *filter_grad, const float *dst_grad,
+                                          size_t n, size_t w, size_t h, size_t d, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t fz, size_t px, size_t py, size_t pz,
+                                          size_t sx, size_t sy, size_t sz, size_t dx, size_t dy, size_t dz, size_t group) {
+    if(conv_ref_cpu_3d_naive())
+        naive_conv_wrw_ndhwc(src, filter_grad, dst_grad, n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+    else
+        blocked_conv_wrw_ndhwc(src, filter_grad, dst_grad, n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+}
+
+#endif
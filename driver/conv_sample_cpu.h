@@ -0,0 +1,323 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _CONV_SAMPLE_CPU_H
+#define _CONV_SAMPLE_CPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+#include <math.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "thread_pool_cpu.h"
+#include "simd_cpu.h"
+#include "conv_geometry_cpu.h"
+
+/*
+ * sampled host reference. only a stratified random sample of the checked tensor (fwd output, bwd input grad, wrw
+ * filter grad) is computed, element by element with the per pixel loops of the threaded naive_conv.h, and compared
+ * against the same elements of the device result by valid_vector_sampled().
+ *
+ * the checked tensor is seen as [outer][ch][a][b], fwd/bwd: n, k or c, h, w. wrw: k, c_per_group, fy, fx.
+ * it is cut into strata, and every stratum is sampled:
+ *   every block of CONV_SAMPLE_CPU_K_BLOCK output channels (k for fwd and wrw, c for bwd)
+ *   x low border, interior, high border along h, and along w. the border is where the filter window reaches into
+ *     the padding (fwd), where some taps fall off the output (bwd), or the first/last filter tap (wrw),
+ *     so the corners are strata of their own.
+ * a stratum of size S gets rate * S samples, at least CONV_SAMPLE_CPU_MIN_SAMPLES, or all of it when smaller.
+ * samples are drawn with replacement from a seeded std::mt19937_64, then sorted and deduplicated.
+ *
+ * false negatives: a bug that breaks one whole k block, border, or corner is always sampled. a bug that breaks a
+ * fraction f of the elements of a stratum at random is missed with probability (1 - f)^(rate * S), e.g. below 5e-5
+ * for 1 element in 1000 of a 1M element stratum at rate 0.01, and a single wrong element is missed with probability
+ * about 1 - rate. a sampled wrong element still has to move the nrms of the sample over the tolerance, or fail
+ * PER_PIXEL_CHECK, as in the full validation.
+ *
+ * cost: fwd/bwd samples cost c_per_group * fy * fx (k_per_group * fy * fx) each, wrw samples n * ho * wo each.
+ * fp32 accumulation in the order of the naive loops, so integer data is exact while the sums stay below 2^24.
+ */
+#ifndef CONV_SAMPLE_CPU_K_BLOCK
+#define CONV_SAMPLE_CPU_K_BLOCK 16
+#endif
+#ifndef CONV_SAMPLE_CPU_MIN_SAMPLES
+#define CONV_SAMPLE_CPU_MIN_SAMPLES 4
+#endif
+#define CONV_SAMPLE_CPU_WRW_CHUNK 64
+
+
+// extent of one spatial dim, and the width of its low and high border
+struct conv_sample_cpu_dim_t{
+    size_t size, lo, hi;
+};
+
+// fwd output positions, whose taps do not all read inside the input
+static inline conv_sample_cpu_dim_t conv_sample_cpu_fwd_dim(const conv_geometry_cpu_dim_t & geo)
+{
+    auto full = [&](size_t o){ return geo.tap_begin(o) == 0 && geo.tap_end(o) == geo.f(); };
+    size_t lo = 0, hi = 0;
+    while(lo < geo.out() && !full(lo))
+        lo++;
+    while(lo + hi < geo.out() && !full(geo.out() - 1 - hi))
+        hi++;
+    return {geo.out(), lo, hi};
+}
+
+// bwd input positions, that some tap of their stride phase maps out of the output
+static inline conv_sample_cpu_dim_t conv_sample_cpu_bwd_dim(size_t in, size_t out, size_t f, size_t p, size_t s, size_t d)
+{
+    // i is inside when i + p - d * (f - 1) >= 0 and (i + p) / s < out
+    size_t lo = d * (f - 1) > p ? d * (f - 1) - p : 0;
+    lo = lo < in ? lo : in;
+    size_t hi_begin = (out - 1) * s + 1 > p ? (out - 1) * s + 1 - p : 0;
+    hi_begin = hi_begin < lo ? lo : (hi_begin < in ? hi_begin : in);
+    return {in, lo, in - hi_begin};
+}
+
+// wrw filter taps, the first and the last are the ones that meet the padding
+static inline conv_sample_cpu_dim_t conv_sample_cpu_wrw_dim(size_t f)
+{
+    return {f, f > 1 ? (size_t)1 : (size_t)0, f > 2 ? (size_t)1 : (size_t)0};
+}
+
+static inline void conv_sample_cpu_region(const conv_sample_cpu_dim_t & dim, int region, size_t *begin, size_t *end)
+{
+    *begin = region == 0 ? 0 : (region == 1 ? dim.lo : dim.size - dim.hi);
+    *end = region == 0 ? dim.lo : (region == 1 ? dim.size - dim.hi : dim.size);
+}
+
+/*
+ * sorted linear indices of the sample of a [outer][ch][a][b] tensor, [outer][a][b][ch] when ch_last.
+ * outer and ch are cut in blocks of outer_block and ch_block, each block a stratum of its own.
+ */
+static inline std::vector<size_t> conv_sample_cpu_pick(bool ch_last, size_t outer, size_t outer_block, size_t ch,
+                                                       size_t ch_block, const conv_sample_cpu_dim_t & a,
+                                                       const conv_sample_cpu_dim_t & b, double rate, uint64_t seed)
+{
+    std::vector<size_t> index;
+    std::mt19937_64 rng(seed);
+    auto linear = [&](size_t io, size_t ic, size_t ia, size_t ib){
+        return ch_last ? ((io * a.size + ia) * b.size + ib) * ch + ic : ((io * ch + ic) * a.size + ia) * b.size + ib;
+    };
+    for(size_t o0 = 0; o0 < outer; o0 += outer_block){
+        size_t no = outer - o0 < outer_block ? outer - o0 : outer_block;
+        for(size_t c0 = 0; c0 < ch; c0 += ch_block){
+            size_t nc = ch - c0 < ch_block ? ch - c0 : ch_block;
+            for(int ra = 0; ra < 3; ra++){
+                size_t a0, a1;
+                conv_sample_cpu_region(a, ra, &a0, &a1);
+                for(int rb = 0; rb < 3; rb++){
+                    size_t b0, b1;
+                    conv_sample_cpu_region(b, rb, &b0, &b1);
+                    size_t na = a1 - a0, nb = b1 - b0;
+                    size_t stratum = no * nc * na * nb;
+                    if(stratum == 0)
+                        continue;
+                    size_t samples = (size_t)ceil(rate * stratum);
+                    samples = samples < CONV_SAMPLE_CPU_MIN_SAMPLES ? CONV_SAMPLE_CPU_MIN_SAMPLES : samples;
+                    if(samples >= stratum){
+                        for(size_t i = 0; i < stratum; i++)
+                            index.push_back(linear(o0 + i / (nc * na * nb), c0 + i / (na * nb) % nc,
+                                                   a0 + i / nb % na, b0 + i % nb));
+                        continue;
+                    }
+                    for(size_t i = 0; i < samples; i++)
+                        index.push_back(linear(o0 + rng() % no, c0 + rng() % nc, a0 + rng() % na, b0 + rng() % nb));
+                }
+            }
+        }
+    }
+    std::sort(index.begin(), index.end());
+    index.erase(std::unique(index.begin(), index.end()), index.end());
+    return index;
+}
+
+// dst[i] = point_func(index[i]), in parallel
+template<typename point_func_t>
+static inline void conv_sample_cpu_compute(const std::vector<size_t> & index, std::vector<float> *dst,
+                                           const point_func_t & point_func)
+{
+    dst->resize(index.size());
+    float *d = dst->data();
+    thread_pool_cpu_parallel_for(index.size(), [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++)
+            d[i] = point_func(index[i]);
+    });
+}
+
+/*
+ * sample of the fwd output dst, picked by (rate, seed). index gets the linear index of each sample in dst, value its
+ * reference value
+ */
+static inline void conv_sample_cpu_fwd(bool nhwc, const float *src, const float *filter, std::vector<size_t> *index,
+                                       std::vector<float> *value, size_t n, size_t w, size_t h, size_t c, size_t k,
+                                       size_t fx, size_t fy, size_t px, size_t py, size_t sx, size_t sy, size_t dx,
+                                       size_t dy, size_t group, double rate, uint64_t seed)
+{
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    conv_geometry_cpu_t geo(n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    size_t oh = geo.y.out(), ow = geo.x.out();
+    size_t k_per_group = geo.k_per_group, c_per_group = geo.c_per_group;
+    *index = conv_sample_cpu_pick(nhwc, n, n, k, CONV_SAMPLE_CPU_K_BLOCK, conv_sample_cpu_fwd_dim(geo.y),
+                                  conv_sample_cpu_fwd_dim(geo.x), rate, seed);
+    conv_sample_cpu_compute(*index, value, [&](size_t o_idx){
+        size_t in, ik, ioh, iow, ic, ir, is;
+        if(nhwc){
+            ik = o_idx % k; iow = o_idx / k % ow; ioh = o_idx / k / ow % oh; in = o_idx / k / ow / oh;
+        }else{
+            iow = o_idx % ow; ioh = o_idx / ow % oh; ik = o_idx / ow / oh % k; in = o_idx / ow / oh / k;
+        }
+        size_t ig = ik / k_per_group;
+        size_t ir_begin = geo.y.tap_begin(ioh), nr = geo.y.tap_end(ioh) - ir_begin;
+        size_t is_begin = geo.x.tap_begin(iow), ns = geo.x.tap_end(iow) - is_begin;
+        float v = .0f;
+        if(nr == 0 || ns == 0)
+            return v;
+        if(nhwc){
+            const float *src_p = src + in * h * w * c + ig * c_per_group + (geo.y.in_first(ioh) * w + geo.x.in_first(iow)) * c;
+            const float *filter_p = filter + ik * fy * fx * c_per_group + (ir_begin * fx + is_begin) * c_per_group;
+            for(ir = 0; ir < nr; ir++)
+                for(is = 0; is < ns; is++)
+                    v += simd_cpu_dot_f32(src_p + (ir * dy * w + is * dx) * c, filter_p + (ir * fx + is) * c_per_group, c_per_group);
+        }else{
+            const float *src_p = src + in * c * h * w + ig * c_per_group * h * w + geo.y.in_first(ioh) * w + geo.x.in_first(iow);
+            const float *filter_p = filter + ik * c_per_group * fy * fx + ir_begin * fx + is_begin;
+            for(ic = 0; ic < c_per_group; ic++){
+                for(ir = 0; ir < nr; ir++)
+                    for(is = 0; is < ns; is++)
+                        v += src_p[ir * dy * w + is * dx] * filter_p[ir * fx + is];
+                src_p += h * w;
+                filter_p += fy * fx;
+            }
+        }
+        return v;
+    });
+}
+
+// sample of the bwd input grad src_grad
+static inline void conv_sample_cpu_bwd(bool nhwc, const float *filter, const float *dst_grad, std::vector<size_t> *index,
+                                       std::vector<float> *value, size_t n, size_t w, size_t h, size_t c, size_t k,
+                                       size_t fx, size_t fy, size_t px, size_t py, size_t sx, size_t sy, size_t dx,
+                                       size_t dy, size_t group, double rate, uint64_t seed)
+{
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    conv_geometry_cpu_t geo(n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    size_t oh = geo.y.out(), ow = geo.x.out();
+    size_t k_per_group = geo.k_per_group, c_per_group = geo.c_per_group;
+    *index = conv_sample_cpu_pick(nhwc, n, n, c, CONV_SAMPLE_CPU_K_BLOCK,
+                                  conv_sample_cpu_bwd_dim(h, oh, fy, py, sy, dy),
+                                  conv_sample_cpu_bwd_dim(w, ow, fx, px, sx, dx), rate, seed);
+    conv_sample_cpu_compute(*index, value, [&](size_t i_idx){
+        size_t in, icc, ih, iw, ik;
+        if(nhwc){
+            icc = i_idx % c; iw = i_idx / c % w; ih = i_idx / c / w % h; in = i_idx / c / w / h;
+        }else{
+            iw = i_idx % w; ih = i_idx / w % h; icc = i_idx / w / h % c; in = i_idx / w / h / c;
+        }
+        size_t ig = icc / c_per_group, ic = icc % c_per_group;
+        const conv_geometry_cpu_dim_t::tap_t *ty, *ty_begin, *ty_end, *tx, *tx_begin, *tx_end;
+        size_t base_h, base_w;
+        geo.y.bwd_taps(ih, &ty_begin, &ty_end, &base_h);
+        geo.x.bwd_taps(iw, &tx_begin, &tx_end, &base_w);
+        float v = .0f;
+        for(ik = 0; ik < k_per_group; ik++){
+            size_t kk = ig * k_per_group + ik;
+            for(ty = ty_begin; ty < ty_end; ty++){
+                size_t cur_oh = base_h - ty->q;
+                for(tx = tx_begin; tx < tx_end; tx++){
+                    size_t cur_ow = base_w - tx->q;
+                    if(nhwc)
+                        v += dst_grad[((in * oh + cur_oh) * ow + cur_ow) * k + kk] *
+                             filter[((kk * fy + ty->r) * fx + tx->r) * c_per_group + ic];
+                    else
+                        v += dst_grad[((in * k + kk) * oh + cur_oh) * ow + cur_ow] *
+                             filter[((kk * c_per_group + ic) * fy + ty->r) * fx + tx->r];
+                }
+            }
+        }
+        return v;
+    });
+}
+
+// sample of the wrw filter grad
+static inline void conv_sample_cpu_wrw(bool nhwc, const float *src, const float *dst_grad, std::vector<size_t> *index,
+                                       std::vector<float> *value, size_t n, size_t w, size_t h, size_t c, size_t k,
+                                       size_t fx, size_t fy, size_t px, size_t py, size_t sx, size_t sy, size_t dx,
+                                       size_t dy, size_t group, double rate, uint64_t seed)
+{
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    conv_geometry_cpu_t geo(n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    size_t oh = geo.y.out(), ow = geo.x.out();
+    size_t k_per_group = geo.k_per_group, c_per_group = geo.c_per_group;
+    *index = conv_sample_cpu_pick(nhwc, k, CONV_SAMPLE_CPU_K_BLOCK, c_per_group, c_per_group,
+                                  conv_sample_cpu_wrw_dim(fy), conv_sample_cpu_wrw_dim(fx), rate, seed);
+    // each sample reads the whole batch. a chunk of samples walks it together, row by row, so the rows stay in cache
+    struct tap_t{
+        size_t ic, ir, is, ik, ig;
+    };
+    value->assign(index->size(), .0f);
+    thread_pool_cpu_parallel_for(index->size(), [&](size_t begin, size_t end){
+        for(size_t s0 = begin; s0 < end; s0 += CONV_SAMPLE_CPU_WRW_CHUNK){
+            size_t s1 = end - s0 < CONV_SAMPLE_CPU_WRW_CHUNK ? end : s0 + CONV_SAMPLE_CPU_WRW_CHUNK;
+            tap_t tap[CONV_SAMPLE_CPU_WRW_CHUNK];
+            for(size_t i = s0; i < s1; i++){
+                size_t f_idx = (*index)[i];
+                tap_t & t = tap[i - s0];
+                if(nhwc){
+                    t.ic = f_idx % c_per_group; t.is = f_idx / c_per_group % fx; t.ir = f_idx / c_per_group / fx % fy;
+                    t.ik = f_idx / c_per_group / fx / fy;
+                }else{
+                    t.is = f_idx % fx; t.ir = f_idx / fx % fy; t.ic = f_idx / fx / fy % c_per_group; t.ik = f_idx / fx / fy / c_per_group;
+                }
+                t.ig = t.ik / k_per_group;
+            }
+            for(size_t in = 0; in < n; in++){
+                for(size_t ioh = 0; ioh < oh; ioh++){
+                    for(size_t i = s0; i < s1; i++){
+                        const tap_t & t = tap[i - s0];
+                        if(ioh < geo.y.out_begin(t.ir) || ioh >= geo.y.out_end(t.ir))
+                            continue;
+                        size_t ih = geo.y.in_of(ioh, t.ir);
+                        size_t ow_begin = geo.x.out_begin(t.is), ow_end = geo.x.out_end(t.is);
+                        float v = (*value)[i];
+                        for(size_t iow = ow_begin; iow < ow_end; iow++){
+                            size_t iw = geo.x.in_of(iow, t.is);
+                            if(nhwc)
+                                v += src[((in * h + ih) * w + iw) * c + t.ig * c_per_group + t.ic] *
+                                     dst_grad[((in * oh + ioh) * ow + iow) * k + t.ik];
+                            else
+                                v += src[((in * c + t.ig * c_per_group + t.ic) * h + ih) * w + iw] *
+                                     dst_grad[((in * k + t.ik) * oh + ioh) * ow + iow];
+                        }
+                        (*value)[i] = v;
+                    }
+                }
+            }
+        }
+    });
+}
+
+#endif
@@ -0,0 +1,514 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _CONVERT_CPU_H
+#define _CONVERT_CPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "thread_pool_cpu.h"
+#include "simd_cpu.h"
+
+/*
+ * element conversion between fp32/int32 and the storage formats of host tensors.
+ * fp16 is ieee half, bf16 the upper 16 bits of fp32 (round to nearest even, nan preserved, as the bfloat16
+ * class of common.h), int8 is stored as is, int4 packs element 2i in the low and 2i+1 in the high nibble,
+ * as the lo/hi fields of int4x2_t. narrowing of integers keeps the low bits, which is what the
+ * int8/int4 validation compares against.
+ * the bulk routines take an element offset "begin" into the native tensor, so int4 can start from any element.
+ */
+typedef enum {
+    convert_cpu_fp32    = 0,
+    convert_cpu_fp16    = 1,
+    convert_cpu_bf16    = 2,
+    convert_cpu_int8    = 3,
+    convert_cpu_int4    = 4,
+} convert_cpu_dtype_t;
+
+static inline bool convert_cpu_is_int(convert_cpu_dtype_t dtype)
+{
+    return dtype == convert_cpu_int8 || dtype == convert_cpu_int4;
+}
+
+// bytes taken by cnt native elements, int4 rounded up to a whole byte
+static inline size_t convert_cpu_bytes(convert_cpu_dtype_t dtype, size_t cnt)
+{
+    return dtype == convert_cpu_int4 ? (cnt + 1) / 2 : cnt * (dtype == convert_cpu_fp32 ? 4 : (dtype == convert_cpu_int8 ? 1 : 2));
+}
+
+static inline float convert_cpu_f16_to_f32_scalar(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t bits;
+    if(exp == 0){
+        if(mant == 0)
+            bits = sign;
+        else{
+            // subnormal, normalize
+            exp = 113;
+            while(!(mant & 0x400)){
+                mant <<= 1;
+                exp--;
+            }
+            bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+        }
+    }else if(exp == 31)
+        bits = sign | 0x7f800000 | (mant << 13) | (mant ? 0x400000 : 0);    // nan is made quiet, as f16c does
+    else
+        bits = sign | ((exp + 112) << 23) | (mant << 13);
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+static inline uint16_t convert_cpu_f32_to_f16_scalar(float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t absx = bits & 0x7fffffff;
+    if(absx > 0x7f800000)                   // nan, quiet with the upper payload bits, as f16c does
+        return (uint16_t)(sign | 0x7e00 | ((absx >> 13) & 0x3ff));
+    if(absx >= 0x477ff000)                  // rounds to inf
+        return (uint16_t)(sign | 0x7c00);
+    if(absx < 0x38800000){                  // below 2^-14, subnormal result
+        if(absx <= 0x33000000)
+            return (uint16_t)sign;
+        uint32_t m = (absx & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - (absx >> 23);
+        uint32_t r = m >> shift;
+        uint32_t rem = m & ((1u << shift) - 1);
+        uint32_t half = 1u << (shift - 1);
+        if(rem > half || (rem == half && (r & 1)))
+            r++;
+        return (uint16_t)(sign | r);
+    }
+    uint32_t r = (absx >> 13) - (112 << 10);
+    uint32_t rem = absx & 0x1fff;
+    if(rem > 0x1000 || (rem == 0x1000 && (r & 1)))
+        r++;
+    return (uint16_t)(sign | r);
+}
+
+static inline float convert_cpu_bf16_to_f32_scalar(uint16_t h)
+{
+    uint32_t bits = (uint32_t)h << 16;
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+static inline uint16_t convert_cpu_f32_to_bf16_scalar(float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    if((~bits & 0x7f800000) == 0){          // inf or nan
+        if((bits & 0xffff) != 0)
+            bits |= 0x10000;                // keep a signaling nan a nan
+    }else
+        bits += 0x7fff + ((bits >> 16) & 1);
+    return (uint16_t)(bits >> 16);
+}
+
+static inline int16_t convert_cpu_s4_get(const uint8_t *src, size_t i)
+{
+    int8_t b = (int8_t)src[i / 2];
+    return (i & 1) ? (int16_t)(b >> 4) : (int16_t)((int8_t)(b << 4) >> 4);
+}
+
+static inline void convert_cpu_s4_set(uint8_t *dst, size_t i, int32_t v)
+{
+    uint8_t nib = (uint8_t)(v & 0xf);
+    if(i & 1)
+        dst[i / 2] = (uint8_t)((dst[i / 2] & 0x0f) | (nib << 4));
+    else
+        dst[i / 2] = (uint8_t)((dst[i / 2] & 0xf0) | nib);
+}
+
+#if SIMD_CPU_X86
+__attribute__((target("avx2,fma,f16c")))
+static inline size_t convert_cpu_f16_to_f32_avx2(float *dst, const uint16_t *src, size_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + i))));
+    return i;
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static inline size_t convert_cpu_f32_to_f16_avx2(uint16_t *dst, const float *src, size_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+        _mm_storeu_si128((__m128i *)(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    return i;
+}
+
+__attribute__((target("avx2,fma")))
+static inline size_t convert_cpu_bf16_to_f32_avx2(float *dst, const uint16_t *src, size_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(src + i)));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_slli_epi32(v, 16));
+    }
+    return i;
+}
+
+__attribute__((target("avx2,fma")))
+static inline size_t convert_cpu_f32_to_bf16_avx2(uint16_t *dst, const float *src, size_t n)
+{
+    const __m256i exp_mask = _mm256_set1_epi32(0x7f800000);
+    const __m256i low_mask = _mm256_set1_epi32(0xffff);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i quiet = _mm256_set1_epi32(0x10000);
+    const __m256i bias = _mm256_set1_epi32(0x7fff);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m256i u = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i is_special = _mm256_cmpeq_epi32(_mm256_and_si256(u, exp_mask), exp_mask);
+        __m256i has_low = _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_and_si256(u, low_mask), _mm256_setzero_si256()),
+                                           _mm256_set1_epi32(-1));
+        __m256i special = _mm256_or_si256(u, _mm256_and_si256(has_low, quiet));
+        __m256i rne = _mm256_add_epi32(u, _mm256_add_epi32(bias, _mm256_and_si256(_mm256_srli_epi32(u, 16), one)));
+        __m256i r = _mm256_srli_epi32(_mm256_blendv_epi8(rne, special, is_special), 16);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0xd8);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm256_castsi256_si128(packed));
+    }
+    return i;
+}
+
+__attribute__((target("avx2,fma")))
+static inline size_t convert_cpu_s8_to_s16_avx2(int16_t *dst, const int8_t *src, size_t n)
+{
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16)
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(src + i))));
+    return i;
+}
+
+__attribute__((target("avx2,fma")))
+static inline size_t convert_cpu_s8_to_f32_avx2(float *dst, const int8_t *src, size_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(src + i)))));
+    return i;
+}
+
+// truncated to int32 as the scalar cast, then the low byte of each
+__attribute__((target("avx2,fma")))
+static inline size_t convert_cpu_f32_to_s8_avx2(int8_t *dst, const float *src, size_t n)
+{
+    const __m256i low_byte = _mm256_set1_epi32(0xff);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+    for(; i + 32 <= n; i += 32){
+        __m256i a = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_loadu_ps(src + i)), low_byte);
+        __m256i b = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_loadu_ps(src + i + 8)), low_byte);
+        __m256i c = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_loadu_ps(src + i + 16)), low_byte);
+        __m256i d = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_loadu_ps(src + i + 24)), low_byte);
+        __m256i r = _mm256_packus_epi16(_mm256_packus_epi32(a, b), _mm256_packus_epi32(c, d));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_permutevar8x32_epi32(r, order));
+    }
+    return i;
+}
+
+// src is a whole byte, element 2j in the low nibble of src[j]
+__attribute__((target("avx2,fma")))
+static inline size_t convert_cpu_s4_to_f32_avx2(float *dst, const uint8_t *src, size_t n)
+{
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16){
+        __m128i b = _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i *)(src + i / 2)));
+        __m128i lo = _mm_srai_epi16(_mm_slli_epi16(b, 12), 12);
+        __m128i hi = _mm_srai_epi16(b, 4);
+        _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_unpacklo_epi16(lo, hi))));
+        _mm256_storeu_ps(dst + i + 8, _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_unpackhi_epi16(lo, hi))));
+    }
+    return i;
+}
+
+// dst is a whole byte, the pair of int32 in each 64 bit lane is packed to its low byte
+__attribute__((target("avx2,fma")))
+static inline size_t convert_cpu_f32_to_s4_avx2(uint8_t *dst, const float *src, size_t n)
+{
+    const __m256i lo_mask = _mm256_set1_epi64x(0x0f);
+    const __m256i hi_mask = _mm256_set1_epi64x(0xf0);
+    const __m256i gather = _mm256_setr_epi8(0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                            0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16){
+        __m256i a = _mm256_cvttps_epi32(_mm256_loadu_ps(src + i));
+        __m256i b = _mm256_cvttps_epi32(_mm256_loadu_ps(src + i + 8));
+        a = _mm256_shuffle_epi8(_mm256_or_si256(_mm256_and_si256(a, lo_mask), _mm256_and_si256(_mm256_srli_epi64(a, 28), hi_mask)), gather);
+        b = _mm256_shuffle_epi8(_mm256_or_si256(_mm256_and_si256(b, lo_mask), _mm256_and_si256(_mm256_srli_epi64(b, 28), hi_mask)), gather);
+        // 2 bytes at the bottom of each 128 bit lane, 4 per register once the lanes are joined
+        __m128i r = _mm_unpacklo_epi32(_mm_unpacklo_epi16(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1)),
+                                       _mm_unpacklo_epi16(_mm256_castsi256_si128(b), _mm256_extracti128_si256(b, 1)));
+        _mm_storel_epi64((__m128i *)(dst + i / 2), r);
+    }
+    return i;
+}
+
+__attribute__((target("avx512f")))
+static inline size_t convert_cpu_f16_to_f32_avx512(float *dst, const uint16_t *src, size_t n)
+{
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(src + i))));
+    return i;
+}
+
+__attribute__((target("avx512f")))
+static inline size_t convert_cpu_f32_to_f16_avx512(uint16_t *dst, const float *src, size_t n)
+{
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16)
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    return i;
+}
+
+__attribute__((target("avx512f")))
+static inline size_t convert_cpu_bf16_to_f32_avx512(float *dst, const uint16_t *src, size_t n)
+{
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16){
+        __m512i v = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)(src + i)));
+        _mm512_storeu_si512(dst + i, _mm512_slli_epi32(v, 16));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f")))
+static inline size_t convert_cpu_f32_to_bf16_avx512(uint16_t *dst, const float *src, size_t n)
+{
+    const __m512i exp_mask = _mm512_set1_epi32(0x7f800000);
+    const __m512i low_mask = _mm512_set1_epi32(0xffff);
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i quiet = _mm512_set1_epi32(0x10000);
+    const __m512i bias = _mm512_set1_epi32(0x7fff);
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16){
+        __m512i u = _mm512_loadu_si512(src + i);
+        __mmask16 is_special = _mm512_cmpeq_epi32_mask(_mm512_and_si512(u, exp_mask), exp_mask);
+        __mmask16 has_low = _mm512_test_epi32_mask(u, low_mask);
+        __m512i special = _mm512_mask_or_epi32(u, has_low, u, quiet);
+        __m512i rne = _mm512_add_epi32(u, _mm512_add_epi32(bias, _mm512_and_si512(_mm512_srli_epi32(u, 16), one)));
+        __m512i r = _mm512_srli_epi32(_mm512_mask_blend_epi32(is_special, rne, special), 16);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm512_cvtepi32_epi16(r));
+    }
+    return i;
+}
+#endif
+
+static inline bool convert_cpu_use_avx2()
+{
+    return simd_cpu_get_isa() >= simd_cpu_isa_avx2;
+}
+
+static inline bool convert_cpu_use_avx512()
+{
+    return simd_cpu_get_isa() >= simd_cpu_isa_avx512;
+}
+
+// dst[i] = src[begin + i], i < cnt, to fp32
+static inline void convert_cpu_widen_f32_block(convert_cpu_dtype_t dtype, float *dst, const void *src, size_t begin, size_t cnt)
+{
+    size_t i = 0;
+    switch(dtype){
+        case convert_cpu_fp32:
+            memcpy(dst, (const float *)src + begin, cnt * sizeof(float));
+            return;
+        case convert_cpu_fp16:{
+            const uint16_t *s = (const uint16_t *)src + begin;
+#if SIMD_CPU_X86
+            if(convert_cpu_use_avx512())
+                i = convert_cpu_f16_to_f32_avx512(dst, s, cnt);
+            else if(convert_cpu_use_avx2())
+                i = convert_cpu_f16_to_f32_avx2(dst, s, cnt);
+#endif
+            for(; i < cnt; i++)
+                dst[i] = convert_cpu_f16_to_f32_scalar(s[i]);
+            return;
+        }
+        case convert_cpu_bf16:{
+            const uint16_t *s = (const uint16_t *)src + begin;
+#if SIMD_CPU_X86
+            if(convert_cpu_use_avx512())
+                i = convert_cpu_bf16_to_f32_avx512(dst, s, cnt);
+            else if(convert_cpu_use_avx2())
+                i = convert_cpu_bf16_to_f32_avx2(dst, s, cnt);
+#endif
+            for(; i < cnt; i++)
+                dst[i] = convert_cpu_bf16_to_f32_scalar(s[i]);
+            return;
+        }
+        case convert_cpu_int8:
+#if SIMD_CPU_X86
+            if(convert_cpu_use_avx2())
+                i = convert_cpu_s8_to_f32_avx2(dst, (const int8_t *)src + begin, cnt);
+#endif
+            for(; i < cnt; i++)
+                dst[i] = (float)((const int8_t *)src)[begin + i];
+            return;
+        case convert_cpu_int4:
+            if((begin & 1) && cnt){
+                dst[0] = (float)convert_cpu_s4_get((const uint8_t *)src, begin);
+                i = 1;
+            }
+#if SIMD_CPU_X86
+            if(convert_cpu_use_avx2())
+                i += convert_cpu_s4_to_f32_avx2(dst + i, (const uint8_t *)src + (begin + i) / 2, cnt - i);
+#endif
+            for(; i < cnt; i++)
+                dst[i] = (float)convert_cpu_s4_get((const uint8_t *)src, begin + i);
+            return;
+    }
+}
+
+// dst[begin + i] = src[i], i < cnt, from fp32. integers are truncated to int32 first
+static inline void convert_cpu_narrow_f32_block(convert_cpu_dtype_t dtype, void *dst, size_t begin, const float *src, size_t cnt)
+{
+    size_t i = 0;
+    switch(dtype){
+        case convert_cpu_fp32:
+            memcpy((float *)dst + begin, src, cnt * sizeof(float));
+            return;
+        case convert_cpu_fp16:{
+            uint16_t *d = (uint16_t *)dst + begin;
+#if SIMD_CPU_X86
+            if(convert_cpu_use_avx512())
+                i = convert_cpu_f32_to_f16_avx512(d, src, cnt);
+            else if(convert_cpu_use_avx2())
+                i = convert_cpu_f32_to_f16_avx2(d, src, cnt);
+#endif
+            for(; i < cnt; i++)
+                d[i] = convert_cpu_f32_to_f16_scalar(src[i]);
+            return;
+        }
+        case convert_cpu_bf16:{
+            uint16_t *d = (uint16_t *)dst + begin;
+#if SIMD_CPU_X86
+            if(convert_cpu_use_avx512())
+                i = convert_cpu_f32_to_bf16_avx512(d, src, cnt);
+            else if(convert_cpu_use_avx2())
+                i = convert_cpu_f32_to_bf16_avx2(d, src, cnt);
+#endif
+            for(; i < cnt; i++)
+                d[i] = convert_cpu_f32_to_bf16_scalar(src[i]);
+            return;
+        }
+        case convert_cpu_int8:
+#if SIMD_CPU_X86
+            if(convert_cpu_use_avx2())
+                i = convert_cpu_f32_to_s8_avx2((int8_t *)dst + begin, src, cnt);
+#endif
+            for(; i < cnt; i++)
+                ((int8_t *)dst)[begin + i] = (int8_t)(int32_t)src[i];
+            return;
+        case convert_cpu_int4:
+            if((begin & 1) && cnt){
+                convert_cpu_s4_set((uint8_t *)dst, begin, (int32_t)src[0]);
+                i = 1;
+            }
+#if SIMD_CPU_X86
+            if(convert_cpu_use_avx2())
+                i += convert_cpu_f32_to_s4_avx2((uint8_t *)dst + (begin + i) / 2, src + i, cnt - i);
+#endif
+            for(; i < cnt; i++)
+                convert_cpu_s4_set((uint8_t *)dst, begin + i, (int32_t)src[i]);
+            return;
+    }
+}
+
+// integer tensors only, dst[i] = src[begin + i] widened to int16
+static inline void convert_cpu_widen_s16_block(convert_cpu_dtype_t dtype, int16_t *dst, const void *src, size_t begin, size_t cnt)
+{
+    size_t i = 0;
+    if(dtype == convert_cpu_int8){
+        const int8_t *s = (const int8_t *)src + begin;
+#if SIMD_CPU_X86
+        if(convert_cpu_use_avx2())
+            i = convert_cpu_s8_to_s16_avx2(dst, s, cnt);
+#endif
+        for(; i < cnt; i++)
+            dst[i] = s[i];
+    }else{
+        for(; i < cnt; i++)
+            dst[i] = convert_cpu_s4_get((const uint8_t *)src, begin + i);
+    }
+}
+
+// integer tensors only, dst[begin + i] = low bits of src[i]
+static inline void convert_cpu_narrow_s32_block(convert_cpu_dtype_t dtype, void *dst, size_t begin, const int32_t *src, size_t cnt)
+{
+    if(dtype == convert_cpu_int8)
+        for(size_t i = 0; i < cnt; i++)
+            ((int8_t *)dst)[begin + i] = (int8_t)src[i];
+    else
+        for(size_t i = 0; i < cnt; i++)
+            convert_cpu_s4_set((uint8_t *)dst, begin + i, src[i]);
+}
+
+/*
+ * multithreaded versions. the split is on even native elements, so no two threads write the same int4 byte
+ */
+static inline void convert_cpu_widen_f32(convert_cpu_dtype_t dtype, float *dst, const void *src, size_t begin, size_t cnt)
+{
+    thread_pool_cpu_parallel_for(cnt, [&](size_t b, size_t e){
+        convert_cpu_widen_f32_block(dtype, dst + b, src, begin + b, e - b);
+    });
+}
+
+static inline void convert_cpu_narrow_f32(convert_cpu_dtype_t dtype, void *dst, size_t begin, const float *src, size_t cnt)
+{
+    size_t head = (dtype == convert_cpu_int4 && (begin & 1) && cnt) ? 1 : 0;
+    convert_cpu_narrow_f32_block(dtype, dst, begin, src, head);
+    thread_pool_cpu_parallel_for(cnt - head, [&](size_t b, size_t e){
+        convert_cpu_narrow_f32_block(dtype, dst, begin + head + b, src + head + b, e - b);
+    }, 2);
+}
+
+static inline void convert_cpu_widen_s16(convert_cpu_dtype_t dtype, int16_t *dst, const void *src, size_t begin, size_t cnt)
+{
+    thread_pool_cpu_parallel_for(cnt, [&](size_t b, size_t e){
+        convert_cpu_widen_s16_block(dtype, dst + b, src, begin + b, e - b);
+    });
+}
+
+static inline void convert_cpu_narrow_s32(convert_cpu_dtype_t dtype, void *dst, size_t begin, const int32_t *src, size_t cnt)
+{
+    size_t head = (dtype == convert_cpu_int4 && (begin & 1) && cnt) ? 1 : 0;
+    convert_cpu_narrow_s32_block(dtype, dst, begin, src, head);
+    thread_pool_cpu_parallel_for(cnt - head, [&](size_t b, size_t e){
+        convert_cpu_narrow_s32_block(dtype, dst, begin + head + b, src + head + b, e - b);
+    }, 2);
+}
+
+#endif
@@ -0,0 +1,467 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _DEPTHWISE_CONV_CPU_H
+#define _DEPTHWISE_CONV_CPU_H
+
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <vector>
+#include "thread_pool_cpu.h"
+#include "naive_conv.h"
+#include "spec_conv_cpu.h"
+#include "conv_geometry_cpu.h"
+
+/*
+ * host direct convolution for depthwise problems, one input channel per group (c == group) and any channel
+ * multiplier k / group. naive_conv walks a c_per_group loop of length 1 there, with nothing to vectorize.
+ *   nchw : vectorized across output (fwd) or input (bwd) columns, tasks are (n, k, row) or (n, c, row).
+ *          bwd takes the columns of one stride phase at a time, their taps are the same and their outputs
+ *          are consecutive. fwd and bwd sum in the naive_conv order, so they are bit identical to it.
+ *   nhwc : vectorized across a block of DEPTHWISE_CONV_CPU_C_BLOCK channels, tasks are (n, row, channel block),
+ *          with the filter transposed once to [y][x][k].
+ *   wrw  : every filter tap sums over (n, output row) through naive_conv_wrw_split_reduce, so the result does
+ *          not depend on the thread count. nchw keeps W_BLOCK partial sums per tap, unless the rows are
+ *          narrower than that. nhwc sums a channel block of all taps per task.
+ * nhwc and wrw sum the same products as naive_conv in another grouping, so they match within rounding.
+ * selected by conv_ref_cpu for any depthwise problem, unless IGEMM_CPU_CONV_SPEC=0.
+ */
+#ifndef DEPTHWISE_CONV_CPU_C_BLOCK
+#define DEPTHWISE_CONV_CPU_C_BLOCK 16
+#endif
+
+static inline bool depthwise_conv_cpu_applicable(size_t c, size_t k, size_t group)
+{
+    return group > 1 && c == group && k % group == 0;
+}
+
+// filter [k][y][x] to [y][x][k]
+static inline std::vector<float> depthwise_conv_cpu_transpose_filter(const float *filter, size_t k, size_t taps)
+{
+    std::vector<float> filter_t(taps * k);
+    for(size_t ik = 0; ik < k; ik++)
+        for(size_t t = 0; t < taps; t++)
+            filter_t[t * k + ik] = filter[ik * taps + t];
+    return filter_t;
+}
+
+// input channel of every output channel of a block, for a channel multiplier > 1
+static inline void depthwise_conv_cpu_channel_index(size_t *index, size_t k0, size_t nk, size_t k_per_group)
+{
+    for(size_t j = 0; j < nk; j++)
+        index[j] = (k0 + j) / k_per_group;
+}
+
+static inline void depthwise_conv_cpu_fwd_nchw(const float *src, const float *filter, float *dst,
+                                               const conv_geometry_cpu_t & geo, size_t fx, size_t fy,
+                                               size_t sx, size_t dx, size_t dy)
+{
+    size_t h = geo.y.in(), w = geo.x.in(), oh = geo.y.out(), ow = geo.x.out();
+    size_t c = geo.c, k = geo.k, k_per_group = geo.k_per_group;
+    size_t x_lo, x_hi;
+    spec_conv_cpu_interior(geo.x, fx, &x_lo, &x_hi);
+
+    auto conv_row = [&](size_t in, size_t ik, size_t ioh){
+        const float *src_c = src + (in * c + ik / k_per_group) * h * w;
+        const float *filter_k = filter + ik * fy * fx;
+        float *dst_row = dst + ((in * k + ik) * oh + ioh) * ow;
+        size_t ir_begin = geo.y.tap_begin(ioh), nr = geo.y.tap_end(ioh) - ir_begin;
+        if(nr == 0){
+            memset(dst_row, 0, ow * sizeof(float));
+            return;
+        }
+        for(size_t iow = 0; iow < x_lo; iow++)
+            dst_row[iow] = spec_conv_cpu_fwd_nchw_pixel(src_c, filter_k, geo, h, w, fx, fy, dx, dy, ioh, iow);
+        for(size_t iow = x_hi; iow < ow; iow++)
+            dst_row[iow] = spec_conv_cpu_fwd_nchw_pixel(src_c, filter_k, geo, h, w, fx, fy, dx, dy, ioh, iow);
+        const float *src_r = src_c + geo.y.in_first(ioh) * w;
+        const float *filter_r = filter_k + ir_begin * fx;
+        for(size_t iow = x_lo; iow < x_hi; iow += SPEC_CONV_CPU_W_BLOCK){
+            size_t nw = x_hi - iow < SPEC_CONV_CPU_W_BLOCK ? x_hi - iow : SPEC_CONV_CPU_W_BLOCK;
+            const float *src_t = src_r + geo.x.in_first(iow);
+            float acc[SPEC_CONV_CPU_W_BLOCK] = {.0f};
+            for(size_t ir = 0; ir < nr; ir++){
+                for(size_t is = 0; is < fx; is++){
+                    const float *s = src_t + ir * dy * w + is * dx;
+                    float fv = filter_r[ir * fx + is];
+                    if(nw == SPEC_CONV_CPU_W_BLOCK){
+                        for(size_t j = 0; j < SPEC_CONV_CPU_W_BLOCK; j++)
+                            acc[j] += s[j * sx] * fv;
+                    }else{
+                        for(size_t j = 0; j < nw; j++)
+                            acc[j] += s[j * sx] * fv;
+                    }
+                }
+            }
+            memcpy(dst_row + iow, acc, nw * sizeof(float));
+        }
+    };
+
+    thread_pool_cpu_parallel_for(geo.n * k * oh, [&](size_t begin, size_t end){
+        for(size_t row = begin; row < end; row++)
+            conv_row(row / (k * oh), (row / oh) % k, row % oh);
+    });
+}
+
+static inline void depthwise_conv_cpu_fwd_nhwc(const float *src, const float *filter, float *dst,
+                                               const conv_geometry_cpu_t & geo, size_t fx, size_t fy,
+                                               size_t dx, size_t dy)
+{
+    size_t h = geo.y.in(), w = geo.x.in(), oh = geo.y.out(), ow = geo.x.out();
+    size_t c = geo.c, k = geo.k, k_per_group = geo.k_per_group;
+    size_t k_blocks = (k + DEPTHWISE_CONV_CPU_C_BLOCK - 1) / DEPTHWISE_CONV_CPU_C_BLOCK;
+    std::vector<float> filter_t = depthwise_conv_cpu_transpose_filter(filter, k, fy * fx);
+
+    auto conv_row = [&](size_t in, size_t ioh, size_t ikb){
+        size_t k0 = ikb * DEPTHWISE_CONV_CPU_C_BLOCK;
+        size_t nk = k - k0 < DEPTHWISE_CONV_CPU_C_BLOCK ? k - k0 : DEPTHWISE_CONV_CPU_C_BLOCK;
+        size_t index[DEPTHWISE_CONV_CPU_C_BLOCK];
+        depthwise_conv_cpu_channel_index(index, k0, nk, k_per_group);
+        size_t ir_begin = geo.y.tap_begin(ioh), nr = geo.y.tap_end(ioh) - ir_begin;
+        for(size_t iow = 0; iow < ow; iow++){
+            size_t is_begin = geo.x.tap_begin(iow), ns = geo.x.tap_end(iow) - is_begin;
+            float acc[DEPTHWISE_CONV_CPU_C_BLOCK] = {.0f};
+            for(size_t ir = 0; ir < nr && ns != 0; ir++){
+                for(size_t is = 0; is < ns; is++){
+                    size_t ih = geo.y.in_first(ioh) + ir * dy;
+                    size_t iw = geo.x.in_first(iow) + is * dx;
+                    const float *src_p = src + ((in * h + ih) * w + iw) * c;
+                    const float *filter_p = filter_t.data() + ((ir_begin + ir) * fx + is_begin + is) * k + k0;
+                    if(k_per_group == 1 && nk == DEPTHWISE_CONV_CPU_C_BLOCK){
+                        for(size_t j = 0; j < DEPTHWISE_CONV_CPU_C_BLOCK; j++)
+                            acc[j] += src_p[k0 + j] * filter_p[j];
+                    }else{
+                        for(size_t j = 0; j < nk; j++)
+                            acc[j] += src_p[index[j]] * filter_p[j];
+                    }
+                }
+            }
+            memcpy(dst + ((in * oh + ioh) * ow + iow) * k + k0, acc, nk * sizeof(float));
+        }
+    };
+
+    thread_pool_cpu_parallel_for(geo.n * oh * k_blocks, [&](size_t begin, size_t end){
+        for(size_t t = begin; t < end; t++)
+            conv_row(t / (oh * k_blocks), (t / k_blocks) % oh, t % k_blocks);
+    });
+}
+
+static inline void depthwise_conv_cpu_bwd_nchw(float *src_grad, const float *filter, const float *dst_grad,
+                                               const conv_geometry_cpu_t & geo, size_t fx, size_t fy, size_t sx)
+{
+    typedef conv_geometry_cpu_dim_t::tap_t tap_t;
+    size_t h = geo.y.in(), w = geo.x.in(), oh = geo.y.out(), ow = geo.x.out();
+    size_t c = geo.c, k = geo.k, k_per_group = geo.k_per_group;
+
+    auto conv_row = [&](size_t in, size_t ic, size_t ih){
+        const tap_t *ty, *ty_begin, *ty_end, *tx, *tx_begin, *tx_end;
+        size_t base_h, base_w;
+        const float *dst_grad_c = dst_grad + (in * k + ic * k_per_group) * oh * ow;
+        const float *filter_c = filter + ic * k_per_group * fy * fx;
+        float *src_grad_row = src_grad + ((in * c + ic) * h + ih) * w;
+        geo.y.bwd_taps(ih, &ty_begin, &ty_end, &base_h);
+
+        // one input column, in the naive order: filter, tap y, tap x
+        auto conv_pixel = [&](size_t iw){
+            float value = .0f;
+            geo.x.bwd_taps(iw, &tx_begin, &tx_end, &base_w);
+            for(size_t ik = 0; ik < k_per_group; ik++)
+                for(ty = ty_begin; ty < ty_end; ty++)
+                    for(tx = tx_begin; tx < tx_end; tx++)
+                        value += dst_grad_c[(ik * oh + base_h - ty->q) * ow + base_w - tx->q] *
+                                 filter_c[(ik * fy + ty->r) * fx + tx->r];
+            src_grad_row[iw] = value;
+        };
+
+        // columns iw0, iw0 + sx, ... share a stride phase and read consecutive outputs. the run of them with
+        // the longest tap list (all the taps of the phase, away from the border) has the same taps, and is vectorized
+        for(size_t iw0 = 0; iw0 < sx && iw0 < w; iw0++){
+            size_t cols = (w - iw0 + sx - 1) / sx;
+            size_t full = 0, j_lo = 0, j_hi = 0;
+            for(size_t j = 0; j < cols; j++){
+                geo.x.bwd_taps(iw0 + j * sx, &tx_begin, &tx_end, &base_w);
+                full = (size_t)(tx_end - tx_begin) > full ? (size_t)(tx_end - tx_begin) : full;
+            }
+            const tap_t *tx_full_begin = nullptr, *tx_full_end = nullptr;
+            size_t base_w_lo = 0;
+            if(full != 0 && ty_begin != ty_end){
+                while(j_lo < cols){
+                    geo.x.bwd_taps(iw0 + j_lo * sx, &tx_full_begin, &tx_full_end, &base_w_lo);
+                    if((size_t)(tx_full_end - tx_full_begin) == full)
+                        break;
+                    j_lo++;
+                }
+                j_hi = j_lo;
+                while(j_hi < cols){
+                    geo.x.bwd_taps(iw0 + j_hi * sx, &tx_begin, &tx_end, &base_w);
+                    if(tx_begin != tx_full_begin || tx_end != tx_full_end)
+                        break;
+                    j_hi++;
+                }
+            }
+            for(size_t j = 0; j < j_lo; j++)
+                conv_pixel(iw0 + j * sx);
+            for(size_t j = j_hi; j < cols; j++)
+                conv_pixel(iw0 + j * sx);
+            if(j_lo == j_hi)
+                continue;
+            for(size_t j = j_lo; j < j_hi; j += SPEC_CONV_CPU_W_BLOCK){
+                size_t nw = j_hi - j < SPEC_CONV_CPU_W_BLOCK ? j_hi - j : SPEC_CONV_CPU_W_BLOCK;
+                float acc[SPEC_CONV_CPU_W_BLOCK] = {.0f};
+                for(size_t ik = 0; ik < k_per_group; ik++){
+                    for(ty = ty_begin; ty < ty_end; ty++){
+                        const float *dst_grad_r = dst_grad_c + (ik * oh + base_h - ty->q) * ow + base_w_lo + (j - j_lo);
+                        const float *filter_r = filter_c + (ik * fy + ty->r) * fx;
+                        for(tx = tx_full_begin; tx < tx_full_end; tx++){
+                            const float *d = dst_grad_r - tx->q;
+                            float fv = filter_r[tx->r];
+                            if(nw == SPEC_CONV_CPU_W_BLOCK){
+                                for(size_t jj = 0; jj < SPEC_CONV_CPU_W_BLOCK; jj++)
+                                    acc[jj] += d[jj] * fv;
+                            }else{
+                                for(size_t jj = 0; jj < nw; jj++)
+                                    acc[jj] += d[jj] * fv;
+                            }
+                        }
+                    }
+                }
+                for(size_t jj = 0; jj < nw; jj++)
+                    src_grad_row[iw0 + (j + jj) * sx] = acc[jj];
+            }
+        }
+    };
+
+    thread_pool_cpu_parallel_for(geo.n * c * h, [&](size_t begin, size_t end){
+        for(size_t row = begin; row < end; row++)
+            conv_row(row / (c * h), (row / h) % c, row % h);
+    });
+}
+
+static inline void depthwise_conv_cpu_bwd_nhwc(float *src_grad, const float *filter, const float *dst_grad,
+                                               const conv_geometry_cpu_t & geo, size_t fx, size_t fy)
+{
+    typedef conv_geometry_cpu_dim_t::tap_t tap_t;
+    size_t h = geo.y.in(), w = geo.x.in(), oh = geo.y.out(), ow = geo.x.out();
+    size_t c = geo.c, k = geo.k, k_per_group = geo.k_per_group;
+    size_t c_blocks = (c + DEPTHWISE_CONV_CPU_C_BLOCK - 1) / DEPTHWISE_CONV_CPU_C_BLOCK;
+    std::vector<float> filter_t = depthwise_conv_cpu_transpose_filter(filter, k, fy * fx);
+
+    auto conv_row = [&](size_t in, size_t ih, size_t icb){
+        const tap_t *ty, *ty_begin, *ty_end, *tx, *tx_begin, *tx_end;
+        size_t base_h, base_w;
+        size_t c0 = icb * DEPTHWISE_CONV_CPU_C_BLOCK;
+        size_t nc = c - c0 < DEPTHWISE_CONV_CPU_C_BLOCK ? c - c0 : DEPTHWISE_CONV_CPU_C_BLOCK;
+        geo.y.bwd_taps(ih, &ty_begin, &ty_end, &base_h);
+        for(size_t iw = 0; iw < w; iw++){
+            geo.x.bwd_taps(iw, &tx_begin, &tx_end, &base_w);
+            float acc[DEPTHWISE_CONV_CPU_C_BLOCK] = {.0f};
+            for(ty = ty_begin; ty < ty_end; ty++){
+                for(tx = tx_begin; tx < tx_end; tx++){
+                    const float *dst_grad_p = dst_grad + ((in * oh + base_h - ty->q) * ow + base_w - tx->q) * k + c0 * k_per_group;
+                    const float *filter_p = filter_t.data() + (ty->r * fx + tx->r) * k + c0 * k_per_group;
+                    if(k_per_group == 1 && nc == DEPTHWISE_CONV_CPU_C_BLOCK){
+                        for(size_t j = 0; j < DEPTHWISE_CONV_CPU_C_BLOCK; j++)
+                            acc[j] += dst_grad_p[j] * filter_p[j];
+                    }else{
+                        for(size_t j = 0; j < nc; j++)
+                            for(size_t ik = 0; ik < k_per_group; ik++)
+                                acc[j] += dst_grad_p[j * k_per_group + ik] * filter_p[j * k_per_group + ik];
+                    }
+                }
+            }
+            memcpy(src_grad + ((in * h + ih) * w + iw) * c + c0, acc, nc * sizeof(float));
+        }
+    };
+
+    thread_pool_cpu_parallel_for(geo.n * h * c_blocks, [&](size_t begin, size_t end){
+        for(size_t t = begin; t < end; t++)
+            conv_row(t / (h * c_blocks), (t / c_blocks) % h, t % c_blocks);
+    });
+}
+
+static inline void depthwise_conv_cpu_wrw_nchw(const float *src, float *filter_grad, const float *dst_grad,
+                                               const conv_geometry_cpu_t & geo, size_t fx, size_t fy, size_t sx)
+{
+    size_t h = geo.y.in(), w = geo.x.in(), oh = geo.y.out(), ow = geo.x.out();
+    size_t c = geo.c, k = geo.k, k_per_group = geo.k_per_group;
+    size_t rows = geo.n * oh;
+
+    // filter taps [begin, end) of (k, y, x), every one summed over rows [r_begin, r_end)
+    auto range_func = [&](size_t r_begin, size_t r_end, float *grad, size_t begin, size_t end){
+        for(size_t t = begin; t < end; t++){
+            size_t ik = t / (fy * fx), ir = (t / fx) % fy, is = t % fx;
+            size_t ow_begin = geo.x.out_begin(is), nw = geo.x.out_end(is) - ow_begin;
+            size_t oh_begin = geo.y.out_begin(ir), oh_end = geo.y.out_end(ir);
+            const float *src_k = src + (ik / k_per_group) * h * w + geo.x.in_of(ow_begin, is);
+            const float *dst_grad_k = dst_grad + ik * oh * ow + ow_begin;
+            float value = .0f;
+            float acc[SPEC_CONV_CPU_W_BLOCK] = {.0f};
+            for(size_t row = r_begin; row < r_end && nw != 0; row++){
+                size_t in = row / oh, ioh = row % oh;
+                if(ioh < oh_begin || ioh >= oh_end)
+                    continue;
+                const float *src_p = src_k + (in * c * h + geo.y.in_of(ioh, ir)) * w;
+                const float *dst_grad_p = dst_grad_k + (in * k * oh + ioh) * ow;
+                if(nw < SPEC_CONV_CPU_W_BLOCK){
+                    // too narrow for partial sums
+                    for(size_t j = 0; j < nw; j++)
+                        value += src_p[j * sx] * dst_grad_p[j];
+                    continue;
+                }
+                size_t j = 0;
+                for(; j + SPEC_CONV_CPU_W_BLOCK <= nw; j += SPEC_CONV_CPU_W_BLOCK)
+                    for(size_t jj = 0; jj < SPEC_CONV_CPU_W_BLOCK; jj++)
+                        acc[jj] += src_p[(j + jj) * sx] * dst_grad_p[j + jj];
+                for(size_t jj = 0; j + jj < nw; jj++)
+                    acc[jj] += src_p[(j + jj) * sx] * dst_grad_p[j + jj];
+            }
+            for(size_t jj = 0; jj < SPEC_CONV_CPU_W_BLOCK && nw >= SPEC_CONV_CPU_W_BLOCK; jj++)
+                value += acc[jj];
+            grad[t] = value;
+        }
+    };
+    size_t tasks = k * fy * fx;
+    naive_conv_wrw_split_reduce(range_func, filter_grad, tasks, tasks, rows, naive_conv_wrw_get_splits(tasks, rows));
+}
+
+static inline void depthwise_conv_cpu_wrw_nhwc(const float *src, float *filter_grad, const float *dst_grad,
+                                               const conv_geometry_cpu_t & geo, size_t fx, size_t fy)
+{
+    size_t h = geo.y.in(), w = geo.x.in(), oh = geo.y.out(), ow = geo.x.out();
+    size_t c = geo.c, k = geo.k, k_per_group = geo.k_per_group;
+    size_t rows = geo.n * oh;
+    size_t k_blocks = (k + DEPTHWISE_CONV_CPU_C_BLOCK - 1) / DEPTHWISE_CONV_CPU_C_BLOCK;
+
+    // filter blocks [begin, end), every (tap, channel) summed over rows [r_begin, r_end)
+    auto range_func = [&](size_t r_begin, size_t r_end, float *grad, size_t begin, size_t end){
+        std::vector<float> acc(fy * fx * DEPTHWISE_CONV_CPU_C_BLOCK);
+        size_t index[DEPTHWISE_CONV_CPU_C_BLOCK];
+        for(size_t ikb = begin; ikb < end; ikb++){
+            size_t k0 = ikb * DEPTHWISE_CONV_CPU_C_BLOCK;
+            size_t nk = k - k0 < DEPTHWISE_CONV_CPU_C_BLOCK ? k - k0 : DEPTHWISE_CONV_CPU_C_BLOCK;
+            depthwise_conv_cpu_channel_index(index, k0, nk, k_per_group);
+            std::fill(acc.begin(), acc.end(), .0f);
+            for(size_t row = r_begin; row < r_end; row++){
+                size_t in = row / oh, ioh = row % oh;
+                for(size_t ir = 0; ir < fy; ir++){
+                    if(ioh < geo.y.out_begin(ir) || ioh >= geo.y.out_end(ir))
+                        continue;
+                    size_t ih = geo.y.in_of(ioh, ir);
+                    for(size_t is = 0; is < fx; is++){
+                        float *a = acc.data() + (ir * fx + is) * DEPTHWISE_CONV_CPU_C_BLOCK;
+                        for(size_t iow = geo.x.out_begin(is); iow < geo.x.out_end(is); iow++){
+                            const float *src_p = src + ((in * h + ih) * w + geo.x.in_of(iow, is)) * c;
+                            const float *dst_grad_p = dst_grad + ((in * oh + ioh) * ow + iow) * k + k0;
+                            if(k_per_group == 1 && nk == DEPTHWISE_CONV_CPU_C_BLOCK){
+                                for(size_t j = 0; j < DEPTHWISE_CONV_CPU_C_BLOCK; j++)
+                                    a[j] += src_p[k0 + j] * dst_grad_p[j];
+                            }else{
+                                for(size_t j = 0; j < nk; j++)
+                                    a[j] += src_p[index[j]] * dst_grad_p[j];
+                            }
+                        }
+                    }
+                }
+            }
+            for(size_t j = 0; j < nk; j++)
+                for(size_t t = 0; t < fy * fx; t++)
+                    grad[(k0 + j) * fy * fx + t] = acc[t * DEPTHWISE_CONV_CPU_C_BLOCK + j];
+        }
+    };
+    naive_conv_wrw_split_reduce(range_func, filter_grad, k * fy * fx, k_blocks, rows, naive_conv_wrw_get_splits(k_blocks, rows));
+}
+
+#define DEPTHWISE_CONV_CPU_GEOMETRY conv_geometry_cpu_t geo(n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group)
+
+static inline bool depthwise_conv_fwd_nchw(const float *src, const float *filter, float *dst, size_t n, size_t w,
+                                           size_t h, size_t c, size_t k, size_t fx, size_t fy, size_t px, size_t py,
+                                           size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    if(!spec_conv_cpu_enabled() || !depthwise_conv_cpu_applicable(c, k, group))
+        return false;
+    DEPTHWISE_CONV_CPU_GEOMETRY;
+    depthwise_conv_cpu_fwd_nchw(src, filter, dst, geo, fx, fy, sx, dx, dy);
+    return true;
+}
+
+static inline bool depthwise_conv_fwd_nhwc(const float *src, const float *filter, float *dst, size_t n, size_t w,
+                                           size_t h, size_t c, size_t k, size_t fx, size_t fy, size_t px, size_t py,
+                                           size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    if(!spec_conv_cpu_enabled() || !depthwise_conv_cpu_applicable(c, k, group))
+        return false;
+    DEPTHWISE_CONV_CPU_GEOMETRY;
+    depthwise_conv_cpu_fwd_nhwc(src, filter, dst, geo, fx, fy, dx, dy);
+    return true;
+}
+
+static inline bool depthwise_conv_bwd_nchw(float *src_grad, const float *filter, const float *dst_grad, size_t n,
+                                           size_t w, size_t h, size_t c, size_t k, size_t fx, size_t fy, size_t px,
+                                           size_t py, size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    if(!spec_conv_cpu_enabled() || !depthwise_conv_cpu_applicable(c, k, group))
+        return false;
+    DEPTHWISE_CONV_CPU_GEOMETRY;
+    depthwise_conv_cpu_bwd_nchw(src_grad, filter, dst_grad, geo, fx, fy, sx);
+    return true;
+}
+
+static inline bool depthwise_conv_bwd_nhwc(float *src_grad, const float *filter, const float *dst_grad, size_t n,
+                                           size_t w, size_t h, size_t c, size_t k, size_t fx, size_t fy, size_t px,
+                                           size_t py, size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    if(!spec_conv_cpu_enabled() || !depthwise_conv_cpu_applicable(c, k, group))
+        return false;
+    DEPTHWISE_CONV_CPU_GEOMETRY;
+    depthwise_conv_cpu_bwd_nhwc(src_grad, filter, dst_grad, geo, fx, fy);
+    return true;
+}
+
+static inline bool depthwise_conv_wrw_nchw(const float *src, float *filter_grad, const float *dst_grad, size_t n,
+                                           size_t w, size_t h, size_t c, size_t k, size_t fx, size_t fy, size_t px,
+                                           size_t py, size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    if(!spec_conv_cpu_enabled() || !depthwise_conv_cpu_applicable(c, k, group))
+        return false;
+    DEPTHWISE_CONV_CPU_GEOMETRY;
+    depthwise_conv_cpu_wrw_nchw(src, filter_grad, dst_grad, geo, fx, fy, sx);
+    return true;
+}
+
+static inline bool depthwise_conv_wrw_nhwc(const float *src, float *filter_grad, const float *dst_grad, size_t n,
+                                           size_t w, size_t h, size_t c, size_t k, size_t fx, size_t fy, size_t px,
+                                           size_t py, size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    if(!spec_conv_cpu_enabled() || !depthwise_conv_cpu_applicable(c, k, group))
+        return false;
+    DEPTHWISE_CONV_CPU_GEOMETRY;
+    depthwise_conv_cpu_wrw_nhwc(src, filter_grad, dst_grad, geo, fx, fy);
+    return true;
+}
+
+#undef DEPTHWISE_CONV_CPU_GEOMETRY
+
+#endif
@@ -0,0 +1,342 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _FFT_CONV_CPU_H
+#define _FFT_CONV_CPU_H
+
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <vector>
+#include <memory>
+#include "thread_pool_cpu.h"
+#include "fft_cpu.h"
+#include "simd_cpu.h"
+#include "naive_conv.h"
+
+/*
+ * host reference convolution through 2d real fft, same argument order as naive_conv_*.
+ * every plane is zero padded to nh x nw, the powers of 2 not less than the padded input, which is
+ * large enough for both the correlation (fwd, wrw) and the full convolution (bwd) to not wrap around.
+ * dilation is done by spreading the filter taps, stride by spreading dst/dst_grad.
+ *   fwd : dst(n, k)         = ifft(sum_c   fft(src(n, c))      * conj(fft(filter(k, c))))
+ *   bwd : src_grad(n, c)    = ifft(sum_k   fft(dst_grad(n, k)) *      fft(filter(k, c)))
+ *   wrw : filter_grad(k, c) = ifft(sum_n   fft(src(n, c))      * conj(fft(dst_grad(n, k))))
+ * the cost hardly depends on the filter size, so this pays off for large and dilated filters.
+ */
+#ifndef FFT_CONV_CPU_SPECTRA_FLOATS
+#define FFT_CONV_CPU_SPECTRA_FLOATS (1 << 24)  // limit of the spectra kept for either operand, in floats
+#endif
+#define FFT_CONV_CPU_JR     4                   // products accumulated together, sharing the load of the a operand
+#define FFT_CONV_CPU_QC     256                 // frequencies accumulated at a time, to stay in L1
+
+/*
+ * flop estimate of fft against a direct conv. radix-2 fft and the complex products run a few times less
+ * efficient than the direct loop nest or gemm, hence FFT_CONV_CPU_COST_RATIO (in 1/10)
+ */
+#ifndef FFT_CONV_CPU_COST_RATIO
+#define FFT_CONV_CPU_COST_RATIO 25
+#endif
+static inline bool fft_conv_cpu_preferred(size_t n, size_t w, size_t h, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t px, size_t py, size_t sx,
+                                          size_t sy, size_t dx, size_t dy, size_t group)
+{
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    size_t nh = fft_cpu_next_pow2(h + 2 * py);
+    size_t nw = fft_cpu_next_pow2(w + 2 * px);
+    double log_len = log2((double)nh * nw);
+    double planes = (double)n * c + (double)k * (c / group) + (double)n * k;
+    double fft_flops = planes * 2.5 * nh * nw * log_len + 8.0 * n * k * (c / group) * nh * (nw / 2 + 1);
+    double direct_flops = 2.0 * n * k * (c / group) * oh * ow * fy * fx;
+    return fft_flops * FFT_CONV_CPU_COST_RATIO < direct_flops * 10;
+}
+
+// extra tolerance to allow on top of the fp32 get_nrms() when fft is the reference. measured on par with gemm for
+// the shapes of test_cpu_conv_ref, the margin is for the rounding error growing with log(nh * nw)
+static inline double fft_conv_cpu_nrms_scale()
+{
+    return 2.0;
+}
+
+static inline void fft_conv_cpu_load(float *plane, size_t nh, const float *p, size_t rows, size_t cols,
+                                     size_t rs, size_t cs, size_t oy, size_t ox, size_t sy, size_t sx)
+{
+    for(size_t y = 0; y < rows; y++)
+        for(size_t x = 0; x < cols; x++)
+            plane[(ox + x * sx) * nh + oy + y * sy] = p[y * rs + x * cs];
+}
+
+static inline void fft_conv_cpu_store(float *p, size_t rows, size_t cols, size_t rs, size_t cs, const float *plane,
+                                      size_t nh, size_t oy, size_t ox, size_t sy, size_t sx, float scale)
+{
+    for(size_t y = 0; y < rows; y++)
+        for(size_t x = 0; x < cols; x++)
+            p[y * rs + x * cs] = plane[(ox + x * sx) * nh + oy + y * sy] * scale;
+}
+
+/*
+ * out(i, j) = ifft(sum_m fft(a(i, m)) * [conj](fft(b(j, m)))).
+ * load_a(i, m, plane) / load_b(j, m, plane) fill a zeroed plane, store(i, j, plane, scale) gets the unscaled
+ * result. planes are stored transposed, [x][y] of nw x nh, see fft_cpu_r2c_2d(). spectra of a and b are
+ * computed for a block of i/j at a time, within FFT_CONV_CPU_SPECTRA_FLOATS
+ */
+template<typename load_a_t, typename load_b_t, typename store_t>
+static inline void fft_conv_cpu_engine(size_t ni, size_t nj, size_t nm, size_t nh, size_t nw, bool conj_b,
+                                       const load_a_t & load_a, const load_b_t & load_b, const store_t & store)
+{
+    size_t wc = nw / 2 + 1;
+    size_t nq = nh * wc;                    // complex values per spectrum
+    size_t spec_len = 2 * nq;
+    size_t ib = FFT_CONV_CPU_SPECTRA_FLOATS / (nm * spec_len);
+    size_t jb = FFT_CONV_CPU_SPECTRA_FLOATS / (nm * spec_len);
+    ib = ib == 0 ? 1 : (ib > ni ? ni : ib);
+    jb = jb == 0 ? 1 : (jb > nj ? nj : jb);
+    std::unique_ptr<float[]> a_spec(new float[ib * nm * spec_len]);
+    std::unique_ptr<float[]> b_spec(new float[jb * nm * spec_len]);
+    float scale = 1.0f / (nh * nw);
+
+    auto get_scratch = [&](size_t size){
+        static thread_local std::vector<float> scratch;
+        if(scratch.size() < size)
+            scratch.resize(size);
+        return scratch.data();
+    };
+    auto transform = [&](float *spec, size_t i0, size_t cnt, bool is_a){
+        thread_pool_cpu_get().run(cnt * nm, [&](size_t task){
+            float *plane = get_scratch(nh * nw);
+            memset(plane, 0, nh * nw * sizeof(float));
+            if(is_a)
+                load_a(i0 + task / nm, task % nm, plane);
+            else
+                load_b(i0 + task / nm, task % nm, plane);
+            fft_cpu_r2c_2d(plane, spec + task * spec_len, nh, nw);
+        });
+    };
+
+    for(size_t i0 = 0; i0 < ni; i0 += ib){
+        size_t ci = i0 + ib < ni ? ib : ni - i0;
+        transform(a_spec.get(), i0, ci, true);
+        for(size_t j0 = 0; j0 < nj; j0 += jb){
+            size_t cj = j0 + jb < nj ? jb : nj - j0;
+            transform(b_spec.get(), j0, cj, false);
+            size_t j_tasks = (cj + FFT_CONV_CPU_JR - 1) / FFT_CONV_CPU_JR;
+            thread_pool_cpu_get().run(ci * j_tasks, [&](size_t task){
+                size_t ii = task / j_tasks;
+                size_t jj0 = (task % j_tasks) * FFT_CONV_CPU_JR;
+                size_t nr = jj0 + FFT_CONV_CPU_JR < cj ? FFT_CONV_CPU_JR : cj - jj0;
+                float *acc = get_scratch(FFT_CONV_CPU_JR * spec_len + nh * nw);
+                float *plane = acc + FFT_CONV_CPU_JR * spec_len;
+                for(size_t q0 = 0; q0 < nq; q0 += FFT_CONV_CPU_QC){
+                    size_t q1 = q0 + FFT_CONV_CPU_QC < nq ? q0 + FFT_CONV_CPU_QC : nq;
+                    for(size_t r = 0; r < nr; r++){
+                        memset(acc + r * spec_len + q0, 0, (q1 - q0) * sizeof(float));
+                        memset(acc + r * spec_len + nq + q0, 0, (q1 - q0) * sizeof(float));
+                    }
+                    for(size_t m = 0; m < nm; m++){
+                        const float *ar = a_spec.get() + (ii * nm + m) * spec_len;
+                        const float *ai = ar + nq;
+                        for(size_t r = 0; r < nr; r++){
+                            const float *br = b_spec.get() + ((jj0 + r) * nm + m) * spec_len;
+                            const float *bi = br + nq;
+                            float *cr = acc + r * spec_len;
+                            simd_cpu_cmac_f32(cr + q0, cr + nq + q0, ar + q0, ai + q0, br + q0, bi + q0, conj_b, q1 - q0);
+                        }
+                    }
+                }
+                for(size_t r = 0; r < nr; r++){
+                    fft_cpu_c2r_2d(acc + r * spec_len, plane, nh, nw);
+                    store(i0 + ii, j0 + jj0 + r, plane, scale);
+                }
+            });
+        }
+    }
+}
+
+static inline void fft_conv_cpu_fwd(const float *src, const float *filter, float *dst,
+                                    size_t n, size_t w, size_t h, size_t c, size_t k,
+                                    size_t fx, size_t fy, size_t px, size_t py, size_t sx,
+                                    size_t sy, size_t dx, size_t dy, size_t group, bool is_nhwc)
+{
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    size_t nh = fft_cpu_next_pow2(h + 2 * py);
+    size_t nw = fft_cpu_next_pow2(w + 2 * px);
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    for(size_t ig = 0; ig < group; ig++){
+        auto load_src = [&](size_t in, size_t ic, float *plane){
+            if(is_nhwc)
+                fft_conv_cpu_load(plane, nh, src + in * h * w * c + ig * c_per_group + ic, h, w, w * c, c, py, px, 1, 1);
+            else
+                fft_conv_cpu_load(plane, nh, src + (in * c + ig * c_per_group + ic) * h * w, h, w, w, 1, py, px, 1, 1);
+        };
+        auto load_filter = [&](size_t ik, size_t ic, float *plane){
+            size_t gk = ig * k_per_group + ik;
+            if(is_nhwc)
+                fft_conv_cpu_load(plane, nh, filter + gk * fy * fx * c_per_group + ic, fy, fx, fx * c_per_group, c_per_group, 0, 0, dy, dx);
+            else
+                fft_conv_cpu_load(plane, nh, filter + (gk * c_per_group + ic) * fy * fx, fy, fx, fx, 1, 0, 0, dy, dx);
+        };
+        auto store_dst = [&](size_t in, size_t ik, const float *plane, float scale){
+            if(is_nhwc)
+                fft_conv_cpu_store(dst + in * oh * ow * k + ig * k_per_group + ik, oh, ow, ow * k, k, plane, nh, 0, 0, sy, sx, scale);
+            else
+                fft_conv_cpu_store(dst + (in * k + ig * k_per_group + ik) * oh * ow, oh, ow, ow, 1, plane, nh, 0, 0, sy, sx, scale);
+        };
+        fft_conv_cpu_engine(n, k_per_group, c_per_group, nh, nw, true, load_src, load_filter, store_dst);
+    }
+}
+
+static inline void fft_conv_cpu_bwd(float *src_grad, const float *filter, const float *dst_grad,
+                                    size_t n, size_t w, size_t h, size_t c, size_t k,
+                                    size_t fx, size_t fy, size_t px, size_t py, size_t sx,
+                                    size_t sy, size_t dx, size_t dy, size_t group, bool is_nhwc)
+{
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    size_t nh = fft_cpu_next_pow2(h + 2 * py);
+    size_t nw = fft_cpu_next_pow2(w + 2 * px);
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    for(size_t ig = 0; ig < group; ig++){
+        auto load_dst_grad = [&](size_t in, size_t ik, float *plane){
+            if(is_nhwc)
+                fft_conv_cpu_load(plane, nh, dst_grad + in * oh * ow * k + ig * k_per_group + ik, oh, ow, ow * k, k, 0, 0, sy, sx);
+            else
+                fft_conv_cpu_load(plane, nh, dst_grad + (in * k + ig * k_per_group + ik) * oh * ow, oh, ow, ow, 1, 0, 0, sy, sx);
+        };
+        auto load_filter = [&](size_t ic, size_t ik, float *plane){
+            size_t gk = ig * k_per_group + ik;
+            if(is_nhwc)
+                fft_conv_cpu_load(plane, nh, filter + gk * fy * fx * c_per_group + ic, fy, fx, fx * c_per_group, c_per_group, 0, 0, dy, dx);
+            else
+                fft_conv_cpu_load(plane, nh, filter + (gk * c_per_group + ic) * fy * fx, fy, fx, fx, 1, 0, 0, dy, dx);
+        };
+        auto store_src_grad = [&](size_t in, size_t ic, const float *plane, float scale){
+            if(is_nhwc)
+                fft_conv_cpu_store(src_grad + in * h * w * c + ig * c_per_group + ic, h, w, w * c, c, plane, nh, py, px, 1, 1, scale);
+            else
+                fft_conv_cpu_store(src_grad + (in * c + ig * c_per_group + ic) * h * w, h, w, w, 1, plane, nh, py, px, 1, 1, scale);
+        };
+        fft_conv_cpu_engine(n, c_per_group, k_per_group, nh, nw, false, load_dst_grad, load_filter, store_src_grad);
+    }
+}
+
+static inline void fft_conv_cpu_wrw(const float *src, float *filter_grad, const float *dst_grad,
+                                    size_t n, size_t w, size_t h, size_t c, size_t k,
+                                    size_t fx, size_t fy, size_t px, size_t py, size_t sx,
+                                    size_t sy, size_t dx, size_t dy, size_t group, bool is_nhwc)
+{
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    size_t nh = fft_cpu_next_pow2(h + 2 * py);
+    size_t nw = fft_cpu_next_pow2(w + 2 * px);
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    for(size_t ig = 0; ig < group; ig++){
+        auto load_src = [&](size_t ic, size_t in, float *plane){
+            if(is_nhwc)
+                fft_conv_cpu_load(plane, nh, src + in * h * w * c + ig * c_per_group + ic, h, w, w * c, c, py, px, 1, 1);
+            else
+                fft_conv_cpu_load(plane, nh, src + (in * c + ig * c_per_group + ic) * h * w, h, w, w, 1, py, px, 1, 1);
+        };
+        auto load_dst_grad = [&](size_t ik, size_t in, float *plane){
+            if(is_nhwc)
+                fft_conv_cpu_load(plane, nh, dst_grad + in * oh * ow * k + ig * k_per_group + ik, oh, ow, ow * k, k, 0, 0, sy, sx);
+            else
+                fft_conv_cpu_load(plane, nh, dst_grad + (in * k + ig * k_per_group + ik) * oh * ow, oh, ow, ow, 1, 0, 0, sy, sx);
+        };
+        auto store_filter_grad = [&](size_t ic, size_t ik, const float *plane, float scale){
+            size_t gk = ig * k_per_group + ik;
+            if(is_nhwc)
+                fft_conv_cpu_store(filter_grad + gk * fy * fx * c_per_group + ic, fy, fx, fx * c_per_group, c_per_group, plane, nh, 0, 0, dy, dx, scale);
+            else
+                fft_conv_cpu_store(filter_grad + (gk * c_per_group + ic) * fy * fx, fy, fx, fx, 1, plane, nh, 0, 0, dy, dx, scale);
+        };
+        fft_conv_cpu_engine(c_per_group, k_per_group, n, nh, nw, true, load_src, load_dst_grad, store_filter_grad);
+    }
+}
+
+static inline void fft_conv_fwd_nchw(const float *src, const float *filter,
+                                     float *dst, size_t n, size_t w, size_t h,
+                                     size_t c, size_t k, size_t fx, size_t fy,
+                                     size_t px, size_t py, size_t sx,
+                                     size_t sy, size_t dx, size_t dy, size_t group) {
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    fft_conv_cpu_fwd(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group, false);
+}
+
+static inline void fft_conv_fwd_nhwc(const float *src, const float *filter,
+                                     float *dst, size_t n, size_t w, size_t h,
+                                     size_t c, size_t k, size_t fx, size_t fy,
+                                     size_t px, size_t py, size_t sx,
+                                     size_t sy, size_t dx, size_t dy, size_t group) {
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    fft_conv_cpu_fwd(src, filter, dst, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group, true);
+}
+
+static inline void fft_conv_bwd_nchw(float *src_grad, const float *filter,
+                                     const float *dst_grad, size_t n,
+                                     size_t w, size_t h, size_t c, size_t k,
+                                     size_t fx, size_t fy, size_t px,
+                                     size_t py, size_t sx, size_t sy,
+                                     size_t dx, size_t dy, size_t group) {
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    fft_conv_cpu_bwd(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group, false);
+}
+
+static inline void fft_conv_bwd_nhwc(float *src_grad, const float *filter,
+                                     const float *dst_grad, size_t n,
+                                     size_t w, size_t h, size_t c, size_t k,
+                                     size_t fx, size_t fy, size_t px,
+                                     size_t py, size_t sx, size_t sy,
+                                     size_t dx, size_t dy, size_t group) {
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    fft_conv_cpu_bwd(src_grad, filter, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group, true);
+}
+
+static inline void fft_conv_wrw_nchw(const float *src, float *filter_grad,
+                                     const float *dst_grad, size_t n,
+                                     size_t w, size_t h, size_t c, size_t k,
+                                     size_t fx, size_t fy, size_t px,
+                                     size_t py, size_t sx, size_t sy,
+                                     size_t dx, size_t dy, size_t group) {
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    fft_conv_cpu_wrw(src, filter_grad, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group, false);
+}
+
+static inline void fft_conv_wrw_nhwc(const float *src, float *filter_grad,
+                                     const float *dst_grad, size_t n,
+                                     size_t w, size_t h, size_t c, size_t k,
+                                     size_t fx, size_t fy, size_t px,
+                                     size_t py, size_t sx, size_t sy,
+                                     size_t dx, size_t dy, size_t group) {
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    fft_conv_cpu_wrw(src, filter_grad, dst_grad, n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group, true);
+}
+
+#endif
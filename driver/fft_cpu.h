@@ -0,0 +1,184 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _FFT_CPU_H
+#define _FFT_CPU_H
+
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "simd_cpu.h"
+
+/*
+ * radix-2 fft used by the host fft convolution. same butterfly as test/common/fft.h, but with the
+ * bit-reverse table and twiddles computed once per length (fft_cpu_get_plan) instead of on every call,
+ * and with split re/im storage, so that a transform over rows of "vec" complex values runs through the
+ * simd butterfly of simd_cpu.h.
+ *
+ * a real plane of nh x nw is kept in the frequency domain as re[nh][nw/2+1] followed by im[nh][nw/2+1].
+ * rows are transformed in pairs as one complex fft (a + i*b), then split by conj symmetry, as
+ * FFTCONV_USE_CONJ of fft.h does. no scaling on either direction, the inverse is nh*nw times larger.
+ */
+typedef struct {
+    size_t length;
+    std::vector<size_t> bit_reverse;
+    std::vector<float> wr;                  // exp(-2*pi*i*j/length), j < length/2
+    std::vector<float> wi;
+} fft_cpu_plan_t;
+
+static inline size_t fft_cpu_next_pow2(size_t v)
+{
+    size_t r = 2;
+    while(r < v)
+        r <<= 1;
+    return r;
+}
+
+// plans are built once per length and live for the process, so the returned reference stays valid
+static inline const fft_cpu_plan_t & fft_cpu_get_plan(size_t length)
+{
+    static std::mutex mtx;
+    static std::map<size_t, std::unique_ptr<fft_cpu_plan_t>> plans;
+    assert((length & (length - 1)) == 0 && "length must be power of 2");
+    std::lock_guard<std::mutex> lk(mtx);
+    std::unique_ptr<fft_cpu_plan_t> & plan = plans[length];
+    if(!plan){
+        plan.reset(new fft_cpu_plan_t);
+        plan->length = length;
+        plan->bit_reverse.resize(length);
+        size_t nbits = 0;
+        while(((size_t)1 << nbits) < length)
+            nbits++;
+        for(size_t i = 0; i < length; i++){
+            size_t r = 0;
+            for(size_t b = 0; b < nbits; b++)
+                if(i & ((size_t)1 << b))
+                    r |= (size_t)1 << (nbits - 1 - b);
+            plan->bit_reverse[i] = r;
+        }
+        plan->wr.resize(length / 2);
+        plan->wi.resize(length / 2);
+        for(size_t j = 0; j < length / 2; j++){
+            double theta = -2.0 * M_PI * j / length;
+            plan->wr[j] = (float)cos(theta);
+            plan->wi[j] = (float)sin(theta);
+        }
+    }
+    return *plan;
+}
+
+// in place complex fft over plan.length elements, element e being re/im[e * stride + v], v < vec
+static inline void fft_cpu_c2c(float *re, float *im, size_t stride, size_t vec, const fft_cpu_plan_t & plan, bool inverse)
+{
+    size_t len = plan.length;
+    for(size_t e = 0; e < len; e++){
+        size_t r = plan.bit_reverse[e];
+        if(e < r)
+            for(size_t v = 0; v < vec; v++){
+                float t = re[e * stride + v]; re[e * stride + v] = re[r * stride + v]; re[r * stride + v] = t;
+                t = im[e * stride + v]; im[e * stride + v] = im[r * stride + v]; im[r * stride + v] = t;
+            }
+    }
+    for(size_t hs = 1; hs < len; hs <<= 1){
+        size_t step = len / (2 * hs);
+        for(size_t blk = 0; blk < len; blk += 2 * hs){
+            for(size_t j = 0; j < hs; j++){
+                float omr = plan.wr[j * step];
+                float omi = inverse ? -plan.wi[j * step] : plan.wi[j * step];
+                if(vec >= 8)
+                    simd_cpu_butterfly_f32(re + (blk + j) * stride, im + (blk + j) * stride,
+                                           re + (blk + j + hs) * stride, im + (blk + j + hs) * stride, omr, omi, vec);
+                else
+                    simd_cpu_butterfly_f32_scalar(re + (blk + j) * stride, im + (blk + j) * stride,
+                                                  re + (blk + j + hs) * stride, im + (blk + j + hs) * stride, omr, omi, vec);
+            }
+        }
+    }
+}
+
+/*
+ * 2d real to complex. src is the real plane stored transposed, src[x][y] of nw x nh, so that the fft along x
+ * runs over nh / 2 row pairs at once: rows y and y + nh / 2 go as the real and imaginary part of one complex fft.
+ * spec gets re[nh][wc] then im[nh][wc], wc = nw / 2 + 1, and src is overwritten
+ */
+static inline void fft_cpu_r2c_2d(float *src, float *spec, size_t nh, size_t nw)
+{
+    const fft_cpu_plan_t & plan_w = fft_cpu_get_plan(nw);
+    const fft_cpu_plan_t & plan_h = fft_cpu_get_plan(nh);
+    size_t wc = nw / 2 + 1;
+    size_t hh = nh / 2;
+    float *spec_re = spec;
+    float *spec_im = spec + nh * wc;
+    fft_cpu_c2c(src, src + hh, nh, hh, plan_w, false);
+    for(size_t x = 0; x < wc; x++){
+        const float *zr = src + x * nh;
+        const float *zi = zr + hh;
+        const float *cr = src + ((nw - x) & (nw - 1)) * nh;
+        const float *ci = cr + hh;
+        for(size_t y = 0; y < hh; y++){
+            // a = (z[x] + conj(z[n-x])) / 2, b = (z[x] - conj(z[n-x])) / 2i
+            spec_re[y * wc + x] = .5f * (zr[y] + cr[y]);
+            spec_im[y * wc + x] = .5f * (zi[y] - ci[y]);
+            spec_re[(y + hh) * wc + x] = .5f * (zi[y] + ci[y]);
+            spec_im[(y + hh) * wc + x] = .5f * (cr[y] - zr[y]);
+        }
+    }
+    fft_cpu_c2c(spec_re, spec_im, wc, wc, plan_h, false);
+}
+
+// inverse of fft_cpu_r2c_2d, unscaled, dst gets the transposed plane dst[x][y]. spec is overwritten
+static inline void fft_cpu_c2r_2d(float *spec, float *dst, size_t nh, size_t nw)
+{
+    const fft_cpu_plan_t & plan_w = fft_cpu_get_plan(nw);
+    const fft_cpu_plan_t & plan_h = fft_cpu_get_plan(nh);
+    size_t wc = nw / 2 + 1;
+    size_t hh = nh / 2;
+    float *spec_re = spec;
+    float *spec_im = spec + nh * wc;
+    fft_cpu_c2c(spec_re, spec_im, wc, wc, plan_h, true);
+    // z = a + i * b over the full row, the upper half from hermitian symmetry
+    for(size_t x = 0; x < nw; x++){
+        float *zr = dst + x * nh;
+        float *zi = zr + hh;
+        size_t xs = x < wc ? x : nw - x;
+        float sign = x < wc ? 1.0f : -1.0f;     // conj for the upper half
+        for(size_t y = 0; y < hh; y++){
+            float ar = spec_re[y * wc + xs];
+            float ai = spec_im[y * wc + xs] * sign;
+            float br = spec_re[(y + hh) * wc + xs];
+            float bi = spec_im[(y + hh) * wc + xs] * sign;
+            zr[y] = ar - bi;
+            zi[y] = ai + br;
+        }
+    }
+    fft_cpu_c2c(dst, dst + hh, nh, hh, plan_w, true);
+}
+
+#endif
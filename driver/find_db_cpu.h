@@ -0,0 +1,272 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _FIND_DB_CPU_H
+#define _FIND_DB_CPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+/*
+ * persistent find-db of the tuning results of conv_driver.exe, host only so it can be tested without a device.
+ * a record is keyed by the full problem signature (direction, layouts, precision, conv sizes, arch and cu count) and
+ * keeps the FIND_DB_CPU_TOP fastest kernels of the last tuning, ranked, each with its gks and spatial tiling.
+ *
+ * the file is a small header followed by fixed size records sorted by key bytes, so a lookup maps the file and
+ * binary searches it, nothing is parsed. keys are zero filled before being set, hence memcmp is a valid compare.
+ * a store maps the current file under an exclusive flock on "<path>.lock", merges the record in and renames a
+ * fresh copy over the old one, so concurrent drivers never see a half written db, the last store of a key wins.
+ */
+#define FIND_DB_CPU_MAGIC       0x42444649      // "IFDB"
+#define FIND_DB_CPU_VERSION     1
+#ifndef FIND_DB_CPU_TOP
+#define FIND_DB_CPU_TOP         4
+#endif
+#define FIND_DB_CPU_NAME_LEN    192
+
+typedef struct {
+    char direction[4];          // "fwd", "bwd", "wrw"
+    char in_layout[8];
+    char fil_layout[8];
+    char out_layout[8];
+    char arch[32];              // gcnArchName up to the first ':', e.g. "gfx90a"
+    int32_t data_type;          // driverDataType_t
+    int32_t num_cu;
+    int32_t n, c, hi, wi, k, y, x;
+    int32_t pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w, group;
+} find_db_cpu_key_t;
+
+typedef struct {
+    char kernel_name[FIND_DB_CPU_NAME_LEN];
+    int32_t gks;
+    int32_t tile_h, tile_w;     // igemm_spatial_tiling_t of the problem, 0 if not tiled
+    float duration_ms;
+    float gflops;
+} find_db_cpu_entry_t;
+
+typedef struct {
+    find_db_cpu_key_t key;
+    int32_t num_entries;
+    find_db_cpu_entry_t entries[FIND_DB_CPU_TOP];   // fastest first
+} find_db_cpu_record_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t num_records;
+} find_db_cpu_header_t;
+
+typedef struct {
+    void *map;
+    size_t map_size;
+    const find_db_cpu_record_t *records;
+    size_t num_records;
+} find_db_cpu_t;
+
+static inline void find_db_cpu_set_str(char *dst, size_t len, const char *src, char stop = '\0')
+{
+    size_t i = 0;
+    for(; i < len - 1 && src[i] != '\0' && src[i] != stop; i++)
+        dst[i] = src[i];
+    memset(dst + i, 0, len - i);
+}
+
+static inline void find_db_cpu_key_init(find_db_cpu_key_t *key, const char *direction, const char *in_layout,
+                                        const char *fil_layout, const char *out_layout, int data_type,
+                                        const char *arch, int num_cu)
+{
+    memset(key, 0, sizeof(find_db_cpu_key_t));
+    find_db_cpu_set_str(key->direction, sizeof(key->direction), direction);
+    find_db_cpu_set_str(key->in_layout, sizeof(key->in_layout), in_layout);
+    find_db_cpu_set_str(key->fil_layout, sizeof(key->fil_layout), fil_layout);
+    find_db_cpu_set_str(key->out_layout, sizeof(key->out_layout), out_layout);
+    find_db_cpu_set_str(key->arch, sizeof(key->arch), arch, ':');
+    key->data_type = data_type;
+    key->num_cu = num_cu;
+}
+
+static inline int find_db_cpu_key_cmp(const find_db_cpu_key_t *a, const find_db_cpu_key_t *b)
+{
+    return memcmp(a, b, sizeof(find_db_cpu_key_t));
+}
+
+static inline void find_db_cpu_close(find_db_cpu_t *db)
+{
+    if(db->map)
+        munmap(db->map, db->map_size);
+    db->map = nullptr;
+    db->map_size = 0;
+    db->records = nullptr;
+    db->num_records = 0;
+}
+
+// a missing file opens as an empty db. returns false, leaving the db empty, if the file is not a valid db
+static inline bool find_db_cpu_open(find_db_cpu_t *db, const char *path)
+{
+    db->map = nullptr;
+    db->map_size = 0;
+    db->records = nullptr;
+    db->num_records = 0;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return true;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(find_db_cpu_header_t)){
+        close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return false;
+
+    const find_db_cpu_header_t *header = reinterpret_cast<const find_db_cpu_header_t *>(map);
+    if(header->magic != FIND_DB_CPU_MAGIC || header->version != FIND_DB_CPU_VERSION ||
+        header->record_size != sizeof(find_db_cpu_record_t) ||
+        size != sizeof(find_db_cpu_header_t) + static_cast<size_t>(header->num_records) * sizeof(find_db_cpu_record_t)){
+        munmap(map, size);
+        return false;
+    }
+    db->map = map;
+    db->map_size = size;
+    db->records = reinterpret_cast<const find_db_cpu_record_t *>(header + 1);
+    db->num_records = header->num_records;
+    return true;
+}
+
+static inline const find_db_cpu_record_t *find_db_cpu_find(const find_db_cpu_t *db, const find_db_cpu_key_t *key)
+{
+    size_t lo = 0, hi = db->num_records;
+    while(lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        int r = find_db_cpu_key_cmp(&db->records[mid].key, key);
+        if(r == 0)
+            return &db->records[mid];
+        if(r < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return nullptr;
+}
+
+// keep the FIND_DB_CPU_TOP fastest of the candidates into record, the key is left untouched
+static inline void find_db_cpu_rank(find_db_cpu_record_t *record, std::vector<find_db_cpu_entry_t> candidates)
+{
+    std::stable_sort(candidates.begin(), candidates.end(), [](const find_db_cpu_entry_t &a, const find_db_cpu_entry_t &b){
+        return a.duration_ms < b.duration_ms;
+    });
+    size_t num = std::min(candidates.size(), static_cast<size_t>(FIND_DB_CPU_TOP));
+    memset(record->entries, 0, sizeof(record->entries));
+    for(size_t i = 0; i < num; i++)
+        record->entries[i] = candidates[i];
+    record->num_entries = static_cast<int32_t>(num);
+}
+
+// insert or replace record in the db file at path. an invalid existing file is replaced by a fresh db.
+// with merge, entries of an existing record for the same key are kept and re-ranked together with the
+// new ones (a new entry wins over an old one of the same kernel and gks), used by partial sweeps
+static inline bool find_db_cpu_store(const char *path, const find_db_cpu_record_t *record, bool merge = false)
+{
+    std::string lock_path = std::string(path) + ".lock";
+    int lock_fd = open(lock_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(lock_fd < 0)
+        return false;
+    if(flock(lock_fd, LOCK_EX) != 0){
+        close(lock_fd);
+        return false;
+    }
+
+    find_db_cpu_t db;
+    if(!find_db_cpu_open(&db, path))
+        fprintf(stderr, "find-db %s is not valid, rewrite it\n", path);
+
+    const find_db_cpu_record_t *begin = db.records;
+    const find_db_cpu_record_t *end = db.records + db.num_records;
+    const find_db_cpu_record_t *pos = std::lower_bound(begin, end, *record,
+        [](const find_db_cpu_record_t &a, const find_db_cpu_record_t &b){ return find_db_cpu_key_cmp(&a.key, &b.key) < 0; });
+    bool replace = pos != end && find_db_cpu_key_cmp(&pos->key, &record->key) == 0;
+
+    find_db_cpu_record_t merged = *record;
+    if(merge && replace){
+        std::vector<find_db_cpu_entry_t> candidates(record->entries, record->entries + record->num_entries);
+        for(int32_t i = 0; i < pos->num_entries; i++){
+            const find_db_cpu_entry_t &old_entry = pos->entries[i];
+            bool superseded = std::any_of(record->entries, record->entries + record->num_entries,
+                [&](const find_db_cpu_entry_t &e){ return e.gks == old_entry.gks &&
+                    strncmp(e.kernel_name, old_entry.kernel_name, FIND_DB_CPU_NAME_LEN) == 0; });
+            if(!superseded)
+                candidates.push_back(old_entry);
+        }
+        find_db_cpu_rank(&merged, candidates);
+        record = &merged;
+    }
+
+    find_db_cpu_header_t header;
+    header.magic = FIND_DB_CPU_MAGIC;
+    header.version = FIND_DB_CPU_VERSION;
+    header.record_size = sizeof(find_db_cpu_record_t);
+    header.num_records = static_cast<uint32_t>(db.num_records + (replace ? 0 : 1));
+
+    std::string tmp_path = std::string(path) + ".tmp." + std::to_string(getpid());
+    FILE *fp = fopen(tmp_path.c_str(), "wb");
+    bool ok = fp != nullptr;
+    if(ok){
+        ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+        size_t num_before = pos - begin;
+        size_t num_after = end - pos - (replace ? 1 : 0);
+        if(ok && num_before)
+            ok = fwrite(begin, sizeof(find_db_cpu_record_t), num_before, fp) == num_before;
+        if(ok)
+            ok = fwrite(record, sizeof(find_db_cpu_record_t), 1, fp) == 1;
+        if(ok && num_after)
+            ok = fwrite(end - num_after, sizeof(find_db_cpu_record_t), num_after, fp) == num_after;
+        ok = (fclose(fp) == 0) && ok;
+        if(ok)
+            ok = rename(tmp_path.c_str(), path) == 0;
+        if(!ok)
+            unlink(tmp_path.c_str());
+    }
+
+    find_db_cpu_close(&db);
+    flock(lock_fd, LOCK_UN);
+    close(lock_fd);
+    return ok;
+}
+
+#endif
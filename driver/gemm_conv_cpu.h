@@ -0,0 +1,367 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _GEMM_CONV_CPU_H
+#define _GEMM_CONV_CPU_H
+
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <vector>
+#include "thread_pool_cpu.h"
+#include "sgemm_cpu.h"
+#include "naive_conv.h"
+
+/*
+ * host reference convolution lowered to sgemm_cpu. same argument order as naive_conv_*.
+ *   fwd : im2col of a chunk of output pixels, then filter x col
+ *   bwd : one gemm per filter tap (filter_tap^T x dst_grad), then scattered back (col2im).
+ *         every task owns a chunk of input channels, so the scatter has no race
+ *   wrw : every task owns a chunk of the (c, y, x) filter rows and accumulates dst_grad x col^T over n
+ * the summation order differs from naive_conv, so results match within nrms tolerance, not bitwise.
+ */
+#ifndef GEMM_CONV_CPU_COL_FLOATS
+#define GEMM_CONV_CPU_COL_FLOATS (1 << 20)     // per thread scratch limit, in floats
+#endif
+#ifndef GEMM_CONV_CPU_MIN_MACS
+#define GEMM_CONV_CPU_MIN_MACS (1 << 16)       // below this the direct conv is only a few us slower
+#endif
+
+// whether the im2col + sgemm lowering is worth it over the direct loop nest. measured faster on every
+// non depthwise shape of a few thousand macs and up, 7x-60x once the filter is 3x3 or larger
+static inline bool gemm_conv_cpu_preferred(size_t n, size_t w, size_t h, size_t c, size_t k,
+                                           size_t fx, size_t fy, size_t px, size_t py, size_t sx,
+                                           size_t sy, size_t dx, size_t dy, size_t group)
+{
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    double macs = (double)n * k * (c / group) * oh * ow * fy * fx;
+    return macs >= GEMM_CONV_CPU_MIN_MACS;
+}
+
+// chunk length to split "total" into, with every chunk using chunk * row_len floats of scratch.
+// shrink the chunk until outer * num_chunks gives every thread a few tasks
+static inline size_t gemm_conv_cpu_chunk(size_t total, size_t row_len, size_t outer, size_t min_chunk)
+{
+    size_t chunk = GEMM_CONV_CPU_COL_FLOATS / (row_len == 0 ? 1 : row_len);
+    if(chunk == 0)
+        chunk = 1;
+    if(chunk > total)
+        chunk = total;
+    size_t want_tasks = 2 * thread_pool_cpu_get_num_threads();
+    while(outer * ((total + chunk - 1) / chunk) < want_tasks && chunk / 2 >= min_chunk)
+        chunk = (chunk + 1) / 2;
+    return chunk;
+}
+
+static inline float * gemm_conv_cpu_scratch(size_t size)
+{
+    static thread_local std::vector<float> scratch;
+    if(scratch.size() < size)
+        scratch.resize(size);
+    return scratch.data();
+}
+
+// col[j - j0][p - p0], j = ic * fy * fx + ir * fx + is, p = ioh * ow + iow. src points to the first channel of this group
+static inline void gemm_conv_cpu_im2col_nchw(float *col, const float *src, size_t h, size_t w, size_t fx, size_t fy,
+                                             size_t px, size_t py, size_t sx, size_t sy, size_t dx, size_t dy,
+                                             size_t ow, size_t j0, size_t j1, size_t p0, size_t p1)
+{
+    size_t np = p1 - p0;
+    for(size_t j = j0; j < j1; j++){
+        size_t ic = j / (fy * fx);
+        size_t ir = (j / fx) % fy;
+        size_t is = j % fx;
+        const float *src_c = src + ic * h * w;
+        float *col_row = col + (j - j0) * np;
+        size_t ioh = p0 / ow;
+        size_t iow = p0 % ow;
+        for(size_t p = 0; p < np; p++){
+            size_t cur_h = sy * ioh - py + dy * ir;
+            size_t cur_w = sx * iow - px + dx * is;
+            col_row[p] = (cur_h < h && cur_w < w) ? src_c[cur_h * w + cur_w] : .0f;
+            if(++iow == ow){
+                iow = 0;
+                ioh++;
+            }
+        }
+    }
+}
+
+// col[p - p0][j - j0], j = (ir * fx + is) * c_per_group + ic. src points to the first channel of this group, c is the pixel stride
+static inline void gemm_conv_cpu_im2col_nhwc(float *col, const float *src, size_t h, size_t w, size_t c, size_t c_per_group,
+                                             size_t fx, size_t fy, size_t px, size_t py, size_t sx, size_t sy, size_t dx, size_t dy,
+                                             size_t ow, size_t j0, size_t j1, size_t p0, size_t p1)
+{
+    size_t nj = j1 - j0;
+    (void)fy;
+    for(size_t p = p0; p < p1; p++){
+        size_t ioh = p / ow;
+        size_t iow = p % ow;
+        float *col_row = col + (p - p0) * nj;
+        size_t j = j0;
+        while(j < j1){
+            size_t tap = j / c_per_group;
+            size_t ic = j % c_per_group;
+            size_t len = c_per_group - ic < j1 - j ? c_per_group - ic : j1 - j;
+            size_t cur_h = sy * ioh - py + dy * (tap / fx);
+            size_t cur_w = sx * iow - px + dx * (tap % fx);
+            if(cur_h < h && cur_w < w)
+                memcpy(col_row + j - j0, src + (cur_h * w + cur_w) * c + ic, len * sizeof(float));
+            else
+                memset(col_row + j - j0, 0, len * sizeof(float));
+            j += len;
+        }
+    }
+}
+
+static inline void gemm_conv_fwd_nchw(const float *src, const float *filter,
+                                      float *dst, size_t n, size_t w, size_t h,
+                                      size_t c, size_t k, size_t fx, size_t fy,
+                                      size_t px, size_t py, size_t sx,
+                                      size_t sy, size_t dx, size_t dy, size_t group) {
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    size_t crs = c_per_group * fy * fx;
+    size_t ohw = oh * ow;
+    size_t chunk = gemm_conv_cpu_chunk(ohw, crs, group * n, 16);
+    size_t num_chunks = (ohw + chunk - 1) / chunk;
+
+    thread_pool_cpu_get().run(group * n * num_chunks, [&](size_t task){
+        size_t ig = task / (n * num_chunks);
+        size_t in = (task / num_chunks) % n;
+        size_t p0 = (task % num_chunks) * chunk;
+        size_t p1 = p0 + chunk < ohw ? p0 + chunk : ohw;
+        float *col = gemm_conv_cpu_scratch(crs * (p1 - p0));
+        gemm_conv_cpu_im2col_nchw(col, src + (in * c + ig * c_per_group) * h * w, h, w, fx, fy,
+                                  px, py, sx, sy, dx, dy, ow, 0, crs, p0, p1);
+        sgemm_cpu(k_per_group, p1 - p0, crs,
+                  filter + ig * k_per_group * crs, crs, 1,
+                  col, p1 - p0, 1,
+                  dst + (in * k + ig * k_per_group) * ohw + p0, ohw, 1);
+    });
+}
+
+static inline void gemm_conv_fwd_nhwc(const float *src, const float *filter,
+                                      float *dst, size_t n, size_t w, size_t h,
+                                      size_t c, size_t k, size_t fx, size_t fy,
+                                      size_t px, size_t py, size_t sx,
+                                      size_t sy, size_t dx, size_t dy, size_t group) {
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    size_t crs = c_per_group * fy * fx;
+    size_t ohw = oh * ow;
+    size_t chunk = gemm_conv_cpu_chunk(ohw, crs, group * n, 16);
+    size_t num_chunks = (ohw + chunk - 1) / chunk;
+
+    thread_pool_cpu_get().run(group * n * num_chunks, [&](size_t task){
+        size_t ig = task / (n * num_chunks);
+        size_t in = (task / num_chunks) % n;
+        size_t p0 = (task % num_chunks) * chunk;
+        size_t p1 = p0 + chunk < ohw ? p0 + chunk : ohw;
+        float *col = gemm_conv_cpu_scratch(crs * (p1 - p0));
+        gemm_conv_cpu_im2col_nhwc(col, src + in * h * w * c + ig * c_per_group, h, w, c, c_per_group,
+                                  fx, fy, px, py, sx, sy, dx, dy, ow, 0, crs, p0, p1);
+        sgemm_cpu(p1 - p0, k_per_group, crs,
+                  col, crs, 1,
+                  filter + ig * k_per_group * crs, 1, crs,
+                  dst + (in * ohw + p0) * k + ig * k_per_group, k, 1);
+    });
+}
+
+static inline void gemm_conv_bwd_nchw(float *src_grad, const float *filter,
+                                      const float *dst_grad, size_t n,
+                                      size_t w, size_t h, size_t c, size_t k,
+                                      size_t fx, size_t fy, size_t px,
+                                      size_t py, size_t sx, size_t sy,
+                                      size_t dx, size_t dy, size_t group) {
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    size_t rs = fy * fx;
+    size_t crs = c_per_group * rs;
+    size_t ohw = oh * ow;
+    size_t chunk = gemm_conv_cpu_chunk(c_per_group, ohw, group * n, 1);
+    size_t num_chunks = (c_per_group + chunk - 1) / chunk;
+
+    thread_pool_cpu_get().run(group * n * num_chunks, [&](size_t task){
+        size_t ig = task / (n * num_chunks);
+        size_t in = (task / num_chunks) % n;
+        size_t c0 = (task % num_chunks) * chunk;
+        size_t cc = c0 + chunk < c_per_group ? chunk : c_per_group - c0;
+        float *grad = gemm_conv_cpu_scratch(cc * ohw);
+        float *src_grad_c = src_grad + (in * c + ig * c_per_group + c0) * h * w;
+        memset(src_grad_c, 0, cc * h * w * sizeof(float));
+        for(size_t ir = 0; ir < fy; ir++){
+            for(size_t is = 0; is < fx; is++){
+                sgemm_cpu(cc, ohw, k_per_group,
+                          filter + ig * k_per_group * crs + c0 * rs + ir * fx + is, rs, crs,
+                          dst_grad + (in * k + ig * k_per_group) * ohw, ohw, 1,
+                          grad, ohw, 1);
+                for(size_t ic = 0; ic < cc; ic++){
+                    const float *grad_c = grad + ic * ohw;
+                    float *src_grad_cc = src_grad_c + ic * h * w;
+                    for(size_t ioh = 0; ioh < oh; ioh++){
+                        size_t cur_h = sy * ioh - py + dy * ir;
+                        if(cur_h >= h)
+                            continue;
+                        for(size_t iow = 0; iow < ow; iow++){
+                            size_t cur_w = sx * iow - px + dx * is;
+                            if(cur_w >= w)
+                                continue;
+                            src_grad_cc[cur_h * w + cur_w] += grad_c[ioh * ow + iow];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+static inline void gemm_conv_bwd_nhwc(float *src_grad, const float *filter,
+                                      const float *dst_grad, size_t n,
+                                      size_t w, size_t h, size_t c, size_t k,
+                                      size_t fx, size_t fy, size_t px,
+                                      size_t py, size_t sx, size_t sy,
+                                      size_t dx, size_t dy, size_t group) {
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    size_t crs = c_per_group * fy * fx;
+    size_t ohw = oh * ow;
+    size_t chunk = gemm_conv_cpu_chunk(c_per_group, ohw, group * n, 8);
+    size_t num_chunks = (c_per_group + chunk - 1) / chunk;
+
+    thread_pool_cpu_get().run(group * n * num_chunks, [&](size_t task){
+        size_t ig = task / (n * num_chunks);
+        size_t in = (task / num_chunks) % n;
+        size_t c0 = (task % num_chunks) * chunk;
+        size_t cc = c0 + chunk < c_per_group ? chunk : c_per_group - c0;
+        float *grad = gemm_conv_cpu_scratch(ohw * cc);
+        float *src_grad_c = src_grad + in * h * w * c + ig * c_per_group + c0;
+        for(size_t i = 0; i < h * w; i++)
+            memset(src_grad_c + i * c, 0, cc * sizeof(float));
+        for(size_t ir = 0; ir < fy; ir++){
+            for(size_t is = 0; is < fx; is++){
+                sgemm_cpu(ohw, cc, k_per_group,
+                          dst_grad + in * ohw * k + ig * k_per_group, k, 1,
+                          filter + ig * k_per_group * crs + (ir * fx + is) * c_per_group + c0, crs, 1,
+                          grad, cc, 1);
+                for(size_t ioh = 0; ioh < oh; ioh++){
+                    size_t cur_h = sy * ioh - py + dy * ir;
+                    if(cur_h >= h)
+                        continue;
+                    for(size_t iow = 0; iow < ow; iow++){
+                        size_t cur_w = sx * iow - px + dx * is;
+                        if(cur_w >= w)
+                            continue;
+                        const float *grad_p = grad + (ioh * ow + iow) * cc;
+                        float *src_grad_p = src_grad_c + (cur_h * w + cur_w) * c;
+                        for(size_t ic = 0; ic < cc; ic++)
+                            src_grad_p[ic] += grad_p[ic];
+                    }
+                }
+            }
+        }
+    });
+}
+
+static inline void gemm_conv_wrw_nchw(const float *src, float *filter_grad,
+                                      const float *dst_grad, size_t n,
+                                      size_t w, size_t h, size_t c, size_t k,
+                                      size_t fx, size_t fy, size_t px,
+                                      size_t py, size_t sx, size_t sy,
+                                      size_t dx, size_t dy, size_t group) {
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    size_t crs = c_per_group * fy * fx;
+    size_t ohw = oh * ow;
+    size_t chunk = gemm_conv_cpu_chunk(crs, ohw, group, 4);
+    size_t num_chunks = (crs + chunk - 1) / chunk;
+
+    thread_pool_cpu_get().run(group * num_chunks, [&](size_t task){
+        size_t ig = task / num_chunks;
+        size_t j0 = (task % num_chunks) * chunk;
+        size_t j1 = j0 + chunk < crs ? j0 + chunk : crs;
+        float *col = gemm_conv_cpu_scratch((j1 - j0) * ohw);
+        for(size_t in = 0; in < n; in++){
+            gemm_conv_cpu_im2col_nchw(col, src + (in * c + ig * c_per_group) * h * w, h, w, fx, fy,
+                                      px, py, sx, sy, dx, dy, ow, j0, j1, 0, ohw);
+            sgemm_cpu(k_per_group, j1 - j0, ohw,
+                      dst_grad + (in * k + ig * k_per_group) * ohw, ohw, 1,
+                      col, 1, ohw,
+                      filter_grad + ig * k_per_group * crs + j0, crs, 1,
+                      in != 0);
+        }
+    });
+}
+
+static inline void gemm_conv_wrw_nhwc(const float *src, float *filter_grad,
+                                      const float *dst_grad, size_t n,
+                                      size_t w, size_t h, size_t c, size_t k,
+                                      size_t fx, size_t fy, size_t px,
+                                      size_t py, size_t sx, size_t sy,
+                                      size_t dx, size_t dy, size_t group) {
+    size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+    size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    size_t crs = c_per_group * fy * fx;
+    size_t ohw = oh * ow;
+    size_t chunk = gemm_conv_cpu_chunk(crs, ohw, group, 8);
+    size_t num_chunks = (crs + chunk - 1) / chunk;
+
+    thread_pool_cpu_get().run(group * num_chunks, [&](size_t task){
+        size_t ig = task / num_chunks;
+        size_t j0 = (task % num_chunks) * chunk;
+        size_t j1 = j0 + chunk < crs ? j0 + chunk : crs;
+        float *col = gemm_conv_cpu_scratch(ohw * (j1 - j0));
+        for(size_t in = 0; in < n; in++){
+            gemm_conv_cpu_im2col_nhwc(col, src + in * h * w * c + ig * c_per_group, h, w, c, c_per_group,
+                                      fx, fy, px, py, sx, sy, dx, dy, ow, j0, j1, 0, ohw);
+            sgemm_cpu(k_per_group, j1 - j0, ohw,
+                      dst_grad + in * ohw * k + ig * k_per_group, 1, k,
+                      col, j1 - j0, 1,
+                      filter_grad + ig * k_per_group * crs + j0, crs, 1,
+                      in != 0);
+        }
+    });
+}
+
+#endif
@@ -601,11 +601,7 @@ public:
             use_workspace = 0;
 
         size_t workspace_size = get_workspace_size(arg, tunable);
-        void *p_in_workspace;
-        if(workspace_size == 0)
-            p_in_workspace = nullptr;
-        else
-            HIP_CALL(hipMalloc(&p_in_workspace, workspace_size));
+        void *p_in_workspace = igemm_device_arena_acquire(workspace_size);    // nullptr if 0
 
         size_t karg_size = 0;
         uint8_t karg_buffer[IGEMM_BWD_GTC_MAX_KARG_SIZE];
@@ -963,7 +959,7 @@ public:
 #ifdef IGEMM_SPLIT_KERNEL
         HIP_CALL(hipModuleUnload(cur_kernel_module));
 #endif
-        hipFree(p_in_workspace);
+        igemm_device_arena_get()->release(p_in_workspace);
         usleep(1000 * 5);
         return result;
     }
@@ -573,11 +573,7 @@ public:
             use_workspace = 0;
 
         size_t workspace_size = get_workspace_size(arg, tunable);
-        void *p_out_workspace;
-        if(workspace_size == 0)
-            p_out_workspace = nullptr;
-        else
-            HIP_CALL(hipMalloc(&p_out_workspace, workspace_size));
+        void *p_out_workspace = igemm_device_arena_acquire(workspace_size);    // nullptr if 0
 
         if(tunable->tensor_layout == "nchw"){
             igemm_fwd_gtc_karg_t karg;
@@ -891,7 +887,7 @@ public:
 #ifdef IGEMM_SPLIT_KERNEL
         HIP_CALL(hipModuleUnload(cur_kernel_module));
 #endif
-        hipFree(p_out_workspace);
+        igemm_device_arena_get()->release(p_out_workspace);
         usleep(1000 * 5);
         return result;
     }
@@ -37,6 +37,7 @@ using float16 = int16_t;
 #include <hip/hip_ext.h>
 #include <hip/hip_runtime.h>
 #include "config_parser.h"
+#include "buffer_arena_cpu.h"
 #include "utility.h"
 #include <string>
 #include <unistd.h>
@@ -613,6 +614,61 @@ igemm_spatial_tiling(const args_t *arg, uint32_t flag, uint32_t var)
     return tiling;
 }
 
+// process-wide arena of device buffers, the tensors of each problem and the gks workspace of each kernel run.
+// never deleted, blocks still cached at exit go with the process
+static inline buffer_arena_cpu_t * igemm_device_arena_get()
+{
+    static buffer_arena_cpu_t * arena = new buffer_arena_cpu_t(
+        [](size_t bytes, int *kind) -> void * {
+            void *ptr;
+            hipError_t status = hipMalloc(&ptr, bytes);
+            if(status == hipErrorOutOfMemory)
+                return nullptr;     // the arena gives back its cached blocks and retries
+            HIP_CALL(status);
+            return ptr;
+        },
+        [](void *ptr, size_t bytes, int kind){
+            hipFree(ptr);
+        });
+    return arena;
+}
+
+// a device block from the arena, exits if the device is out of memory even with the cache given back
+static inline void * igemm_device_arena_acquire(size_t bytes)
+{
+    void *ptr = igemm_device_arena_get()->acquire(bytes);
+    if(bytes != 0 && !ptr){
+        printf("[hiperror] out of device memory for %zu bytes\n", bytes);
+        exit(1);
+    }
+    return ptr;
+}
+
+// process-wide arena of host buffers. pinning is opt-in: with IGEMM_HOST_PINNED_MIN_KB set, blocks of that many KB
+// or more are pinned, so the copies to and from the device skip a staging buffer. off by default, since pinning
+// commits and locks every page, also of host tensors that are never touched
+static inline buffer_arena_cpu_t * igemm_host_arena_get()
+{
+    static size_t pinned_min = static_cast<size_t>(env_get_int("IGEMM_HOST_PINNED_MIN_KB", 0)) * 1024;
+    static buffer_arena_cpu_t * arena = new buffer_arena_cpu_t(
+        [](size_t bytes, int *kind) -> void * {
+            void *ptr = nullptr;
+            if(pinned_min != 0 && bytes >= pinned_min && hipHostMalloc(&ptr, bytes, hipHostMallocDefault) == hipSuccess){
+                *kind = 1;
+                return ptr;
+            }
+            *kind = 0;
+            return malloc(bytes);
+        },
+        [](void *ptr, size_t bytes, int kind){
+            if(kind == 1)
+                hipHostFree(ptr);
+            else
+                free(ptr);
+        });
+    return arena;
+}
+
 class igemm_driver_base_t{
 public:
     igemm_driver_base_t(hipModule_t module_tensor_cast_, hipModule_t module_, driver_mode_t driver_mode_, driverDataType_t data_type_, int warmup_, int repeat_, bool verbose_) : 
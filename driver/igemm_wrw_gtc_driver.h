@@ -686,11 +686,7 @@ public:
             use_workspace = 0;
 
         size_t workspace_size = get_workspace_size(arg, tunable);
-        void *p_wei_workspace;
-        if(workspace_size == 0)
-            p_wei_workspace = nullptr;
-        else
-            HIP_CALL(hipMalloc(&p_wei_workspace, workspace_size));
+        void *p_wei_workspace = igemm_device_arena_acquire(workspace_size);    // nullptr if 0
 
         igemm_wrw_gtc_karg_t karg;
         size_t karg_size = sizeof(karg);
@@ -872,8 +868,7 @@ public:
 #ifdef IGEMM_SPLIT_KERNEL
         HIP_CALL(hipModuleUnload(cur_kernel_module));
 #endif
-        if(workspace_size > 0)
-            hipFree(p_wei_workspace);
+        igemm_device_arena_get()->release(p_wei_workspace);
         return result;
     }
     std::vector<int> get_gks_list(const args_t *arg, const igemm_gtc_tunable_t *tunable) override
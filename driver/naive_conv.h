@@ -33,26 +33,47 @@
 #include <assert.h>
 #include <thread>
 #include <vector>
-#include <functional>
+#include <stdlib.h>
+#include <string.h>
+#include "thread_pool_cpu.h"
+#include "simd_cpu.h"
+#include "conv_geometry_cpu.h"
 
-using naive_conv_threadwise_conv_5d_t = std::function<void(size_t,size_t,size_t,size_t,size_t)>;
+// channel block of the per-pixel accumulators in nhwc/ndhwc bwd and wrw
+#ifndef NAIVE_CONV_C_BLOCK
+#define NAIVE_CONV_C_BLOCK 64
+#endif
 
+// each thread walks a contiguous chunk of the flattened index space. the start index is decomposed once,
+// then the per-dimension counters are advanced with carry, so there is no div/mod per element.
+// the per-pixel functor is a template argument, so it is inlined into the loop.
+template<class threadwise_t>
 class naive_conv_blockwise_5d_t{
 public:
-    naive_conv_blockwise_5d_t(naive_conv_threadwise_conv_5d_t f):mf(f){}
-    void operator()(size_t thread_id, size_t block_size,
-        size_t d0, size_t d1, size_t d2, size_t d3, size_t d4)
+    naive_conv_blockwise_5d_t(const threadwise_t & f):mf(f){}
+    void operator()(size_t begin, size_t end,
+        size_t d0, size_t d1, size_t d2, size_t d3, size_t d4) const
     {
-        size_t total_length = d0 * d1 * d2 * d3 * d4;
-        for(size_t tid = thread_id; tid<total_length ; tid += block_size){
-            size_t id0, id1, id2, id3, id4;
-            get_index_5d(tid, d0, d1, d2, d3, d4, &id0, &id1, &id2, &id3, &id4);
+        if(begin >= end)
+            return;
+        size_t id0, id1, id2, id3, id4;
+        get_index_5d(begin, d0, d1, d2, d3, d4, &id0, &id1, &id2, &id3, &id4);
+        for(size_t tid = begin; tid < end; tid++){
             mf(id0, id1, id2, id3, id4);
+            if(++id4 < d4) continue;
+            id4 = 0;
+            if(++id3 < d3) continue;
+            id3 = 0;
+            if(++id2 < d2) continue;
+            id2 = 0;
+            if(++id1 < d1) continue;
+            id1 = 0;
+            ++id0;
         }
     }
 private:
-    naive_conv_threadwise_conv_5d_t mf;
-    void get_index_5d(size_t idx, size_t d0, size_t d1, size_t d2, size_t d3, size_t d4,
+    const threadwise_t & mf;
+    static void get_index_5d(size_t idx, size_t d0, size_t d1, size_t d2, size_t d3, size_t d4,
                         size_t *id0, size_t *id1, size_t *id2, size_t *id3, size_t *id4)
     {
         *id4 = idx % d4;
@@ -64,24 +85,35 @@ private:
     }
 };
 
-using naive_conv_threadwise_conv_6d_t = std::function<void(size_t,size_t,size_t,size_t,size_t,size_t)>;
-
+template<class threadwise_t>
 class naive_conv_blockwise_6d_t{
 public:
-    naive_conv_blockwise_6d_t(naive_conv_threadwise_conv_6d_t f):mf(f){}
-    void operator()(size_t thread_id, size_t block_size,
-        size_t d0, size_t d1, size_t d2, size_t d3, size_t d4, size_t d5)
+    naive_conv_blockwise_6d_t(const threadwise_t & f):mf(f){}
+    void operator()(size_t begin, size_t end,
+        size_t d0, size_t d1, size_t d2, size_t d3, size_t d4, size_t d5) const
     {
-        size_t total_length = d0 * d1 * d2 * d3 * d4 * d5;
-        for(size_t tid = thread_id; tid<total_length ; tid += block_size){
-            size_t id0, id1, id2, id3, id4, id5;
-            get_index_6d(tid, d0, d1, d2, d3, d4, d5, &id0, &id1, &id2, &id3, &id4, &id5);
+        if(begin >= end)
+            return;
+        size_t id0, id1, id2, id3, id4, id5;
+        get_index_6d(begin, d0, d1, d2, d3, d4, d5, &id0, &id1, &id2, &id3, &id4, &id5);
+        for(size_t tid = begin; tid < end; tid++){
             mf(id0, id1, id2, id3, id4, id5);
+            if(++id5 < d5) continue;
+            id5 = 0;
+            if(++id4 < d4) continue;
+            id4 = 0;
+            if(++id3 < d3) continue;
+            id3 = 0;
+            if(++id2 < d2) continue;
+            id2 = 0;
+            if(++id1 < d1) continue;
+            id1 = 0;
+            ++id0;
         }
     }
 private:
-    naive_conv_threadwise_conv_6d_t mf;
-    void get_index_6d(size_t idx, size_t d0, size_t d1, size_t d2, size_t d3, size_t d4, size_t d5,
+    const threadwise_t & mf;
+    static void get_index_6d(size_t idx, size_t d0, size_t d1, size_t d2, size_t d3, size_t d4, size_t d5,
                         size_t *id0, size_t *id1, size_t *id2, size_t *id3, size_t *id4, size_t *id5)
     {
         *id5 = idx % d5;
@@ -94,28 +126,101 @@ private:
     }
 };
 
-template<class blockwise_t, class threadwise_t, class... args_t>
-void naive_conv_blockwise_in_parallel(threadwise_t thread_func, args_t... args)
+template<class threadwise_t>
+static inline void naive_conv_blockwise_in_parallel_5d(const threadwise_t & thread_func,
+    size_t d0, size_t d1, size_t d2, size_t d3, size_t d4){
+    naive_conv_blockwise_5d_t<threadwise_t> blockwise(thread_func);
+    thread_pool_cpu_parallel_for(d0 * d1 * d2 * d3 * d4, [&](size_t begin, size_t end){
+        blockwise(begin, end, d0, d1, d2, d3, d4);
+    });
+}
+
+template<class threadwise_t>
+static inline void naive_conv_blockwise_in_parallel_6d(const threadwise_t & thread_func,
+    size_t d0, size_t d1, size_t d2, size_t d3, size_t d4, size_t d5){
+    naive_conv_blockwise_6d_t<threadwise_t> blockwise(thread_func);
+    thread_pool_cpu_parallel_for(d0 * d1 * d2 * d3 * d4 * d5, [&](size_t begin, size_t end){
+        blockwise(begin, end, d0, d1, d2, d3, d4, d5);
+    });
+}
+
+// wrw reduces over n * output rows for every filter element. when there are too few filter tasks to keep
+// the threads busy, the rows are also cut into slices, each slice sums into its own copy of the filter grad,
+// and the copies are merged pairwise in a fixed tree order. the number of slices depends on the shape only,
+// so the result is the same for any number of threads.
+//
+// IGEMM_CPU_WRW_SPLIT : force the number of slices, 1 is no split. default picks by shape
+#ifndef NAIVE_CONV_WRW_SPLIT_TASKS
+#define NAIVE_CONV_WRW_SPLIT_TASKS 256      // split until there are this many (slice, filter) tasks
+#endif
+static inline size_t naive_conv_wrw_get_splits(size_t tasks, size_t rows)
 {
-    int num_threads = std::thread::hardware_concurrency();
-    std::vector<std::thread> threads(num_threads);
+    size_t splits = 1;
+    char *v = getenv("IGEMM_CPU_WRW_SPLIT");
+    if(v && atoi(v) > 0)
+        splits = atoi(v);
+    else
+        while(splits * tasks < NAIVE_CONV_WRW_SPLIT_TASKS && splits * 2 <= rows)
+            splits *= 2;
+    return splits < rows ? splits : rows;
+}
 
-    for(size_t tid = 0; tid < num_threads; tid++)
-        threads[tid] = std::thread(blockwise_t(thread_func), tid, num_threads, args...);
-    for(size_t tid = 0; tid < num_threads; tid++)
-        threads[tid].join();
+// range_func(r_begin, r_end, grad, begin, end) sums rows [r_begin, r_end) into grad for tasks [begin, end)
+template<class range_t>
+static inline void naive_conv_wrw_split_reduce(const range_t & range_func, float *filter_grad, size_t filter_size,
+    size_t tasks, size_t rows, size_t splits){
+    if(splits <= 1){
+        thread_pool_cpu_parallel_for(tasks, [&](size_t begin, size_t end){
+            range_func(0, rows, filter_grad, begin, end);
+        });
+        return;
+    }
+    // slice 0 sums into filter_grad directly
+    std::vector<float> partial((splits - 1) * filter_size);
+    auto grad_of = [&](size_t split){
+        return split == 0 ? filter_grad : partial.data() + (split - 1) * filter_size;
+    };
+    thread_pool_cpu_parallel_for(splits * tasks, [&](size_t begin, size_t end){
+        while(begin < end){
+            size_t split = begin / tasks;
+            size_t split_end = (split + 1) * tasks < end ? (split + 1) * tasks : end;
+            range_func(rows * split / splits, rows * (split + 1) / splits, grad_of(split),
+                       begin - split * tasks, split_end - split * tasks);
+            begin = split_end;
+        }
+    });
+    thread_pool_cpu_parallel_for(filter_size, [&](size_t begin, size_t end){
+        for(size_t stride = 1; stride < splits; stride *= 2)
+            for(size_t split = 0; split + stride < splits; split += 2 * stride)
+                simd_cpu_axpy_f32(grad_of(split) + begin, 1.0f, grad_of(split + stride) + begin, end - begin);
+    });
 }
 
-static inline void naive_conv_blockwise_in_parallel_5d(naive_conv_threadwise_conv_5d_t && thread_func,
-    size_t d0, size_t d1, size_t d2, size_t d3, size_t d4){
-    naive_conv_blockwise_in_parallel<naive_conv_blockwise_5d_t, naive_conv_threadwise_conv_5d_t,
-            size_t, size_t, size_t, size_t, size_t>(thread_func, d0, d1, d2, d3, d4);
+// row_func(r_begin, r_end, grad, id0, ..., id4) computes filter element (id0, ..., id4) over rows [r_begin, r_end)
+template<class rowwise_t>
+static inline void naive_conv_wrw_in_parallel_5d(const rowwise_t & row_func, float *filter_grad, size_t filter_size,
+    size_t rows, size_t d0, size_t d1, size_t d2, size_t d3, size_t d4){
+    size_t tasks = d0 * d1 * d2 * d3 * d4;
+    naive_conv_wrw_split_reduce([&](size_t r_begin, size_t r_end, float *grad, size_t begin, size_t end){
+        auto thread_func = [&](size_t id0, size_t id1, size_t id2, size_t id3, size_t id4){
+            row_func(r_begin, r_end, grad, id0, id1, id2, id3, id4);
+        };
+        naive_conv_blockwise_5d_t<decltype(thread_func)> blockwise(thread_func);
+        blockwise(begin, end, d0, d1, d2, d3, d4);
+    }, filter_grad, filter_size, tasks, rows, naive_conv_wrw_get_splits(tasks, rows));
 }
 
-static inline void naive_conv_blockwise_in_parallel_6d(naive_conv_threadwise_conv_6d_t && thread_func,
-    size_t d0, size_t d1, size_t d2, size_t d3, size_t d4, size_t d5){
-    naive_conv_blockwise_in_parallel<naive_conv_blockwise_6d_t, naive_conv_threadwise_conv_6d_t,
-            size_t, size_t, size_t, size_t, size_t, size_t>(thread_func, d0, d1, d2, d3, d4, d5);
+template<class rowwise_t>
+static inline void naive_conv_wrw_in_parallel_6d(const rowwise_t & row_func, float *filter_grad, size_t filter_size,
+    size_t rows, size_t d0, size_t d1, size_t d2, size_t d3, size_t d4, size_t d5){
+    size_t tasks = d0 * d1 * d2 * d3 * d4 * d5;
+    naive_conv_wrw_split_reduce([&](size_t r_begin, size_t r_end, float *grad, size_t begin, size_t end){
+        auto thread_func = [&](size_t id0, size_t id1, size_t id2, size_t id3, size_t id4, size_t id5){
+            row_func(r_begin, r_end, grad, id0, id1, id2, id3, id4, id5);
+        };
+        naive_conv_blockwise_6d_t<decltype(thread_func)> blockwise(thread_func);
+        blockwise(begin, end, d0, d1, d2, d3, d4, d5);
+    }, filter_grad, filter_size, tasks, rows, naive_conv_wrw_get_splits(tasks, rows));
 }
 
 #endif
@@ -135,25 +240,24 @@ static inline void naive_conv_fwd_nchw(const float *src, const float *filter,
     size_t k_per_group = k / group;
     size_t c_per_group = c / group;
 #ifdef NAIVE_CONV_THREADED
+    conv_geometry_cpu_t geo(n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
     auto conv_one_pixel = [&](size_t ig, size_t in, size_t ik, size_t ioh, size_t iow){
-        size_t ic, is, ir, cur_h, cur_w, o_idx, i_idx, f_idx;
+        size_t ic, is, ir, o_idx;
+        size_t ir_begin = geo.y.tap_begin(ioh), nr = geo.y.tap_end(ioh) - ir_begin;
+        size_t is_begin = geo.x.tap_begin(iow), ns = geo.x.tap_end(iow) - is_begin;
         float value = .0f;
         o_idx = in * k * oh * ow + ig * k_per_group * oh * ow + ik * oh * ow + ioh * ow + iow;
-        for (ic = 0; ic < c_per_group; ic++) {
-            for (ir = 0; ir < fy; ir++) {
-                cur_h = sy * ioh - py + dy * ir;
-                if (cur_h < 0 || cur_h >= h)
-                    continue;
-                for (is = 0; is < fx; is++) {
-                    cur_w = sx * iow - px + dx * is;
-                    if (cur_w < 0 || cur_w >= w)
-                        continue;
-                    i_idx = in * c * h * w + ig * c_per_group * h * w + ic * h * w +
-                            cur_h * w + cur_w;
-                    f_idx = ig * k_per_group * c_per_group * fy * fx + ik * c_per_group * fy * fx + ic * fy * fx +
-                            ir * fx + is;
-                    value += src[i_idx] * filter[f_idx];
+        if (nr != 0 && ns != 0) {
+            const float *src_p = src + in * c * h * w + ig * c_per_group * h * w + geo.y.in_first(ioh) * w + geo.x.in_first(iow);
+            const float *filter_p = filter + ig * k_per_group * c_per_group * fy * fx + ik * c_per_group * fy * fx +
+                                    ir_begin * fx + is_begin;
+            for (ic = 0; ic < c_per_group; ic++) {
+                for (ir = 0; ir < nr; ir++) {
+                    for (is = 0; is < ns; is++)
+                        value += src_p[ir * dy * w + is * dx] * filter_p[ir * fx + is];
                 }
+                src_p += h * w;
+                filter_p += fy * fx;
             }
         }
         dst[o_idx] = value;
@@ -208,29 +312,23 @@ static inline void naive_conv_bwd_nchw(float *src_grad, const float *filter,
     size_t k_per_group = k / group;
     size_t c_per_group = c / group;
 #ifdef NAIVE_CONV_THREADED
+    conv_geometry_cpu_t geo(n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
     auto conv_one_pixel = [&](size_t ig, size_t in, size_t ic, size_t ih, size_t iw){
         size_t ik, is, ir;
         size_t cur_oh, cur_ow, o_idx, i_idx, f_idx;
+        const conv_geometry_cpu_dim_t::tap_t *ty, *ty_begin, *ty_end, *tx, *tx_begin, *tx_end;
+        size_t base_h, base_w;
         float value = .0f;
+        geo.y.bwd_taps(ih, &ty_begin, &ty_end, &base_h);
+        geo.x.bwd_taps(iw, &tx_begin, &tx_end, &base_w);
         i_idx = in * c * h * w + ig * c_per_group * h * w + ic * h * w + ih * w + iw;
         for (ik = 0; ik < k_per_group; ik++) {
-            for (ir = 0; ir < fy; ir++) {
-                cur_oh =
-                    ih + py - dy * ir; // cur_h = sy*ioh-py+dy*ir;
-                if (cur_oh < 0 || cur_oh % sy)
-                    continue;
-                cur_oh /= sy;
-                if (cur_oh >= oh)
-                    continue;
-                for (is = 0; is < fx; is++) {
-                    cur_ow = iw + px -
-                                dx * is; // cur_w = sx*iow-px+dx*is;
-                    if (cur_ow < 0 || cur_ow % sx)
-                        continue;
-                    cur_ow /= sx;
-                    if (cur_ow >= ow)
-                        continue;
-
+            for (ty = ty_begin; ty < ty_end; ty++) {
+                ir = ty->r;
+                cur_oh = base_h - ty->q; // cur_h = sy*ioh-py+dy*ir;
+                for (tx = tx_begin; tx < tx_end; tx++) {
+                    is = tx->r;
+                    cur_ow = base_w - tx->q; // cur_w = sx*iow-px+dx*is;
                     o_idx = in * k * oh * ow + ig * k_per_group * oh * ow + ik * oh * ow + 
                             cur_oh * ow + cur_ow;
                     f_idx = ig * k_per_group * c_per_group * fy * fx + ik * c_per_group * fy * fx + ic * fy * fx +
@@ -242,7 +340,6 @@ static inline void naive_conv_bwd_nchw(float *src_grad, const float *filter,
         }
         src_grad[i_idx] = value;
     };
-    // naive_conv_blockwise_in_parallel(conv_one_pixel, n, c, h, w);
     naive_conv_blockwise_in_parallel_5d(conv_one_pixel, group, n, c_per_group, h, w);
 #else
     size_t ig, in, ik, ih, iw, ic, is, ir;
@@ -303,32 +400,27 @@ static inline void naive_conv_wrw_nchw(const float *src, float *filter_grad,
     size_t k_per_group = k / group;
     size_t c_per_group = c / group;
 #ifdef NAIVE_CONV_THREADED
-    auto conv_one_pixel = [&](size_t ig, size_t ik, size_t ic, size_t ir, size_t is){
-        size_t in, ioh, iow;
-        size_t cur_h, cur_w, o_idx, i_idx, f_idx;
+    conv_geometry_cpu_t geo(n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    auto conv_one_pixel = [&](size_t r_begin, size_t r_end, float *grad, size_t ig, size_t ik, size_t ic, size_t ir, size_t is){
+        size_t in, ioh, iow, row, f_idx;
+        size_t ow_begin = geo.x.out_begin(is), ow_end = geo.x.out_end(is);
         float value = .0f;
         f_idx = ig * k_per_group * c_per_group * fy * fx + ik * c_per_group * fy * fx + ic * fy * fx + ir * fx + is;
-        for (in = 0; in < n; in++) {
-            for (ioh = 0; ioh < oh; ioh++) {
-                cur_h = sy * ioh - py + dy * ir;
-                if (cur_h < 0 || cur_h >= h)
-                    continue;
-                for (iow = 0; iow < ow; iow++) {
-                    cur_w = sx * iow - px + dx * is;
-                    if (cur_w < 0 || cur_w >= w)
-                        continue;
-                    i_idx = in * c * h * w + ig * c_per_group * h * w + ic * h * w +
-                            cur_h * w + cur_w;
-                    o_idx = in * k * oh * ow + ig * k_per_group * oh * ow + ik * oh * ow +
-                            ioh * ow + iow;
-                    value += src[i_idx] * dst_grad[o_idx];
-                }
-            }
+        for (row = r_begin; row < r_end; row++) {
+            in = row / oh;
+            ioh = row % oh;
+            if (ioh < geo.y.out_begin(ir) || ioh >= geo.y.out_end(ir) || ow_begin == ow_end)
+                continue;
+            const float *src_p = src + in * c * h * w + ig * c_per_group * h * w + ic * h * w +
+                                 geo.y.in_of(ioh, ir) * w + geo.x.in_of(ow_begin, is);
+            const float *dst_grad_p = dst_grad + in * k * oh * ow + ig * k_per_group * oh * ow + ik * oh * ow + ioh * ow;
+            for (iow = ow_begin; iow < ow_end; iow++)
+                value += src_p[(iow - ow_begin) * sx] * dst_grad_p[iow];
         }
-        filter_grad[f_idx] = value;
+        grad[f_idx] = value;
     };
-    // naive_conv_blockwise_in_parallel(conv_one_pixel, k, c, fy, fx);
-    naive_conv_blockwise_in_parallel_5d(conv_one_pixel, group, k_per_group, c_per_group, fy, fx);
+    naive_conv_wrw_in_parallel_5d(conv_one_pixel, filter_grad, k * c_per_group * fy * fx, n * oh,
+                                  group, k_per_group, c_per_group, fy, fx);
 #else
     size_t ig, in, ik, ioh, iow, ic, is, ir;
     size_t cur_h, cur_w, o_idx, i_idx, f_idx;
@@ -378,28 +470,28 @@ static inline void naive_conv_fwd_ncdhw(const float *src, const float *filter, f
     size_t k_per_group = k / group;
     size_t c_per_group = c / group;
 #ifdef NAIVE_CONV_THREADED
+    conv_geometry_cpu_t geo(n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
     auto conv_one_pixel = [&](size_t ig, size_t in, size_t ik, size_t iod, size_t ioh, size_t iow){
-        size_t ic, iz, is, ir, cur_d, cur_h, cur_w, o_idx, i_idx, f_idx;
+        size_t ic, iz, is, ir, o_idx;
+        size_t iz_begin = geo.z.tap_begin(iod), nz = geo.z.tap_end(iod) - iz_begin;
+        size_t ir_begin = geo.y.tap_begin(ioh), nr = geo.y.tap_end(ioh) - ir_begin;
+        size_t is_begin = geo.x.tap_begin(iow), ns = geo.x.tap_end(iow) - is_begin;
         float value = .0f;
         o_idx = in * k * od * oh * ow + ig * k_per_group * od * oh * ow + ik * od * oh * ow + iod * oh * ow + ioh * ow + iow;
-        for (ic = 0; ic < c_per_group; ic++) {
-            for (iz = 0; iz < fz; iz++) {
-                cur_d = sz * iod - pz + dz * iz;
-                if (cur_d < 0 || cur_d >= d)
-                    continue;
-                for (ir = 0; ir < fy; ir++) {
-                    cur_h = sy * ioh - py + dy * ir;
-                    if (cur_h < 0 || cur_h >= h)
-                        continue;
-                    for (is = 0; is < fx; is++) {
-                        cur_w = sx * iow - px + dx * is;
-                        if (cur_w < 0 || cur_w >= w)
-                            continue;
-                        i_idx = in * c * d * h * w + ig * c_per_group * d * h * w + ic * d * h * w + cur_d * h * w + cur_h * w + cur_w;
-                        f_idx = ig * k_per_group * c_per_group * fz * fy * fx + ik * c_per_group * fz * fy * fx + ic * fz * fy * fx + iz * fy * fx + ir * fx + is;
-                        value += src[i_idx] * filter[f_idx];
+        if (nz != 0 && nr != 0 && ns != 0) {
+            const float *src_p = src + in * c * d * h * w + ig * c_per_group * d * h * w +
+                                 geo.z.in_first(iod) * h * w + geo.y.in_first(ioh) * w + geo.x.in_first(iow);
+            const float *filter_p = filter + ig * k_per_group * c_per_group * fz * fy * fx + ik * c_per_group * fz * fy * fx +
+                                    iz_begin * fy * fx + ir_begin * fx + is_begin;
+            for (ic = 0; ic < c_per_group; ic++) {
+                for (iz = 0; iz < nz; iz++) {
+                    for (ir = 0; ir < nr; ir++) {
+                        for (is = 0; is < ns; is++)
+                            value += src_p[iz * dz * h * w + ir * dy * w + is * dx] * filter_p[iz * fy * fx + ir * fx + is];
                     }
                 }
+                src_p += d * h * w;
+                filter_p += fz * fy * fx;
             }
         }
         dst[o_idx] = value;
@@ -458,34 +550,27 @@ static inline void naive_conv_bwd_ncdhw(float *src_grad, const float *filter, co
     size_t k_per_group = k / group;
     size_t c_per_group = c / group;
 #ifdef NAIVE_CONV_THREADED
+    conv_geometry_cpu_t geo(n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
     auto conv_one_pixel = [&](size_t ig, size_t in, size_t ic, size_t id, size_t ih, size_t iw){
         size_t ik, iz, is, ir;
         size_t cur_od, cur_oh, cur_ow, o_idx, i_idx, f_idx;
+        const conv_geometry_cpu_dim_t::tap_t *tz, *tz_begin, *tz_end, *ty, *ty_begin, *ty_end, *tx, *tx_begin, *tx_end;
+        size_t base_d, base_h, base_w;
         float value = .0f;
+        geo.z.bwd_taps(id, &tz_begin, &tz_end, &base_d);
+        geo.y.bwd_taps(ih, &ty_begin, &ty_end, &base_h);
+        geo.x.bwd_taps(iw, &tx_begin, &tx_end, &base_w);
         i_idx = in * c * d * h * w + ig * c_per_group * d * h * w + ic * d * h * w + id * h * w + ih * w + iw;
         for (ik = 0; ik < k_per_group; ik++) {
-            for (iz = 0; iz < fz; iz++) {
-                cur_od = id + pz - dz * iz;
-                if (cur_od < 0 || cur_od % sz)
-                    continue;
-                cur_od /= sz;
-                if (cur_od >= od)
-                    continue;
-                for (ir = 0; ir < fy; ir++) {
-                    cur_oh = ih + py - dy * ir; // cur_h = sy*ioh-py+dy*ir;
-                    if (cur_oh < 0 || cur_oh % sy)
-                        continue;
-                    cur_oh /= sy;
-                    if (cur_oh >= oh)
-                        continue;
-                    for (is = 0; is < fx; is++) {
-                        cur_ow = iw + px - dx * is; // cur_w = sx*iow-px+dx*is;
-                        if (cur_ow < 0 || cur_ow % sx)
-                            continue;
-                        cur_ow /= sx;
-                        if (cur_ow >= ow)
-                            continue;
-
+            for (tz = tz_begin; tz < tz_end; tz++) {
+                iz = tz->r;
+                cur_od = base_d - tz->q;
+                for (ty = ty_begin; ty < ty_end; ty++) {
+                    ir = ty->r;
+                    cur_oh = base_h - ty->q; // cur_h = sy*ioh-py+dy*ir;
+                    for (tx = tx_begin; tx < tx_end; tx++) {
+                        is = tx->r;
+                        cur_ow = base_w - tx->q; // cur_w = sx*iow-px+dx*is;
                         o_idx = in * k * od * oh * ow + ig * k_per_group * od * oh * ow + ik * od * oh * ow + cur_od * oh * ow +
                                 cur_oh * ow + cur_ow;
                         f_idx = ig * k_per_group * c_per_group * fz * fy * fx + ik * c_per_group * fz * fy * fx + ic * fz * fy * fx + iz * fy * fx +
@@ -565,36 +650,32 @@ static inline void naive_conv_wrw_ncdhw(const float *src, float *filter_grad, co
     size_t k_per_group = k / group;
     size_t c_per_group = c / group;
 #ifdef NAIVE_CONV_THREADED
-    auto conv_one_pixel = [&](size_t ig, size_t ik, size_t ic, size_t iz, size_t ir, size_t is){
-        size_t in, iod, ioh, iow;
-        size_t cur_d, cur_h, cur_w, o_idx, i_idx, f_idx;
+    conv_geometry_cpu_t geo(n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+    auto conv_one_pixel = [&](size_t r_begin, size_t r_end, float *grad, size_t ig, size_t ik, size_t ic, size_t iz, size_t ir, size_t is){
+        size_t in, iod, ioh, iow, row, f_idx;
+        size_t oh_begin = geo.y.out_begin(ir), oh_end = geo.y.out_end(ir);
+        size_t ow_begin = geo.x.out_begin(is), ow_end = geo.x.out_end(is);
         float value = .0f;
         f_idx = ig * k_per_group * c_per_group * fz * fy * fx + ik * c_per_group * fz * fy * fx + ic * fz * fy * fx + iz * fy * fx + ir * fx + is;
-        for (in = 0; in < n; in++) {
-            for (iod = 0; iod < od; iod++) {
-                cur_d = sz * iod - pz + dz * iz;
-                if (cur_d < 0 || cur_d >= d)
-                    continue;
-                for (ioh = 0; ioh < oh; ioh++) {
-                    cur_h = sy * ioh - py + dy * ir;
-                    if (cur_h < 0 || cur_h >= h)
-                        continue;
-                    for (iow = 0; iow < ow; iow++) {
-                        cur_w = sx * iow - px + dx * is;
-                        if (cur_w < 0 || cur_w >= w)
-                            continue;
-                        i_idx = in * c * d * h * w + ig * c_per_group * d * h * w + ic * d * h * w + cur_d * h * w +
-                                cur_h * w + cur_w;
-                        o_idx = in * k * od * oh * ow + ig * k_per_group * od * oh * ow + ik * od * oh * ow + iod * oh * ow +
-                                ioh * ow + iow;
-                        value += src[i_idx] * dst_grad[o_idx];
-                    }
-                }
+        for (row = r_begin; row < r_end; row++) {
+            in = row / od;
+            iod = row % od;
+            if (iod < geo.z.out_begin(iz) || iod >= geo.z.out_end(iz) || oh_begin == oh_end || ow_begin == ow_end)
+                continue;
+            const float *src_p = src + in * c * d * h * w + ig * c_per_group * d * h * w + ic * d * h * w +
+                                 geo.z.in_of(iod, iz) * h * w + geo.y.in_of(oh_begin, ir) * w + geo.x.in_of(ow_begin, is);
+            const float *dst_grad_p = dst_grad + in * k * od * oh * ow + ig * k_per_group * od * oh * ow + ik * od * oh * ow + iod * oh * ow;
+            for (ioh = oh_begin; ioh < oh_end; ioh++) {
+                const float *src_r = src_p + (ioh - oh_begin) * sy * w;
+                const float *dst_grad_r = dst_grad_p + ioh * ow;
+                for (iow = ow_begin; iow < ow_end; iow++)
+                    value += src_r[(iow - ow_begin) * sx] * dst_grad_r[iow];
             }
         }
-        filter_grad[f_idx] = value;
+        grad[f_idx] = value;
     };
-    naive_conv_blockwise_in_parallel_6d(conv_one_pixel, group, k_per_group, c_per_group, fz, fy, fx);
+    naive_conv_wrw_in_parallel_6d(conv_one_pixel, filter_grad, k * c_per_group * fz * fy * fx, n * od,
+                                  group, k_per_group, c_per_group, fz, fy, fx);
 #else
     size_t ig, in, ik, iod, ioh, iow, ic, iz, is, ir;
     size_t cur_d, cur_h, cur_w, o_idx, i_idx, f_idx;
@@ -651,24 +732,21 @@ static inline void naive_conv_fwd_nhwc(const float *src, const float *filter,
     size_t k_per_group = k / group;
     size_t c_per_group = c / group;
 #ifdef NAIVE_CONV_THREADED
+    conv_geometry_cpu_t geo(n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
     auto conv_one_pixel = [&](size_t ig, size_t in, size_t ioh, size_t iow, size_t ik){
-        size_t ic, is, ir, cur_h, cur_w, o_idx, i_idx, f_idx;
+        size_t is, ir, o_idx;
+        size_t ir_begin = geo.y.tap_begin(ioh), nr = geo.y.tap_end(ioh) - ir_begin;
+        size_t is_begin = geo.x.tap_begin(iow), ns = geo.x.tap_end(iow) - is_begin;
         float value = .0f;
         o_idx = in * oh * ow * k + ioh * ow * k + iow * k + ig * k_per_group + ik;
-        for (ir = 0; ir < fy; ir++) {
-            cur_h = sy * ioh - py + dy * ir;
-            if (cur_h < 0 || cur_h >= h)
-                continue;
-            for (is = 0; is < fx; is++) {
-                cur_w = sx * iow - px + dx * is;
-                if (cur_w < 0 || cur_w >= w)
-                    continue;
-                for (ic = 0; ic < c_per_group; ic++) {
-                    i_idx = in * h * w * c + cur_h * w * c + cur_w * c + ig * c_per_group + ic;
-                    f_idx = ig * k_per_group * fy * fx * c_per_group + ik * fy * fx * c_per_group +
-                            ir * fx * c_per_group + is * c_per_group + ic;
-                    value += src[i_idx] * filter[f_idx];
-                }
+        if (nr != 0 && ns != 0) {
+            const float *src_p = src + in * h * w * c + ig * c_per_group + (geo.y.in_first(ioh) * w + geo.x.in_first(iow)) * c;
+            const float *filter_p = filter + ig * k_per_group * fy * fx * c_per_group + ik * fy * fx * c_per_group +
+                                    (ir_begin * fx + is_begin) * c_per_group;
+            for (ir = 0; ir < nr; ir++) {
+                for (is = 0; is < ns; is++)
+                    value += simd_cpu_dot_f32(src_p + (ir * dy * w + is * dx) * c,
+                                              filter_p + (ir * fx + is) * c_per_group, c_per_group);
             }
         }
         dst[o_idx] = value;
@@ -722,35 +800,35 @@ static inline void naive_conv_bwd_nhwc(float *src_grad, const float *filter,
     size_t k_per_group = k / group;
     size_t c_per_group = c / group;
 #ifdef NAIVE_CONV_THREADED
-    auto conv_one_pixel = [&](size_t ig, size_t in, size_t ih, size_t iw, size_t ic){
+    size_t c_blocks = (c_per_group + NAIVE_CONV_C_BLOCK - 1) / NAIVE_CONV_C_BLOCK;
+    conv_geometry_cpu_t geo(n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    auto conv_one_pixel = [&](size_t ig, size_t in, size_t ih, size_t iw, size_t icb){
         size_t ik, is, ir;
-        size_t cur_oh, cur_ow, o_idx, i_idx, f_idx;
-        float value = .0f;
-        i_idx = in * h * w * c + ih * w * c + iw * c + ig * c_per_group + ic;
-        for (ir = 0; ir < fy; ir++) {
-            cur_oh = ih + py - dy * ir; // cur_h = sy*ioh-py+dy*ir;
-            if (cur_oh < 0 || cur_oh % sy)
-                continue;
-            cur_oh /= sy;
-            if (cur_oh >= oh)
-                continue;
-            for (is = 0; is < fx; is++) {
-                cur_ow = iw + px - dx * is; // cur_w = sx*iow-px+dx*is;
-                if (cur_ow < 0 || cur_ow % sx)
-                    continue;
-                cur_ow /= sx;
-                if (cur_ow >= ow)
-                    continue;
-                for (ik = 0; ik < k_per_group; ik++) {
-                    o_idx = in * oh * ow * k + cur_oh * ow * k + cur_ow * k + ig * k_per_group + ik;
-                    f_idx = ig * k_per_group * fy * fx * c_per_group + ik * fy * fx * c_per_group + ir * fx * c_per_group + is * c_per_group + ic;
-                    value += dst_grad[o_idx] * filter[f_idx];
-                }
+        size_t cur_oh, cur_ow;
+        const conv_geometry_cpu_dim_t::tap_t *ty, *ty_end, *tx, *tx_begin, *tx_end;
+        size_t base_h, base_w;
+        size_t ic0 = icb * NAIVE_CONV_C_BLOCK;
+        size_t cb = c_per_group - ic0 < NAIVE_CONV_C_BLOCK ? c_per_group - ic0 : NAIVE_CONV_C_BLOCK;
+        float value[NAIVE_CONV_C_BLOCK] = {.0f};
+        const float *dst_grad_n = dst_grad + in * oh * ow * k + ig * k_per_group;
+        const float *filter_c = filter + ig * k_per_group * fy * fx * c_per_group + ic0;
+        geo.y.bwd_taps(ih, &ty, &ty_end, &base_h);
+        geo.x.bwd_taps(iw, &tx_begin, &tx_end, &base_w);
+        for (; ty < ty_end; ty++) {
+            ir = ty->r;
+            cur_oh = base_h - ty->q; // cur_h = sy*ioh-py+dy*ir;
+            for (tx = tx_begin; tx < tx_end; tx++) {
+                is = tx->r;
+                cur_ow = base_w - tx->q; // cur_w = sx*iow-px+dx*is;
+                const float *dst_grad_p = dst_grad_n + cur_oh * ow * k + cur_ow * k;
+                const float *filter_t = filter_c + ir * fx * c_per_group + is * c_per_group;
+                for (ik = 0; ik < k_per_group; ik++)
+                    simd_cpu_axpy_f32(value, dst_grad_p[ik], filter_t + ik * fy * fx * c_per_group, cb);
             }
         }
-        src_grad[i_idx] = value;
+        memcpy(src_grad + in * h * w * c + ih * w * c + iw * c + ig * c_per_group + ic0, value, cb * sizeof(float));
     };
-    naive_conv_blockwise_in_parallel_5d(conv_one_pixel, group, n, h, w, c_per_group);
+    naive_conv_blockwise_in_parallel_5d(conv_one_pixel, group, n, h, w, c_blocks);
 #else
     size_t ig, in, ik, ih, iw, ic, is, ir;
     size_t cur_oh, cur_ow, o_idx, i_idx, f_idx;
@@ -804,29 +882,30 @@ static inline void naive_conv_wrw_nhwc(const float *src, float *filter_grad,
     size_t k_per_group = k / group;
     size_t c_per_group = c / group;
 #ifdef NAIVE_CONV_THREADED
-    auto conv_one_pixel = [&](size_t ig, size_t ik, size_t ir, size_t is, size_t ic){
-        size_t in, ioh, iow;
-        size_t cur_h, cur_w, o_idx, i_idx, f_idx;
-        float value = .0f;
-        f_idx = ig * k_per_group * fy * fx * c_per_group + ik * fy * fx * c_per_group + ir * fx * c_per_group + is * c_per_group + ic;
-        for (in = 0; in < n; in++) {
-            for (ioh = 0; ioh < oh; ioh++) {
-                cur_h = sy * ioh - py + dy * ir;
-                if (cur_h < 0 || cur_h >= h)
-                    continue;
-                for (iow = 0; iow < ow; iow++) {
-                    cur_w = sx * iow - px + dx * is;
-                    if (cur_w < 0 || cur_w >= w)
-                        continue;
-                    i_idx = in * h * w * c + cur_h * w * c + cur_w * c + ig * c_per_group + ic;
-                    o_idx = in * oh * ow * k + ioh * ow * k + iow * k + ig * k_per_group + ik;
-                    value += src[i_idx] * dst_grad[o_idx];
-                }
-            }
+    size_t c_blocks = (c_per_group + NAIVE_CONV_C_BLOCK - 1) / NAIVE_CONV_C_BLOCK;
+    conv_geometry_cpu_t geo(n, w, h, c, k, fx, fy, px, py, sx, sy, dx, dy, group);
+    auto conv_one_pixel = [&](size_t r_begin, size_t r_end, float *grad, size_t ig, size_t ik, size_t ir, size_t is, size_t icb){
+        size_t in, ioh, iow, row, f_idx;
+        size_t ow_begin = geo.x.out_begin(is), ow_end = geo.x.out_end(is);
+        size_t ic0 = icb * NAIVE_CONV_C_BLOCK;
+        size_t cb = c_per_group - ic0 < NAIVE_CONV_C_BLOCK ? c_per_group - ic0 : NAIVE_CONV_C_BLOCK;
+        float value[NAIVE_CONV_C_BLOCK] = {.0f};
+        f_idx = ig * k_per_group * fy * fx * c_per_group + ik * fy * fx * c_per_group + ir * fx * c_per_group + is * c_per_group + ic0;
+        for (row = r_begin; row < r_end; row++) {
+            in = row / oh;
+            ioh = row % oh;
+            if (ioh < geo.y.out_begin(ir) || ioh >= geo.y.out_end(ir) || ow_begin == ow_end)
+                continue;
+            const float *src_p = src + in * h * w * c + ig * c_per_group + ic0 +
+                                 (geo.y.in_of(ioh, ir) * w + geo.x.in_of(ow_begin, is)) * c;
+            const float *dst_grad_p = dst_grad + in * oh * ow * k + ioh * ow * k + ig * k_per_group + ik;
+            for (iow = ow_begin; iow < ow_end; iow++)
+                simd_cpu_axpy_f32(value, dst_grad_p[iow * k], src_p + (iow - ow_begin) * sx * c, cb);
         }
-        filter_grad[f_idx] = value;
+        memcpy(grad + f_idx, value, cb * sizeof(float));
     };
-    naive_conv_blockwise_in_parallel_5d(conv_one_pixel, group, k_per_group, fy, fx, c_per_group);
+    naive_conv_wrw_in_parallel_5d(conv_one_pixel, filter_grad, k * fy * fx * c_per_group, n * oh,
+                                  group, k_per_group, fy, fx, c_blocks);
 #else
     size_t ig, in, ik, ioh, iow, ic, is, ir;
     size_t cur_h, cur_w, o_idx, i_idx, f_idx;
@@ -872,27 +951,24 @@ static inline void naive_conv_fwd_ndhwc(const float *src, const float *filter, f
     size_t k_per_group = k / group;
     size_t c_per_group = c / group;
 #ifdef NAIVE_CONV_THREADED
+    conv_geometry_cpu_t geo(n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
     auto conv_one_pixel = [&](size_t ig, size_t in, size_t iod, size_t ioh, size_t iow, size_t ik){
-        size_t ic, iz, is, ir, cur_d, cur_h, cur_w, o_idx, i_idx, f_idx;
+        size_t iz, is, ir, o_idx;
+        size_t iz_begin = geo.z.tap_begin(iod), nz = geo.z.tap_end(iod) - iz_begin;
+        size_t ir_begin = geo.y.tap_begin(ioh), nr = geo.y.tap_end(ioh) - ir_begin;
+        size_t is_begin = geo.x.tap_begin(iow), ns = geo.x.tap_end(iow) - is_begin;
         float value = .0f;
         o_idx = in * od * oh * ow * k + iod * oh * ow * k + ioh * ow * k + iow * k + ig * k_per_group + ik;
-        for (iz = 0; iz < fz; iz++) {
-            cur_d = sz * iod - pz + dz * iz;
-            if (cur_d < 0 || cur_d >= d)
-                continue;
-            for (ir = 0; ir < fy; ir++) {
-                cur_h = sy * ioh - py + dy * ir;
-                if (cur_h < 0 || cur_h >= h)
-                    continue;
-                for (is = 0; is < fx; is++) {
-                    cur_w = sx * iow - px + dx * is;
-                    if (cur_w < 0 || cur_w >= w)
-                        continue;
-                    for (ic = 0; ic < c_per_group; ic++) {
-                        i_idx = in * d * h * w * c + cur_d * h * w * c + cur_h * w * c + cur_w * c + ig * c_per_group + ic;
-                        f_idx = ig * k_per_group * fz * fy * fx * c_per_group + ik * fz * fy * fx * c_per_group + iz * fy * fx * c_per_group + ir * fx * c_per_group + is * c_per_group + ic;
-                        value += src[i_idx] * filter[f_idx];
-                    }
+        if (nz != 0 && nr != 0 && ns != 0) {
+            const float *src_p = src + in * d * h * w * c + ig * c_per_group +
+                                 ((geo.z.in_first(iod) * h + geo.y.in_first(ioh)) * w + geo.x.in_first(iow)) * c;
+            const float *filter_p = filter + ig * k_per_group * fz * fy * fx * c_per_group + ik * fz * fy * fx * c_per_group +
+                                    ((iz_begin * fy + ir_begin) * fx + is_begin) * c_per_group;
+            for (iz = 0; iz < nz; iz++) {
+                for (ir = 0; ir < nr; ir++) {
+                    for (is = 0; is < ns; is++)
+                        value += simd_cpu_dot_f32(src_p + (iz * dz * h * w + ir * dy * w + is * dx) * c,
+                                                  filter_p + ((iz * fy + ir) * fx + is) * c_per_group, c_per_group);
                 }
             }
         }
@@ -952,44 +1028,40 @@ static inline void naive_conv_bwd_ndhwc(float *src_grad, const float *filter, co
     size_t k_per_group = k / group;
     size_t c_per_group = c / group;
 #ifdef NAIVE_CONV_THREADED
-    auto conv_one_pixel = [&](size_t ig, size_t in, size_t id, size_t ih, size_t iw, size_t ic){
+    size_t c_blocks = (c_per_group + NAIVE_CONV_C_BLOCK - 1) / NAIVE_CONV_C_BLOCK;
+    conv_geometry_cpu_t geo(n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+    auto conv_one_pixel = [&](size_t ig, size_t in, size_t id, size_t ih, size_t iw, size_t icb){
         size_t ik, iz, is, ir;
-        size_t cur_od, cur_oh, cur_ow, o_idx, i_idx, f_idx;
-        float value = .0f;
-        i_idx = in * d * h * w * c + id * h * w * c + ih * w * c + iw * c + ig * c_per_group + ic;
-        for (iz = 0; iz < fz; iz++) {
-            cur_od = id + pz - dz * iz;
-            if (cur_od < 0 || cur_od % sz)
-                continue;
-            cur_od /= sz;
-            if (cur_od >= od)
-                continue;
-            for (ir = 0; ir < fy; ir++) {
-                cur_oh = ih + py - dy * ir; // cur_h = sy*ioh-py+dy*ir;
-                if (cur_oh < 0 || cur_oh % sy)
-                    continue;
-                cur_oh /= sy;
-                if (cur_oh >= oh)
-                    continue;
-                for (is = 0; is < fx; is++) {
-                    cur_ow = iw + px - dx * is; // cur_w = sx*iow-px+dx*is;
-                    if (cur_ow < 0 || cur_ow % sx)
-                        continue;
-                    cur_ow /= sx;
-                    if (cur_ow >= ow)
-                        continue;
-                    for (ik = 0; ik < k_per_group; ik++) {
-                        o_idx = in * od * oh * ow * k + cur_od * oh * ow * k + cur_oh * ow * k + cur_ow * k + ig * k_per_group + ik;
-                        f_idx = ig * k_per_group * fz * fy * fx * c_per_group + ik * fz * fy * fx * c_per_group + iz * fy * fx * c_per_group + ir * fx * c_per_group + is * c_per_group + ic;
-
-                        value += dst_grad[o_idx] * filter[f_idx];
-                    }
+        size_t cur_od, cur_oh, cur_ow;
+        const conv_geometry_cpu_dim_t::tap_t *tz, *tz_end, *ty, *ty_begin, *ty_end, *tx, *tx_begin, *tx_end;
+        size_t base_d, base_h, base_w;
+        size_t ic0 = icb * NAIVE_CONV_C_BLOCK;
+        size_t cb = c_per_group - ic0 < NAIVE_CONV_C_BLOCK ? c_per_group - ic0 : NAIVE_CONV_C_BLOCK;
+        float value[NAIVE_CONV_C_BLOCK] = {.0f};
+        const float *dst_grad_n = dst_grad + in * od * oh * ow * k + ig * k_per_group;
+        const float *filter_c = filter + ig * k_per_group * fz * fy * fx * c_per_group + ic0;
+        geo.z.bwd_taps(id, &tz, &tz_end, &base_d);
+        geo.y.bwd_taps(ih, &ty_begin, &ty_end, &base_h);
+        geo.x.bwd_taps(iw, &tx_begin, &tx_end, &base_w);
+        for (; tz < tz_end; tz++) {
+            iz = tz->r;
+            cur_od = base_d - tz->q;
+            for (ty = ty_begin; ty < ty_end; ty++) {
+                ir = ty->r;
+                cur_oh = base_h - ty->q; // cur_h = sy*ioh-py+dy*ir;
+                for (tx = tx_begin; tx < tx_end; tx++) {
+                    is = tx->r;
+                    cur_ow = base_w - tx->q; // cur_w = sx*iow-px+dx*is;
+                    const float *dst_grad_p = dst_grad_n + cur_od * oh * ow * k + cur_oh * ow * k + cur_ow * k;
+                    const float *filter_t = filter_c + iz * fy * fx * c_per_group + ir * fx * c_per_group + is * c_per_group;
+                    for (ik = 0; ik < k_per_group; ik++)
+                        simd_cpu_axpy_f32(value, dst_grad_p[ik], filter_t + ik * fz * fy * fx * c_per_group, cb);
                 }
             }
         }
-        src_grad[i_idx] = value;
+        memcpy(src_grad + in * d * h * w * c + id * h * w * c + ih * w * c + iw * c + ig * c_per_group + ic0, value, cb * sizeof(float));
     };
-    naive_conv_blockwise_in_parallel_6d(conv_one_pixel, group, n, d, h, w, c_per_group);
+    naive_conv_blockwise_in_parallel_6d(conv_one_pixel, group, n, d, h, w, c_blocks);
 #else
     size_t ig, in, ik, id, ih, iw, ic, iz, is, ir;
     size_t cur_od, cur_oh, cur_ow, o_idx, i_idx, f_idx;
@@ -1052,34 +1124,35 @@ static inline void naive_conv_wrw_ndhwc(const float *src, float *filter_grad, co
     size_t k_per_group = k / group;
     size_t c_per_group = c / group;
 #ifdef NAIVE_CONV_THREADED
-    auto conv_one_pixel = [&](size_t ig, size_t ik, size_t iz, size_t ir, size_t is, size_t ic){
-        size_t in, iod, ioh, iow;
-        size_t cur_d, cur_h, cur_w, o_idx, i_idx, f_idx;
-        float value = .0f;
-        f_idx = ig * k_per_group * fz * fy * fx * c_per_group + ik * fz * fy * fx * c_per_group + iz * fy * fx * c_per_group + ir * fx * c_per_group + is * c_per_group + ic;
-        for (in = 0; in < n; in++) {
-            for (iod = 0; iod < od; iod++) {
-                cur_d = sz * iod - pz + dz * iz;
-                if (cur_d < 0 || cur_d >= d)
-                    continue;
-                for (ioh = 0; ioh < oh; ioh++) {
-                    cur_h = sy * ioh - py + dy * ir;
-                    if (cur_h < 0 || cur_h >= h)
-                        continue;
-                    for (iow = 0; iow < ow; iow++) {
-                        cur_w = sx * iow - px + dx * is;
-                        if (cur_w < 0 || cur_w >= w)
-                            continue;
-                        i_idx = in * d * h * w * c + cur_d * h * w * c + cur_h * w * c + cur_w * c + ig * c_per_group + ic;
-                        o_idx = in * od * oh * ow * k + iod * oh * ow * k + ioh * ow * k + iow * k + ig * k_per_group + ik;
-                        value += src[i_idx] * dst_grad[o_idx];
-                    }
-                }
+    size_t c_blocks = (c_per_group + NAIVE_CONV_C_BLOCK - 1) / NAIVE_CONV_C_BLOCK;
+    conv_geometry_cpu_t geo(n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group);
+    auto conv_one_pixel = [&](size_t r_begin, size_t r_end, float *grad, size_t ig, size_t ik, size_t iz, size_t ir, size_t is, size_t icb){
+        size_t in, iod, ioh, iow, row, f_idx;
+        size_t oh_begin = geo.y.out_begin(ir), oh_end = geo.y.out_end(ir);
+        size_t ow_begin = geo.x.out_begin(is), ow_end = geo.x.out_end(is);
+        size_t ic0 = icb * NAIVE_CONV_C_BLOCK;
+        size_t cb = c_per_group - ic0 < NAIVE_CONV_C_BLOCK ? c_per_group - ic0 : NAIVE_CONV_C_BLOCK;
+        float value[NAIVE_CONV_C_BLOCK] = {.0f};
+        f_idx = ig * k_per_group * fz * fy * fx * c_per_group + ik * fz * fy * fx * c_per_group + iz * fy * fx * c_per_group + ir * fx * c_per_group + is * c_per_group + ic0;
+        for (row = r_begin; row < r_end; row++) {
+            in = row / od;
+            iod = row % od;
+            if (iod < geo.z.out_begin(iz) || iod >= geo.z.out_end(iz) || oh_begin == oh_end || ow_begin == ow_end)
+                continue;
+            const float *src_p = src + in * d * h * w * c + ig * c_per_group + ic0 +
+                                 ((geo.z.in_of(iod, iz) * h + geo.y.in_of(oh_begin, ir)) * w + geo.x.in_of(ow_begin, is)) * c;
+            const float *dst_grad_p = dst_grad + in * od * oh * ow * k + iod * oh * ow * k + ig * k_per_group + ik;
+            for (ioh = oh_begin; ioh < oh_end; ioh++) {
+                const float *src_r = src_p + (ioh - oh_begin) * sy * w * c;
+                const float *dst_grad_r = dst_grad_p + ioh * ow * k;
+                for (iow = ow_begin; iow < ow_end; iow++)
+                    simd_cpu_axpy_f32(value, dst_grad_r[iow * k], src_r + (iow - ow_begin) * sx * c, cb);
             }
         }
-        filter_grad[f_idx] = value;
+        memcpy(grad + f_idx, value, cb * sizeof(float));
     };
-    naive_conv_blockwise_in_parallel_6d(conv_one_pixel, group, k_per_group, fz, fy, fx, c_per_group);
+    naive_conv_wrw_in_parallel_6d(conv_one_pixel, filter_grad, k * fz * fy * fx * c_per_group, n * od,
+                                  group, k_per_group, fz, fy, fx, c_blocks);
 #else
     size_t ig, in, ik, iod, ioh, iow, ic, iz, is, ir;
     size_t cur_d, cur_h, cur_w, o_idx, i_idx, f_idx;
@@ -26,6 +26,16 @@
 #ifndef __NAIVE_TILED_CONV_H
 #define __NAIVE_TILED_CONV_H
 
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <vector>
+#include <algorithm>
+#include "thread_pool_cpu.h"
+#include "simd_cpu.h"
+#include "naive_conv.h"
+#include "conv_geometry_cpu.h"
+
 // implement convolution pre tiled in h-w
 static inline size_t naive_tiled_conv_out_size(size_t in_size, size_t pad,
                                          size_t dilation, size_t ksize,
@@ -33,6 +43,20 @@ static inline size_t naive_tiled_conv_out_size(size_t in_size, size_t pad,
     return (in_size + 2 * pad - dilation * (ksize - 1) - 1) / stride + 1;
 }
 
+// clamp the input slice [i_start, i_start + len) of a tile to [0, in). i_start may be a wrapped negative inside the
+// left pad, and a tile entirely inside the padding gets an empty slice
+static inline void naive_tiled_conv_slice(size_t i_start, size_t len, size_t in,
+                                          size_t *sps_start, size_t *sps_len, size_t *sps_pad)
+{
+    ptrdiff_t begin = static_cast<ptrdiff_t>(i_start);
+    ptrdiff_t end = begin + static_cast<ptrdiff_t>(len);
+    ptrdiff_t lo = begin < 0 ? 0 : begin;
+    ptrdiff_t hi = end < static_cast<ptrdiff_t>(in) ? end : static_cast<ptrdiff_t>(in);
+    *sps_pad = static_cast<size_t>(lo - begin);
+    *sps_len = hi > lo ? static_cast<size_t>(hi - lo) : 0;
+    *sps_start = lo < static_cast<ptrdiff_t>(in) ? static_cast<size_t>(lo) : 0;
+}
+
 template<typename p_src_t, typename p_dst_t, typename tiled_conv_func_t>
 void naive_2d_tiled_conv_iterator(
     p_src_t src, p_dst_t dst,
@@ -63,47 +87,134 @@ void naive_2d_tiled_conv_iterator(
     size_t i_thi = sy * i_tho - py;
     size_t i_twi = sx * i_two - px;
 
-    // spatial-slice size of input, need further modify
-    size_t sps_hi = (sps_ho - 1) * sy + 1 + dy * (fy - 1);
-    size_t sps_wi = (sps_wo - 1) * sx + 1 + dx * (fx - 1);
+    // spatial-slice of input, trimmed by the left/right pad
+    size_t sps_hi, sps_wi;
+    size_t sps_py, sps_px;  // left pad for each sec
+    naive_tiled_conv_slice(i_thi, (sps_ho - 1) * sy + 1 + dy * (fy - 1), h, &i_thi, &sps_hi, &sps_py);
+    naive_tiled_conv_slice(i_twi, (sps_wo - 1) * sx + 1 + dx * (fx - 1), w, &i_twi, &sps_wi, &sps_px);
 
-    size_t tmp_sps_end_hi = sps_hi + i_thi;
-    size_t tmp_sps_end_wi = sps_wi + i_twi;
+    // printf("tile_h:%lu, tile_w:%lu, sps_hi:%lu, sps_wi:%lu, sps_ho:%lu, sps_wo:%lu\n", tile_h, tile_w, sps_hi, sps_wi, sps_ho, sps_wo); fflush(stdout);
 
-    size_t sps_py = 0;  // left pad for each sec
-    size_t sps_px = 0;  // left pad for each sec
+    // accumulate offset of each tile, and parse to tiled_conv
+    p_src_t tile_src = src + i_thi * w + i_twi;
+    p_dst_t tile_dst = dst + i_tho * wo + i_two;
 
-    // modify input spatial-slice size according to left pad
-    if(tmp_sps_end_hi < sps_hi){
-        sps_py = sps_hi - tmp_sps_end_hi;
-        sps_hi = tmp_sps_end_hi;
-    }
+    tiled_conv(tile_src, tile_dst, sps_hi, sps_wi, sps_ho, sps_wo, sps_py, sps_px);
+}
 
-    if(tmp_sps_end_wi < sps_wi){
-        sps_px = sps_wi - tmp_sps_end_wi;
-        sps_wi = tmp_sps_end_wi;
-    }
+/*
+ * tiled host convolution. the output is cut into tile_h x tile_w tiles, and every tile is an independent conv
+ * over its input slice, with the per tile pads of naive_2d_tiled_conv_iterator, the same split igemm_spatial_tiling
+ * does on the gpu. a tile is the unit of work of the thread pool:
+ *   fwd : a task is (group, n, tile, k block), the input slice of the group stays in l2 while the k block reuses it.
+ *         each output is summed in the order of naive_conv, so the result is bit identical to it.
+ *   bwd : a task is (group, n, tile, c) or a c block for nhwc, and adds the gradient of the tile into its input
+ *         slice. slices of neighbour tiles overlap by the halo, so the tiles run in rounds of tiles far enough
+ *         apart not to overlap, in a fixed order.
+ *   wrw : every (n, tile) is a row of naive_conv_wrw_split_reduce, and a row sums into all filters of the task
+ *         range before the next one, so the slice is read once per task range.
+ * bwd/wrw sum the same products as naive_conv in another order, and do not depend on the thread count.
+ * tx, ty of 0 pick the largest tile whose input slice and k block of outputs fit NAIVE_TILED_CONV_L2_SIZE.
+ */
+#ifndef NAIVE_TILED_CONV_L2_SIZE
+#define NAIVE_TILED_CONV_L2_SIZE (256 * 1024)
+#endif
+#ifndef NAIVE_TILED_CONV_K_BLOCK
+#define NAIVE_TILED_CONV_K_BLOCK 16
+#endif
 
-    // modify input spatial-slice size according to right pad
-    if(tmp_sps_end_hi > h)
-        sps_hi -= tmp_sps_end_hi - h;
+static inline void naive_tiled_conv_get_tile(size_t w, size_t h, size_t c_per_group, size_t k_per_group,
+                                             size_t fx, size_t fy, size_t px, size_t py,
+                                             size_t sx, size_t sy, size_t dx, size_t dy,
+                                             size_t *tx, size_t *ty)
+{
+    size_t ho = naive_tiled_conv_out_size(h, py, dy, fy, sy);
+    size_t wo = naive_tiled_conv_out_size(w, px, dx, fx, sx);
+    size_t kb = k_per_group < NAIVE_TILED_CONV_K_BLOCK ? k_per_group : NAIVE_TILED_CONV_K_BLOCK;
+    auto tile_bytes = [&](size_t tile_h, size_t tile_w){
+        size_t sps_hi = (tile_h - 1) * sy + 1 + dy * (fy - 1);
+        size_t sps_wi = (tile_w - 1) * sx + 1 + dx * (fx - 1);
+        sps_hi = sps_hi < h ? sps_hi : h;
+        sps_wi = sps_wi < w ? sps_wi : w;
+        return (c_per_group * sps_hi * sps_wi + kb * tile_h * tile_w) * sizeof(float);
+    };
+    // halve h first, so a tile keeps whole rows as long as possible
+    *ty = ho;
+    *tx = wo;
+    while(*ty > 1 && tile_bytes(*ty, *tx) > NAIVE_TILED_CONV_L2_SIZE)
+        *ty = (*ty + 1) / 2;
+    while(*tx > 1 && tile_bytes(*ty, *tx) > NAIVE_TILED_CONV_L2_SIZE)
+        *tx = (*tx + 1) / 2;
+}
 
-    if(tmp_sps_end_wi > w)
-        sps_wi -= tmp_sps_end_wi - w;
+// the tiles of a conv. the iterator is fed pixel offsets instead of pointers, so the same slices serve nchw and nhwc
+class naive_tiled_conv_plan_t{
+public:
+    struct tile_t{
+        size_t src;             // first input pixel of the slice, h * w index
+        size_t dst;             // first output pixel of the tile, ho * wo index
+        size_t i_tile_h, i_tile_w;
+    };
 
-    // tile index should start from 0
-    if(i_thi < 0 || i_thi >= h)
-        i_thi = 0;
-    if(i_twi < 0 || i_twi >= w)
-        i_twi = 0;
+    naive_tiled_conv_plan_t(size_t w, size_t h, size_t c_per_group, size_t k_per_group,
+                            size_t fx, size_t fy, size_t px, size_t py,
+                            size_t sx, size_t sy, size_t dx, size_t dy, size_t tx, size_t ty)
+    {
+        ho = naive_tiled_conv_out_size(h, py, dy, fy, sy);
+        wo = naive_tiled_conv_out_size(w, px, dx, fx, sx);
+        if(tx == 0 || ty == 0)
+            naive_tiled_conv_get_tile(w, h, c_per_group, k_per_group, fx, fy, px, py, sx, sy, dx, dy, &tx, &ty);
+        assert((tx <= wo) && (ty <= ho));
+        tiles_h = (ho + ty - 1) / ty;
+        tiles_w = (wo + tx - 1) / tx;
+        for(size_t i_tile_h = 0; i_tile_h < tiles_h; i_tile_h++){
+            for(size_t i_tile_w = 0; i_tile_w < tiles_w; i_tile_w++){
+                naive_2d_tiled_conv_iterator(
+                    static_cast<size_t>(0), static_cast<size_t>(0),
+                    i_tile_h, i_tile_w, ty, tx,
+                    w, h, fx, fy, px, py,
+                    sx, sy, dx, dy,
+                    [&](size_t tile_src, size_t tile_dst, size_t sps_hi, size_t sps_wi, size_t sps_ho, size_t sps_wo,
+                        size_t sps_py, size_t sps_px){
+                        tiles.push_back({tile_src, tile_dst, i_tile_h, i_tile_w});
+                        if(i_tile_w == 0)
+                            geo_y.emplace_back(sps_hi, sps_ho, fy, sps_py, sy, dy);
+                        if(i_tile_h == 0)
+                            geo_x.emplace_back(sps_wi, sps_wo, fx, sps_px, sx, dx);
+                    });
+            }
+        }
+        // tiles that many apart along a dim have disjoint input slices
+        rounds_h = ((ty - 1) * sy + dy * (fy - 1) + ty * sy) / (ty * sy);
+        rounds_w = ((tx - 1) * sx + dx * (fx - 1) + tx * sx) / (tx * sx);
+        rounds_h = rounds_h < tiles_h ? rounds_h : tiles_h;
+        rounds_w = rounds_w < tiles_w ? rounds_w : tiles_w;
+    }
 
-    // printf("tile_h:%lu, tile_w:%lu, sps_hi:%lu, sps_wi:%lu, sps_ho:%lu, sps_wo:%lu\n", tile_h, tile_w, sps_hi, sps_wi, sps_ho, sps_wo); fflush(stdout);
+    const tile_t & tile(size_t i_tile_h, size_t i_tile_w) const { return tiles[i_tile_h * tiles_w + i_tile_w]; }
 
-    // accumulate offset of each tile, and parse to tiled_conv
-    p_src_t tile_src = src + i_thi * w + i_twi;
-    p_dst_t tile_dst = dst + i_tho * wo + i_two;
+    size_t ho, wo;
+    size_t tiles_h, tiles_w;
+    size_t rounds_h, rounds_w;
+    std::vector<tile_t> tiles;
+    std::vector<conv_geometry_cpu_dim_t> geo_y, geo_x;      // per tile row / column, on the slice
+};
 
-    tiled_conv(tile_src, tile_dst, sps_hi, sps_wi, sps_ho, sps_wo, sps_py, sps_px);
+// run tile_func(ig, in, i_tile_h, i_tile_w, id) for all tiles, round by round, so no two concurrent tiles share input
+template<class tile_func_t>
+static inline void naive_tiled_conv_in_rounds(const naive_tiled_conv_plan_t & plan, const tile_func_t & tile_func,
+                                              size_t group, size_t n, size_t ids)
+{
+    for(size_t round_h = 0; round_h < plan.rounds_h; round_h++){
+        for(size_t round_w = 0; round_w < plan.rounds_w; round_w++){
+            size_t tiles_h = (plan.tiles_h - round_h + plan.rounds_h - 1) / plan.rounds_h;
+            size_t tiles_w = (plan.tiles_w - round_w + plan.rounds_w - 1) / plan.rounds_w;
+            auto round_func = [&](size_t ig, size_t in, size_t j_tile_h, size_t j_tile_w, size_t id){
+                tile_func(ig, in, round_h + j_tile_h * plan.rounds_h, round_w + j_tile_w * plan.rounds_w, id);
+            };
+            naive_conv_blockwise_in_parallel_5d(round_func, group, n, tiles_h, tiles_w, ids);
+        }
+    }
 }
 
 static inline void naive_tiled_conv_fwd_nchw(const float *src, const float *filter,
@@ -114,61 +225,325 @@ static inline void naive_tiled_conv_fwd_nchw(const float *src, const float *filt
                                        size_t tx, size_t ty)
 {
     // tx, ty is used to tile output h, w
-    size_t ho = naive_tiled_conv_out_size(h, py, dy, fy, sy);
-    size_t wo = naive_tiled_conv_out_size(w, px, dx, fx, sx);
     assert((group >= 1) && (c % group == 0) && (k % group == 0));
     size_t k_per_group = k / group;
     size_t c_per_group = c / group;
+    naive_tiled_conv_plan_t plan(w, h, c_per_group, k_per_group, fx, fy, px, py, sx, sy, dx, dy, tx, ty);
+    size_t ho = plan.ho, wo = plan.wo;
+    size_t k_blocks = (k_per_group + NAIVE_TILED_CONV_K_BLOCK - 1) / NAIVE_TILED_CONV_K_BLOCK;
 
-    assert((tx <= wo) && (ty <= ho));
-    size_t tiles_w = (wo + tx - 1) / tx;
-    size_t tiles_h = (ho + ty - 1) / ty;
-
-    auto tiled_conv = [&](const float * tile_src, float * tile_dst,
-                    size_t sps_hi, size_t sps_wi, size_t sps_ho, size_t sps_wo,
-                    size_t sps_py, size_t sps_px){
-        for (size_t ig = 0; ig < group; ig++) {
-            for (size_t in = 0; in < n; in++) {
-                for (size_t ik = 0; ik < k_per_group; ik++) {
-                    for (size_t i_sho = 0; i_sho < sps_ho; i_sho++) {
-                        for (size_t i_swo = 0; i_swo < sps_wo; i_swo++) {
-                            double value = .0f;
-                            size_t o_idx = in * k * ho * wo + ig * k_per_group * ho * wo + ik * ho * wo + i_sho * wo + i_swo;
-                            for (size_t ic = 0; ic < c_per_group; ic++) {
-                                for (size_t ir = 0; ir < fy; ir++) {
-                                    size_t i_shi = sy * i_sho - sps_py + dy * ir;
-                                    if (i_shi < 0 || i_shi >= sps_hi)
-                                        continue;
-                                    for (size_t is = 0; is < fx; is++) {
-                                        size_t i_swi = sx * i_swo - sps_px + dx * is;
-                                        if (i_swi < 0 || i_swi >= sps_wi)
-                                            continue;
-                                        size_t i_idx = in * c * h * w + ig * c_per_group * h * w + ic * h * w +
-                                                i_shi * w + i_swi;
-                                        size_t f_idx = ig * k_per_group * c_per_group * fy * fx + ik * c_per_group * fy * fx + ic * fy * fx +
-                                                ir * fx + is;
-                                        value += static_cast<double>(tile_src[i_idx]) * filter[f_idx];
-                                    }
-                                }
+    auto tiled_conv = [&](size_t ig, size_t in, size_t i_tile_h, size_t i_tile_w, size_t ikb){
+        const naive_tiled_conv_plan_t::tile_t & tile = plan.tile(i_tile_h, i_tile_w);
+        const conv_geometry_cpu_dim_t & geo_y = plan.geo_y[i_tile_h];
+        const conv_geometry_cpu_dim_t & geo_x = plan.geo_x[i_tile_w];
+        size_t ik_end = (ikb + 1) * NAIVE_TILED_CONV_K_BLOCK < k_per_group ? (ikb + 1) * NAIVE_TILED_CONV_K_BLOCK : k_per_group;
+        const float *tile_src = src + in * c * h * w + ig * c_per_group * h * w + tile.src;
+        // columns [x0, x1) see every x tap. they are summed a row at a time, in the same order per output,
+        // so the innermost loop runs along the row
+        size_t x0 = 0, x1;
+        while (x0 < geo_x.out() && (geo_x.tap_begin(x0) != 0 || geo_x.tap_end(x0) != fx))
+            x0++;
+        for (x1 = x0; x1 < geo_x.out() && geo_x.tap_begin(x1) == 0 && geo_x.tap_end(x1) == fx; x1++)
+            ;
+        std::vector<float> row_value(x1 - x0);
+        for (size_t ik = ikb * NAIVE_TILED_CONV_K_BLOCK; ik < ik_end; ik++) {
+            float *tile_dst = dst + in * k * ho * wo + ig * k_per_group * ho * wo + ik * ho * wo + tile.dst;
+            const float *filter_k = filter + ig * k_per_group * c_per_group * fy * fx + ik * c_per_group * fy * fx;
+            for (size_t i_sho = 0; i_sho < geo_y.out(); i_sho++) {
+                size_t ir_begin = geo_y.tap_begin(i_sho), nr = geo_y.tap_end(i_sho) - ir_begin;
+                for (size_t i_swo = 0; i_swo < geo_x.out(); i_swo++) {
+                    if (i_swo >= x0 && i_swo < x1)
+                        continue;
+                    float value = .0f;
+                    size_t is_begin = geo_x.tap_begin(i_swo), ns = geo_x.tap_end(i_swo) - is_begin;
+                    if (nr != 0 && ns != 0) {
+                        const float *src_p = tile_src + geo_y.in_first(i_sho) * w + geo_x.in_first(i_swo);
+                        const float *filter_p = filter_k + ir_begin * fx + is_begin;
+                        for (size_t ic = 0; ic < c_per_group; ic++) {
+                            for (size_t ir = 0; ir < nr; ir++) {
+                                for (size_t is = 0; is < ns; is++)
+                                    value += src_p[ir * dy * w + is * dx] * filter_p[ir * fx + is];
+                            }
+                            src_p += h * w;
+                            filter_p += fy * fx;
+                        }
+                    }
+                    tile_dst[i_sho * wo + i_swo] = value;
+                }
+                if (x0 == x1)
+                    continue;
+                std::fill(row_value.begin(), row_value.end(), .0f);
+                if (nr != 0) {
+                    const float *src_p = tile_src + geo_y.in_first(i_sho) * w + geo_x.in_of(x0, 0);
+                    const float *filter_p = filter_k + ir_begin * fx;
+                    for (size_t ic = 0; ic < c_per_group; ic++) {
+                        for (size_t ir = 0; ir < nr; ir++) {
+                            for (size_t is = 0; is < fx; is++) {
+                                const float *src_row = src_p + ir * dy * w + is * dx;
+                                float f = filter_p[ir * fx + is];
+                                if (sx == 1)
+                                    for (size_t x = 0; x < x1 - x0; x++)
+                                        row_value[x] += src_row[x] * f;
+                                else
+                                    for (size_t x = 0; x < x1 - x0; x++)
+                                        row_value[x] += src_row[x * sx] * f;
                             }
-                            tile_dst[o_idx] = static_cast<float>(value);
                         }
+                        src_p += h * w;
+                        filter_p += fy * fx;
                     }
                 }
+                memcpy(tile_dst + i_sho * wo + x0, row_value.data(), (x1 - x0) * sizeof(float));
             }
         }
     };
+    naive_conv_blockwise_in_parallel_5d(tiled_conv, group, n, plan.tiles_h, plan.tiles_w, k_blocks);
+}
+
+static inline void naive_tiled_conv_fwd_nhwc(const float *src, const float *filter,
+                                       float *dst, size_t n, size_t w, size_t h,
+                                       size_t c, size_t k, size_t fx, size_t fy,
+                                       size_t px, size_t py, size_t sx, size_t sy,
+                                       size_t dx, size_t dy, size_t group,
+                                       size_t tx, size_t ty)
+{
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    naive_tiled_conv_plan_t plan(w, h, c_per_group, k_per_group, fx, fy, px, py, sx, sy, dx, dy, tx, ty);
+    size_t ho = plan.ho, wo = plan.wo;
+    size_t k_blocks = (k_per_group + NAIVE_TILED_CONV_K_BLOCK - 1) / NAIVE_TILED_CONV_K_BLOCK;
 
-    for(size_t i_tile_h = 0; i_tile_h < tiles_h; i_tile_h++){
-        for(size_t i_tile_w = 0; i_tile_w < tiles_w; i_tile_w++){
-            naive_2d_tiled_conv_iterator(
-                src, dst,
-                i_tile_h, i_tile_w, ty, tx,
-                w, h, fx, fy, px, py,
-                sx, sy, dx, dy,
-                tiled_conv);
+    auto tiled_conv = [&](size_t ig, size_t in, size_t i_tile_h, size_t i_tile_w, size_t ikb){
+        const naive_tiled_conv_plan_t::tile_t & tile = plan.tile(i_tile_h, i_tile_w);
+        const conv_geometry_cpu_dim_t & geo_y = plan.geo_y[i_tile_h];
+        const conv_geometry_cpu_dim_t & geo_x = plan.geo_x[i_tile_w];
+        size_t ik_begin = ikb * NAIVE_TILED_CONV_K_BLOCK;
+        size_t ik_end = ik_begin + NAIVE_TILED_CONV_K_BLOCK < k_per_group ? ik_begin + NAIVE_TILED_CONV_K_BLOCK : k_per_group;
+        const float *tile_src = src + (in * h * w + tile.src) * c + ig * c_per_group;
+        float *tile_dst = dst + (in * ho * wo + tile.dst) * k + ig * k_per_group;
+        for (size_t i_sho = 0; i_sho < geo_y.out(); i_sho++) {
+            for (size_t i_swo = 0; i_swo < geo_x.out(); i_swo++) {
+                size_t ir_begin = geo_y.tap_begin(i_sho), nr = geo_y.tap_end(i_sho) - ir_begin;
+                size_t is_begin = geo_x.tap_begin(i_swo), ns = geo_x.tap_end(i_swo) - is_begin;
+                float *dst_p = tile_dst + (i_sho * wo + i_swo) * k;
+                const float *src_p = nr != 0 && ns != 0 ?
+                                     tile_src + (geo_y.in_first(i_sho) * w + geo_x.in_first(i_swo)) * c : tile_src;
+                for (size_t ik = ik_begin; ik < ik_end; ik++) {
+                    float value = .0f;
+                    if (nr != 0 && ns != 0) {
+                        const float *filter_p = filter + ig * k_per_group * fy * fx * c_per_group + ik * fy * fx * c_per_group +
+                                                (ir_begin * fx + is_begin) * c_per_group;
+                        for (size_t ir = 0; ir < nr; ir++) {
+                            for (size_t is = 0; is < ns; is++)
+                                value += simd_cpu_dot_f32(src_p + (ir * dy * w + is * dx) * c,
+                                                          filter_p + (ir * fx + is) * c_per_group, c_per_group);
+                        }
+                    }
+                    dst_p[ik] = value;
+                }
+            }
         }
-    }
+    };
+    naive_conv_blockwise_in_parallel_5d(tiled_conv, group, n, plan.tiles_h, plan.tiles_w, k_blocks);
+}
+
+static inline void naive_tiled_conv_bwd_nchw(float *src_grad, const float *filter,
+                                       const float *dst_grad, size_t n, size_t w, size_t h,
+                                       size_t c, size_t k, size_t fx, size_t fy,
+                                       size_t px, size_t py, size_t sx, size_t sy,
+                                       size_t dx, size_t dy, size_t group,
+                                       size_t tx, size_t ty)
+{
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    naive_tiled_conv_plan_t plan(w, h, c_per_group, k_per_group, fx, fy, px, py, sx, sy, dx, dy, tx, ty);
+    size_t ho = plan.ho, wo = plan.wo;
+
+    // inputs no tile reads, e.g. skipped by the stride, get no contribution
+    thread_pool_cpu_parallel_for(n * c, [&](size_t begin, size_t end){
+        memset(src_grad + begin * h * w, 0, (end - begin) * h * w * sizeof(float));
+    });
+    auto tiled_conv = [&](size_t ig, size_t in, size_t i_tile_h, size_t i_tile_w, size_t ic){
+        const naive_tiled_conv_plan_t::tile_t & tile = plan.tile(i_tile_h, i_tile_w);
+        const conv_geometry_cpu_dim_t & geo_y = plan.geo_y[i_tile_h];
+        const conv_geometry_cpu_dim_t & geo_x = plan.geo_x[i_tile_w];
+        float *tile_src_grad = src_grad + in * c * h * w + ig * c_per_group * h * w + ic * h * w + tile.src;
+        for (size_t ik = 0; ik < k_per_group; ik++) {
+            const float *tile_dst_grad = dst_grad + in * k * ho * wo + ig * k_per_group * ho * wo + ik * ho * wo + tile.dst;
+            const float *filter_p = filter + ig * k_per_group * c_per_group * fy * fx + ik * c_per_group * fy * fx + ic * fy * fx;
+            for (size_t ir = 0; ir < fy; ir++) {
+                for (size_t is = 0; is < fx; is++) {
+                    size_t ow_begin = geo_x.out_begin(is), ow_end = geo_x.out_end(is);
+                    if (ow_begin == ow_end)
+                        continue;
+                    float f = filter_p[ir * fx + is];
+                    for (size_t i_sho = geo_y.out_begin(ir); i_sho < geo_y.out_end(ir); i_sho++) {
+                        float *src_grad_p = tile_src_grad + geo_y.in_of(i_sho, ir) * w + geo_x.in_of(ow_begin, is);
+                        const float *dst_grad_p = tile_dst_grad + i_sho * wo + ow_begin;
+                        if (sx == 1)
+                            simd_cpu_axpy_f32(src_grad_p, f, dst_grad_p, ow_end - ow_begin);
+                        else
+                            for (size_t i_swo = 0; i_swo < ow_end - ow_begin; i_swo++)
+                                src_grad_p[i_swo * sx] += dst_grad_p[i_swo] * f;
+                    }
+                }
+            }
+        }
+    };
+    naive_tiled_conv_in_rounds(plan, tiled_conv, group, n, c_per_group);
+}
+
+static inline void naive_tiled_conv_bwd_nhwc(float *src_grad, const float *filter,
+                                       const float *dst_grad, size_t n, size_t w, size_t h,
+                                       size_t c, size_t k, size_t fx, size_t fy,
+                                       size_t px, size_t py, size_t sx, size_t sy,
+                                       size_t dx, size_t dy, size_t group,
+                                       size_t tx, size_t ty)
+{
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    naive_tiled_conv_plan_t plan(w, h, c_per_group, k_per_group, fx, fy, px, py, sx, sy, dx, dy, tx, ty);
+    size_t ho = plan.ho, wo = plan.wo;
+    size_t c_blocks = (c_per_group + NAIVE_CONV_C_BLOCK - 1) / NAIVE_CONV_C_BLOCK;
+
+    thread_pool_cpu_parallel_for(n * h, [&](size_t begin, size_t end){
+        memset(src_grad + begin * w * c, 0, (end - begin) * w * c * sizeof(float));
+    });
+    auto tiled_conv = [&](size_t ig, size_t in, size_t i_tile_h, size_t i_tile_w, size_t icb){
+        const naive_tiled_conv_plan_t::tile_t & tile = plan.tile(i_tile_h, i_tile_w);
+        const conv_geometry_cpu_dim_t & geo_y = plan.geo_y[i_tile_h];
+        const conv_geometry_cpu_dim_t & geo_x = plan.geo_x[i_tile_w];
+        size_t ic0 = icb * NAIVE_CONV_C_BLOCK;
+        size_t cb = c_per_group - ic0 < NAIVE_CONV_C_BLOCK ? c_per_group - ic0 : NAIVE_CONV_C_BLOCK;
+        float *tile_src_grad = src_grad + (in * h * w + tile.src) * c + ig * c_per_group + ic0;
+        const float *tile_dst_grad = dst_grad + (in * ho * wo + tile.dst) * k + ig * k_per_group;
+        const float *filter_c = filter + ig * k_per_group * fy * fx * c_per_group + ic0;
+        // every input of the slice sums the taps of this tile that reach it, then adds once into src_grad
+        for (size_t i_shi = 0; i_shi < geo_y.in(); i_shi++) {
+            for (size_t i_swi = 0; i_swi < geo_x.in(); i_swi++) {
+                const conv_geometry_cpu_dim_t::tap_t *ty, *ty_end, *tx, *tx_begin, *tx_end;
+                size_t base_h, base_w;
+                geo_y.bwd_taps(i_shi, &ty, &ty_end, &base_h);
+                geo_x.bwd_taps(i_swi, &tx_begin, &tx_end, &base_w);
+                if (ty == ty_end || tx_begin == tx_end)
+                    continue;
+                float value[NAIVE_CONV_C_BLOCK] = {.0f};
+                for (; ty < ty_end; ty++) {
+                    for (tx = tx_begin; tx < tx_end; tx++) {
+                        const float *dst_grad_p = tile_dst_grad + ((base_h - ty->q) * wo + base_w - tx->q) * k;
+                        const float *filter_t = filter_c + (ty->r * fx + tx->r) * c_per_group;
+                        for (size_t ik = 0; ik < k_per_group; ik++)
+                            simd_cpu_axpy_f32(value, dst_grad_p[ik], filter_t + ik * fy * fx * c_per_group, cb);
+                    }
+                }
+                simd_cpu_axpy_f32(tile_src_grad + (i_shi * w + i_swi) * c, 1.0f, value, cb);
+            }
+        }
+    };
+    naive_tiled_conv_in_rounds(plan, tiled_conv, group, n, c_blocks);
+}
+
+static inline void naive_tiled_conv_wrw_nchw(const float *src, float *filter_grad,
+                                       const float *dst_grad, size_t n, size_t w, size_t h,
+                                       size_t c, size_t k, size_t fx, size_t fy,
+                                       size_t px, size_t py, size_t sx, size_t sy,
+                                       size_t dx, size_t dy, size_t group,
+                                       size_t tx, size_t ty)
+{
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    naive_tiled_conv_plan_t plan(w, h, c_per_group, k_per_group, fx, fy, px, py, sx, sy, dx, dy, tx, ty);
+    size_t ho = plan.ho, wo = plan.wo;
+    size_t tiles = plan.tiles.size();
+    size_t tasks = k * c_per_group;     // one (k, c) filter of fy * fx taps
+    size_t rows = n * tiles;
+
+    auto range_func = [&](size_t r_begin, size_t r_end, float *grad, size_t begin, size_t end){
+        memset(grad + begin * fy * fx, 0, (end - begin) * fy * fx * sizeof(float));
+        for (size_t row = r_begin; row < r_end; row++) {
+            size_t in = row / tiles;
+            const naive_tiled_conv_plan_t::tile_t & tile = plan.tiles[row % tiles];
+            const conv_geometry_cpu_dim_t & geo_y = plan.geo_y[tile.i_tile_h];
+            const conv_geometry_cpu_dim_t & geo_x = plan.geo_x[tile.i_tile_w];
+            for (size_t task = begin; task < end; task++) {
+                size_t ik = task / c_per_group;     // across groups
+                size_t ic = task % c_per_group + ik / k_per_group * c_per_group;
+                const float *tile_src = src + in * c * h * w + ic * h * w + tile.src;
+                const float *tile_dst_grad = dst_grad + in * k * ho * wo + ik * ho * wo + tile.dst;
+                float *grad_p = grad + task * fy * fx;
+                for (size_t ir = 0; ir < fy; ir++) {
+                    for (size_t is = 0; is < fx; is++) {
+                        size_t ow_begin = geo_x.out_begin(is), ow_end = geo_x.out_end(is);
+                        if (ow_begin == ow_end)
+                            continue;
+                        float value = .0f;
+                        for (size_t i_sho = geo_y.out_begin(ir); i_sho < geo_y.out_end(ir); i_sho++) {
+                            const float *src_p = tile_src + geo_y.in_of(i_sho, ir) * w + geo_x.in_of(ow_begin, is);
+                            const float *dst_grad_p = tile_dst_grad + i_sho * wo + ow_begin;
+                            if (sx == 1)
+                                value += simd_cpu_dot_f32(src_p, dst_grad_p, ow_end - ow_begin);
+                            else
+                                for (size_t i_swo = 0; i_swo < ow_end - ow_begin; i_swo++)
+                                    value += src_p[i_swo * sx] * dst_grad_p[i_swo];
+                        }
+                        grad_p[ir * fx + is] += value;
+                    }
+                }
+            }
+        }
+    };
+    naive_conv_wrw_split_reduce(range_func, filter_grad, tasks * fy * fx, tasks, rows, naive_conv_wrw_get_splits(tasks, rows));
+}
+
+static inline void naive_tiled_conv_wrw_nhwc(const float *src, float *filter_grad,
+                                       const float *dst_grad, size_t n, size_t w, size_t h,
+                                       size_t c, size_t k, size_t fx, size_t fy,
+                                       size_t px, size_t py, size_t sx, size_t sy,
+                                       size_t dx, size_t dy, size_t group,
+                                       size_t tx, size_t ty)
+{
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    naive_tiled_conv_plan_t plan(w, h, c_per_group, k_per_group, fx, fy, px, py, sx, sy, dx, dy, tx, ty);
+    size_t ho = plan.ho, wo = plan.wo;
+    size_t tiles = plan.tiles.size();
+    size_t filter_size = fy * fx * c_per_group;     // one task is a k, across groups
+    size_t rows = n * tiles;
+
+    auto range_func = [&](size_t r_begin, size_t r_end, float *grad, size_t begin, size_t end){
+        memset(grad + begin * filter_size, 0, (end - begin) * filter_size * sizeof(float));
+        for (size_t row = r_begin; row < r_end; row++) {
+            size_t in = row / tiles;
+            const naive_tiled_conv_plan_t::tile_t & tile = plan.tiles[row % tiles];
+            const conv_geometry_cpu_dim_t & geo_y = plan.geo_y[tile.i_tile_h];
+            const conv_geometry_cpu_dim_t & geo_x = plan.geo_x[tile.i_tile_w];
+            for (size_t ik = begin; ik < end; ik++) {
+                const float *tile_src = src + (in * h * w + tile.src) * c + ik / k_per_group * c_per_group;
+                const float *tile_dst_grad = dst_grad + (in * ho * wo + tile.dst) * k + ik;
+                float *grad_k = grad + ik * filter_size;
+                for (size_t ir = 0; ir < fy; ir++) {
+                    for (size_t is = 0; is < fx; is++) {
+                        size_t ow_begin = geo_x.out_begin(is), ow_end = geo_x.out_end(is);
+                        if (ow_begin == ow_end)
+                            continue;
+                        float *grad_p = grad_k + (ir * fx + is) * c_per_group;
+                        for (size_t i_sho = geo_y.out_begin(ir); i_sho < geo_y.out_end(ir); i_sho++) {
+                            const float *src_p = tile_src + (geo_y.in_of(i_sho, ir) * w + geo_x.in_of(ow_begin, is)) * c;
+                            const float *dst_grad_p = tile_dst_grad + i_sho * wo * k;
+                            for (size_t i_swo = ow_begin; i_swo < ow_end; i_swo++)
+                                simd_cpu_axpy_f32(grad_p, dst_grad_p[i_swo * k], src_p + (i_swo - ow_begin) * sx * c, c_per_group);
+                        }
+                    }
+                }
+            }
+        }
+    };
+    naive_conv_wrw_split_reduce(range_func, filter_grad, k * filter_size, k, rows, naive_conv_wrw_get_splits(k, rows));
 }
 
 #endif
@@ -0,0 +1,102 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _RAND_CPU_H
+#define _RAND_CPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "thread_pool_cpu.h"
+#include "simd_cpu.h"
+#include "convert_cpu.h"
+
+/*
+ * counter based random tensor init. element i of a tensor is drawn from philox4x32-10 at counter i / 4, word i % 4,
+ * with the tensor id as stream and the seed as key, so the data depends on (seed, tensor, i) only, and not on the
+ * thread count or the split. the bits are drawn in blocks of RAND_CPU_BLOCK elements by simd_cpu_philox_u32, on the
+ * thread pool, then mapped to the range element by element:
+ *   float : min + u * (max - min), u = (bits >> 8) / 2^24 in [0, 1)
+ *   int   : min + ((bits * (max - min + 1)) >> 32), in [min, max] as std::uniform_int_distribution
+ * rand_cpu_uniform_dtype fuses the init with the conversion to the tensor dtype: each block is mapped to fp32 in a
+ * stack buffer and narrowed by convert_cpu_narrow_f32_block while still in cache, so the fp32 tensor is only written
+ * when the caller asks for it. the values are the ones of rand_cpu_uniform<float> followed by convert_cpu_narrow_f32.
+ */
+#define RAND_CPU_BLOCK 1024
+
+// tensor ids, one stream per tensor of a problem
+typedef enum {
+    rand_cpu_tensor_input   = 0,
+    rand_cpu_tensor_weight  = 1,
+    rand_cpu_tensor_output  = 2,
+} rand_cpu_tensor_t;
+
+static inline float rand_cpu_map(uint32_t bits, float min, float max)
+{
+    float u = (float)(bits >> 8) * (1.0f / 16777216.0f);
+    float v = u * (max - min);
+    return min + v;
+}
+
+static inline int rand_cpu_map(uint32_t bits, int min, int max)
+{
+    uint64_t range = (uint64_t)((int64_t)max - (int64_t)min) + 1;
+    return (int)((int64_t)min + (int64_t)(((uint64_t)bits * range) >> 32));
+}
+
+// dst[i] = static_cast<Dst_T>(scale * uniform(min, max)) for i < n
+template<typename Dst_T, typename Src_T>
+static inline void rand_cpu_uniform(Dst_T *dst, size_t n, Src_T min, Src_T max, uint64_t seed, uint32_t tensor, Src_T scale = 1)
+{
+    thread_pool_cpu_parallel_for(n, [&](size_t begin, size_t end){
+        uint32_t bits[RAND_CPU_BLOCK];
+        for(size_t i = begin; i < end; i += RAND_CPU_BLOCK){
+            size_t cnt = end - i < RAND_CPU_BLOCK ? end - i : RAND_CPU_BLOCK;
+            simd_cpu_philox_u32(bits, i / 4, (cnt + 3) / 4, tensor, seed);
+            for(size_t j = 0; j < cnt; j++)
+                dst[i + j] = static_cast<Dst_T>(scale * rand_cpu_map(bits[j], min, max));
+        }
+    }, 4);
+}
+
+// dst[i] = uniform(min, max) in dtype for i < n, and dst_f32[i] the same value before the narrowing if dst_f32 is not NULL
+template<typename Src_T>
+static inline void rand_cpu_uniform_dtype(convert_cpu_dtype_t dtype, void *dst, float *dst_f32, size_t n, Src_T min, Src_T max, uint64_t seed, uint32_t tensor)
+{
+    thread_pool_cpu_parallel_for(n, [&](size_t begin, size_t end){
+        uint32_t bits[RAND_CPU_BLOCK];
+        float value[RAND_CPU_BLOCK];
+        for(size_t i = begin; i < end; i += RAND_CPU_BLOCK){
+            size_t cnt = end - i < RAND_CPU_BLOCK ? end - i : RAND_CPU_BLOCK;
+            float *f = dst_f32 ? dst_f32 + i : (dtype == convert_cpu_fp32 ? (float *)dst + i : value);
+            simd_cpu_philox_u32(bits, i / 4, (cnt + 3) / 4, tensor, seed);
+            for(size_t j = 0; j < cnt; j++)
+                f[j] = static_cast<float>(rand_cpu_map(bits[j], min, max));
+            if(f != (float *)dst + i)
+                convert_cpu_narrow_f32_block(dtype, dst, i, f, cnt);
+        }
+    }, 4);      // int4 blocks start on a byte
+}
+
+#endif
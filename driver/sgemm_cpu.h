@@ -0,0 +1,268 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _SGEMM_CPU_H
+#define _SGEMM_CPU_H
+
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "simd_cpu.h"
+
+/*
+ * single threaded, packed and cache blocked fp32 gemm for the host reference path.
+ *     C[m][n] = A[m][k] * B[k][n]      (accumulate == false)
+ *     C[m][n] += A[m][k] * B[k][n]     (accumulate == true)
+ * every operand is addressed by a row stride and a column stride, so transposed
+ * or strided views (e.g. one group of a filter, or one tap of an im2col matrix) need no copy.
+ * callers parallelize on a higher level, every thread owning its own part of C.
+ *
+ * the register tile (MR x NR) depends on the micro kernel picked at runtime from simd_cpu_get_isa():
+ * scalar 4x8, avx2 6x16, avx512 8x32.
+ */
+#ifndef SGEMM_CPU_MC
+#define SGEMM_CPU_MC 96         // multiple of every MR
+#endif
+#ifndef SGEMM_CPU_KC
+#define SGEMM_CPU_KC 256
+#endif
+#ifndef SGEMM_CPU_NC
+#define SGEMM_CPU_NC 512        // multiple of every NR
+#endif
+#define SGEMM_CPU_MAX_MR 8
+#define SGEMM_CPU_MAX_NR 32
+
+// acc[MR][NR] = sum over kc of pa[p][MR] x pb[p][NR]
+typedef void (*sgemm_cpu_kernel_t)(size_t kc, const float *pa, const float *pb, float *acc);
+
+typedef struct {
+    size_t mr;
+    size_t nr;
+    sgemm_cpu_kernel_t func;
+} sgemm_cpu_kernel_desc_t;
+
+static inline void sgemm_cpu_kernel_4x8(size_t kc, const float *pa, const float *pb, float *acc)
+{
+    float c[4][8];
+    for(size_t i = 0; i < 4; i++)
+        for(size_t j = 0; j < 8; j++)
+            c[i][j] = .0f;
+    for(size_t p = 0; p < kc; p++){
+        for(size_t i = 0; i < 4; i++){
+            float a = pa[i];
+            for(size_t j = 0; j < 8; j++)
+                c[i][j] += a * pb[j];
+        }
+        pa += 4;
+        pb += 8;
+    }
+    for(size_t i = 0; i < 4; i++)
+        for(size_t j = 0; j < 8; j++)
+            acc[i * 8 + j] = c[i][j];
+}
+
+#if SIMD_CPU_X86
+__attribute__((target("avx2,fma")))
+static inline void sgemm_cpu_kernel_6x16_avx2(size_t kc, const float *pa, const float *pb, float *acc)
+{
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+    for(size_t p = 0; p < kc; p++){
+        __m256 b0 = _mm256_loadu_ps(pb);
+        __m256 b1 = _mm256_loadu_ps(pb + 8);
+        __m256 a;
+        a = _mm256_broadcast_ss(pa + 0); c00 = _mm256_fmadd_ps(a, b0, c00); c01 = _mm256_fmadd_ps(a, b1, c01);
+        a = _mm256_broadcast_ss(pa + 1); c10 = _mm256_fmadd_ps(a, b0, c10); c11 = _mm256_fmadd_ps(a, b1, c11);
+        a = _mm256_broadcast_ss(pa + 2); c20 = _mm256_fmadd_ps(a, b0, c20); c21 = _mm256_fmadd_ps(a, b1, c21);
+        a = _mm256_broadcast_ss(pa + 3); c30 = _mm256_fmadd_ps(a, b0, c30); c31 = _mm256_fmadd_ps(a, b1, c31);
+        a = _mm256_broadcast_ss(pa + 4); c40 = _mm256_fmadd_ps(a, b0, c40); c41 = _mm256_fmadd_ps(a, b1, c41);
+        a = _mm256_broadcast_ss(pa + 5); c50 = _mm256_fmadd_ps(a, b0, c50); c51 = _mm256_fmadd_ps(a, b1, c51);
+        pa += 6;
+        pb += 16;
+    }
+    _mm256_storeu_ps(acc + 0 * 16, c00); _mm256_storeu_ps(acc + 0 * 16 + 8, c01);
+    _mm256_storeu_ps(acc + 1 * 16, c10); _mm256_storeu_ps(acc + 1 * 16 + 8, c11);
+    _mm256_storeu_ps(acc + 2 * 16, c20); _mm256_storeu_ps(acc + 2 * 16 + 8, c21);
+    _mm256_storeu_ps(acc + 3 * 16, c30); _mm256_storeu_ps(acc + 3 * 16 + 8, c31);
+    _mm256_storeu_ps(acc + 4 * 16, c40); _mm256_storeu_ps(acc + 4 * 16 + 8, c41);
+    _mm256_storeu_ps(acc + 5 * 16, c50); _mm256_storeu_ps(acc + 5 * 16 + 8, c51);
+}
+
+__attribute__((target("avx512f")))
+static inline void sgemm_cpu_kernel_8x32_avx512(size_t kc, const float *pa, const float *pb, float *acc)
+{
+    __m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps();
+    __m512 c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+    __m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps();
+    __m512 c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+    __m512 c40 = _mm512_setzero_ps(), c41 = _mm512_setzero_ps();
+    __m512 c50 = _mm512_setzero_ps(), c51 = _mm512_setzero_ps();
+    __m512 c60 = _mm512_setzero_ps(), c61 = _mm512_setzero_ps();
+    __m512 c70 = _mm512_setzero_ps(), c71 = _mm512_setzero_ps();
+    for(size_t p = 0; p < kc; p++){
+        __m512 b0 = _mm512_loadu_ps(pb);
+        __m512 b1 = _mm512_loadu_ps(pb + 16);
+        __m512 a;
+        a = _mm512_set1_ps(pa[0]); c00 = _mm512_fmadd_ps(a, b0, c00); c01 = _mm512_fmadd_ps(a, b1, c01);
+        a = _mm512_set1_ps(pa[1]); c10 = _mm512_fmadd_ps(a, b0, c10); c11 = _mm512_fmadd_ps(a, b1, c11);
+        a = _mm512_set1_ps(pa[2]); c20 = _mm512_fmadd_ps(a, b0, c20); c21 = _mm512_fmadd_ps(a, b1, c21);
+        a = _mm512_set1_ps(pa[3]); c30 = _mm512_fmadd_ps(a, b0, c30); c31 = _mm512_fmadd_ps(a, b1, c31);
+        a = _mm512_set1_ps(pa[4]); c40 = _mm512_fmadd_ps(a, b0, c40); c41 = _mm512_fmadd_ps(a, b1, c41);
+        a = _mm512_set1_ps(pa[5]); c50 = _mm512_fmadd_ps(a, b0, c50); c51 = _mm512_fmadd_ps(a, b1, c51);
+        a = _mm512_set1_ps(pa[6]); c60 = _mm512_fmadd_ps(a, b0, c60); c61 = _mm512_fmadd_ps(a, b1, c61);
+        a = _mm512_set1_ps(pa[7]); c70 = _mm512_fmadd_ps(a, b0, c70); c71 = _mm512_fmadd_ps(a, b1, c71);
+        pa += 8;
+        pb += 32;
+    }
+    _mm512_storeu_ps(acc + 0 * 32, c00); _mm512_storeu_ps(acc + 0 * 32 + 16, c01);
+    _mm512_storeu_ps(acc + 1 * 32, c10); _mm512_storeu_ps(acc + 1 * 32 + 16, c11);
+    _mm512_storeu_ps(acc + 2 * 32, c20); _mm512_storeu_ps(acc + 2 * 32 + 16, c21);
+    _mm512_storeu_ps(acc + 3 * 32, c30); _mm512_storeu_ps(acc + 3 * 32 + 16, c31);
+    _mm512_storeu_ps(acc + 4 * 32, c40); _mm512_storeu_ps(acc + 4 * 32 + 16, c41);
+    _mm512_storeu_ps(acc + 5 * 32, c50); _mm512_storeu_ps(acc + 5 * 32 + 16, c51);
+    _mm512_storeu_ps(acc + 6 * 32, c60); _mm512_storeu_ps(acc + 6 * 32 + 16, c61);
+    _mm512_storeu_ps(acc + 7 * 32, c70); _mm512_storeu_ps(acc + 7 * 32 + 16, c71);
+}
+#endif
+
+static inline sgemm_cpu_kernel_desc_t sgemm_cpu_select_kernel()
+{
+    sgemm_cpu_kernel_desc_t desc = {4, 8, sgemm_cpu_kernel_4x8};
+#if SIMD_CPU_X86
+    if(simd_cpu_get_isa() == simd_cpu_isa_avx512){
+        desc.mr = 8; desc.nr = 32; desc.func = sgemm_cpu_kernel_8x32_avx512;
+    }else if(simd_cpu_get_isa() == simd_cpu_isa_avx2){
+        desc.mr = 6; desc.nr = 16; desc.func = sgemm_cpu_kernel_6x16_avx2;
+    }
+#endif
+    return desc;
+}
+
+static inline const sgemm_cpu_kernel_desc_t & sgemm_cpu_get_kernel()
+{
+    static const sgemm_cpu_kernel_desc_t desc = sgemm_cpu_select_kernel();
+    return desc;
+}
+
+// pack a mc x kc block of A into mr row panels, k major inside a panel. rows past mc are zero
+static inline void sgemm_cpu_pack_a(size_t mc, size_t kc, const float *a, size_t a_sm, size_t a_sk, size_t mr_max, float *pa)
+{
+    for(size_t i0 = 0; i0 < mc; i0 += mr_max){
+        size_t mr = mc - i0 < mr_max ? mc - i0 : mr_max;
+        for(size_t p = 0; p < kc; p++){
+            for(size_t i = 0; i < mr; i++)
+                pa[i] = a[(i0 + i) * a_sm + p * a_sk];
+            for(size_t i = mr; i < mr_max; i++)
+                pa[i] = .0f;
+            pa += mr_max;
+        }
+    }
+}
+
+// pack a kc x nc block of B into nr column panels, k major inside a panel. columns past nc are zero
+static inline void sgemm_cpu_pack_b(size_t kc, size_t nc, const float *b, size_t b_sk, size_t b_sn, size_t nr_max, float *pb)
+{
+    for(size_t j0 = 0; j0 < nc; j0 += nr_max){
+        size_t nr = nc - j0 < nr_max ? nc - j0 : nr_max;
+        for(size_t p = 0; p < kc; p++){
+            const float *b_row = b + p * b_sk + j0 * b_sn;
+            if(b_sn == 1)
+                memcpy(pb, b_row, nr * sizeof(float));
+            else
+                for(size_t j = 0; j < nr; j++)
+                    pb[j] = b_row[j * b_sn];
+            for(size_t j = nr; j < nr_max; j++)
+                pb[j] = .0f;
+            pb += nr_max;
+        }
+    }
+}
+
+static inline void sgemm_cpu(size_t m, size_t n, size_t k,
+                             const float *a, size_t a_sm, size_t a_sk,
+                             const float *b, size_t b_sk, size_t b_sn,
+                             float *c, size_t c_sm, size_t c_sn,
+                             bool accumulate = false)
+{
+    if(m == 0 || n == 0)
+        return;
+    if(k == 0){
+        if(!accumulate)
+            for(size_t i = 0; i < m; i++)
+                for(size_t j = 0; j < n; j++)
+                    c[i * c_sm + j * c_sn] = .0f;
+        return;
+    }
+
+    const sgemm_cpu_kernel_desc_t & kernel = sgemm_cpu_get_kernel();
+    const size_t mr_max = kernel.mr;
+    const size_t nr_max = kernel.nr;
+
+    // pack buffers are kept per thread and reused across calls
+    static thread_local std::vector<float> buf_a;
+    static thread_local std::vector<float> buf_b;
+    buf_a.resize(SGEMM_CPU_MC * SGEMM_CPU_KC);
+    buf_b.resize(SGEMM_CPU_NC * SGEMM_CPU_KC);
+    float *pa = buf_a.data();
+    float *pb = buf_b.data();
+    float acc[SGEMM_CPU_MAX_MR * SGEMM_CPU_MAX_NR];
+
+    for(size_t jc = 0; jc < n; jc += SGEMM_CPU_NC){
+        size_t nc = n - jc < SGEMM_CPU_NC ? n - jc : SGEMM_CPU_NC;
+        for(size_t pc = 0; pc < k; pc += SGEMM_CPU_KC){
+            size_t kc = k - pc < SGEMM_CPU_KC ? k - pc : SGEMM_CPU_KC;
+            bool accumulate_c = accumulate || pc != 0;
+            sgemm_cpu_pack_b(kc, nc, b + pc * b_sk + jc * b_sn, b_sk, b_sn, nr_max, pb);
+            for(size_t ic = 0; ic < m; ic += SGEMM_CPU_MC){
+                size_t mc = m - ic < SGEMM_CPU_MC ? m - ic : SGEMM_CPU_MC;
+                sgemm_cpu_pack_a(mc, kc, a + ic * a_sm + pc * a_sk, a_sm, a_sk, mr_max, pa);
+                for(size_t jr = 0; jr < nc; jr += nr_max){
+                    size_t nr = nc - jr < nr_max ? nc - jr : nr_max;
+                    for(size_t ir = 0; ir < mc; ir += mr_max){
+                        size_t mr = mc - ir < mr_max ? mc - ir : mr_max;
+                        kernel.func(kc, pa + ir * kc, pb + jr * kc, acc);
+                        float *c_tile = c + (ic + ir) * c_sm + (jc + jr) * c_sn;
+                        for(size_t i = 0; i < mr; i++){
+                            float *c_row = c_tile + i * c_sm;
+                            const float *acc_row = acc + i * nr_max;
+                            if(accumulate_c)
+                                for(size_t j = 0; j < nr; j++)
+                                    c_row[j * c_sn] += acc_row[j];
+                            else
+                                for(size_t j = 0; j < nr; j++)
+                                    c_row[j * c_sn] = acc_row[j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+#endif
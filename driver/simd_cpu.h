@@ -0,0 +1,696 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _SIMD_CPU_H
+#define _SIMD_CPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * runtime dispatched simd helpers for host side loops.
+ * the binary is built without -march, so each isa variant is compiled with a target attribute,
+ * and the widest one the cpu supports is picked on first use.
+ *
+ * IGEMM_CPU_SIMD : cap the isa to use, "scalar", "avx2" or "avx512". default is what the cpu supports
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_CPU_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_CPU_X86 0
+#endif
+
+typedef enum {
+    simd_cpu_isa_scalar = 0,
+    simd_cpu_isa_avx2   = 1,    // avx2 + fma + f16c
+    simd_cpu_isa_avx512 = 2,    // avx512f
+} simd_cpu_isa_t;
+
+static inline simd_cpu_isa_t simd_cpu_detect_isa()
+{
+    simd_cpu_isa_t isa = simd_cpu_isa_scalar;
+#if SIMD_CPU_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+        isa = simd_cpu_isa_avx2;
+    if(isa == simd_cpu_isa_avx2 && __builtin_cpu_supports("avx512f"))
+        isa = simd_cpu_isa_avx512;
+#endif
+    char *v = getenv("IGEMM_CPU_SIMD");
+    if(v){
+        simd_cpu_isa_t cap = isa;
+        if(strcmp(v, "scalar") == 0)
+            cap = simd_cpu_isa_scalar;
+        else if(strcmp(v, "avx2") == 0)
+            cap = simd_cpu_isa_avx2;
+        if(cap < isa)
+            isa = cap;
+    }
+    return isa;
+}
+
+static inline simd_cpu_isa_t simd_cpu_get_isa()
+{
+    static const simd_cpu_isa_t isa = simd_cpu_detect_isa();
+    return isa;
+}
+
+static inline const char * simd_cpu_isa_name(simd_cpu_isa_t isa)
+{
+    switch(isa){
+        case simd_cpu_isa_avx2: return "avx2";
+        case simd_cpu_isa_avx512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+/********************************************************************************
+ * dot : return sum(a[i] * b[i])
+ */
+static inline float simd_cpu_dot_f32_scalar(const float *a, const float *b, size_t n)
+{
+    float acc = .0f;
+    for(size_t i = 0; i < n; i++)
+        acc += a[i] * b[i];
+    return acc;
+}
+
+/********************************************************************************
+ * axpy : y[i] += alpha * x[i]
+ */
+static inline void simd_cpu_axpy_f32_scalar(float *y, float alpha, const float *x, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+        y[i] += alpha * x[i];
+}
+
+/********************************************************************************
+ * butterfly : t = omega * b, b = a - t, a = a + t, complex values in split re/im arrays
+ */
+static inline void simd_cpu_butterfly_f32_scalar(float *ar, float *ai, float *br, float *bi, float omr, float omi, size_t n)
+{
+    for(size_t i = 0; i < n; i++){
+        float tr = br[i] * omr - bi[i] * omi;
+        float ti = br[i] * omi + bi[i] * omr;
+        br[i] = ar[i] - tr;
+        bi[i] = ai[i] - ti;
+        ar[i] = ar[i] + tr;
+        ai[i] = ai[i] + ti;
+    }
+}
+
+/********************************************************************************
+ * cmac : c += a * b, or c += a * conj(b) if conj_b, complex values in split re/im arrays
+ */
+static inline void simd_cpu_cmac_f32_scalar(float *cr, float *ci, const float *ar, const float *ai,
+                                            const float *br, const float *bi, bool conj_b, size_t n)
+{
+    float s = conj_b ? -1.0f : 1.0f;
+    for(size_t i = 0; i < n; i++){
+        cr[i] += ar[i] * br[i] - ai[i] * bi[i] * s;
+        ci[i] += ai[i] * br[i] + ar[i] * bi[i] * s;
+    }
+}
+
+/********************************************************************************
+ * nrms : s[0] += sum((r[i] - p[i])^2), s[1] += sum(2 * r[i]^2) in fp64, m[0] = max(m[0], |r[i]|),
+ * m[1] = max(m[1], |p[i]|), the terms of the nrms of tensor_validation_cpu.h. nan does not move the max.
+ * return false if any r[i] or p[i] is nan/inf
+ */
+static inline bool simd_cpu_nrms_f32_scalar(const float *r, const float *p, size_t n, double *s, float *m)
+{
+    bool finite = true;
+    for(size_t i = 0; i < n; i++){
+        double ri = (double)r[i];
+        double d = ri - (double)p[i];
+        float ar = r[i] < 0 ? -r[i] : r[i];
+        float ap = p[i] < 0 ? -p[i] : p[i];
+        s[0] += d * d;
+        s[1] += 2.0 * ri * ri;
+        m[0] = m[0] < ar ? ar : m[0];
+        m[1] = m[1] < ap ? ap : m[1];
+        finite = finite && ar <= 3.40282347e+38f && ap <= 3.40282347e+38f;
+    }
+    return finite;
+}
+
+/********************************************************************************
+ * dot_s16 : return sum(a[i] * b[i]) in int32, exact as long as it does not overflow
+ */
+static inline int32_t simd_cpu_dot_s16_scalar(const int16_t *a, const int16_t *b, size_t n)
+{
+    int32_t acc = 0;
+    for(size_t i = 0; i < n; i++)
+        acc += (int32_t)a[i] * (int32_t)b[i];
+    return acc;
+}
+
+/********************************************************************************
+ * philox : dst[4 * j + w] = word w of philox4x32-10 at counter {ctr + j (64 bit), stream, 0} and key, j < n.
+ * a counter based generator, so any element can be drawn on its own, by any thread
+ */
+#define SIMD_CPU_PHILOX_M0 0xD2511F53u
+#define SIMD_CPU_PHILOX_M1 0xCD9E8D57u
+#define SIMD_CPU_PHILOX_W0 0x9E3779B9u
+#define SIMD_CPU_PHILOX_W1 0xBB67AE85u
+
+static inline void simd_cpu_philox_u32_scalar(uint32_t *dst, uint64_t ctr, size_t n, uint32_t stream, uint64_t key)
+{
+    for(size_t j = 0; j < n; j++){
+        uint32_t c[4] = {(uint32_t)(ctr + j), (uint32_t)((ctr + j) >> 32), stream, 0};
+        uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key >> 32);
+        for(int r = 0; r < 10; r++){
+            uint64_t p0 = (uint64_t)SIMD_CPU_PHILOX_M0 * c[0];
+            uint64_t p1 = (uint64_t)SIMD_CPU_PHILOX_M1 * c[2];
+            uint32_t t[4] = {(uint32_t)(p1 >> 32) ^ c[1] ^ k0, (uint32_t)p1, (uint32_t)(p0 >> 32) ^ c[3] ^ k1, (uint32_t)p0};
+            memcpy(c, t, sizeof(c));
+            k0 += SIMD_CPU_PHILOX_W0;
+            k1 += SIMD_CPU_PHILOX_W1;
+        }
+        memcpy(dst + 4 * j, c, sizeof(c));
+    }
+}
+
+#if SIMD_CPU_X86
+__attribute__((target("avx2,fma")))
+static inline int32_t simd_cpu_dot_s16_avx2(const int16_t *a, const int16_t *b, size_t n)
+{
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for(; i + 32 <= n; i += 32){
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                                        _mm256_loadu_si256((const __m256i *)(b + i))));
+        acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(a + i + 16)),
+                                                        _mm256_loadu_si256((const __m256i *)(b + i + 16))));
+    }
+    for(; i + 16 <= n; i += 16)
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                                        _mm256_loadu_si256((const __m256i *)(b + i))));
+    __m256i acc = _mm256_add_epi32(acc0, acc1);
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    int32_t r = _mm_cvtsi128_si32(s);
+    for(; i < n; i++)
+        r += (int32_t)a[i] * (int32_t)b[i];
+    return r;
+}
+
+__attribute__((target("avx2,fma")))
+static inline float simd_cpu_dot_f32_avx2(const float *a, const float *b, size_t n)
+{
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for(; i + 32 <= n; i += 32){
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i),      _mm256_loadu_ps(b + i),      acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8),  _mm256_loadu_ps(b + i + 8),  acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), acc3);
+    }
+    for(; i + 8 <= n; i += 8)
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    __m256 acc = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x55));
+    float r = _mm_cvtss_f32(s);
+    for(; i < n; i++)
+        r += a[i] * b[i];
+    return r;
+}
+
+__attribute__((target("avx2,fma")))
+static inline void simd_cpu_axpy_f32_avx2(float *y, float alpha, const float *x, size_t n)
+{
+    __m256 va = _mm256_set1_ps(alpha);
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16){
+        __m256 y0 = _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i),     _mm256_loadu_ps(y + i));
+        __m256 y1 = _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(y + i + 8));
+        _mm256_storeu_ps(y + i, y0);
+        _mm256_storeu_ps(y + i + 8, y1);
+    }
+    for(; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+    for(; i < n; i++)
+        y[i] += alpha * x[i];
+}
+
+__attribute__((target("avx2,fma")))
+static inline void simd_cpu_butterfly_f32_avx2(float *ar, float *ai, float *br, float *bi, float omr, float omi, size_t n)
+{
+    __m256 vr = _mm256_set1_ps(omr);
+    __m256 vi = _mm256_set1_ps(omi);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m256 xr = _mm256_loadu_ps(br + i);
+        __m256 xi = _mm256_loadu_ps(bi + i);
+        __m256 tr = _mm256_fmsub_ps(xr, vr, _mm256_mul_ps(xi, vi));
+        __m256 ti = _mm256_fmadd_ps(xr, vi, _mm256_mul_ps(xi, vr));
+        __m256 yr = _mm256_loadu_ps(ar + i);
+        __m256 yi = _mm256_loadu_ps(ai + i);
+        _mm256_storeu_ps(br + i, _mm256_sub_ps(yr, tr));
+        _mm256_storeu_ps(bi + i, _mm256_sub_ps(yi, ti));
+        _mm256_storeu_ps(ar + i, _mm256_add_ps(yr, tr));
+        _mm256_storeu_ps(ai + i, _mm256_add_ps(yi, ti));
+    }
+    simd_cpu_butterfly_f32_scalar(ar + i, ai + i, br + i, bi + i, omr, omi, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static inline void simd_cpu_cmac_f32_avx2(float *cr, float *ci, const float *ar, const float *ai,
+                                          const float *br, const float *bi, bool conj_b, size_t n)
+{
+    __m256 s = _mm256_set1_ps(conj_b ? -1.0f : 1.0f);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m256 xr = _mm256_loadu_ps(ar + i);
+        __m256 xi = _mm256_loadu_ps(ai + i);
+        __m256 yr = _mm256_loadu_ps(br + i);
+        __m256 yi = _mm256_mul_ps(_mm256_loadu_ps(bi + i), s);
+        _mm256_storeu_ps(cr + i, _mm256_fnmadd_ps(xi, yi, _mm256_fmadd_ps(xr, yr, _mm256_loadu_ps(cr + i))));
+        _mm256_storeu_ps(ci + i, _mm256_fmadd_ps(xr, yi, _mm256_fmadd_ps(xi, yr, _mm256_loadu_ps(ci + i))));
+    }
+    simd_cpu_cmac_f32_scalar(cr + i, ci + i, ar + i, ai + i, br + i, bi + i, conj_b, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static inline bool simd_cpu_nrms_f32_avx2(const float *r, const float *p, size_t n, double *s, float *m)
+{
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 fmax = _mm256_set1_ps(3.40282347e+38f);
+    const __m256d two = _mm256_set1_pd(2.0);
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    __m256 m0 = _mm256_set1_ps(m[0]), m1 = _mm256_set1_ps(m[1]);
+    __m256 finite = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m256 vr = _mm256_loadu_ps(r + i);
+        __m256 vp = _mm256_loadu_ps(p + i);
+        __m256 ar = _mm256_andnot_ps(sign, vr);
+        __m256 ap = _mm256_andnot_ps(sign, vp);
+        m0 = _mm256_max_ps(ar, m0);     // the second operand is kept when the first is nan
+        m1 = _mm256_max_ps(ap, m1);
+        finite = _mm256_and_ps(finite, _mm256_and_ps(_mm256_cmp_ps(ar, fmax, _CMP_LE_OQ), _mm256_cmp_ps(ap, fmax, _CMP_LE_OQ)));
+        for(int h = 0; h < 2; h++){
+            __m256d dr = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(vr, 1) : _mm256_castps256_ps128(vr));
+            __m256d dp = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(vp, 1) : _mm256_castps256_ps128(vp));
+            __m256d d = _mm256_sub_pd(dr, dp);
+            s0 = _mm256_add_pd(s0, _mm256_mul_pd(d, d));
+            s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_mul_pd(two, dr), dr));
+        }
+    }
+    double ts0[4], ts1[4];
+    float tm0[8], tm1[8];
+    _mm256_storeu_pd(ts0, s0);
+    _mm256_storeu_pd(ts1, s1);
+    _mm256_storeu_ps(tm0, m0);
+    _mm256_storeu_ps(tm1, m1);
+    for(int l = 0; l < 4; l++){
+        s[0] += ts0[l];
+        s[1] += ts1[l];
+    }
+    for(int l = 0; l < 8; l++){
+        m[0] = m[0] < tm0[l] ? tm0[l] : m[0];
+        m[1] = m[1] < tm1[l] ? tm1[l] : m[1];
+    }
+    bool tail_finite = simd_cpu_nrms_f32_scalar(r + i, p + i, n - i, s, m);
+    return _mm256_movemask_ps(finite) == 0xff && tail_finite;
+}
+
+// hi and lo 32 bit of a[i] * m, for 8 lanes
+__attribute__((target("avx2,fma")))
+static inline void simd_cpu_mulhilo_u32_avx2(__m256i a, __m256i m, __m256i *hi, __m256i *lo)
+{
+    __m256i p_even = _mm256_mul_epu32(a, m);
+    __m256i p_odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+    *lo = _mm256_blend_epi32(p_even, _mm256_slli_epi64(p_odd, 32), 0xaa);
+    *hi = _mm256_blend_epi32(_mm256_srli_epi64(p_even, 32), p_odd, 0xaa);
+}
+
+__attribute__((target("avx2,fma")))
+static inline void simd_cpu_philox_u32_avx2(uint32_t *dst, uint64_t ctr, size_t n, uint32_t stream, uint64_t key)
+{
+    const __m256i m0 = _mm256_set1_epi32((int)SIMD_CPU_PHILOX_M0);
+    const __m256i m1 = _mm256_set1_epi32((int)SIMD_CPU_PHILOX_M1);
+    size_t j = 0;
+    for(; j + 8 <= n; j += 8){
+        uint32_t lo[8], hi[8];
+        for(int l = 0; l < 8; l++){
+            lo[l] = (uint32_t)(ctr + j + l);
+            hi[l] = (uint32_t)((ctr + j + l) >> 32);
+        }
+        __m256i c0 = _mm256_loadu_si256((const __m256i *)lo);
+        __m256i c1 = _mm256_loadu_si256((const __m256i *)hi);
+        __m256i c2 = _mm256_set1_epi32((int)stream);
+        __m256i c3 = _mm256_setzero_si256();
+        uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key >> 32);
+        for(int r = 0; r < 10; r++){
+            __m256i hi0, lo0, hi1, lo1;
+            simd_cpu_mulhilo_u32_avx2(c0, m0, &hi0, &lo0);
+            simd_cpu_mulhilo_u32_avx2(c2, m1, &hi1, &lo1);
+            c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32((int)k0));
+            c1 = lo1;
+            c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32((int)k1));
+            c3 = lo0;
+            k0 += SIMD_CPU_PHILOX_W0;
+            k1 += SIMD_CPU_PHILOX_W1;
+        }
+        // 4 words x 8 counters to counter major
+        __m256i t0 = _mm256_unpacklo_epi32(c0, c1), t1 = _mm256_unpackhi_epi32(c0, c1);
+        __m256i t2 = _mm256_unpacklo_epi32(c2, c3), t3 = _mm256_unpackhi_epi32(c2, c3);
+        __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);     // counters 0|4, 1|5
+        __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);     // counters 2|6, 3|7
+        __m256i *d = (__m256i *)(dst + 4 * j);
+        _mm256_storeu_si256(d + 0, _mm256_permute2x128_si256(u0, u1, 0x20));
+        _mm256_storeu_si256(d + 1, _mm256_permute2x128_si256(u2, u3, 0x20));
+        _mm256_storeu_si256(d + 2, _mm256_permute2x128_si256(u0, u1, 0x31));
+        _mm256_storeu_si256(d + 3, _mm256_permute2x128_si256(u2, u3, 0x31));
+    }
+    simd_cpu_philox_u32_scalar(dst + 4 * j, ctr + j, n - j, stream, key);
+}
+
+__attribute__((target("avx512f")))
+static inline float simd_cpu_dot_f32_avx512(const float *a, const float *b, size_t n)
+{
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps();
+    __m512 acc3 = _mm512_setzero_ps();
+    size_t i = 0;
+    for(; i + 64 <= n; i += 64){
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i),      _mm512_loadu_ps(b + i),      acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+        acc2 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32), acc2);
+        acc3 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48), acc3);
+    }
+    for(; i + 16 <= n; i += 16)
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+    if(i < n){
+        __mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i), acc1);
+    }
+    __m512 acc = _mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3));
+    return _mm512_reduce_add_ps(acc);
+}
+
+__attribute__((target("avx512f")))
+static inline void simd_cpu_axpy_f32_avx512(float *y, float alpha, const float *x, size_t n)
+{
+    __m512 va = _mm512_set1_ps(alpha);
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+    if(i < n){
+        __mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(y + i, m, _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, x + i), _mm512_maskz_loadu_ps(m, y + i)));
+    }
+}
+
+__attribute__((target("avx512f")))
+static inline void simd_cpu_butterfly_f32_avx512(float *ar, float *ai, float *br, float *bi, float omr, float omi, size_t n)
+{
+    __m512 vr = _mm512_set1_ps(omr);
+    __m512 vi = _mm512_set1_ps(omi);
+    for(size_t i = 0; i < n; i += 16){
+        __mmask16 m = n - i >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << (n - i)) - 1);
+        __m512 xr = _mm512_maskz_loadu_ps(m, br + i);
+        __m512 xi = _mm512_maskz_loadu_ps(m, bi + i);
+        __m512 tr = _mm512_fmsub_ps(xr, vr, _mm512_mul_ps(xi, vi));
+        __m512 ti = _mm512_fmadd_ps(xr, vi, _mm512_mul_ps(xi, vr));
+        __m512 yr = _mm512_maskz_loadu_ps(m, ar + i);
+        __m512 yi = _mm512_maskz_loadu_ps(m, ai + i);
+        _mm512_mask_storeu_ps(br + i, m, _mm512_sub_ps(yr, tr));
+        _mm512_mask_storeu_ps(bi + i, m, _mm512_sub_ps(yi, ti));
+        _mm512_mask_storeu_ps(ar + i, m, _mm512_add_ps(yr, tr));
+        _mm512_mask_storeu_ps(ai + i, m, _mm512_add_ps(yi, ti));
+    }
+}
+
+__attribute__((target("avx512f")))
+static inline void simd_cpu_cmac_f32_avx512(float *cr, float *ci, const float *ar, const float *ai,
+                                            const float *br, const float *bi, bool conj_b, size_t n)
+{
+    __m512 s = _mm512_set1_ps(conj_b ? -1.0f : 1.0f);
+    for(size_t i = 0; i < n; i += 16){
+        __mmask16 m = n - i >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << (n - i)) - 1);
+        __m512 xr = _mm512_maskz_loadu_ps(m, ar + i);
+        __m512 xi = _mm512_maskz_loadu_ps(m, ai + i);
+        __m512 yr = _mm512_maskz_loadu_ps(m, br + i);
+        __m512 yi = _mm512_mul_ps(_mm512_maskz_loadu_ps(m, bi + i), s);
+        _mm512_mask_storeu_ps(cr + i, m, _mm512_fnmadd_ps(xi, yi, _mm512_fmadd_ps(xr, yr, _mm512_maskz_loadu_ps(m, cr + i))));
+        _mm512_mask_storeu_ps(ci + i, m, _mm512_fmadd_ps(xr, yi, _mm512_fmadd_ps(xi, yr, _mm512_maskz_loadu_ps(m, ci + i))));
+    }
+}
+__attribute__((target("avx512f")))
+static inline bool simd_cpu_nrms_f32_avx512(const float *r, const float *p, size_t n, double *s, float *m)
+{
+    const __m512 fmax = _mm512_set1_ps(3.40282347e+38f);
+    const __m512d two = _mm512_set1_pd(2.0);
+    __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+    __m512 m0 = _mm512_set1_ps(m[0]), m1 = _mm512_set1_ps(m[1]);
+    __mmask16 finite = 0xffff;
+    for(size_t i = 0; i < n; i += 16){
+        // the masked off lanes of the tail load 0, which adds nothing
+        __mmask16 k = n - i < 16 ? (__mmask16)((1u << (n - i)) - 1) : (__mmask16)0xffff;
+        __m512 vr = _mm512_maskz_loadu_ps(k, r + i);
+        __m512 vp = _mm512_maskz_loadu_ps(k, p + i);
+        __m512 ar = _mm512_abs_ps(vr);
+        __m512 ap = _mm512_abs_ps(vp);
+        m0 = _mm512_max_ps(ar, m0);     // the second operand is kept when the first is nan
+        m1 = _mm512_max_ps(ap, m1);
+        finite &= _mm512_cmp_ps_mask(ar, fmax, _CMP_LE_OQ) & _mm512_cmp_ps_mask(ap, fmax, _CMP_LE_OQ);
+        for(int h = 0; h < 2; h++){
+            __m512d dr = _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(vr), h)));
+            __m512d dp = _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(vp), h)));
+            __m512d d = _mm512_sub_pd(dr, dp);
+            s0 = _mm512_add_pd(s0, _mm512_mul_pd(d, d));
+            s1 = _mm512_add_pd(s1, _mm512_mul_pd(_mm512_mul_pd(two, dr), dr));
+        }
+    }
+    s[0] += _mm512_reduce_add_pd(s0);
+    s[1] += _mm512_reduce_add_pd(s1);
+    float r0 = _mm512_reduce_max_ps(m0), r1 = _mm512_reduce_max_ps(m1);
+    m[0] = m[0] < r0 ? r0 : m[0];
+    m[1] = m[1] < r1 ? r1 : m[1];
+    return finite == 0xffff;
+}
+__attribute__((target("avx512f")))
+static inline void simd_cpu_mulhilo_u32_avx512(__m512i a, __m512i m, __m512i *hi, __m512i *lo)
+{
+    __m512i p_even = _mm512_mul_epu32(a, m);
+    __m512i p_odd = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), m);
+    *lo = _mm512_mask_blend_epi32(0xaaaa, p_even, _mm512_slli_epi64(p_odd, 32));
+    *hi = _mm512_mask_blend_epi32(0xaaaa, _mm512_srli_epi64(p_even, 32), p_odd);
+}
+
+__attribute__((target("avx512f")))
+static inline void simd_cpu_philox_u32_avx512(uint32_t *dst, uint64_t ctr, size_t n, uint32_t stream, uint64_t key)
+{
+    const __m512i m0 = _mm512_set1_epi32((int)SIMD_CPU_PHILOX_M0);
+    const __m512i m1 = _mm512_set1_epi32((int)SIMD_CPU_PHILOX_M1);
+    size_t j = 0;
+    for(; j + 16 <= n; j += 16){
+        uint32_t lo[16], hi[16];
+        for(int l = 0; l < 16; l++){
+            lo[l] = (uint32_t)(ctr + j + l);
+            hi[l] = (uint32_t)((ctr + j + l) >> 32);
+        }
+        __m512i c0 = _mm512_loadu_si512(lo);
+        __m512i c1 = _mm512_loadu_si512(hi);
+        __m512i c2 = _mm512_set1_epi32((int)stream);
+        __m512i c3 = _mm512_setzero_si512();
+        uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key >> 32);
+        for(int r = 0; r < 10; r++){
+            __m512i hi0, lo0, hi1, lo1;
+            simd_cpu_mulhilo_u32_avx512(c0, m0, &hi0, &lo0);
+            simd_cpu_mulhilo_u32_avx512(c2, m1, &hi1, &lo1);
+            c0 = _mm512_xor_si512(_mm512_xor_si512(hi1, c1), _mm512_set1_epi32((int)k0));
+            c1 = lo1;
+            c2 = _mm512_xor_si512(_mm512_xor_si512(hi0, c3), _mm512_set1_epi32((int)k1));
+            c3 = lo0;
+            k0 += SIMD_CPU_PHILOX_W0;
+            k1 += SIMD_CPU_PHILOX_W1;
+        }
+        // 4 words x 16 counters to counter major, u0..u3 hold counters {0,4,8,12} .. {3,7,11,15} per 128 bit lane
+        __m512i t0 = _mm512_unpacklo_epi32(c0, c1), t1 = _mm512_unpackhi_epi32(c0, c1);
+        __m512i t2 = _mm512_unpacklo_epi32(c2, c3), t3 = _mm512_unpackhi_epi32(c2, c3);
+        __m512i u0 = _mm512_unpacklo_epi64(t0, t2), u1 = _mm512_unpackhi_epi64(t0, t2);
+        __m512i u2 = _mm512_unpacklo_epi64(t1, t3), u3 = _mm512_unpackhi_epi64(t1, t3);
+        __m512i v0 = _mm512_shuffle_i32x4(u0, u1, _MM_SHUFFLE(1, 0, 1, 0));     // 0, 4, 1, 5
+        __m512i v1 = _mm512_shuffle_i32x4(u2, u3, _MM_SHUFFLE(1, 0, 1, 0));     // 2, 6, 3, 7
+        __m512i v2 = _mm512_shuffle_i32x4(u0, u1, _MM_SHUFFLE(3, 2, 3, 2));     // 8, 12, 9, 13
+        __m512i v3 = _mm512_shuffle_i32x4(u2, u3, _MM_SHUFFLE(3, 2, 3, 2));     // 10, 14, 11, 15
+        uint32_t *d = dst + 4 * j;
+        _mm512_storeu_si512(d + 0, _mm512_shuffle_i32x4(v0, v1, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm512_storeu_si512(d + 16, _mm512_shuffle_i32x4(v0, v1, _MM_SHUFFLE(3, 1, 3, 1)));
+        _mm512_storeu_si512(d + 32, _mm512_shuffle_i32x4(v2, v3, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm512_storeu_si512(d + 48, _mm512_shuffle_i32x4(v2, v3, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    simd_cpu_philox_u32_scalar(dst + 4 * j, ctr + j, n - j, stream, key);
+}
+#endif
+
+typedef float (*simd_cpu_dot_f32_t)(const float *, const float *, size_t);
+typedef int32_t (*simd_cpu_dot_s16_t)(const int16_t *, const int16_t *, size_t);
+typedef void (*simd_cpu_axpy_f32_t)(float *, float, const float *, size_t);
+typedef void (*simd_cpu_butterfly_f32_t)(float *, float *, float *, float *, float, float, size_t);
+typedef void (*simd_cpu_cmac_f32_t)(float *, float *, const float *, const float *, const float *, const float *, bool, size_t);
+typedef bool (*simd_cpu_nrms_f32_t)(const float *, const float *, size_t, double *, float *);
+typedef void (*simd_cpu_philox_u32_t)(uint32_t *, uint64_t, size_t, uint32_t, uint64_t);
+
+static inline simd_cpu_dot_f32_t simd_cpu_select_dot_f32()
+{
+#if SIMD_CPU_X86
+    switch(simd_cpu_get_isa()){
+        case simd_cpu_isa_avx512: return simd_cpu_dot_f32_avx512;
+        case simd_cpu_isa_avx2: return simd_cpu_dot_f32_avx2;
+        default: break;
+    }
+#endif
+    return simd_cpu_dot_f32_scalar;
+}
+
+// avx512f has no 16 bit integer ops (that is avx512bw), so both levels use avx2
+static inline simd_cpu_dot_s16_t simd_cpu_select_dot_s16()
+{
+#if SIMD_CPU_X86
+    if(simd_cpu_get_isa() >= simd_cpu_isa_avx2)
+        return simd_cpu_dot_s16_avx2;
+#endif
+    return simd_cpu_dot_s16_scalar;
+}
+
+static inline simd_cpu_axpy_f32_t simd_cpu_select_axpy_f32()
+{
+#if SIMD_CPU_X86
+    switch(simd_cpu_get_isa()){
+        case simd_cpu_isa_avx512: return simd_cpu_axpy_f32_avx512;
+        case simd_cpu_isa_avx2: return simd_cpu_axpy_f32_avx2;
+        default: break;
+    }
+#endif
+    return simd_cpu_axpy_f32_scalar;
+}
+
+static inline simd_cpu_butterfly_f32_t simd_cpu_select_butterfly_f32()
+{
+#if SIMD_CPU_X86
+    switch(simd_cpu_get_isa()){
+        case simd_cpu_isa_avx512: return simd_cpu_butterfly_f32_avx512;
+        case simd_cpu_isa_avx2: return simd_cpu_butterfly_f32_avx2;
+        default: break;
+    }
+#endif
+    return simd_cpu_butterfly_f32_scalar;
+}
+
+static inline simd_cpu_cmac_f32_t simd_cpu_select_cmac_f32()
+{
+#if SIMD_CPU_X86
+    switch(simd_cpu_get_isa()){
+        case simd_cpu_isa_avx512: return simd_cpu_cmac_f32_avx512;
+        case simd_cpu_isa_avx2: return simd_cpu_cmac_f32_avx2;
+        default: break;
+    }
+#endif
+    return simd_cpu_cmac_f32_scalar;
+}
+
+static inline simd_cpu_nrms_f32_t simd_cpu_select_nrms_f32()
+{
+#if SIMD_CPU_X86
+    switch(simd_cpu_get_isa()){
+        case simd_cpu_isa_avx512: return simd_cpu_nrms_f32_avx512;
+        case simd_cpu_isa_avx2: return simd_cpu_nrms_f32_avx2;
+        default: break;
+    }
+#endif
+    return simd_cpu_nrms_f32_scalar;
+}
+
+static inline simd_cpu_philox_u32_t simd_cpu_select_philox_u32()
+{
+#if SIMD_CPU_X86
+    switch(simd_cpu_get_isa()){
+        case simd_cpu_isa_avx512: return simd_cpu_philox_u32_avx512;
+        case simd_cpu_isa_avx2: return simd_cpu_philox_u32_avx2;
+        default: break;
+    }
+#endif
+    return simd_cpu_philox_u32_scalar;
+}
+
+static inline float simd_cpu_dot_f32(const float *a, const float *b, size_t n)
+{
+    static const simd_cpu_dot_f32_t func = simd_cpu_select_dot_f32();
+    return func(a, b, n);
+}
+
+static inline int32_t simd_cpu_dot_s16(const int16_t *a, const int16_t *b, size_t n)
+{
+    static const simd_cpu_dot_s16_t func = simd_cpu_select_dot_s16();
+    return func(a, b, n);
+}
+
+static inline void simd_cpu_axpy_f32(float *y, float alpha, const float *x, size_t n)
+{
+    static const simd_cpu_axpy_f32_t func = simd_cpu_select_axpy_f32();
+    func(y, alpha, x, n);
+}
+
+static inline void simd_cpu_butterfly_f32(float *ar, float *ai, float *br, float *bi, float omr, float omi, size_t n)
+{
+    static const simd_cpu_butterfly_f32_t func = simd_cpu_select_butterfly_f32();
+    func(ar, ai, br, bi, omr, omi, n);
+}
+
+static inline void simd_cpu_cmac_f32(float *cr, float *ci, const float *ar, const float *ai,
+                                     const float *br, const float *bi, bool conj_b, size_t n)
+{
+    static const simd_cpu_cmac_f32_t func = simd_cpu_select_cmac_f32();
+    func(cr, ci, ar, ai, br, bi, conj_b, n);
+}
+
+static inline bool simd_cpu_nrms_f32(const float *r, const float *p, size_t n, double *s, float *m)
+{
+    static const simd_cpu_nrms_f32_t func = simd_cpu_select_nrms_f32();
+    return func(r, p, n, s, m);
+}
+
+static inline void simd_cpu_philox_u32(uint32_t *dst, uint64_t ctr, size_t n, uint32_t stream, uint64_t key)
+{
+    static const simd_cpu_philox_u32_t func = simd_cpu_select_philox_u32();
+    func(dst, ctr, n, stream, key);
+}
+
+#endif
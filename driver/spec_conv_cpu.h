@@ -0,0 +1,373 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _SPEC_CONV_CPU_H
+#define _SPEC_CONV_CPU_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "thread_pool_cpu.h"
+#include "simd_cpu.h"
+#include "conv_geometry_cpu.h"
+
+/*
+ * host direct convolution with filter size and stride as template parameters, for the square, dilation 1
+ * filters that make up most of the model shapes (script/gtc_conv_model.sh):
+ *   1x1 s1, 1x1 s2, 3x3 s1, 3x3 s2, 7x7 s2
+ * padding stays a runtime value, through conv_geometry_cpu_t.
+ *
+ * fwd nchw: every task computes one output row for a block of SPEC_CONV_CPU_K_BLOCK filters. the interior
+ *   columns, where all fx taps are inside the input, go through a register tile of K_BLOCK x W_BLOCK
+ *   outputs with the tap loops unrolled, so every input load is reused by K_BLOCK filters. the border
+ *   columns take the valid tap ranges of the geometry. 1x1 stride 1 pad 0 is a gemm over channels: the
+ *   image is flattened into a single row of h * w, with no border.
+ * fwd nhwc: the interior pixels walk the unrolled taps with the simd dot of naive_conv, for a block of
+ *   filters at once, so the input pixel stays in cache.
+ * bwd nchw, 1x1 stride 1 pad 0: the transposed gemm, input row += filter[k][c] * dst_grad row over k.
+ *
+ * every output sums its products in the order of the threaded naive_conv (channel, then tap y, then tap x),
+ * so the result is bit identical and the specialization is a transparent part of the naive algorithm.
+ * spec_conv_cpu_*() return false when the shape has no specialization, or IGEMM_CPU_CONV_SPEC=0.
+ */
+#ifndef SPEC_CONV_CPU_K_BLOCK
+#define SPEC_CONV_CPU_K_BLOCK 4
+#endif
+#ifndef SPEC_CONV_CPU_W_BLOCK
+#define SPEC_CONV_CPU_W_BLOCK 8
+#endif
+
+static inline bool spec_conv_cpu_enabled()
+{
+    char *v = getenv("IGEMM_CPU_CONV_SPEC");
+    return v ? atoi(v) != 0 : true;
+}
+
+// [*lo, *hi) is the run of outputs with all f taps inside the input
+static inline void spec_conv_cpu_interior(const conv_geometry_cpu_dim_t & dim, size_t f, size_t *lo, size_t *hi)
+{
+    size_t o = 0;
+    while(o < dim.out() && !(dim.tap_begin(o) == 0 && dim.tap_end(o) == f))
+        o++;
+    *lo = o;
+    while(o < dim.out() && dim.tap_begin(o) == 0 && dim.tap_end(o) == f)
+        o++;
+    *hi = o;
+}
+
+// KB x nw outputs of an interior run, starting at input column iw (tap 0 of the first output).
+// src is the first tap row of channel 0, filter the first tap row of channel 0 of the first filter
+template<size_t F, size_t S, size_t KB>
+static inline void spec_conv_cpu_fwd_nchw_tile(const float *src, const float *filter, float *dst,
+                                               size_t nw, size_t nr, size_t c_per_group,
+                                               size_t src_c_stride, size_t src_h_stride, size_t filter_k_stride,
+                                               size_t dst_k_stride)
+{
+    float acc[KB][SPEC_CONV_CPU_W_BLOCK] = {{.0f}};
+    for(size_t ic = 0; ic < c_per_group; ic++){
+        const float *src_c = src + ic * src_c_stride;
+        const float *filter_c = filter + ic * F * F;
+        for(size_t ir = 0; ir < nr; ir++){
+            const float *src_r = src_c + ir * src_h_stride;
+            const float *filter_r = filter_c + ir * F;
+            for(size_t is = 0; is < F; is++){
+                for(size_t kk = 0; kk < KB; kk++){
+                    float fv = filter_r[kk * filter_k_stride + is];
+                    if(nw == SPEC_CONV_CPU_W_BLOCK){
+                        for(size_t j = 0; j < SPEC_CONV_CPU_W_BLOCK; j++)
+                            acc[kk][j] += src_r[j * S + is] * fv;
+                    }else{
+                        for(size_t j = 0; j < nw; j++)
+                            acc[kk][j] += src_r[j * S + is] * fv;
+                    }
+                }
+            }
+        }
+    }
+    for(size_t kk = 0; kk < KB; kk++)
+        memcpy(dst + kk * dst_k_stride, acc[kk], nw * sizeof(float));
+}
+
+// one output of a border column, over the valid tap ranges
+static inline float spec_conv_cpu_fwd_nchw_pixel(const float *src, const float *filter, const conv_geometry_cpu_t & geo,
+                                                 size_t h, size_t w, size_t fx, size_t fy, size_t dx, size_t dy,
+                                                 size_t ioh, size_t iow)
+{
+    size_t ir_begin = geo.y.tap_begin(ioh), nr = geo.y.tap_end(ioh) - ir_begin;
+    size_t is_begin = geo.x.tap_begin(iow), ns = geo.x.tap_end(iow) - is_begin;
+    float value = .0f;
+    if(nr == 0 || ns == 0)
+        return value;
+    const float *src_p = src + geo.y.in_first(ioh) * w + geo.x.in_first(iow);
+    const float *filter_p = filter + ir_begin * fx + is_begin;
+    for(size_t ic = 0; ic < geo.c_per_group; ic++){
+        for(size_t ir = 0; ir < nr; ir++){
+            for(size_t is = 0; is < ns; is++)
+                value += src_p[ir * dy * w + is * dx] * filter_p[ir * fx + is];
+        }
+        src_p += h * w;
+        filter_p += fy * fx;
+    }
+    return value;
+}
+
+template<size_t F, size_t S>
+static inline void spec_conv_cpu_fwd_nchw_kernel(const float *src, const float *filter, float *dst,
+                                                 const conv_geometry_cpu_t & geo)
+{
+    size_t h = geo.y.in(), w = geo.x.in(), oh = geo.y.out(), ow = geo.x.out();
+    size_t c = geo.c, k = geo.k, c_per_group = geo.c_per_group, k_per_group = geo.k_per_group;
+    size_t k_blocks = (k_per_group + SPEC_CONV_CPU_K_BLOCK - 1) / SPEC_CONV_CPU_K_BLOCK;
+    size_t x_lo, x_hi;
+    spec_conv_cpu_interior(geo.x, F, &x_lo, &x_hi);
+
+    auto conv_row = [&](size_t ig, size_t in, size_t ikb, size_t ioh){
+        size_t ik0 = ikb * SPEC_CONV_CPU_K_BLOCK;
+        size_t kb = k_per_group - ik0 < SPEC_CONV_CPU_K_BLOCK ? k_per_group - ik0 : SPEC_CONV_CPU_K_BLOCK;
+        const float *src_g = src + in * c * h * w + ig * c_per_group * h * w;
+        const float *filter_k = filter + (ig * k_per_group + ik0) * c_per_group * F * F;
+        float *dst_row = dst + in * k * oh * ow + (ig * k_per_group + ik0) * oh * ow + ioh * ow;
+        size_t ir_begin = geo.y.tap_begin(ioh), nr = geo.y.tap_end(ioh) - ir_begin;
+
+        for(size_t kk = 0; kk < kb; kk++){
+            for(size_t iow = 0; iow < x_lo; iow++)
+                dst_row[kk * oh * ow + iow] = spec_conv_cpu_fwd_nchw_pixel(src_g, filter_k + kk * c_per_group * F * F,
+                                                    geo, h, w, F, F, 1, 1, ioh, iow);
+            for(size_t iow = x_hi; iow < ow; iow++)
+                dst_row[kk * oh * ow + iow] = spec_conv_cpu_fwd_nchw_pixel(src_g, filter_k + kk * c_per_group * F * F,
+                                                    geo, h, w, F, F, 1, 1, ioh, iow);
+        }
+        if(x_lo == x_hi)
+            return;
+        if(nr == 0){
+            for(size_t kk = 0; kk < kb; kk++)
+                memset(dst_row + kk * oh * ow + x_lo, 0, (x_hi - x_lo) * sizeof(float));
+            return;
+        }
+        const float *src_r = src_g + geo.y.in_first(ioh) * w;
+        const float *filter_r = filter_k + ir_begin * F;
+        for(size_t iow = x_lo; iow < x_hi; iow += SPEC_CONV_CPU_W_BLOCK){
+            size_t nw = x_hi - iow < SPEC_CONV_CPU_W_BLOCK ? x_hi - iow : SPEC_CONV_CPU_W_BLOCK;
+            const float *src_t = src_r + geo.x.in_first(iow);
+            if(kb == SPEC_CONV_CPU_K_BLOCK)
+                spec_conv_cpu_fwd_nchw_tile<F, S, SPEC_CONV_CPU_K_BLOCK>(src_t, filter_r, dst_row + iow, nw, nr,
+                                c_per_group, h * w, w, c_per_group * F * F, oh * ow);
+            else
+                for(size_t kk = 0; kk < kb; kk++)
+                    spec_conv_cpu_fwd_nchw_tile<F, S, 1>(src_t, filter_r + kk * c_per_group * F * F,
+                                dst_row + kk * oh * ow + iow, nw, nr, c_per_group, h * w, w, c_per_group * F * F, oh * ow);
+        }
+    };
+
+    size_t rows = geo.group * geo.n * k_blocks * oh;
+    thread_pool_cpu_parallel_for(rows, [&](size_t begin, size_t end){
+        for(size_t row = begin; row < end; row++){
+            size_t ioh = row % oh;
+            size_t ikb = (row / oh) % k_blocks;
+            size_t in = (row / (oh * k_blocks)) % geo.n;
+            size_t ig = row / (oh * k_blocks * geo.n);
+            conv_row(ig, in, ikb, ioh);
+        }
+    });
+}
+
+template<size_t F, size_t S>
+static inline void spec_conv_cpu_fwd_nhwc_kernel(const float *src, const float *filter, float *dst,
+                                                 const conv_geometry_cpu_t & geo)
+{
+    size_t h = geo.y.in(), w = geo.x.in(), oh = geo.y.out(), ow = geo.x.out();
+    size_t c = geo.c, k = geo.k, c_per_group = geo.c_per_group, k_per_group = geo.k_per_group;
+    size_t x_lo, x_hi;
+    spec_conv_cpu_interior(geo.x, F, &x_lo, &x_hi);
+    simd_cpu_dot_f32_t dot = simd_cpu_select_dot_f32();
+
+    // one output pixel of one group, for all k_per_group filters
+    auto conv_pixel = [&](size_t ig, size_t in, size_t ioh, size_t iow){
+        const float *src_n = src + in * h * w * c + ig * c_per_group;
+        const float *filter_g = filter + ig * k_per_group * F * F * c_per_group;
+        float *dst_p = dst + in * oh * ow * k + ioh * ow * k + iow * k + ig * k_per_group;
+        size_t ir_begin = geo.y.tap_begin(ioh), nr = geo.y.tap_end(ioh) - ir_begin;
+        if(nr == 0){
+            memset(dst_p, 0, k_per_group * sizeof(float));
+            return;
+        }
+        const float *src_p = src_n + geo.y.in_first(ioh) * w * c;
+        const float *filter_p = filter_g + ir_begin * F * c_per_group;
+        if(iow >= x_lo && iow < x_hi){
+            src_p += geo.x.in_first(iow) * c;
+            for(size_t ik = 0; ik < k_per_group; ik++){
+                const float *filter_k = filter_p + ik * F * F * c_per_group;
+                float value = .0f;
+                for(size_t ir = 0; ir < nr; ir++){
+                    for(size_t is = 0; is < F; is++)
+                        value += dot(src_p + (ir * w + is) * c, filter_k + (ir * F + is) * c_per_group, c_per_group);
+                }
+                dst_p[ik] = value;
+            }
+            return;
+        }
+        size_t is_begin = geo.x.tap_begin(iow), ns = geo.x.tap_end(iow) - is_begin;
+        if(ns == 0){
+            memset(dst_p, 0, k_per_group * sizeof(float));
+            return;
+        }
+        src_p += geo.x.in_first(iow) * c;
+        filter_p += is_begin * c_per_group;
+        for(size_t ik = 0; ik < k_per_group; ik++){
+            const float *filter_k = filter_p + ik * F * F * c_per_group;
+            float value = .0f;
+            for(size_t ir = 0; ir < nr; ir++){
+                for(size_t is = 0; is < ns; is++)
+                    value += dot(src_p + (ir * w + is) * c, filter_k + (ir * F + is) * c_per_group, c_per_group);
+            }
+            dst_p[ik] = value;
+        }
+    };
+
+    size_t pixels = geo.group * geo.n * oh * ow;
+    thread_pool_cpu_parallel_for(pixels, [&](size_t begin, size_t end){
+        for(size_t p = begin; p < end; p++){
+            size_t iow = p % ow;
+            size_t ioh = (p / ow) % oh;
+            size_t in = (p / (ow * oh)) % geo.n;
+            size_t ig = p / (ow * oh * geo.n);
+            conv_pixel(ig, in, ioh, iow);
+        }
+    });
+}
+
+// input row (channel ic of one image) = sum over k of filter[k][ic] * dst_grad row k, in ascending k
+static inline void spec_conv_cpu_bwd_nchw_1x1(float *src_grad, const float *filter, const float *dst_grad,
+                                              const conv_geometry_cpu_t & geo)
+{
+    size_t hw = geo.y.in() * geo.x.in();
+    size_t c = geo.c, k = geo.k, c_per_group = geo.c_per_group, k_per_group = geo.k_per_group;
+    size_t c_blocks = (c_per_group + SPEC_CONV_CPU_K_BLOCK - 1) / SPEC_CONV_CPU_K_BLOCK;
+    size_t w_blocks = (hw + SPEC_CONV_CPU_W_BLOCK - 1) / SPEC_CONV_CPU_W_BLOCK;
+
+    auto gemm_tile = [&](size_t ig, size_t in, size_t icb, size_t iwb){
+        size_t ic0 = icb * SPEC_CONV_CPU_K_BLOCK;
+        size_t cb = c_per_group - ic0 < SPEC_CONV_CPU_K_BLOCK ? c_per_group - ic0 : SPEC_CONV_CPU_K_BLOCK;
+        size_t p0 = iwb * SPEC_CONV_CPU_W_BLOCK;
+        size_t nw = hw - p0 < SPEC_CONV_CPU_W_BLOCK ? hw - p0 : SPEC_CONV_CPU_W_BLOCK;
+        const float *dst_grad_p = dst_grad + in * k * hw + ig * k_per_group * hw + p0;
+        const float *filter_c = filter + ig * k_per_group * c_per_group + ic0;
+        float acc[SPEC_CONV_CPU_K_BLOCK][SPEC_CONV_CPU_W_BLOCK] = {{.0f}};
+        for(size_t ik = 0; ik < k_per_group; ik++){
+            const float *dg = dst_grad_p + ik * hw;
+            const float *fk = filter_c + ik * c_per_group;
+            for(size_t cc = 0; cc < cb; cc++){
+                float fv = fk[cc];
+                if(nw == SPEC_CONV_CPU_W_BLOCK){
+                    for(size_t j = 0; j < SPEC_CONV_CPU_W_BLOCK; j++)
+                        acc[cc][j] += dg[j] * fv;
+                }else{
+                    for(size_t j = 0; j < nw; j++)
+                        acc[cc][j] += dg[j] * fv;
+                }
+            }
+        }
+        float *src_grad_p = src_grad + in * c * hw + (ig * c_per_group + ic0) * hw + p0;
+        for(size_t cc = 0; cc < cb; cc++)
+            memcpy(src_grad_p + cc * hw, acc[cc], nw * sizeof(float));
+    };
+
+    size_t tiles = geo.group * geo.n * c_blocks * w_blocks;
+    thread_pool_cpu_parallel_for(tiles, [&](size_t begin, size_t end){
+        for(size_t t = begin; t < end; t++){
+            size_t iwb = t % w_blocks;
+            size_t icb = (t / w_blocks) % c_blocks;
+            size_t in = (t / (w_blocks * c_blocks)) % geo.n;
+            size_t ig = t / (w_blocks * c_blocks * geo.n);
+            gemm_tile(ig, in, icb, iwb);
+        }
+    });
+}
+
+#define SPEC_CONV_CPU_DISPATCH(kernel, F, S, ...)           \
+    if(fx == F && fy == F && sx == S && sy == S){           \
+        kernel<F, S>(__VA_ARGS__);                          \
+        return true;                                        \
+    }
+
+static inline bool spec_conv_cpu_applicable(size_t fx, size_t fy, size_t sx, size_t sy, size_t dx, size_t dy)
+{
+    if(fx != fy || sx != sy || !(fx == 1 || dx == 1) || !(fy == 1 || dy == 1))
+        return false;
+    return (fx == 1 && (sx == 1 || sx == 2)) || (fx == 3 && (sx == 1 || sx == 2)) || (fx == 7 && sx == 2);
+}
+
+static inline bool spec_conv_fwd_nchw(const float *src, const float *filter, float *dst, size_t n, size_t w,
+                                      size_t h, size_t c, size_t k, size_t fx, size_t fy, size_t px, size_t py,
+                                      size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    if(!spec_conv_cpu_enabled() || !spec_conv_cpu_applicable(fx, fy, sx, sy, dx, dy))
+        return false;
+    if(fx == 1 && sx == 1 && px == 0 && py == 0){
+        // gemm over channels, the image is a single row
+        conv_geometry_cpu_t geo(n, h * w, 1, c, k, 1, 1, 0, 0, 1, 1, 1, 1, group);
+        spec_conv_cpu_fwd_nchw_kernel<1, 1>(src, filter, dst, geo);
+        return true;
+    }
+    conv_geometry_cpu_t geo(n, w, h, c, k, fx, fy, px, py, sx, sy, 1, 1, group);
+    SPEC_CONV_CPU_DISPATCH(spec_conv_cpu_fwd_nchw_kernel, 1, 1, src, filter, dst, geo)
+    SPEC_CONV_CPU_DISPATCH(spec_conv_cpu_fwd_nchw_kernel, 1, 2, src, filter, dst, geo)
+    SPEC_CONV_CPU_DISPATCH(spec_conv_cpu_fwd_nchw_kernel, 3, 1, src, filter, dst, geo)
+    SPEC_CONV_CPU_DISPATCH(spec_conv_cpu_fwd_nchw_kernel, 3, 2, src, filter, dst, geo)
+    SPEC_CONV_CPU_DISPATCH(spec_conv_cpu_fwd_nchw_kernel, 7, 2, src, filter, dst, geo)
+    return false;
+}
+
+static inline bool spec_conv_fwd_nhwc(const float *src, const float *filter, float *dst, size_t n, size_t w,
+                                      size_t h, size_t c, size_t k, size_t fx, size_t fy, size_t px, size_t py,
+                                      size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    if(!spec_conv_cpu_enabled() || !spec_conv_cpu_applicable(fx, fy, sx, sy, dx, dy))
+        return false;
+    conv_geometry_cpu_t geo(n, w, h, c, k, fx, fy, px, py, sx, sy, 1, 1, group);
+    SPEC_CONV_CPU_DISPATCH(spec_conv_cpu_fwd_nhwc_kernel, 1, 1, src, filter, dst, geo)
+    SPEC_CONV_CPU_DISPATCH(spec_conv_cpu_fwd_nhwc_kernel, 1, 2, src, filter, dst, geo)
+    SPEC_CONV_CPU_DISPATCH(spec_conv_cpu_fwd_nhwc_kernel, 3, 1, src, filter, dst, geo)
+    SPEC_CONV_CPU_DISPATCH(spec_conv_cpu_fwd_nhwc_kernel, 3, 2, src, filter, dst, geo)
+    SPEC_CONV_CPU_DISPATCH(spec_conv_cpu_fwd_nhwc_kernel, 7, 2, src, filter, dst, geo)
+    return false;
+}
+
+static inline bool spec_conv_bwd_nchw(float *src_grad, const float *filter, const float *dst_grad, size_t n, size_t w,
+                                      size_t h, size_t c, size_t k, size_t fx, size_t fy, size_t px, size_t py,
+                                      size_t sx, size_t sy, size_t dx, size_t dy, size_t group)
+{
+    if(!spec_conv_cpu_enabled() || fx != 1 || fy != 1 || sx != 1 || sy != 1 || px != 0 || py != 0)
+        return false;
+    (void)dx; (void)dy;
+    conv_geometry_cpu_t geo(n, w, h, c, k, 1, 1, 0, 0, 1, 1, 1, 1, group);
+    spec_conv_cpu_bwd_nchw_1x1(src_grad, filter, dst_grad, geo);
+    return true;
+}
+
+#undef SPEC_CONV_CPU_DISPATCH
+
+#endif
@@ -27,7 +27,13 @@
 #define _TENSOR_COPY_CPU_H
 
 #include <stddef.h>
-#include <thread>
+#include <stdint.h>
+#include <type_traits>
+#include "thread_pool_cpu.h"
+#include "convert_cpu.h"
+#ifdef USE_HALF
+#include "half.hpp"
+#endif
 
 typedef struct
 {
@@ -42,44 +48,62 @@ typedef struct
     };
 }int4x2_t;
 
+/*
+ * tensor_copy between fp32 and a storage format of convert_cpu.h goes through the simd bulk conversion, which
+ * gives the bits of the scalar convert_cpu routines (bf16 rounds to nearest even, integers keep the low bits).
+ * the element types are mapped by tensor_copy_dtype_t, bfloat16 (and half_float::half with USE_HALF) must be
+ * declared before this header. other pairs are copied by static_cast, and so is fp32 to half_float::half, whose
+ * rounding follows HALF_ROUND_STYLE of half.hpp rather than the round to nearest even of convert_cpu. fp16 to
+ * fp32 is exact either way and takes the simd path.
+ */
+template<typename T>
+struct tensor_copy_dtype_t{ static const int dtype = -1; };
+template<>
+struct tensor_copy_dtype_t<float>{ static const int dtype = convert_cpu_fp32; };
+template<>
+struct tensor_copy_dtype_t<bfloat16>{ static const int dtype = convert_cpu_bf16; };
+#ifdef USE_HALF
+template<>
+struct tensor_copy_dtype_t<half_float::half>{ static const int dtype = convert_cpu_fp16; };
+#endif
+template<>
+struct tensor_copy_dtype_t<int8_t>{ static const int dtype = convert_cpu_int8; };
+template<>
+struct tensor_copy_dtype_t<int4x2_t>{ static const int dtype = convert_cpu_int4; };
+
 template <typename Dst_T, typename Src_T>
-void block_wise_tensor_copy(Dst_T *p_dst, Src_T *p_src, int tid, size_t block_size, size_t total_size)
+void block_wise_tensor_copy(Dst_T *p_dst, Src_T *p_src, size_t begin, size_t end)
 {
-    for (int i = tid; i < total_size; i += block_size) {
+    for (size_t i = begin; i < end; i++) {
         p_dst[i] = static_cast<Dst_T>(p_src[i]);
     }
 }
 
-template <>
-void block_wise_tensor_copy<int4x2_t, float>(int4x2_t *p_dst, float *p_src, int tid, size_t block_size, size_t total_size)
-{
-    // sizeof(int4x2_t) is 4. So need to find a way to avoid seg fault
-    int8_t *tmp_dst = (int8_t*)(p_dst);
-    for (int i = tid; i < (total_size / 2); i += block_size) {
-        int8_t lo = static_cast<int8_t>(p_src[2 * i]);
-        int8_t hi = static_cast<int8_t>(p_src[2 * i + 1]);
-
-        lo = lo & 0xf;
-        hi = hi & 0xf;
+template <typename Dst_T, typename Src_T>
+void tensor_copy_impl(Dst_T *p_dst, Src_T *p_src, size_t tensor_size, std::true_type) {
+    const int dst_dtype = tensor_copy_dtype_t<Dst_T>::dtype;
+    const int src_dtype = tensor_copy_dtype_t<Src_T>::dtype;
+    if(src_dtype == convert_cpu_fp32)
+        convert_cpu_narrow_f32(static_cast<convert_cpu_dtype_t>(dst_dtype), p_dst, 0, reinterpret_cast<const float *>(p_src), tensor_size);
+    else
+        convert_cpu_widen_f32(static_cast<convert_cpu_dtype_t>(src_dtype), reinterpret_cast<float *>(p_dst), p_src, 0, tensor_size);
+}
 
-        int8_t composed = (hi << 4) + lo;
-        tmp_dst[i] = composed;
-    }
+template <typename Dst_T, typename Src_T>
+void tensor_copy_impl(Dst_T *p_dst, Src_T *p_src, size_t tensor_size, std::false_type) {
+    thread_pool_cpu_parallel_for(tensor_size, [&](size_t begin, size_t end){
+        block_wise_tensor_copy<Dst_T, Src_T>(p_dst, p_src, begin, end);
+    });
 }
 
+// tensor_size is in elements, int4 packs 2 of them per int4x2_t byte
 template <typename Dst_T, typename Src_T>
 void tensor_copy(Dst_T *p_dst, Src_T *p_src, size_t tensor_size) {
-    int num_threads = std::thread::hardware_concurrency();
-    if (num_threads < 4)
-        num_threads = 4;
-
-    std::vector<std::thread> threads;
-    for (int t = 0; t < num_threads; t++) {
-        threads.push_back(std::thread(block_wise_tensor_copy<Dst_T, Src_T>,
-            p_dst, p_src, t, num_threads, tensor_size));
-    }
-    for (auto &th : threads)
-        th.join();
+    const int dst_dtype = tensor_copy_dtype_t<Dst_T>::dtype;
+    const int src_dtype = tensor_copy_dtype_t<Src_T>::dtype;
+    tensor_copy_impl<Dst_T, Src_T>(p_dst, p_src, tensor_size, std::integral_constant<bool,
+        (src_dtype == convert_cpu_fp32 && dst_dtype >= 0 && dst_dtype != convert_cpu_fp16) ||
+        (dst_dtype == convert_cpu_fp32 && src_dtype >= 0)>());
 }
 
 
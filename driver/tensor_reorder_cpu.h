@@ -0,0 +1,189 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _TENSOR_REORDER_CPU_H
+#define _TENSOR_REORDER_CPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "thread_pool_cpu.h"
+#include "transpose_cpu.h"
+
+/*
+ * host counterpart of gpu_tensor_reorder: dst is src with its dims permuted, dst dim j being src dim dst_order::at(j),
+ * both packed row major. dst_order is the sequence<...> of gpu_tensor_reorder/sequence.hpp, or
+ * tensor_reorder_cpu_order<...> where hip is not there, any rank up to TENSOR_REORDER_CPU_MAX_DIMS.
+ * the plan comes from the strides: size 1 dims are dropped, and dims that stay adjacent on both sides are merged.
+ *   - same innermost dim on both sides : the outer dims are looped in dst order and each innermost run is a memcpy
+ *   - otherwise                         : a batch of 2d transposes (src innermost <-> dst innermost) cut in tiles
+ *                                         through transpose_cpu_tile, which takes the avx2 8x8 kernels
+ * the tiles are sized from the 2 transposed dims, so a short one (e.g. vector_c of 4) gets longer tiles on the other.
+ * the batch and the tiles are split over the thread pool.
+ */
+#ifndef TENSOR_REORDER_CPU_MAX_DIMS
+#define TENSOR_REORDER_CPU_MAX_DIMS 8
+#endif
+
+template<int... Is>
+struct tensor_reorder_cpu_order{
+    static constexpr int size() { return sizeof...(Is); }
+    static constexpr int at(int i)
+    {
+        const int data[sizeof...(Is) + 1] = {Is..., 0};
+        return data[i];
+    }
+};
+
+typedef struct {
+    size_t len, src_stride, dst_stride;
+} tensor_reorder_cpu_dim_t;
+
+// the batch dims are ordered outer to inner, and their index i is unrolled into both offsets
+static inline void tensor_reorder_cpu_batch_offset(const tensor_reorder_cpu_dim_t *batch, size_t num_batch, size_t i,
+                                                   size_t *src_offset, size_t *dst_offset)
+{
+    size_t s = 0, d = 0;
+    for(size_t k = num_batch; k > 0; k--){
+        size_t idx = i % batch[k - 1].len;
+        i /= batch[k - 1].len;
+        s += idx * batch[k - 1].src_stride;
+        d += idx * batch[k - 1].dst_stride;
+    }
+    *src_offset = s;
+    *dst_offset = d;
+}
+
+// dims[] are the src dims, order[j] the src dim of dst dim j
+template<typename T>
+void tensor_reorder_cpu_run(T *dst, const T *src, size_t ndim, const size_t *dims, const int *order)
+{
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4, "1, 2 or 4 byte elements");
+    assert(ndim > 0 && ndim <= TENSOR_REORDER_CPU_MAX_DIMS);
+    size_t src_stride[TENSOR_REORDER_CPU_MAX_DIMS], dst_stride[TENSOR_REORDER_CPU_MAX_DIMS];
+    size_t total = 1;
+    for(size_t a = ndim; a > 0; a--){
+        src_stride[a - 1] = total;
+        total *= dims[a - 1];
+    }
+    size_t stride = 1;
+    for(size_t j = ndim; j > 0; j--){
+        dst_stride[order[j - 1]] = stride;
+        stride *= dims[order[j - 1]];
+    }
+    if(total == 0)
+        return;
+
+    // in src order, without size 1 dims, merging a dim into the previous one when it is adjacent on both sides
+    tensor_reorder_cpu_dim_t d[TENSOR_REORDER_CPU_MAX_DIMS];
+    size_t nd = 0;
+    for(size_t a = 0; a < ndim; a++){
+        if(dims[a] == 1)
+            continue;
+        if(nd > 0 && d[nd - 1].src_stride == dims[a] * src_stride[a] && d[nd - 1].dst_stride == dims[a] * dst_stride[a]){
+            d[nd - 1].len *= dims[a];
+            d[nd - 1].src_stride = src_stride[a];
+            d[nd - 1].dst_stride = dst_stride[a];
+        }else
+            d[nd++] = {dims[a], src_stride[a], dst_stride[a]};
+    }
+    if(nd <= 1){
+        memcpy(dst, src, total * sizeof(T));
+        return;
+    }
+
+    size_t s_in = nd - 1, d_in = 0;
+    for(size_t k = 0; k < nd; k++)
+        if(d[k].dst_stride == 1)
+            d_in = k;
+    // the rest is the batch, looped in dst order so the writes of consecutive batch entries are close
+    tensor_reorder_cpu_dim_t batch[TENSOR_REORDER_CPU_MAX_DIMS];
+    size_t num_batch = 0, batch_total = 1;
+    for(size_t k = 0; k < nd; k++)
+        if(k != s_in && k != d_in){
+            size_t p = num_batch++;
+            for(; p > 0 && batch[p - 1].dst_stride < d[k].dst_stride; p--)
+                batch[p] = batch[p - 1];
+            batch[p] = d[k];
+            batch_total *= d[k].len;
+        }
+
+    if(s_in == d_in){
+        size_t run = d[s_in].len;
+        thread_pool_cpu_parallel_for(batch_total, [&](size_t begin, size_t end){
+            for(size_t i = begin; i < end; i++){
+                size_t so, dof;
+                tensor_reorder_cpu_batch_offset(batch, num_batch, i, &so, &dof);
+                memcpy(dst + dof, src + so, run * sizeof(T));
+            }
+        });
+        return;
+    }
+
+    // src (rows x cols) with rows along the dst innermost dim, cols along the src innermost one
+    size_t rows = d[d_in].len, cols = d[s_in].len;
+    size_t ld_src = d[d_in].src_stride, ld_dst = d[s_in].dst_stride;
+    const size_t tile = TRANSPOSE_CPU_TILE;
+    size_t tile_r = rows < tile ? rows : tile;
+    size_t tile_c = cols < tile * tile / tile_r ? cols : tile * tile / tile_r;
+    tile_r = rows < tile * tile / tile_c ? rows : tile * tile / tile_c;
+    size_t tiles_r = (rows + tile_r - 1) / tile_r;
+    size_t tiles_c = (cols + tile_c - 1) / tile_c;
+    size_t tiles = tiles_r * tiles_c;
+    bool simd = simd_cpu_get_isa() >= simd_cpu_isa_avx2;
+    thread_pool_cpu_parallel_for(batch_total * tiles, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++){
+            size_t so, dof;
+            tensor_reorder_cpu_batch_offset(batch, num_batch, i / tiles, &so, &dof);
+            size_t r0 = (i % tiles) / tiles_c * tile_r;
+            size_t c0 = (i % tiles) % tiles_c * tile_c;
+            size_t r1 = r0 + tile_r < rows ? r0 + tile_r : rows;
+            size_t c1 = c0 + tile_c < cols ? c0 + tile_c : cols;
+            transpose_cpu_tile(dst + dof, ld_dst, src + so, ld_src, r0, r1, c0, c1, simd);
+        }
+    });
+}
+
+template<typename T, typename dst_order>
+void tensor_reorder_cpu(T *dst, const T *src, const size_t *dims)
+{
+    const size_t ndim = dst_order::size();
+    int order[TENSOR_REORDER_CPU_MAX_DIMS];
+    for(size_t j = 0; j < ndim; j++)
+        order[j] = dst_order::at(j);
+    tensor_reorder_cpu_run(dst, src, ndim, dims, order);
+}
+
+// the 4d interface of gpu_tensor_reorder
+template<typename T, typename dst_order>
+void tensor_reorder_cpu(T *dst, const T *src, size_t dim_0, size_t dim_1, size_t dim_2, size_t dim_3)
+{
+    static_assert(dst_order::size() == 4, "4d order");
+    const size_t dims[4] = {dim_0, dim_1, dim_2, dim_3};
+    tensor_reorder_cpu<T, dst_order>(dst, src, dims);
+}
+
+#endif
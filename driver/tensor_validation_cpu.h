@@ -28,6 +28,19 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
+#include <float.h>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <vector>
+#include "thread_pool_cpu.h"
+#include "simd_cpu.h"
+#include "convert_cpu.h"
+#include "tensor_copy_cpu.h"
+#ifdef USE_HALF
+#include "half.hpp"
+#endif
 
 #ifndef ABS
 #define ABS(x) ((x) > 0 ? (x) : -1 * (x))
@@ -53,9 +66,8 @@ bool valid_float<int4x2_t>(int4x2_t p)
     return true;
 }
 
-template<typename T>
-bool valid_vector(const float *ref, const T *pred, size_t n,
-                                double nrms = 1.5e-6) {
+template<typename R, typename T>
+bool valid_vector_impl_serial(const R *ref, const T *pred, size_t n, double nrms) {
     double s0 = 0.0;
     double s1 = 0.0;
     int igemm_per_pixel_check = env_get_int("PER_PIXEL_CHECK", 0);
@@ -70,7 +82,7 @@ bool valid_vector(const float *ref, const T *pred, size_t n,
         // dump as dword, weather the type of pred
         size_t total_safe_size = n / ( sizeof(float) / sizeof(T) );
         for(size_t i=0; i<total_safe_size;i++ ){
-            printf("[%zu] ref:%lf, pred:0x%08x\n", i, ref[i], ((uint32_t*)pred)[i]);
+            printf("[%zu] ref:%lf, pred:0x%08x\n", i, (double)ref[i], ((uint32_t*)pred)[i]);
         }
     }
 #if USE_MIOPEN_NRMS
@@ -79,8 +91,8 @@ bool valid_vector(const float *ref, const T *pred, size_t n,
     double mag2 = .0;
     for (size_t i = 0; i < n; ++i) {
         if(igemm_valid_float)
-            if(!(valid_float<float>(ref[i]) && valid_float<T>(pred[i]))){
-                printf(" invalid float at %zu, ref:%f, pred:%f\n", i, ref[i], pred[i]);
+            if(!(valid_float<R>(ref[i]) && valid_float<T>(pred[i]))){
+                printf(" invalid float at %zu, ref:%f, pred:%f\n", i, (double)ref[i], (double)pred[i]);
                 return false;
             }
         
@@ -119,8 +131,8 @@ bool valid_vector(const float *ref, const T *pred, size_t n,
 #else
     for (size_t i = 0; i < n; ++i) {
         if(igemm_valid_float)
-            if(!(valid_float<float>(ref[i]) && valid_float<T>(pred[i]))){
-                printf(" invalid float at %zu, ref:%f, pred:%f\n", i, ref[i], pred[i]);
+            if(!(valid_float<R>(ref[i]) && valid_float<T>(pred[i]))){
+                printf(" invalid float at %zu, ref:%f, pred:%f\n", i, (double)ref[i], (double)pred[i]);
                 return false;
             }
         double ri = (double)ref[i];
@@ -154,9 +166,130 @@ bool valid_vector(const float *ref, const T *pred, size_t n,
 #endif
 }
 
-template<>
-bool valid_vector<int8_t>(const float *ref, const int8_t *pred, size_t n,
-                                double nrms) {
+/*
+ * valid_vector_impl runs the loop above on the thread pool. fixed blocks of VALID_VECTOR_BLOCK elements are widened
+ * to fp32 and reduced by simd_cpu_nrms_f32, in one pass, and the block partials are summed in block order, so the
+ * result does not depend on the thread count.
+ * it takes the same decision as the serial loop: the first nan/inf is the one reported, and all the summed terms are
+ * non negative, so both sums are within a relative (n + 1) * eps of the exact one whatever the order. when the
+ * tolerance falls inside that band around the result, the serial loop decides.
+ * per pixel checks and dumps print in element order, so they also take the serial loop.
+ */
+#ifndef VALID_VECTOR_BLOCK
+#define VALID_VECTOR_BLOCK (64 * 1024)
+#endif
+#define VALID_VECTOR_WIDEN_BLOCK 1024
+
+// elements [begin, begin + cnt) as fp32, in buf unless they already are. the storage formats of tensor_copy_dtype_t
+// widen through convert_cpu.h, other types by static_cast
+template<typename T>
+static inline const float * valid_vector_widen(float *buf, const T *src, size_t begin, size_t cnt)
+{
+    const int dtype = tensor_copy_dtype_t<T>::dtype;
+    if(dtype == convert_cpu_fp32)
+        return reinterpret_cast<const float *>(src) + begin;
+    if(dtype >= 0)
+        convert_cpu_widen_f32_block(static_cast<convert_cpu_dtype_t>(dtype), buf, src, begin, cnt);
+    else
+        for(size_t i = 0; i < cnt; i++)
+            buf[i] = static_cast<float>(src[begin + i]);
+    return buf;
+}
+
+// block_func(begin, end, &invalid, &errors) checks [begin, end), and sets invalid to its first invalid element.
+// returns the first invalid element of [0, n), n if none, and the total of errors
+template<class block_func_t>
+static inline size_t valid_vector_in_blocks(size_t n, const block_func_t & block_func, size_t *errors)
+{
+    size_t blocks = (n + VALID_VECTOR_BLOCK - 1) / VALID_VECTOR_BLOCK;
+    std::vector<size_t> block_invalid(blocks, n), block_errors(blocks, 0);
+    thread_pool_cpu_parallel_for(blocks, [&](size_t begin, size_t end){
+        for(size_t b = begin; b < end; b++){
+            size_t e = (b + 1) * VALID_VECTOR_BLOCK < n ? (b + 1) * VALID_VECTOR_BLOCK : n;
+            block_func(b * VALID_VECTOR_BLOCK, e, &block_invalid[b], &block_errors[b]);
+        }
+    });
+    *errors = 0;
+    for(size_t b = 0; b < blocks; b++){
+        if(block_invalid[b] != n)
+            return block_invalid[b];
+        *errors += block_errors[b];
+    }
+    return n;
+}
+
+template<typename R, typename T>
+bool valid_vector_impl(const R *ref, const T *pred, size_t n, double nrms) {
+    if(env_get_int("PER_PIXEL_CHECK", 0) || env_get_int("DUMP_PRED", 0))
+        return valid_vector_impl_serial<R, T>(ref, pred, n, nrms);
+    int print_nrms = env_get_int("PRINT_NRMS", 0);
+    int igemm_valid_float = env_get_int("VALID_FLOAT", 1);
+
+    struct partial_t{
+        double s[2];    // sum of (r - p)^2, of 2 * r^2
+        float mag[2];   // max |r|, |p|
+    };
+    size_t blocks = (n + VALID_VECTOR_BLOCK - 1) / VALID_VECTOR_BLOCK;
+    std::vector<partial_t> partial(blocks);
+    size_t errors;
+    size_t invalid = valid_vector_in_blocks(n, [&](size_t begin, size_t end, size_t *block_invalid, size_t *){
+        partial_t & part = partial[begin / VALID_VECTOR_BLOCK];
+        part = {{.0, .0}, {.0f, .0f}};
+        float ref_buf[VALID_VECTOR_WIDEN_BLOCK], pred_buf[VALID_VECTOR_WIDEN_BLOCK];
+        for(size_t i = begin; i < end; i += VALID_VECTOR_WIDEN_BLOCK){
+            size_t cnt = end - i < VALID_VECTOR_WIDEN_BLOCK ? end - i : VALID_VECTOR_WIDEN_BLOCK;
+            const float *r = valid_vector_widen(ref_buf, ref, i, cnt);
+            const float *p = valid_vector_widen(pred_buf, pred, i, cnt);
+            if(!simd_cpu_nrms_f32(r, p, cnt, part.s, part.mag) && igemm_valid_float){
+                size_t j = 0;
+                while(valid_float<float>(r[j]) && valid_float<float>(p[j]))
+                    j++;
+                *block_invalid = i + j;
+                return;
+            }
+        }
+    }, &errors);
+    if(invalid != n){
+        printf(" invalid float at %zu, ref:%f, pred:%f\n", invalid, (double)ref[invalid], (double)pred[invalid]);
+        return false;
+    }
+
+    double s0 = .0, s1 = .0, mag1 = .0, mag2 = .0;
+    for(const partial_t & part : partial){
+        s0 += part.s[0];
+        s1 += part.s[1];
+        mag1 = mag1 < part.mag[0] ? part.mag[0] : mag1;
+        mag2 = mag2 < part.mag[1] ? part.mag[1] : mag2;
+    }
+    // the serial sums are within this relative band of s0, s1, with room to spare for rounding the band itself
+    double band = 4.0 * (n + 2) * DBL_EPSILON;
+#if USE_MIOPEN_NRMS
+    double mag = std::max({mag1, mag2, std::numeric_limits<double>::min()});
+    auto get_nrms = [&](double sq){ return std::sqrt(sq) / (std::sqrt(n) * mag); };
+    double computed_nrms = get_nrms(s0);
+    bool is_valid = computed_nrms < nrms;
+    if((get_nrms(s0 * (1 - band)) < nrms) != is_valid || (get_nrms(s0 * (1 + band)) < nrms) != is_valid)
+        return valid_vector_impl_serial<R, T>(ref, pred, n, nrms);
+    if(print_nrms)
+        printf("\nnrms:%lf, mag1:%lf, mag2:%lf, expected_nrms is %1f\n",computed_nrms,mag1,mag2,nrms);
+#else
+    bool is_valid = sqrt(s0 / s1) < nrms;
+    if((sqrt(s0 * (1 - band) / (s1 * (1 + band))) < nrms) != is_valid ||
+       (sqrt(s0 * (1 + band) / (s1 * (1 - band))) < nrms) != is_valid)
+        return valid_vector_impl_serial<R, T>(ref, pred, n, nrms);
+    if(print_nrms)
+        printf("\nnrms:%lf, s0:%lf, s1:%lf, expected_nrms is %1f\n",sqrt(s0/s1),s0,s1,nrms);
+#endif
+    return is_valid;
+}
+
+template<typename T>
+bool valid_vector(const float *ref, const T *pred, size_t n,
+                                double nrms = 1.5e-6) {
+    return valid_vector_impl<float, T>(ref, pred, n, nrms);
+}
+
+static inline bool valid_vector_int8_serial(const float *ref, const int8_t *pred, size_t n) {
     // int8 valid, we prefer a per pixel match
     int igemm_per_pixel_check = env_get_int("PER_PIXEL_CHECK", 0);
     int igemm_per_pixel_check_print = env_get_int("PER_PIXEL_CHECK_PRINT", 1);
@@ -194,7 +327,29 @@ bool valid_vector<int8_t>(const float *ref, const int8_t *pred, size_t n,
 }
 
 template<>
-bool valid_vector<int4x2_t>(const float *ref, const int4x2_t *pred, size_t n, double nrms) 
+bool valid_vector<int8_t>(const float *ref, const int8_t *pred, size_t n,
+                                double nrms) {
+    if(env_get_int("PER_PIXEL_CHECK", 0) || env_get_int("DUMP_PRED", 0))
+        return valid_vector_int8_serial(ref, pred, n);
+    size_t errors;
+    size_t invalid = valid_vector_in_blocks(n, [&](size_t begin, size_t end, size_t *block_invalid, size_t *block_errors){
+        for (size_t i = begin; i < end; ++i) {
+            if(!valid_float<float>(ref[i])){
+                *block_invalid = i;
+                return;
+            }
+            int8_t ri_clamp = static_cast<int8_t>(static_cast<int32_t>(ref[i]));    // the low byte
+            *block_errors += pred[i] != ri_clamp;
+        }
+    }, &errors);
+    if(invalid != n){
+        printf(" invalid float at %4zu, ref:%f\n", invalid, ref[invalid]);
+        return false;
+    }
+    return errors == 0;
+}
+
+static inline bool valid_vector_int4_serial(const float *ref, const int4x2_t *pred, size_t n)
 {
     // int8 valid, we prefer a per pixel match
     int igemm_per_pixel_check = env_get_int("PER_PIXEL_CHECK", 0);
@@ -245,6 +400,185 @@ bool valid_vector<int4x2_t>(const float *ref, const int4x2_t *pred, size_t n, do
     return pp_err == 0;
 }
 
+template<>
+bool valid_vector<int4x2_t>(const float *ref, const int4x2_t *pred, size_t n, double nrms)
+{
+    if(env_get_int("PER_PIXEL_CHECK", 0) || env_get_int("DUMP_PRED", 0))
+        return valid_vector_int4_serial(ref, pred, n);
+    const int8_t *tmp_pred = (const int8_t *)pred;
+    size_t errors;
+    size_t invalid = valid_vector_in_blocks(n / 2, [&](size_t begin, size_t end, size_t *block_invalid, size_t *block_errors){
+        for (size_t i = begin; i < end; ++i) {
+            if(!(valid_float<float>(ref[2 * i]) && valid_float<float>(ref[2 * i + 1]))){
+                *block_invalid = i;
+                return;
+            }
+            int32_t ri_lo = static_cast<int32_t>(ref[2 * i]) & 0xf;
+            int32_t ri_hi = static_cast<int32_t>(ref[2 * i + 1]) & 0xf;
+            int8_t ri_clamp = (ri_hi << 4) + ri_lo;
+            *block_errors += tmp_pred[i] != ri_clamp;
+        }
+    }, &errors);
+    if(invalid != n / 2){
+        printf(" invalid float at %4zu, ref:%f, %f\n", 2 * invalid, ref[2 * invalid], ref[2 * invalid + 1]);
+        return false;
+    }
+    return errors == 0;
+}
+
+/*
+ * compare against a reference that is already in the data type under test, e.g. from conv_native_cpu.h.
+ * float types use the same nrms as valid_vector, integer types must match bit by bit
+ */
+template<typename T>
+bool valid_vector_native(const T *ref, const T *pred, size_t n, double nrms = 1.5e-6) {
+    return valid_vector_impl<T, T>(ref, pred, n, nrms);
+}
+
+static inline bool valid_vector_native_bytes(const int8_t *ref, const int8_t *pred, size_t bytes) {
+    int igemm_per_pixel_check = env_get_int("PER_PIXEL_CHECK", 0);
+    size_t pp_err = 0;
+    if(!igemm_per_pixel_check){
+        valid_vector_in_blocks(bytes, [&](size_t begin, size_t end, size_t *, size_t *block_errors){
+            if(memcmp(ref + begin, pred + begin, end - begin) == 0)
+                return;
+            for (size_t i = begin; i < end; ++i)
+                *block_errors += ref[i] != pred[i];
+        }, &pp_err);
+        return pp_err == 0;
+    }
+    for (size_t i = 0; i < bytes; ++i) {
+        if(ref[i] != pred[i]){
+            if(igemm_per_pixel_check && pp_err < 100)
+                printf("[%zu] ref:%d(0x%02x), pred:%d(0x%02x) [N]\n", i, ref[i], (uint8_t)ref[i], pred[i], (uint8_t)pred[i]);
+            pp_err++;
+        }
+    }
+    return pp_err == 0;
+}
+
+template<>
+bool valid_vector_native<int8_t>(const int8_t *ref, const int8_t *pred, size_t n, double nrms) {
+    return valid_vector_native_bytes(ref, pred, n);
+}
+
+template<>
+bool valid_vector_native<int4x2_t>(const int4x2_t *ref, const int4x2_t *pred, size_t n, double nrms) {
+    // n is the number of int4 elements, two per byte
+    return valid_vector_native_bytes((const int8_t *)ref, (const int8_t *)pred, n / 2);
+}
+
+/*
+ * validate the sample of conv_sample_cpu.h: ref[i] is the fp32 reference of element index[i] of pred, a tensor in
+ * storage type dtype. ref is rounded to dtype first, as the full native reference is. floats take the nrms of the
+ * sample, integers must match. PER_PIXEL_CHECK prints the position in the sample, not in the tensor.
+ */
+static inline bool valid_vector_sampled(convert_cpu_dtype_t dtype, const std::vector<size_t> & index, const float *ref,
+                                        const void *pred, double nrms)
+{
+    size_t cnt = index.size();
+    std::vector<float> ref_s(cnt), pred_s(cnt);
+    thread_pool_cpu_parallel_for(cnt, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++){
+            uint32_t native = 0;
+            convert_cpu_narrow_f32_block(dtype, &native, 0, ref + i, 1);
+            convert_cpu_widen_f32_block(dtype, &ref_s[i], &native, 0, 1);
+            convert_cpu_widen_f32_block(dtype, &pred_s[i], pred, index[i], 1);
+        }
+    });
+    if(!convert_cpu_is_int(dtype))
+        return valid_vector_native<float>(ref_s.data(), pred_s.data(), cnt, nrms);
+    std::vector<int8_t> ref_i(cnt), pred_i(cnt);
+    for(size_t i = 0; i < cnt; i++){
+        ref_i[i] = static_cast<int8_t>(ref_s[i]);
+        pred_i[i] = static_cast<int8_t>(pred_s[i]);
+    }
+    return valid_vector_native<int8_t>(ref_i.data(), pred_i.data(), cnt, nrms);
+}
+
+/*
+ * validation fed chunk by chunk, for a ref and a pred that are computed and fetched piece by piece (valid_stream_cpu.h).
+ * valid_vector_chunk() folds one chunk, ref and pred in storage type dtype, into a partial of its own, serially on the
+ * calling thread. valid_vector_chunks_end() sums the partials in chunk order and takes the decision of
+ * valid_vector_native. the chunks are gone by then, so there is no serial fallback when the tolerance falls inside the
+ * rounding band of the sums, and no PER_PIXEL_CHECK or DUMP_PRED (conv_driver warns when they are set).
+ */
+struct valid_vector_chunk_t{
+    double s[2];        // sum of (r - p)^2, of 2 * r^2
+    float mag[2];       // max |r|, |p|
+    size_t cnt;
+    size_t invalid;     // first non finite element of the chunk, cnt if none
+    size_t errors;      // integer bytes that differ
+};
+
+static inline valid_vector_chunk_t valid_vector_chunk(convert_cpu_dtype_t dtype, const void *ref, const void *pred, size_t cnt)
+{
+    valid_vector_chunk_t part = {{.0, .0}, {.0f, .0f}, cnt, cnt, 0};
+    if(convert_cpu_is_int(dtype)){
+        // int4 chunks start on a byte, a trailing half byte is not compared, as in valid_vector_native
+        size_t bytes = dtype == convert_cpu_int4 ? cnt / 2 : cnt;
+        const int8_t *r = (const int8_t *)ref, *p = (const int8_t *)pred;
+        if(memcmp(r, p, bytes) != 0)
+            for(size_t i = 0; i < bytes; i++)
+                part.errors += r[i] != p[i];
+        return part;
+    }
+    int igemm_valid_float = env_get_int("VALID_FLOAT", 1);
+    float ref_buf[VALID_VECTOR_WIDEN_BLOCK], pred_buf[VALID_VECTOR_WIDEN_BLOCK];
+    for(size_t i = 0; i < cnt; i += VALID_VECTOR_WIDEN_BLOCK){
+        size_t c = cnt - i < VALID_VECTOR_WIDEN_BLOCK ? cnt - i : VALID_VECTOR_WIDEN_BLOCK;
+        const float *r = ref_buf, *p = pred_buf;
+        if(dtype == convert_cpu_fp32){
+            r = (const float *)ref + i;
+            p = (const float *)pred + i;
+        }else{
+            convert_cpu_widen_f32_block(dtype, ref_buf, ref, i, c);
+            convert_cpu_widen_f32_block(dtype, pred_buf, pred, i, c);
+        }
+        if(!simd_cpu_nrms_f32(r, p, c, part.s, part.mag) && igemm_valid_float){
+            size_t j = 0;
+            while(valid_float<float>(r[j]) && valid_float<float>(p[j]))
+                j++;
+            part.invalid = i + j;
+            return part;
+        }
+    }
+    return part;
+}
+
+static inline bool valid_vector_chunks_end(convert_cpu_dtype_t dtype, const std::vector<valid_vector_chunk_t> & parts,
+                                           double nrms)
+{
+    int print_nrms = env_get_int("PRINT_NRMS", 0);
+    double s0 = .0, s1 = .0, mag1 = .0, mag2 = .0;
+    size_t n = 0, errors = 0;
+    for(const valid_vector_chunk_t & part : parts){
+        if(part.invalid != part.cnt){
+            printf(" invalid float at %zu\n", n + part.invalid);
+            return false;
+        }
+        s0 += part.s[0];
+        s1 += part.s[1];
+        mag1 = mag1 < part.mag[0] ? part.mag[0] : mag1;
+        mag2 = mag2 < part.mag[1] ? part.mag[1] : mag2;
+        errors += part.errors;
+        n += part.cnt;
+    }
+    if(convert_cpu_is_int(dtype))
+        return errors == 0;
+#if USE_MIOPEN_NRMS
+    double mag = std::max({mag1, mag2, std::numeric_limits<double>::min()});
+    double computed_nrms = std::sqrt(s0) / (std::sqrt(n) * mag);
+    if(print_nrms)
+        printf("\nnrms:%lf, mag1:%lf, mag2:%lf, expected_nrms is %1f\n",computed_nrms,mag1,mag2,nrms);
+#else
+    double computed_nrms = sqrt(s0 / s1);
+    if(print_nrms)
+        printf("\nnrms:%lf, s0:%lf, s1:%lf, expected_nrms is %1f\n",computed_nrms,s0,s1,nrms);
+#endif
+    return computed_nrms < nrms;
+}
+
 double get_nrms(std::string direction, driverDataType_t driver_data_type){
     auto basic_tolerance = [=]() -> double{
         if (driver_data_type == driverFloat){
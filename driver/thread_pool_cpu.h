@@ -0,0 +1,257 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _THREAD_POOL_CPU_H
+#define _THREAD_POOL_CPU_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/*
+ * process-wide fork-join worker pool for host side tensor ops.
+ * workers are created once, at the first thread_pool_cpu_get(), and reused by every later job,
+ * so sweeping many shapes in one process does not pay thread creation per tensor op.
+ *
+ * IGEMM_CPU_THREADS : number of threads (caller included) that execute a job, default hardware_concurrency()
+ * IGEMM_CPU_PIN     : set to 1 to pin each worker to one core of the allowed cpu set, default 0
+ *
+ * run() is fork-join: the caller also executes tasks, and returns after every task finished.
+ * a run() issued from inside a task executes serially on that thread, so nested parallel code is safe.
+ */
+class thread_pool_cpu_t {
+public:
+    using task_func_t = std::function<void(size_t)>;
+
+    thread_pool_cpu_t(size_t num_threads_, bool pin_) : num_threads(0), pin(pin_), stopping(false),
+            generation(0), job_func(nullptr), job_tasks(0), next_task(0), active(0)
+    {
+        start(num_threads_);
+    }
+    ~thread_pool_cpu_t() { stop(); }
+
+    size_t get_num_threads() const { return num_threads; }
+
+    // change the thread count. must not be called while a job is running
+    void resize(size_t num_threads_)
+    {
+        std::lock_guard<std::mutex> submit_lock(submit_mutex);
+        if(num_threads_ == 0)
+            num_threads_ = 1;
+        if(num_threads_ == num_threads)
+            return;
+        stop();
+        start(num_threads_);
+    }
+
+    // execute func(task_id) for task_id in [0, num_tasks)
+    void run(size_t num_tasks, const task_func_t & func)
+    {
+        if(num_tasks == 0)
+            return;
+        if(num_tasks == 1 || workers.size() == 0 || in_worker()){
+            for(size_t t = 0; t < num_tasks; t++)
+                func(t);
+            return;
+        }
+
+        std::lock_guard<std::mutex> submit_lock(submit_mutex);
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            job_func = &func;
+            job_tasks = num_tasks;
+            next_task.store(0);
+            active = workers.size();
+            generation++;
+        }
+        cv_work.notify_all();
+
+        in_worker() = true;
+        execute_tasks();
+        in_worker() = false;
+
+        std::unique_lock<std::mutex> lk(mutex);
+        cv_done.wait(lk, [&]{ return active == 0; });
+        job_func = nullptr;
+    }
+
+private:
+    static bool & in_worker()
+    {
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+    void execute_tasks()
+    {
+        const task_func_t & func = *job_func;
+        for(size_t t = next_task.fetch_add(1); t < job_tasks; t = next_task.fetch_add(1))
+            func(t);
+    }
+
+    void worker_loop(size_t worker_id)
+    {
+        in_worker() = true;
+        if(pin)
+            pin_to_core(worker_id + 1);     // leave the first core to the submitting thread
+        size_t seen = 0;
+        while(true){
+            std::unique_lock<std::mutex> lk(mutex);
+            cv_work.wait(lk, [&]{ return stopping || generation != seen; });
+            if(stopping)
+                return;
+            seen = generation;
+            lk.unlock();
+
+            execute_tasks();
+
+            lk.lock();
+            if(--active == 0)
+                cv_done.notify_one();
+        }
+    }
+
+    static void pin_to_core(size_t index)
+    {
+#ifdef __linux__
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            return;
+        int num_allowed = CPU_COUNT(&allowed);
+        if(num_allowed == 0)
+            return;
+        int target = static_cast<int>(index % num_allowed);
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++){
+            if(!CPU_ISSET(cpu, &allowed))
+                continue;
+            if(target-- == 0){
+                cpu_set_t one;
+                CPU_ZERO(&one);
+                CPU_SET(cpu, &one);
+                pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+                return;
+            }
+        }
+#else
+        (void)index;
+#endif
+    }
+
+    void start(size_t num_threads_)
+    {
+        num_threads = num_threads_ == 0 ? 1 : num_threads_;
+        stopping = false;
+        generation = 0;
+        for(size_t i = 0; i < num_threads - 1; i++)
+            workers.push_back(std::thread(&thread_pool_cpu_t::worker_loop, this, i));
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            stopping = true;
+        }
+        cv_work.notify_all();
+        for(auto & w : workers)
+            w.join();
+        workers.clear();
+    }
+
+    size_t                      num_threads;
+    bool                        pin;
+    std::vector<std::thread>    workers;
+    std::mutex                  submit_mutex;   // serialize jobs from different submitting threads
+    std::mutex                  mutex;
+    std::condition_variable     cv_work;
+    std::condition_variable     cv_done;
+    bool                        stopping;
+    size_t                      generation;
+    const task_func_t *         job_func;
+    size_t                      job_tasks;
+    std::atomic<size_t>         next_task;
+    size_t                      active;         // workers not yet done with current generation
+};
+
+static inline size_t thread_pool_cpu_default_threads()
+{
+    char *v = getenv("IGEMM_CPU_THREADS");
+    if(v && atoi(v) > 0)
+        return static_cast<size_t>(atoi(v));
+    size_t hw = std::thread::hardware_concurrency();
+    return hw == 0 ? 1 : hw;
+}
+
+// not static, to have a single pool for the whole process even if included by several translation units
+inline thread_pool_cpu_t & thread_pool_cpu_get()
+{
+    static thread_pool_cpu_t pool(thread_pool_cpu_default_threads(),
+                                  getenv("IGEMM_CPU_PIN") && atoi(getenv("IGEMM_CPU_PIN")) != 0);
+    return pool;
+}
+
+static inline void thread_pool_cpu_set_num_threads(size_t num_threads)
+{
+    thread_pool_cpu_get().resize(num_threads);
+}
+
+static inline size_t thread_pool_cpu_get_num_threads()
+{
+    return thread_pool_cpu_get().get_num_threads();
+}
+
+// split [0, total) into one contiguous range per thread, and call f(begin, end) for each.
+// range boundaries are multiple of align, e.g. for packed sub-byte types
+template<typename range_func_t>
+void thread_pool_cpu_parallel_for(size_t total, range_func_t && f, size_t align = 1)
+{
+    if(total == 0)
+        return;
+    thread_pool_cpu_t & pool = thread_pool_cpu_get();
+    size_t num_units = (total + align - 1) / align;
+    size_t num_tasks = pool.get_num_threads() < num_units ? pool.get_num_threads() : num_units;
+    size_t units_per_task = num_units / num_tasks;
+    size_t units_remain = num_units % num_tasks;
+    pool.run(num_tasks, [&](size_t task){
+        size_t unit_begin = task * units_per_task + (task < units_remain ? task : units_remain);
+        size_t unit_end = unit_begin + units_per_task + (task < units_remain ? 1 : 0);
+        size_t begin = unit_begin * align;
+        size_t end = unit_end * align < total ? unit_end * align : total;
+        f(begin, end);
+    });
+}
+
+#endif
@@ -0,0 +1,239 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _TRANSPOSE_CPU_H
+#define _TRANSPOSE_CPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+#include "thread_pool_cpu.h"
+#include "simd_cpu.h"
+
+/*
+ * blocked, multithreaded layout transforms between nchw and nchwc/chwnc/nhwc, for 1, 2 and 4 byte elements.
+ * every transform is a batch of 2d transposes, dst (cols x rows) = src (rows x cols)^T, with 2 batch dims of their
+ * own strides (e.g. n and the vector_c group of c). each matrix is cut in TRANSPOSE_CPU_TILE square tiles, so the
+ * rows of a tile stay in l1 on both sides, and the (batch, tile) pairs are split over the thread pool. inside a tile
+ * 8x8 blocks are transposed in registers with avx2, the edges element by element.
+ * the loops of tensor_transpose.h compute the same layouts and serve as the reference.
+ */
+#ifndef TRANSPOSE_CPU_TILE
+#define TRANSPOSE_CPU_TILE 64
+#endif
+
+typedef struct {
+    size_t rows, cols;          // of the src matrix
+    size_t ld_src, ld_dst;      // in elements
+    size_t b0, b1;              // batch dims, b0 outer
+    size_t src_b0, src_b1;      // batch strides, in elements
+    size_t dst_b0, dst_b1;
+} transpose_cpu_desc_t;
+
+template<typename T>
+static inline void transpose_cpu_tile_scalar(T *dst, size_t ld_dst, const T *src, size_t ld_src,
+                                              size_t r0, size_t r1, size_t c0, size_t c1)
+{
+    for(size_t c = c0; c < c1; c++)
+        for(size_t r = r0; r < r1; r++)
+            dst[c * ld_dst + r] = src[r * ld_src + c];
+}
+
+#if SIMD_CPU_X86
+__attribute__((target("avx2,fma")))
+static inline void transpose_cpu_8x8_b4_avx2(float *dst, size_t ld_dst, const float *src, size_t ld_src)
+{
+    __m256 r0 = _mm256_loadu_ps(src + 0 * ld_src), r1 = _mm256_loadu_ps(src + 1 * ld_src);
+    __m256 r2 = _mm256_loadu_ps(src + 2 * ld_src), r3 = _mm256_loadu_ps(src + 3 * ld_src);
+    __m256 r4 = _mm256_loadu_ps(src + 4 * ld_src), r5 = _mm256_loadu_ps(src + 5 * ld_src);
+    __m256 r6 = _mm256_loadu_ps(src + 6 * ld_src), r7 = _mm256_loadu_ps(src + 7 * ld_src);
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+    __m256 t4 = _mm256_unpacklo_ps(r4, r5), t5 = _mm256_unpackhi_ps(r4, r5);
+    __m256 t6 = _mm256_unpacklo_ps(r6, r7), t7 = _mm256_unpackhi_ps(r6, r7);
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, 0x44), s1 = _mm256_shuffle_ps(t0, t2, 0xee);
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, 0x44), s3 = _mm256_shuffle_ps(t1, t3, 0xee);
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, 0x44), s5 = _mm256_shuffle_ps(t4, t6, 0xee);
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, 0x44), s7 = _mm256_shuffle_ps(t5, t7, 0xee);
+    _mm256_storeu_ps(dst + 0 * ld_dst, _mm256_permute2f128_ps(s0, s4, 0x20));
+    _mm256_storeu_ps(dst + 1 * ld_dst, _mm256_permute2f128_ps(s1, s5, 0x20));
+    _mm256_storeu_ps(dst + 2 * ld_dst, _mm256_permute2f128_ps(s2, s6, 0x20));
+    _mm256_storeu_ps(dst + 3 * ld_dst, _mm256_permute2f128_ps(s3, s7, 0x20));
+    _mm256_storeu_ps(dst + 4 * ld_dst, _mm256_permute2f128_ps(s0, s4, 0x31));
+    _mm256_storeu_ps(dst + 5 * ld_dst, _mm256_permute2f128_ps(s1, s5, 0x31));
+    _mm256_storeu_ps(dst + 6 * ld_dst, _mm256_permute2f128_ps(s2, s6, 0x31));
+    _mm256_storeu_ps(dst + 7 * ld_dst, _mm256_permute2f128_ps(s3, s7, 0x31));
+}
+
+__attribute__((target("avx2,fma")))
+static inline void transpose_cpu_8x8_b2_avx2(uint16_t *dst, size_t ld_dst, const uint16_t *src, size_t ld_src)
+{
+    __m128i r[8], t[8], u[8];
+    for(int i = 0; i < 8; i++)
+        r[i] = _mm_loadu_si128((const __m128i *)(src + i * ld_src));
+    for(int i = 0; i < 4; i++){
+        t[2 * i]     = _mm_unpacklo_epi16(r[2 * i], r[2 * i + 1]);   // cols 0-3 of 2 rows
+        t[2 * i + 1] = _mm_unpackhi_epi16(r[2 * i], r[2 * i + 1]);   // cols 4-7
+    }
+    for(int i = 0; i < 2; i++){
+        u[4 * i + 0] = _mm_unpacklo_epi32(t[4 * i], t[4 * i + 2]);       // cols 0,1 of 4 rows
+        u[4 * i + 1] = _mm_unpackhi_epi32(t[4 * i], t[4 * i + 2]);       // cols 2,3
+        u[4 * i + 2] = _mm_unpacklo_epi32(t[4 * i + 1], t[4 * i + 3]);   // cols 4,5
+        u[4 * i + 3] = _mm_unpackhi_epi32(t[4 * i + 1], t[4 * i + 3]);   // cols 6,7
+    }
+    for(int i = 0; i < 4; i++){
+        _mm_storeu_si128((__m128i *)(dst + (2 * i) * ld_dst), _mm_unpacklo_epi64(u[i], u[i + 4]));
+        _mm_storeu_si128((__m128i *)(dst + (2 * i + 1) * ld_dst), _mm_unpackhi_epi64(u[i], u[i + 4]));
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static inline void transpose_cpu_8x8_b1_avx2(uint8_t *dst, size_t ld_dst, const uint8_t *src, size_t ld_src)
+{
+    __m128i t[4], u[4];
+    for(int i = 0; i < 4; i++)
+        t[i] = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(src + (2 * i) * ld_src)),
+                                 _mm_loadl_epi64((const __m128i *)(src + (2 * i + 1) * ld_src)));
+    u[0] = _mm_unpacklo_epi16(t[0], t[1]);      // cols 0-3 of rows 0-3
+    u[1] = _mm_unpackhi_epi16(t[0], t[1]);      // cols 4-7 of rows 0-3
+    u[2] = _mm_unpacklo_epi16(t[2], t[3]);      // cols 0-3 of rows 4-7
+    u[3] = _mm_unpackhi_epi16(t[2], t[3]);
+    for(int i = 0; i < 2; i++){
+        __m128i lo = _mm_unpacklo_epi32(u[i], u[i + 2]);     // cols 4i, 4i+1
+        __m128i hi = _mm_unpackhi_epi32(u[i], u[i + 2]);     // cols 4i+2, 4i+3
+        _mm_storel_epi64((__m128i *)(dst + (4 * i + 0) * ld_dst), lo);
+        _mm_storel_epi64((__m128i *)(dst + (4 * i + 1) * ld_dst), _mm_unpackhi_epi64(lo, lo));
+        _mm_storel_epi64((__m128i *)(dst + (4 * i + 2) * ld_dst), hi);
+        _mm_storel_epi64((__m128i *)(dst + (4 * i + 3) * ld_dst), _mm_unpackhi_epi64(hi, hi));
+    }
+}
+#endif
+
+// rows [r0, r1) x cols [c0, c1) of one matrix
+template<typename T>
+static inline void transpose_cpu_tile(T *dst, size_t ld_dst, const T *src, size_t ld_src,
+                                      size_t r0, size_t r1, size_t c0, size_t c1, bool simd)
+{
+    size_t r8 = r0, c8 = c0;
+#if SIMD_CPU_X86
+    if(simd){
+        r8 = r0 + (r1 - r0) / 8 * 8;
+        c8 = c0 + (c1 - c0) / 8 * 8;
+        for(size_t c = c0; c < c8; c += 8)
+            for(size_t r = r0; r < r8; r += 8){
+                if(sizeof(T) == 4)
+                    transpose_cpu_8x8_b4_avx2((float *)(dst + c * ld_dst + r), ld_dst, (const float *)(src + r * ld_src + c), ld_src);
+                else if(sizeof(T) == 2)
+                    transpose_cpu_8x8_b2_avx2((uint16_t *)(dst + c * ld_dst + r), ld_dst, (const uint16_t *)(src + r * ld_src + c), ld_src);
+                else
+                    transpose_cpu_8x8_b1_avx2((uint8_t *)(dst + c * ld_dst + r), ld_dst, (const uint8_t *)(src + r * ld_src + c), ld_src);
+            }
+    }
+#else
+    (void)simd;
+#endif
+    transpose_cpu_tile_scalar(dst, ld_dst, src, ld_src, r8, r1, c0, c8);
+    transpose_cpu_tile_scalar(dst, ld_dst, src, ld_src, r0, r1, c8, c1);
+}
+
+template<typename T>
+static inline void transpose_cpu_run(T *dst, const T *src, const transpose_cpu_desc_t & d)
+{
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4, "1, 2 or 4 byte elements");
+    const size_t tile = TRANSPOSE_CPU_TILE;
+    size_t tiles_r = (d.rows + tile - 1) / tile;
+    size_t tiles_c = (d.cols + tile - 1) / tile;
+    size_t tiles = tiles_r * tiles_c;
+    bool simd = simd_cpu_get_isa() >= simd_cpu_isa_avx2;
+    thread_pool_cpu_parallel_for(d.b0 * d.b1 * tiles, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++){
+            size_t i_tile = i % tiles;
+            size_t i_b1 = (i / tiles) % d.b1;
+            size_t i_b0 = i / tiles / d.b1;
+            size_t r0 = (i_tile / tiles_c) * tile;
+            size_t c0 = (i_tile % tiles_c) * tile;
+            size_t r1 = r0 + tile < d.rows ? r0 + tile : d.rows;
+            size_t c1 = c0 + tile < d.cols ? c0 + tile : d.cols;
+            transpose_cpu_tile(dst + i_b0 * d.dst_b0 + i_b1 * d.dst_b1, d.ld_dst,
+                               src + i_b0 * d.src_b0 + i_b1 * d.src_b1, d.ld_src, r0, r1, c0, c1, simd);
+        }
+    });
+}
+
+// per n and group of vector_c channels, (vector_c x hw) -> (hw x vector_c)
+template<typename T>
+void transpose_cpu_nchw_2_nchwc(T *dst, const T *src, size_t n, size_t c, size_t h, size_t w, size_t vector_c)
+{
+    assert(c % vector_c == 0);
+    size_t hw = h * w;
+    transpose_cpu_desc_t d = {vector_c, hw, hw, vector_c, n, c / vector_c, c * hw, vector_c * hw, c * hw, vector_c * hw};
+    transpose_cpu_run(dst, src, d);
+}
+
+template<typename T>
+void transpose_cpu_nchwc_2_nchw(T *dst, const T *src, size_t n, size_t c, size_t h, size_t w, size_t vector_c)
+{
+    assert(c % vector_c == 0);
+    size_t hw = h * w;
+    transpose_cpu_desc_t d = {hw, vector_c, vector_c, hw, n, c / vector_c, c * hw, vector_c * hw, c * hw, vector_c * hw};
+    transpose_cpu_run(dst, src, d);
+}
+
+// weight kcyx -> cyxkc, the n of one group of vector_c channels are interleaved along a dst row of n * vector_c
+template<typename T>
+void transpose_cpu_nchw_2_chwnc(T *dst, const T *src, size_t n, size_t c, size_t h, size_t w, size_t vector_c)
+{
+    assert(c % vector_c == 0);
+    size_t hw = h * w;
+    transpose_cpu_desc_t d = {vector_c, hw, hw, n * vector_c, c / vector_c, n, vector_c * hw, c * hw, vector_c * hw * n, vector_c};
+    transpose_cpu_run(dst, src, d);
+}
+
+template<typename T>
+void transpose_cpu_chwnc_2_nchw(T *dst, const T *src, size_t n, size_t c, size_t h, size_t w, size_t vector_c)
+{
+    assert(c % vector_c == 0);
+    size_t hw = h * w;
+    transpose_cpu_desc_t d = {hw, vector_c, n * vector_c, hw, c / vector_c, n, vector_c * hw * n, vector_c, vector_c * hw, c * hw};
+    transpose_cpu_run(dst, src, d);
+}
+
+template<typename T>
+void transpose_cpu_nchw_2_nhwc(T *dst, const T *src, size_t n, size_t c, size_t h, size_t w)
+{
+    size_t hw = h * w;
+    transpose_cpu_desc_t d = {c, hw, hw, c, n, 1, c * hw, 0, c * hw, 0};
+    transpose_cpu_run(dst, src, d);
+}
+
+template<typename T>
+void transpose_cpu_nhwc_2_nchw(T *dst, const T *src, size_t n, size_t c, size_t h, size_t w)
+{
+    size_t hw = h * w;
+    transpose_cpu_desc_t d = {hw, c, c, hw, n, 1, c * hw, 0, c * hw, 0};
+    transpose_cpu_run(dst, src, d);
+}
+
+#endif
@@ -0,0 +1,148 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _VALID_STREAM_CPU_H
+#define _VALID_STREAM_CPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "convert_cpu.h"
+
+/*
+ * streaming validation. instead of the whole reference, then the whole device result, then one valid_vector over
+ * both, the checked tensor is walked in chunks of images, through a ring of VALID_STREAM_CPU_SLOTS chunk buffers:
+ *   the calling thread computes the reference of chunk i + 1, on the thread pool
+ *   a comparer thread folds chunk i into its valid_vector_chunk_t, serially, off the pool
+ *   a fetcher thread copies chunk i + 2 of the device result, up to VALID_STREAM_CPU_SLOTS chunks ahead
+ * so the host keeps 2 * VALID_STREAM_CPU_SLOTS chunks instead of two full tensors, and the wall time tends to the
+ * slowest stage (the reference) instead of the sum of all three.
+ * the reference is not kept, each validation recomputes it. the decision is the one of valid_vector_chunks_end().
+ */
+#ifndef VALID_STREAM_CPU_SLOTS
+#define VALID_STREAM_CPU_SLOTS 3
+#endif
+#ifndef VALID_STREAM_CPU_CHUNK_ELEMS
+#define VALID_STREAM_CPU_CHUNK_ELEMS (1 << 24)
+#endif
+
+// images per chunk, at least 1. even for int4, so every chunk starts on a byte
+static inline size_t valid_stream_cpu_chunk(convert_cpu_dtype_t dtype, size_t n, size_t image)
+{
+    size_t nb = VALID_STREAM_CPU_CHUNK_ELEMS / (image ? image : 1);
+    if(dtype == convert_cpu_int4 && (image & 1))
+        nb = nb & ~(size_t)1;
+    if(nb < 1)
+        nb = dtype == convert_cpu_int4 && (image & 1) ? 2 : 1;
+    return nb < n ? nb : n;
+}
+
+/*
+ * run chunks [0, chunks) through ref_func(i, ref), fetch_func(i, pred) and cmp_func(i, ref, pred), ref and pred
+ * being the slot buffers of chunk i, of ref_bytes and pred_bytes. ref_func runs on the calling thread, in chunk order,
+ * fetch_func and cmp_func each on a thread of their own, also in chunk order.
+ */
+template<typename ref_func_t, typename fetch_func_t, typename cmp_func_t>
+static inline void valid_stream_cpu_run(size_t chunks, size_t ref_bytes, size_t pred_bytes, const ref_func_t & ref_func,
+                                        const fetch_func_t & fetch_func, const cmp_func_t & cmp_func)
+{
+    if(chunks == 0)
+        return;
+    size_t slots = chunks < VALID_STREAM_CPU_SLOTS ? chunks : VALID_STREAM_CPU_SLOTS;
+    ref_bytes = (ref_bytes + 63) / 64 * 64;
+    pred_bytes = (pred_bytes + 63) / 64 * 64;
+    std::unique_ptr<uint8_t[]> ref_buf(new uint8_t[slots * ref_bytes]);
+    std::unique_ptr<uint8_t[]> pred_buf(new uint8_t[slots * pred_bytes]);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t ref_done = 0, fetch_done = 0, cmp_done = 0;     // chunks through each stage
+    auto wait_slot = [&](size_t i){
+        std::unique_lock<std::mutex> lk(mutex);
+        cv.wait(lk, [&]{ return i < cmp_done + slots; });
+    };
+    auto advance = [&](size_t *done){
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            (*done)++;
+        }
+        cv.notify_all();
+    };
+
+    std::thread fetcher([&]{
+        for(size_t i = 0; i < chunks; i++){
+            wait_slot(i);
+            fetch_func(i, (void *)(pred_buf.get() + i % slots * pred_bytes));
+            advance(&fetch_done);
+        }
+    });
+    std::thread comparer([&]{
+        for(size_t i = 0; i < chunks; i++){
+            {
+                std::unique_lock<std::mutex> lk(mutex);
+                cv.wait(lk, [&]{ return ref_done > i && fetch_done > i; });
+            }
+            cmp_func(i, (const void *)(ref_buf.get() + i % slots * ref_bytes),
+                     (const void *)(pred_buf.get() + i % slots * pred_bytes));
+            advance(&cmp_done);
+        }
+    });
+    for(size_t i = 0; i < chunks; i++){
+        wait_slot(i);
+        ref_func(i, (void *)(ref_buf.get() + i % slots * ref_bytes));
+        advance(&ref_done);
+    }
+    fetcher.join();
+    comparer.join();
+}
+
+/*
+ * validate a tensor of n images of image elements, in storage type dtype, chunk by chunk.
+ * ref_func(i_n, cn, ref) computes images [i_n, i_n + cn) of the reference into ref, fetch_func(i_n, cn, pred) copies
+ * the same images of the result under test into pred. include after tensor_validation_cpu.h.
+ */
+template<typename ref_func_t, typename fetch_func_t>
+static inline bool valid_stream_cpu_images(convert_cpu_dtype_t dtype, size_t n, size_t image, double nrms,
+                                           const ref_func_t & ref_func, const fetch_func_t & fetch_func)
+{
+    size_t nb = valid_stream_cpu_chunk(dtype, n, image);
+    size_t chunks = (n + nb - 1) / nb;
+    auto images = [&](size_t i){ return n - i * nb < nb ? n - i * nb : nb; };
+    size_t bytes = convert_cpu_bytes(dtype, nb * image);
+    std::vector<valid_vector_chunk_t> parts(chunks);
+    valid_stream_cpu_run(chunks, bytes, bytes,
+        [&](size_t i, void *ref){ ref_func(i * nb, images(i), ref); },
+        [&](size_t i, void *pred){ fetch_func(i * nb, images(i), pred); },
+        [&](size_t i, const void *ref, const void *pred){
+            parts[i] = valid_vector_chunk(dtype, ref, pred, images(i) * image);
+        });
+    return valid_vector_chunks_end(dtype, parts, nrms);
+}
+
+#endif
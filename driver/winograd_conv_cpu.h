@@ -0,0 +1,449 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef _WINOGRAD_CONV_CPU_H
+#define _WINOGRAD_CONV_CPU_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <vector>
+#include <memory>
+#include "thread_pool_cpu.h"
+#include "sgemm_cpu.h"
+#include "simd_cpu.h"
+#include "naive_conv.h"
+
+/*
+ * host reference winograd convolution F(MxM, 3x3), M = 2 or 4, for 3x3 stride 1 dilation 1 filters.
+ *   U = G g G^T               filter transform, once per call
+ *   V = B^T d B               input transform of every (alpha x alpha) input tile
+ *   M[xi][nu] = U[xi][nu] x V[xi][nu]     alpha^2 gemms over channels, through sgemm_cpu
+ * the transforms are applied to many tiles (or channels) at once with simd axpy.
+ *   Y = A^T M A               output transform to an (M x M) output tile
+ * bwd-data is the same forward winograd run on dst_grad with the 180 degree flipped, (k,c) transposed
+ * filter and pad (2 - p), hence pad is limited to 2.
+ * tiles are split into blocks, every pool task transforms and multiplies one block of tiles of one group.
+ *
+ * winograd trades multiplies for transform adds and has larger rounding error than direct conv,
+ * growing with M. see winograd_conv_cpu_nrms_scale()
+ */
+#ifndef WINOGRAD_CONV_CPU_SCRATCH_FLOATS
+#define WINOGRAD_CONV_CPU_SCRATCH_FLOATS (1 << 20)     // per thread V + M scratch limit, in floats
+#endif
+
+template<int M>
+struct winograd_conv_cpu_tile_t;
+
+template<>
+struct winograd_conv_cpu_tile_t<2> {
+    static const int alpha = 4;
+    static const float * bt(){
+        static const float m[4 * 4] = {
+            1,  0, -1,  0,
+            0,  1,  1,  0,
+            0, -1,  1,  0,
+            0,  1,  0, -1};
+        return m;
+    }
+    static const float * g(){
+        static const float m[4 * 3] = {
+            1.0f,  0.0f, 0.0f,
+            0.5f,  0.5f, 0.5f,
+            0.5f, -0.5f, 0.5f,
+            0.0f,  0.0f, 1.0f};
+        return m;
+    }
+    static const float * at(){
+        static const float m[2 * 4] = {
+            1, 1,  1,  0,
+            0, 1, -1, -1};
+        return m;
+    }
+};
+
+template<>
+struct winograd_conv_cpu_tile_t<4> {
+    static const int alpha = 6;
+    static const float * bt(){
+        static const float m[6 * 6] = {
+            4,  0, -5,  0, 1, 0,
+            0, -4, -4,  1, 1, 0,
+            0,  4, -4, -1, 1, 0,
+            0, -2, -1,  2, 1, 0,
+            0,  2, -1, -2, 1, 0,
+            0,  4,  0, -5, 0, 1};
+        return m;
+    }
+    static const float * g(){
+        static const float m[6 * 3] = {
+             1.0f / 4,        0.0f,        0.0f,
+            -1.0f / 6,   -1.0f / 6,   -1.0f / 6,
+            -1.0f / 6,    1.0f / 6,   -1.0f / 6,
+             1.0f / 24,   1.0f / 12,   1.0f / 6,
+             1.0f / 24,  -1.0f / 12,   1.0f / 6,
+             0.0f,        0.0f,        1.0f};
+        return m;
+    }
+    static const float * at(){
+        static const float m[4 * 6] = {
+            1, 1,  1, 1,  1, 0,
+            0, 1, -1, 2, -2, 0,
+            0, 1,  1, 4,  4, 0,
+            0, 1, -1, 8, -8, 1};
+        return m;
+    }
+};
+
+/*
+ * out[a][b][x] = sum_i sum_j l[a][i] * l[b][j] * in[i][j][x] for x in [0, len), i.e. L * in * L^T on len
+ * independent matrices at once. planes of in/out are in_ld/out_ld floats apart, tmp holds R * C * len floats.
+ */
+template<int R, int C>
+static inline void winograd_conv_cpu_transform(const float *l, const float *in, size_t in_ld,
+                                               float *out, size_t out_ld, size_t len, float *tmp)
+{
+    for(int a = 0; a < R; a++){
+        for(int j = 0; j < C; j++){
+            float *t = tmp + (a * C + j) * len;
+            memset(t, 0, len * sizeof(float));
+            for(int i = 0; i < C; i++)
+                if(l[a * C + i] != .0f)
+                    simd_cpu_axpy_f32(t, l[a * C + i], in + (i * C + j) * in_ld, len);
+        }
+    }
+    for(int a = 0; a < R; a++){
+        for(int b = 0; b < R; b++){
+            float *o = out + (a * R + b) * out_ld;
+            memset(o, 0, len * sizeof(float));
+            for(int j = 0; j < C; j++)
+                if(l[b * C + j] != .0f)
+                    simd_cpu_axpy_f32(o, l[b * C + j], tmp + (a * C + j) * len, len);
+        }
+    }
+}
+
+static inline bool winograd_conv_cpu_applicable(size_t fx, size_t fy, size_t px, size_t py,
+                                                size_t sx, size_t sy, size_t dx, size_t dy)
+{
+    return fx == 3 && fy == 3 && sx == 1 && sy == 1 && dx == 1 && dy == 1 && px <= 2 && py <= 2;
+}
+
+/*
+ * output tile size. IGEMM_CPU_WINOGRAD_TILE=2/4 forces one, otherwise take the cheaper by a simple model,
+ * cost ~ alpha^2 * (tiles + WINOGRAD_CONV_CPU_FILTER_COST), the constant being the transformed filter that is
+ * built and streamed once per call, in units of tiles. F(4x4) wins for large images, F(2x2) for 7x7/14x14
+ * with many channels. h/w is the image size, the output of a 3x3 winograd-able conv is within 4 of it
+ */
+#ifndef WINOGRAD_CONV_CPU_FILTER_COST
+#define WINOGRAD_CONV_CPU_FILTER_COST 128
+#endif
+static inline int winograd_conv_cpu_get_tile(size_t n, size_t h, size_t w)
+{
+    char *v = getenv("IGEMM_CPU_WINOGRAD_TILE");
+    if(v && (atoi(v) == 2 || atoi(v) == 4))
+        return atoi(v);
+    size_t cost_2 = 16 * (n * ((h + 1) / 2) * ((w + 1) / 2) + WINOGRAD_CONV_CPU_FILTER_COST);
+    size_t cost_4 = 36 * (n * ((h + 3) / 4) * ((w + 3) / 4) + WINOGRAD_CONV_CPU_FILTER_COST);
+    return cost_2 < cost_4 ? 2 : 4;
+}
+
+// extra tolerance to allow on top of the fp32 get_nrms() when winograd is the reference. against naive,
+// F(4x4,3x3) measures ~3.5x the nrms of im2col + gemm, F(2x2,3x3) less, so one scale covers both.
+// fp16/bf16 are not scaled, their tolerance is far above this error once the reference is rounded to the type
+static inline double winograd_conv_cpu_nrms_scale()
+{
+    return 4.0;
+}
+
+/*
+ * u[ig][xi*alpha+nu][o][i], o/i the output/input channel of the winograd conv.
+ * fwd : o = k, i = c, g = filter[k][c].  bwd : o = c, i = k, g = flip(filter[k][c])
+ */
+template<int M>
+static inline void winograd_conv_cpu_transform_filter(float *u, const float *filter, size_t k, size_t c,
+                                                      size_t group, bool is_nhwc, bool is_bwd)
+{
+    const int alpha = winograd_conv_cpu_tile_t<M>::alpha;
+    const int a2 = alpha * alpha;
+    const size_t kb = 16;       // k per task, so that the transposed store of bwd writes runs of kb floats
+    size_t k_per_group = k / group;
+    size_t c_per_group = c / group;
+    size_t o_len = is_bwd ? c_per_group : k_per_group;
+    size_t i_len = is_bwd ? k_per_group : c_per_group;
+    size_t k_blocks = (k_per_group + kb - 1) / kb;
+    thread_pool_cpu_get().run(group * k_blocks, [&](size_t task){
+        static thread_local std::vector<float> scratch;
+        if(scratch.size() < (9 + a2 * (kb + 1) + alpha * 3) * c_per_group)
+            scratch.resize((9 + a2 * (kb + 1) + alpha * 3) * c_per_group);
+        float *g = scratch.data();                  // [9][c_per_group]
+        float *t = g + 9 * c_per_group;             // [kb][a2][c_per_group]
+        float *tmp = t + a2 * kb * c_per_group;
+        size_t ig = task / k_blocks;
+        size_t k0 = (task % k_blocks) * kb;
+        size_t nk = k0 + kb < k_per_group ? kb : k_per_group - k0;
+        float *u_g = u + ig * a2 * o_len * i_len;
+        for(size_t kk = 0; kk < nk; kk++){
+            size_t gk = ig * k_per_group + k0 + kk;
+            for(size_t rs = 0; rs < 9; rs++){
+                float *g_rs = g + (is_bwd ? 8 - rs : rs) * c_per_group;
+                if(is_nhwc)
+                    memcpy(g_rs, filter + (gk * 9 + rs) * c_per_group, c_per_group * sizeof(float));
+                else
+                    for(size_t ic = 0; ic < c_per_group; ic++)
+                        g_rs[ic] = filter[(gk * c_per_group + ic) * 9 + rs];
+            }
+            float *t_k = t + kk * a2 * c_per_group;
+            winograd_conv_cpu_transform<alpha, 3>(winograd_conv_cpu_tile_t<M>::g(), g, c_per_group,
+                                                  t_k, c_per_group, c_per_group, tmp);
+            if(!is_bwd)
+                for(int xn = 0; xn < a2; xn++)
+                    memcpy(u_g + (xn * o_len + k0 + kk) * i_len, t_k + xn * c_per_group, c_per_group * sizeof(float));
+        }
+        if(is_bwd)
+            for(int xn = 0; xn < a2; xn++)
+                for(size_t ic = 0; ic < c_per_group; ic++){
+                    float *u_c = u_g + (xn * o_len + ic) * i_len + k0;
+                    for(size_t kk = 0; kk < nk; kk++)
+                        u_c[kk] = t[(kk * a2 + xn) * c_per_group + ic];
+                }
+    });
+}
+
+/*
+ * dst[n][o][oh][ow] (or nhwc) = winograd conv of src[n][i][h][w] (or nhwc) with transformed filter u.
+ * c_in/c_out are the total channels of src/dst.
+ * the transforms run vectorized along the contiguous dimension, which is the tiles of a block for nchw,
+ * and the channels for nhwc. hence V/M are kept as [xn][channel][tile] for nchw and [xn][tile][channel] for nhwc
+ */
+template<int M>
+static inline void winograd_conv_cpu_run(const float *src, const float *u, float *dst,
+                                         size_t n, size_t h, size_t w, size_t oh, size_t ow,
+                                         size_t c_in, size_t c_out, size_t px, size_t py,
+                                         size_t group, bool is_nhwc)
+{
+    const int alpha = winograd_conv_cpu_tile_t<M>::alpha;
+    const int a2 = alpha * alpha;
+    size_t i_len = c_in / group;
+    size_t o_len = c_out / group;
+    size_t th = (oh + M - 1) / M;
+    size_t tw = (ow + M - 1) / M;
+    size_t tiles = n * th * tw;
+
+    size_t block = WINOGRAD_CONV_CPU_SCRATCH_FLOATS / (a2 * (i_len + o_len));
+    block = block < 8 ? 8 : (block > 256 ? 256 : block);
+    block = block > tiles ? tiles : block;
+    size_t want_tasks = 2 * thread_pool_cpu_get_num_threads();
+    while(group * ((tiles + block - 1) / block) < want_tasks && block > 8)
+        block = (block + 1) / 2;
+    size_t num_blocks = (tiles + block - 1) / block;
+    size_t vec_len = is_nhwc ? (i_len > o_len ? i_len : o_len) : block;
+
+    thread_pool_cpu_get().run(group * num_blocks, [&](size_t task){
+        size_t ig = task / num_blocks;
+        size_t t0 = (task % num_blocks) * block;
+        size_t nt = t0 + block < tiles ? block : tiles - t0;
+
+        static thread_local std::vector<float> scratch;
+        size_t need = a2 * (i_len + o_len) * block + a2 * vec_len + alpha * alpha * vec_len;
+        if(scratch.size() < need)
+            scratch.resize(need);
+        float *v = scratch.data();                          // a2 * i_len * block
+        float *m = v + a2 * i_len * block;                  // a2 * o_len * block
+        float *d = m + a2 * o_len * block;                  // a2 * vec_len, gathered input / output tile
+        float *tmp = d + a2 * vec_len;                      // alpha * alpha * vec_len
+
+        auto tile_origin = [&](size_t t, size_t *in, size_t *ty, size_t *tx){
+            size_t tile = t0 + t;
+            *in = tile / (th * tw);
+            *ty = (tile / tw) % th;
+            *tx = tile % tw;
+        };
+
+        // input transform
+        if(is_nhwc){
+            for(size_t t = 0; t < nt; t++){
+                size_t in, ty, tx;
+                tile_origin(t, &in, &ty, &tx);
+                for(int i = 0; i < alpha; i++){
+                    size_t cur_h = ty * M - py + i;
+                    for(int j = 0; j < alpha; j++){
+                        size_t cur_w = tx * M - px + j;
+                        float *d_ij = d + (i * alpha + j) * i_len;
+                        if(cur_h < h && cur_w < w)
+                            memcpy(d_ij, src + ((in * h + cur_h) * w + cur_w) * c_in + ig * i_len, i_len * sizeof(float));
+                        else
+                            memset(d_ij, 0, i_len * sizeof(float));
+                    }
+                }
+                winograd_conv_cpu_transform<alpha, alpha>(winograd_conv_cpu_tile_t<M>::bt(), d, i_len,
+                                                          v + t * i_len, block * i_len, i_len, tmp);
+            }
+        }else{
+            for(size_t ic = 0; ic < i_len; ic++){
+                for(size_t t = 0; t < nt; t++){
+                    size_t in, ty, tx;
+                    tile_origin(t, &in, &ty, &tx);
+                    const float *src_c = src + (in * c_in + ig * i_len + ic) * h * w;
+                    for(int i = 0; i < alpha; i++){
+                        size_t cur_h = ty * M - py + i;
+                        for(int j = 0; j < alpha; j++){
+                            size_t cur_w = tx * M - px + j;
+                            d[(i * alpha + j) * block + t] = (cur_h < h && cur_w < w) ? src_c[cur_h * w + cur_w] : .0f;
+                        }
+                    }
+                }
+                winograd_conv_cpu_transform<alpha, alpha>(winograd_conv_cpu_tile_t<M>::bt(), d, block,
+                                                          v + ic * block, i_len * block, nt, tmp);
+            }
+        }
+
+        // element-wise product, as one gemm per transform coordinate
+        const float *u_g = u + ig * a2 * o_len * i_len;
+        for(int xn = 0; xn < a2; xn++){
+            const float *u_xn = u_g + xn * o_len * i_len;
+            if(is_nhwc)     // m[xn][t][o] = v[xn][t][i] x u[xn][o][i]^T
+                sgemm_cpu(nt, o_len, i_len,
+                          v + xn * block * i_len, i_len, 1,
+                          u_xn, 1, i_len,
+                          m + xn * block * o_len, o_len, 1);
+            else            // m[xn][o][t] = u[xn][o][i] x v[xn][i][t]
+                sgemm_cpu(o_len, nt, i_len,
+                          u_xn, i_len, 1,
+                          v + xn * i_len * block, block, 1,
+                          m + xn * o_len * block, block, 1);
+        }
+
+        // output transform
+        if(is_nhwc){
+            for(size_t t = 0; t < nt; t++){
+                size_t in, ty, tx;
+                tile_origin(t, &in, &ty, &tx);
+                winograd_conv_cpu_transform<M, alpha>(winograd_conv_cpu_tile_t<M>::at(), m + t * o_len, block * o_len,
+                                                      d, o_len, o_len, tmp);
+                for(int i = 0; i < M && ty * M + i < oh; i++)
+                    for(int j = 0; j < M && tx * M + j < ow; j++)
+                        memcpy(dst + ((in * oh + ty * M + i) * ow + tx * M + j) * c_out + ig * o_len,
+                               d + (i * M + j) * o_len, o_len * sizeof(float));
+            }
+        }else{
+            for(size_t ik = 0; ik < o_len; ik++){
+                winograd_conv_cpu_transform<M, alpha>(winograd_conv_cpu_tile_t<M>::at(), m + ik * block, o_len * block,
+                                                      d, block, nt, tmp);
+                for(size_t t = 0; t < nt; t++){
+                    size_t in, ty, tx;
+                    tile_origin(t, &in, &ty, &tx);
+                    float *dst_k = dst + (in * c_out + ig * o_len + ik) * oh * ow;
+                    for(int i = 0; i < M && ty * M + i < oh; i++)
+                        for(int j = 0; j < M && tx * M + j < ow; j++)
+                            dst_k[(ty * M + i) * ow + tx * M + j] = d[(i * M + j) * block + t];
+                }
+            }
+        }
+    });
+}
+
+template<int M>
+static inline void winograd_conv_cpu_fwd(const float *src, const float *filter, float *dst,
+                                         size_t n, size_t w, size_t h, size_t c, size_t k,
+                                         size_t px, size_t py, size_t group, bool is_nhwc)
+{
+    const int alpha = winograd_conv_cpu_tile_t<M>::alpha;
+    size_t oh = naive_conv_out_size(h, py, 1, 3, 1);
+    size_t ow = naive_conv_out_size(w, px, 1, 3, 1);
+    std::unique_ptr<float[]> u(new float[alpha * alpha * (k / group) * c]);    // fully written by the transform
+    winograd_conv_cpu_transform_filter<M>(u.get(), filter, k, c, group, is_nhwc, false);
+    winograd_conv_cpu_run<M>(src, u.get(), dst, n, h, w, oh, ow, c, k, px, py, group, is_nhwc);
+}
+
+template<int M>
+static inline void winograd_conv_cpu_bwd(float *src_grad, const float *filter, const float *dst_grad,
+                                         size_t n, size_t w, size_t h, size_t c, size_t k,
+                                         size_t px, size_t py, size_t group, bool is_nhwc)
+{
+    const int alpha = winograd_conv_cpu_tile_t<M>::alpha;
+    size_t oh = naive_conv_out_size(h, py, 1, 3, 1);
+    size_t ow = naive_conv_out_size(w, px, 1, 3, 1);
+    std::unique_ptr<float[]> u(new float[alpha * alpha * (k / group) * c]);    // fully written by the transform
+    winograd_conv_cpu_transform_filter<M>(u.get(), filter, k, c, group, is_nhwc, true);
+    winograd_conv_cpu_run<M>(dst_grad, u.get(), src_grad, n, oh, ow, h, w, k, c, 2 - px, 2 - py, group, is_nhwc);
+}
+
+static inline void winograd_conv_fwd_nchw(const float *src, const float *filter,
+                                          float *dst, size_t n, size_t w, size_t h,
+                                          size_t c, size_t k, size_t fx, size_t fy,
+                                          size_t px, size_t py, size_t sx,
+                                          size_t sy, size_t dx, size_t dy, size_t group) {
+    assert(winograd_conv_cpu_applicable(fx, fy, px, py, sx, sy, dx, dy));
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    if(winograd_conv_cpu_get_tile(n, h, w) == 2)
+        winograd_conv_cpu_fwd<2>(src, filter, dst, n, w, h, c, k, px, py, group, false);
+    else
+        winograd_conv_cpu_fwd<4>(src, filter, dst, n, w, h, c, k, px, py, group, false);
+}
+
+static inline void winograd_conv_fwd_nhwc(const float *src, const float *filter,
+                                          float *dst, size_t n, size_t w, size_t h,
+                                          size_t c, size_t k, size_t fx, size_t fy,
+                                          size_t px, size_t py, size_t sx,
+                                          size_t sy, size_t dx, size_t dy, size_t group) {
+    assert(winograd_conv_cpu_applicable(fx, fy, px, py, sx, sy, dx, dy));
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    if(winograd_conv_cpu_get_tile(n, h, w) == 2)
+        winograd_conv_cpu_fwd<2>(src, filter, dst, n, w, h, c, k, px, py, group, true);
+    else
+        winograd_conv_cpu_fwd<4>(src, filter, dst, n, w, h, c, k, px, py, group, true);
+}
+
+static inline void winograd_conv_bwd_nchw(float *src_grad, const float *filter,
+                                          const float *dst_grad, size_t n,
+                                          size_t w, size_t h, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t px,
+                                          size_t py, size_t sx, size_t sy,
+                                          size_t dx, size_t dy, size_t group) {
+    assert(winograd_conv_cpu_applicable(fx, fy, px, py, sx, sy, dx, dy));
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    if(winograd_conv_cpu_get_tile(n, h, w) == 2)
+        winograd_conv_cpu_bwd<2>(src_grad, filter, dst_grad, n, w, h, c, k, px, py, group, false);
+    else
+        winograd_conv_cpu_bwd<4>(src_grad, filter, dst_grad, n, w, h, c, k, px, py, group, false);
+}
+
+static inline void winograd_conv_bwd_nhwc(float *src_grad, const float *filter,
+                                          const float *dst_grad, size_t n,
+                                          size_t w, size_t h, size_t c, size_t k,
+                                          size_t fx, size_t fy, size_t px,
+                                          size_t py, size_t sx, size_t sy,
+                                          size_t dx, size_t dy, size_t group) {
+    assert(winograd_conv_cpu_applicable(fx, fy, px, py, sx, sy, dx, dy));
+    assert((group >= 1) && (c % group == 0) && (k % group == 0));
+    if(winograd_conv_cpu_get_tile(n, h, w) == 2)
+        winograd_conv_cpu_bwd<2>(src_grad, filter, dst_grad, n, w, h, c, k, px, py, group, true);
+    else
+        winograd_conv_cpu_bwd<4>(src_grad, filter, dst_grad, n, w, h, c, k, px, py, group, true);
+}
+
+#endif
@@ -0,0 +1,7 @@
+#!/bin/sh
+# to launch from top of generator
+rm -rf out
+mkdir out
+
+/opt/rocm/hip/bin/hipcc -Idriver -std=c++14 -O2 test/buffer_arena/test_buffer_arena.cpp -o out/test_buffer_arena.exe || exit 1
+./out/test_buffer_arena.exe
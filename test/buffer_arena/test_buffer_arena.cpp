@@ -0,0 +1,180 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "buffer_arena_cpu.h"
+
+static inline int env_get_int(const char *var_name, int default_int) {
+    char *v = getenv(var_name);
+    int r = default_int;
+    if (v)
+        r = atoi(v);
+    return r;
+}
+
+static bool test_buffer_arena(bool verbose)
+{
+    int num_total = 0, num_fail = 0;
+    // mock device allocator, hands out fake addresses and checks every free matches an alloc
+    std::map<uintptr_t, std::pair<size_t, int>> live;
+    uintptr_t next_addr = 0x10000;
+    size_t num_mock_allocs = 0;
+    size_t live_bytes = 0;
+    size_t live_bytes_limit = SIZE_MAX;             // the mock runs out of memory past it
+    bool free_ok = true;
+    {
+        buffer_arena_cpu_t arena(
+            [&](size_t bytes, int *kind) -> void * {
+                if(live_bytes + bytes > live_bytes_limit)
+                    return nullptr;
+                live_bytes += bytes;
+                uintptr_t addr = next_addr;
+                next_addr += bytes + 4096;
+                *kind = bytes >= (1 << 20) ? 1 : 0;     // e.g. pinned
+                live[addr] = std::make_pair(bytes, *kind);
+                num_mock_allocs++;
+                return reinterpret_cast<void *>(addr);
+            },
+            [&](void *ptr, size_t bytes, int kind){
+                auto it = live.find(reinterpret_cast<uintptr_t>(ptr));
+                free_ok = free_ok && it != live.end() && it->second.first == bytes && it->second.second == kind;
+                if(it != live.end()){
+                    live_bytes -= it->second.first;
+                    live.erase(it);
+                }
+            });
+
+        num_total++;
+        num_fail += !(buffer_arena_cpu_t::size_class(1) == 4096 && buffer_arena_cpu_t::size_class(4096) == 4096 &&
+                      buffer_arena_cpu_t::size_class(5000) == 5120 && buffer_arena_cpu_t::size_class(8192) == 8192 &&
+                      buffer_arena_cpu_t::size_class(8193) == 10240 && buffer_arena_cpu_t::size_class(1000000) == 1048576);
+        bool class_ok = true;
+        for(size_t bytes = 1; bytes < (size_t(1) << 34); bytes = bytes * 3 + 7){
+            size_t cls = buffer_arena_cpu_t::size_class(bytes);
+            class_ok = class_ok && cls >= bytes && (bytes <= 4096 || cls <= bytes + bytes / 4 + 1);
+        }
+        num_total++;
+        num_fail += !class_ok;
+
+        num_total++;
+        num_fail += arena.acquire(0) != nullptr;
+
+        // a sweep of problems, each holding 3 tensors at once, the largest in the middle
+        std::vector<std::vector<size_t>> problems = {{100000, 2000, 100000}, {400000, 9000, 200000}, {3000000, 50000, 3000000},
+                                                     {400000, 9000, 200000}, {100000, 2000, 100000}, {3000000, 50000, 3000000}};
+        size_t allocs_after_largest = 0;
+        for(size_t i = 0; i < problems.size(); i++){
+            std::vector<void *> ptrs;
+            for(size_t bytes : problems[i])
+                ptrs.push_back(arena.acquire(bytes));
+            std::sort(ptrs.begin(), ptrs.end());
+            num_total++;
+            num_fail += std::unique(ptrs.begin(), ptrs.end()) != ptrs.end();   // distinct blocks
+            for(void *ptr : ptrs)
+                arena.release(ptr);
+            if(i == 2)
+                allocs_after_largest = num_mock_allocs;
+        }
+        buffer_arena_cpu_t::stats_t stats = arena.get_stats();
+        if(verbose)
+            printf("buffer_arena sweep: peak in use %zu, peak reserved %zu, reserved %zu, %zu allocs, %zu reuses\n",
+                   stats.peak_in_use, stats.peak_reserved, stats.reserved, stats.num_allocs, stats.num_reuses);
+        size_t largest = buffer_arena_cpu_t::size_class(3000000) * 2 + buffer_arena_cpu_t::size_class(50000);
+        num_total++;
+        num_fail += !(num_mock_allocs == allocs_after_largest && stats.in_use == 0 && stats.peak_in_use >= largest &&
+                      stats.reserved == live_bytes && stats.num_allocs == num_mock_allocs && stats.num_reuses == 18 - num_mock_allocs);
+        num_total++;
+        num_fail += live.size() != num_mock_allocs;     // outgrown blocks stay cached until trim
+
+        // reserve sizes a fresh arena for the largest problem up front, then nothing is allocated
+        arena.trim();
+        num_total++;
+        num_fail += !(live.empty() && arena.get_stats().reserved == 0);
+        arena.reserve({3000000, 50000, 3000000});
+        size_t allocs_reserved = num_mock_allocs;
+        for(auto & sizes : problems){
+            std::vector<void *> ptrs;
+            for(size_t bytes : sizes)
+                ptrs.push_back(arena.acquire(bytes));
+            for(void *ptr : ptrs)
+                arena.release(ptr);
+        }
+        num_total++;
+        num_fail += num_mock_allocs != allocs_reserved;
+
+        // a problem that grows one of the tensors it holds costs one allocation, the others are still cached
+        for(size_t grown : {0, 1, 2}){
+            arena.trim();
+            std::vector<size_t> sizes = {100000, 2000, 100000};
+            std::vector<void *> ptrs;
+            for(size_t bytes : sizes)
+                ptrs.push_back(arena.acquire(bytes));
+            for(void *ptr : ptrs)
+                arena.release(ptr);
+            sizes[grown] *= 4;
+            size_t allocs_before = arena.get_stats().num_allocs;
+            ptrs.clear();
+            for(size_t bytes : sizes)
+                ptrs.push_back(arena.acquire(bytes));
+            for(void *ptr : ptrs)
+                arena.release(ptr);
+            num_total++;
+            num_fail += arena.get_stats().num_allocs != allocs_before + 1;
+        }
+
+        // an allocator out of memory gets the cache back, then the allocation is retried
+        {
+            arena.trim();
+            arena.release(arena.acquire(1000000));
+            live_bytes_limit = buffer_arena_cpu_t::size_class(1000000) + buffer_arena_cpu_t::size_class(2000000) - 1;
+            void *ptr = arena.acquire(2000000);
+            num_total++;
+            num_fail += !(ptr && live.size() == 1 && arena.get_stats().reserved == buffer_arena_cpu_t::size_class(2000000));
+            arena.release(ptr);
+            live_bytes_limit = 0;
+            num_total++;
+            num_fail += arena.acquire(4000000) != nullptr;
+            live_bytes_limit = SIZE_MAX;
+        }
+
+        // a block still held at destruction is freed too
+        arena.acquire(123);
+    }
+    num_total++;
+    num_fail += !(free_ok && live.empty());
+
+    printf("buffer_arena %d of %d cases valid\n", num_total - num_fail, num_total);
+    return num_fail == 0;
+}
+
+int main()
+{
+    return test_buffer_arena(env_get_int("BUFFER_ARENA_VERBOSE", 0)) ? 0 : 1;
+}
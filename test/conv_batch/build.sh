@@ -0,0 +1,7 @@
+#!/bin/sh
+# to launch from top of generator
+rm -rf out
+mkdir out
+
+/opt/rocm/hip/bin/hipcc -Idriver -std=c++14 -O2 test/conv_batch/test_conv_batch.cpp -o out/test_conv_batch.exe || exit 1
+./out/test_conv_batch.exe
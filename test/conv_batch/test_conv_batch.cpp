@@ -0,0 +1,134 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include "conv_batch_cpu.h"
+
+static inline int env_get_int(const char *var_name, int default_int) {
+    char *v = getenv(var_name);
+    int r = default_int;
+    if (v)
+        r = atoi(v);
+    return r;
+}
+
+static std::string test_conv_batch_read(const std::string &path)
+{
+    std::ifstream fs(path);
+    std::stringstream ss;
+    ss << fs.rdbuf();
+    return ss.str();
+}
+
+static bool test_conv_batch(bool verbose)
+{
+    int num_total = 0, num_fail = 0;
+    std::string path = "/tmp/test_conv_batch_" + std::to_string(getpid());
+    {
+        FILE *fp = fopen((path + ".txt").c_str(), "w");
+        fprintf(fp, "# resnet50 fwd\n"
+                    "./out/conv_driver.exe conv -n 64 -c 256 -H 56 -W 56 -k 64 -y 1 -x 1 -F 1\n"
+                    "\n"
+                    "   convfp16 -n 64 -c 64 -H 56 -W 56 -k 64 -y 3 -x 3 -p 1 -q 1 -F 1   # 3x3\n"
+                    "conv -n 64 -c 256 -H 56 -W 56 -k 64 -y 1 -x 1 -F 1\n"
+                    "#./out/conv_driver.exe conv -n 1 -F 1\n"
+                    "conv --batchsize 64 -c 256 -H 56 -W 56 -k 64 -y 1 -x 1 -F 1\n");
+        fclose(fp);
+    }
+    std::vector<conv_batch_cpu_cmd_t> cmds;
+    num_total++;
+    num_fail += !conv_batch_cpu_parse((path + ".txt").c_str(), &cmds);
+    num_total++;
+    num_fail += !(cmds.size() == 4 && cmds[0].line == 2 && cmds[1].line == 4 && cmds[2].line == 5 && cmds[3].line == 7);
+    if(cmds.size() == 4){
+        num_total++;
+        num_fail += conv_batch_cpu_join(cmds[0].tokens) != "conv -n 64 -c 256 -H 56 -W 56 -k 64 -y 1 -x 1 -F 1" ||
+                    conv_batch_cpu_join(cmds[0].tokens) != conv_batch_cpu_join(cmds[2].tokens) ||
+                    conv_batch_cpu_join(cmds[1].tokens) != "convfp16 -n 64 -c 64 -H 56 -W 56 -k 64 -y 3 -x 3 -p 1 -q 1 -F 1";
+    }
+    num_total++;
+    num_fail += conv_batch_cpu_parse((path + ".missing").c_str(), &cmds);
+
+    // the driver keys on the parsed args, so "-n 64" and "--batchsize 64" are the same problem
+    std::vector<std::string> keys = {"a", "b", "a", "c", "b", "a"};
+    std::vector<size_t> unique_of;
+    std::vector<size_t> unique = conv_batch_cpu_dedupe(keys, &unique_of);
+    num_total++;
+    num_fail += !(unique == std::vector<size_t>({0, 1, 3}) && unique_of == std::vector<size_t>({0, 1, 0, 2, 1, 0}));
+
+    std::vector<conv_batch_cpu_result_t> results(2);
+    results[0].cmd = "conv -n 64 -c 256 -H 56 -W 56 -k 64 -y 1 -x 1 -F 1";
+    results[0].lines = {2, 5};
+    results[0].direction = "fwd";
+    results[0].kernel_name = "igemm_fwd_gtcx_nchw_fp32_bx0_ex1_bt128x128x16";
+    results[0].gks = 1;
+    results[0].duration_ms = 0.5;
+    results[0].tflops = 6.5;
+    results[0].efficiency = 28.25;
+    results[0].verified = 1;
+    results[0].num_invalid = 0;
+    results[1] = results[0];
+    results[1].cmd = "convfp16 \"quoted\"";
+    results[1].lines = {4};
+    results[1].kernel_name = "";
+    results[1].num_invalid = 2;
+    num_total++;
+    num_fail += !conv_batch_cpu_write((path + ".csv").c_str(), results);
+    num_total++;
+    num_fail += test_conv_batch_read(path + ".csv") !=
+        "lines,direction,cost_ms,tflops,efficiency,kernel,gks,verified,num_invalid,cmd\n"
+        "2;5,fwd,0.500,6.500,28.25%,igemm_fwd_gtcx_nchw_fp32_bx0_ex1_bt128x128x16,1,1,0,conv -n 64 -c 256 -H 56 -W 56 -k 64 -y 1 -x 1 -F 1\n"
+        "4,fwd,,,,,,1,2,convfp16 \"quoted\"\n";
+    num_total++;
+    num_fail += !conv_batch_cpu_write((path + ".json").c_str(), results);
+    std::string json = test_conv_batch_read(path + ".json");
+    if(verbose)
+        printf("%s", json.c_str());
+    num_total++;
+    num_fail += json !=
+        "[\n"
+        "  {\"lines\": [2, 5], \"direction\": \"fwd\", \"cmd\": \"conv -n 64 -c 256 -H 56 -W 56 -k 64 -y 1 -x 1 -F 1\", "
+        "\"kernel\": \"igemm_fwd_gtcx_nchw_fp32_bx0_ex1_bt128x128x16\", \"gks\": 1, \"cost_ms\": 0.500, \"tflops\": 6.500, "
+        "\"efficiency\": 28.25, \"verified\": true, \"num_invalid\": 0},\n"
+        "  {\"lines\": [4], \"direction\": \"fwd\", \"cmd\": \"convfp16 \\\"quoted\\\"\", \"kernel\": null, "
+        "\"verified\": true, \"num_invalid\": 2}\n"
+        "]\n";
+
+    for(const char *ext : {".txt", ".csv", ".json"})
+        unlink((path + ext).c_str());
+    printf("conv_batch %d of %d cases valid\n", num_total - num_fail, num_total);
+    return num_fail == 0;
+}
+
+int main()
+{
+    return test_conv_batch(env_get_int("CONV_BATCH_VERBOSE", 0)) ? 0 : 1;
+}
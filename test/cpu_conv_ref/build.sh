@@ -0,0 +1,6 @@
+#!/bin/sh
+# to launch from top of generator
+rm -rf out
+mkdir out
+
+/opt/rocm/hip/bin/hipcc -Idriver -std=c++14 -O2 -lpthread test/cpu_conv_ref/test_cpu_conv_ref.cpp -o out/test_cpu_conv_ref.exe || exit 1
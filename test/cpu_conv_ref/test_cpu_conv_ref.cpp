@@ -0,0 +1,1411 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <string>
+
+#define NAIVE_CONV_THREADED
+#include "naive_conv.h"
+#include "conv_ref_cpu.h"
+#define CONV_NATIVE_CPU_CHUNK_FLOATS (1 << 12)    // small, so the batch is split and int4 chunks start mid byte
+#include "conv_native_cpu.h"
+#include "conv_sample_cpu.h"
+
+static inline int env_get_int(const char *var_name, int default_int) {
+    char *v = getenv(var_name);
+    int r = default_int;
+    if (v)
+        r = atoi(v);
+    return r;
+}
+
+// stand-ins for the driver types tensor_validation_cpu.h takes from common.h and igemm_gtc_base.h
+typedef enum {
+    driverHalf  = 0,
+    driverFloat = 1,
+    driverInt8  = 3,
+    driverBFloat16 = 5,
+    driverInt4  = 7,
+} driverDataType_t;
+
+class bfloat16{
+public:
+    bfloat16() : data_(0) {}
+    explicit bfloat16(float f) : data_(convert_cpu_f32_to_bf16_scalar(f)) {}
+    operator float() const { return convert_cpu_bf16_to_f32_scalar(data_); }
+private:
+    uint16_t data_;
+};
+
+#define USE_MIOPEN_NRMS 1
+#include "tensor_copy_cpu.h"
+#include "tensor_validation_cpu.h"
+#define VALID_STREAM_CPU_CHUNK_ELEMS (1 << 10)     // small, so there are more chunks than slots
+#include "valid_stream_cpu.h"
+#include "rand_cpu.h"
+#include "tensor_transpose.h"
+#include "transpose_cpu.h"
+#include "tensor_reorder_cpu.h"
+
+static void gen_rand_vector(float *vec, size_t vec_size, float fmin, float fmax)
+{
+    static std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> distribution(fmin, fmax);
+    for(size_t i = 0; i < vec_size; i++)
+        vec[i] = distribution(rng);
+}
+
+static inline double get_nrms(const float *ref, const float *pred, size_t n)
+{
+    double sd = 0, mag = 0;
+    for(size_t i = 0; i < n; i++){
+        double d = (double)ref[i] - (double)pred[i];
+        sd += d * d;
+        mag = fmax(mag, fmax(fabs((double)ref[i]), fabs((double)pred[i])));
+    }
+    if(mag == 0)
+        return 0;
+    return sqrt(sd) / (sqrt((double)n) * mag);
+}
+
+#define NRMS_TOLERANCE 1.5e-6
+
+struct conv_2d_problem_t{
+    size_t n, c, hi, wi, k, fy, fx, py, px, sy, sx, dy, dx, group;
+};
+
+// argument list of the naive_conv_* style 2d functions, from a conv_2d_problem_t p
+#define CONV_ARGS p.n, p.wi, p.hi, p.c, p.k, p.fx, p.fy, p.px, p.py, p.sx, p.sy, p.dx, p.dy, p.group
+
+static double time_ms(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// run every host algorithm against naive on the same data, return false if nrms is out of tolerance
+static bool test_one(const conv_2d_problem_t & p, const std::string & layout, bool verbose)
+{
+    size_t ho = naive_conv_out_size(p.hi, p.py, p.dy, p.fy, p.sy);
+    size_t wo = naive_conv_out_size(p.wi, p.px, p.dx, p.fx, p.sx);
+    size_t input_size = p.n * p.c * p.hi * p.wi;
+    size_t weight_size = p.k * (p.c / p.group) * p.fy * p.fx;
+    size_t output_size = p.n * p.k * ho * wo;
+
+    std::vector<float> input(input_size), weight(weight_size), output(output_size);
+    std::vector<float> ref_input(input_size), ref_weight(weight_size), ref_output(output_size);
+    gen_rand_vector(input.data(), input_size, -1.0f, 1.0f);
+    gen_rand_vector(weight.data(), weight_size, -0.5f, 0.5f);
+    gen_rand_vector(output.data(), output_size, -1.0f, 1.0f);
+
+    bool nchw = layout == "nchw";
+    bool winograd = winograd_conv_cpu_applicable(p.fx, p.fy, p.px, p.py, p.sx, p.sy, p.dx, p.dy);
+    const char *dir[3] = {"fwd", "bwd", "wrw"};
+
+    auto run = [&](conv_ref_cpu_algo_t algo, int d, float *in, float *wei, float *out){
+        auto t0 = std::chrono::steady_clock::now();
+        if(d == 0)
+            nchw ? conv_ref_cpu_fwd_nchw(algo, in, wei, out, CONV_ARGS) : conv_ref_cpu_fwd_nhwc(algo, in, wei, out, CONV_ARGS);
+        else if(d == 1)
+            nchw ? conv_ref_cpu_bwd_nchw(algo, in, wei, out, CONV_ARGS) : conv_ref_cpu_bwd_nhwc(algo, in, wei, out, CONV_ARGS);
+        else
+            nchw ? conv_ref_cpu_wrw_nchw(algo, in, wei, out, CONV_ARGS) : conv_ref_cpu_wrw_nhwc(algo, in, wei, out, CONV_ARGS);
+        return time_ms(t0);
+    };
+
+    double t_naive[3];
+    t_naive[0] = run(conv_ref_cpu_algo_naive, 0, input.data(), weight.data(), ref_output.data());
+    t_naive[1] = run(conv_ref_cpu_algo_naive, 1, ref_input.data(), weight.data(), output.data());
+    t_naive[2] = run(conv_ref_cpu_algo_naive, 2, input.data(), ref_weight.data(), output.data());
+
+    bool ok = true;
+    for(conv_ref_cpu_algo_t algo : {conv_ref_cpu_algo_gemm, conv_ref_cpu_algo_winograd, conv_ref_cpu_algo_fft, conv_ref_cpu_algo_tiled}){
+        double tolerance = NRMS_TOLERANCE * conv_ref_cpu_nrms_scale(algo, true);
+        for(int d = 0; d < 3; d++){
+            if(algo == conv_ref_cpu_algo_winograd && (!winograd || d == 2))
+                continue;
+            std::vector<float> in = input, wei = weight, out = output;
+            double t = run(algo, d, in.data(), wei.data(), out.data());
+            double nrms = d == 0 ? get_nrms(ref_output.data(), out.data(), output_size) :
+                          d == 1 ? get_nrms(ref_input.data(), in.data(), input_size) :
+                                   get_nrms(ref_weight.data(), wei.data(), weight_size);
+            bool valid = nrms < tolerance;
+            ok = ok && valid;
+            if(verbose || !valid)
+                printf("[%s] n:%zu c:%zu hi:%zu wi:%zu k:%zu fy:%zu fx:%zu py:%zu px:%zu sy:%zu sx:%zu dy:%zu dx:%zu g:%zu, "
+                    "%s %s nrms:%.3e %s, naive:%.1fms %s:%.1fms (%.1fx)\n",
+                    layout.c_str(), p.n, p.c, p.hi, p.wi, p.k, p.fy, p.fx, p.py, p.px, p.sy, p.sx, p.dy, p.dx, p.group,
+                    conv_ref_cpu_algo_name(algo), dir[d], nrms, valid ? "valid" : "fail",
+                    t_naive[d], conv_ref_cpu_algo_name(algo), t, t_naive[d] / t);
+        }
+    }
+    return ok;
+}
+
+// bulk conversion must match the scalar one bit by bit, whatever simd path is taken
+static bool test_convert()
+{
+    size_t num = 65536 + 4096;
+    std::vector<uint16_t> h(num), h2(num);
+    std::vector<float> f(num), f2(num);
+    for(size_t i = 0; i < 65536; i++)
+        h[i] = (uint16_t)i;
+    std::mt19937 rng(5678);
+    for(size_t i = 65536; i < num; i++)
+        h[i] = (uint16_t)rng();
+    bool ok = true;
+    for(convert_cpu_dtype_t dtype : {convert_cpu_fp16, convert_cpu_bf16}){
+        convert_cpu_widen_f32(dtype, f.data(), h.data(), 0, num);
+        for(size_t i = 0; i < num; i++){
+            float r = dtype == convert_cpu_fp16 ? convert_cpu_f16_to_f32_scalar(h[i]) : convert_cpu_bf16_to_f32_scalar(h[i]);
+            ok = ok && memcmp(&r, &f[i], 4) == 0;
+        }
+        // fp32 patterns around every rounding boundary, plus the specials
+        for(size_t i = 0; i < num; i++){
+            uint32_t bits = ((uint32_t)h[i] << 16) | (uint32_t)(rng() & 0xffff);
+            if(i % 4 == 0)
+                bits = (bits & 0xffff0000) | 0x8000;
+            if(i % 4 == 1)
+                bits = (bits & 0xffffe000) | 0x1000;
+            memcpy(&f2[i], &bits, 4);
+        }
+        convert_cpu_narrow_f32(dtype, h2.data(), 0, f2.data(), num);
+        for(size_t i = 0; i < num; i++){
+            uint16_t r = dtype == convert_cpu_fp16 ? convert_cpu_f32_to_f16_scalar(f2[i]) : convert_cpu_f32_to_bf16_scalar(f2[i]);
+            ok = ok && r == h2[i];
+        }
+#if SIMD_CPU_X86
+        // the avx2 kernels on their own, the dispatch above takes the avx512 ones when there are
+        if(simd_cpu_get_isa() >= simd_cpu_isa_avx2){
+            std::vector<uint16_t> h3(num);
+            std::vector<float> f3(num);
+            bool fp16 = dtype == convert_cpu_fp16;
+            size_t w = fp16 ? convert_cpu_f16_to_f32_avx2(f3.data(), h.data(), num) : convert_cpu_bf16_to_f32_avx2(f3.data(), h.data(), num);
+            size_t r = fp16 ? convert_cpu_f32_to_f16_avx2(h3.data(), f2.data(), num) : convert_cpu_f32_to_bf16_avx2(h3.data(), f2.data(), num);
+            ok = ok && w == num && r == num && memcmp(f3.data(), f.data(), num * sizeof(float)) == 0 && h3 == h2;
+        }
+#endif
+    }
+    // integers are truncated and keep the low bits, from an even and an odd start, the nibble next to an odd
+    // start or end untouched
+    std::vector<float> fi(num), fw(num);
+    for(size_t i = 0; i < num; i++)
+        fi[i] = (float)((int32_t)(rng() % 2048) - 1024) / 4.0f;
+    for(convert_cpu_dtype_t dtype : {convert_cpu_int8, convert_cpu_int4})
+    for(size_t begin : {0, 1}){
+        size_t cnt = num - 2;
+        std::vector<uint8_t> ref(num, 0x5a), got(num, 0x5a);
+        for(size_t i = 0; i < cnt; i++){
+            if(dtype == convert_cpu_int8)
+                ref[begin + i] = (uint8_t)(int8_t)(int32_t)fi[i];
+            else
+                convert_cpu_s4_set(ref.data(), begin + i, (int32_t)fi[i]);
+        }
+        convert_cpu_narrow_f32(dtype, got.data(), begin, fi.data(), cnt);
+        ok = ok && ref == got;
+        convert_cpu_widen_f32(dtype, fw.data(), got.data(), begin, cnt);
+        for(size_t i = 0; i < cnt; i++){
+            float r = dtype == convert_cpu_int8 ? (float)(int8_t)got[begin + i] : (float)convert_cpu_s4_get(got.data(), begin + i);
+            ok = ok && r == fw[i];
+        }
+    }
+    // tensor_copy takes the same path
+    {
+        std::vector<bfloat16> b(num);
+        std::vector<uint8_t> q(num / 2);
+        tensor_copy<bfloat16, float>(b.data(), f2.data(), num);
+        tensor_copy<int4x2_t, float>(reinterpret_cast<int4x2_t *>(q.data()), fi.data(), num);
+        for(size_t i = 0; i < num; i++){
+            bfloat16 r(f2[i]);
+            ok = ok && memcmp(&r, &b[i], sizeof(r)) == 0 && convert_cpu_s4_get(q.data(), i) == (int8_t)((int32_t)fi[i] << 4) >> 4;
+        }
+    }
+    printf("convert %s, simd:%s\n", ok ? "valid" : "fail", simd_cpu_isa_name(simd_cpu_get_isa()));
+    return ok;
+}
+
+// native data type reference against fp32 naive on the same (already rounded) values
+static bool test_native(const conv_2d_problem_t & p, const std::string & layout, convert_cpu_dtype_t dtype)
+{
+    size_t ho = naive_conv_out_size(p.hi, p.py, p.dy, p.fy, p.sy);
+    size_t wo = naive_conv_out_size(p.wi, p.px, p.dx, p.fx, p.sx);
+    size_t size[3] = {p.n * p.c * p.hi * p.wi, p.k * (p.c / p.group) * p.fy * p.fx, p.n * p.k * ho * wo};
+    bool nchw = layout == "nchw";
+    bool is_int = convert_cpu_is_int(dtype);
+    const char *dtype_name[] = {"fp32", "fp16", "bf16", "int8", "int4"};
+    const char *dir[3] = {"fwd", "bwd", "wrw"};
+    bool ok = true;
+    for(int d = 0; d < (is_int ? 2 : 3); d++){
+        int out_t = d == 0 ? 2 : (d == 1 ? 0 : 1);      // tensor written by this direction
+        std::vector<float> t32[3];
+        std::vector<uint8_t> tn[3], ref_n(size[out_t] * 4);
+        for(int t = 0; t < 3; t++){
+            t32[t].resize(size[t]);
+            tn[t].resize(size[t] * 4);
+            if(is_int)
+                for(size_t i = 0; i < size[t]; i++)
+                    t32[t][i] = (float)((int)(rand() % (dtype == convert_cpu_int4 ? 15 : 11)) - (dtype == convert_cpu_int4 ? 7 : 5));
+            else
+                gen_rand_vector(t32[t].data(), size[t], -1.0f, 1.0f);
+            convert_cpu_narrow_f32(dtype, tn[t].data(), 0, t32[t].data(), size[t]);
+            convert_cpu_widen_f32(dtype, t32[t].data(), tn[t].data(), 0, size[t]);
+        }
+        conv_ref_cpu_algo_t algo = conv_ref_cpu_algo_naive;
+        if(d == 0){
+            nchw ? naive_conv_fwd_nchw(t32[0].data(), t32[1].data(), t32[2].data(), CONV_ARGS)
+                 : naive_conv_fwd_nhwc(t32[0].data(), t32[1].data(), t32[2].data(), CONV_ARGS);
+            nchw ? conv_native_cpu_fwd_nchw(algo, dtype, tn[0].data(), tn[1].data(), tn[2].data(), CONV_ARGS)
+                 : conv_native_cpu_fwd_nhwc(algo, dtype, tn[0].data(), tn[1].data(), tn[2].data(), CONV_ARGS);
+        }else if(d == 1){
+            nchw ? naive_conv_bwd_nchw(t32[0].data(), t32[1].data(), t32[2].data(), CONV_ARGS)
+                 : naive_conv_bwd_nhwc(t32[0].data(), t32[1].data(), t32[2].data(), CONV_ARGS);
+            nchw ? conv_native_cpu_bwd_nchw(algo, dtype, tn[0].data(), tn[1].data(), tn[2].data(), CONV_ARGS)
+                 : conv_native_cpu_bwd_nhwc(algo, dtype, tn[0].data(), tn[1].data(), tn[2].data(), CONV_ARGS);
+        }else{
+            nchw ? naive_conv_wrw_nchw(t32[0].data(), t32[1].data(), t32[2].data(), CONV_ARGS)
+                 : naive_conv_wrw_nhwc(t32[0].data(), t32[1].data(), t32[2].data(), CONV_ARGS);
+            nchw ? conv_native_cpu_wrw_nchw(algo, dtype, tn[0].data(), tn[1].data(), tn[2].data(), CONV_ARGS)
+                 : conv_native_cpu_wrw_nhwc(algo, dtype, tn[0].data(), tn[1].data(), tn[2].data(), CONV_ARGS);
+        }
+        convert_cpu_narrow_f32(dtype, ref_n.data(), 0, t32[out_t].data(), size[out_t]);
+        bool valid;
+        double nrms = 0;
+        if(is_int)
+            valid = memcmp(ref_n.data(), tn[out_t].data(), dtype == convert_cpu_int4 ? size[out_t] / 2 : size[out_t]) == 0;
+        else{
+            // wrw sums the batch chunk by chunk, so allow a rounding flip of the result
+            std::vector<float> r(size[out_t]), q(size[out_t]);
+            convert_cpu_widen_f32(dtype, r.data(), ref_n.data(), 0, size[out_t]);
+            convert_cpu_widen_f32(dtype, q.data(), tn[out_t].data(), 0, size[out_t]);
+            nrms = get_nrms(r.data(), q.data(), size[out_t]);
+            valid = nrms < (dtype == convert_cpu_fp16 ? 1e-3 : 8e-3);
+        }
+        ok = ok && valid;
+        if(!valid)
+            printf("[%s] n:%zu c:%zu hi:%zu wi:%zu k:%zu fy:%zu fx:%zu py:%zu px:%zu sy:%zu sx:%zu dy:%zu dx:%zu g:%zu, "
+                "%s %s nrms:%.3e fail\n", layout.c_str(), p.n, p.c, p.hi, p.wi, p.k, p.fy, p.fx, p.py, p.px, p.sy, p.sx,
+                p.dy, p.dx, p.group, dtype_name[dtype], dir[d], nrms);
+    }
+    return ok;
+}
+
+// the split wrw reduction must give the same bits for any thread count, and match the unsplit one within nrms
+static bool test_wrw_split(bool verbose)
+{
+    conv_2d_problem_t p = {32, 8, 28, 28, 8, 1, 1, 0, 0, 1, 1, 1, 1, 1};
+    size_t input_size = p.n * p.c * p.hi * p.wi;
+    size_t weight_size = p.k * p.c;
+    std::vector<float> input(input_size), output(p.n * p.k * p.hi * p.wi);
+    gen_rand_vector(input.data(), input.size(), -1.0f, 1.0f);
+    gen_rand_vector(output.data(), output.size(), -1.0f, 1.0f);
+    size_t num_threads = thread_pool_cpu_get_num_threads();
+    bool ok = true;
+    for(std::string layout : {"nchw", "nhwc"}){
+        std::vector<float> ref(weight_size), grad(weight_size);
+        setenv("IGEMM_CPU_WRW_SPLIT", "1", 1);
+        auto t0 = std::chrono::steady_clock::now();
+        (layout == "nchw" ? naive_conv_wrw_nchw : naive_conv_wrw_nhwc)(input.data(), ref.data(), output.data(),
+            p.n, p.wi, p.hi, p.c, p.k, p.fx, p.fy, p.px, p.py, p.sx, p.sy, p.dx, p.dy, p.group);
+        double t_unsplit = time_ms(t0);
+        unsetenv("IGEMM_CPU_WRW_SPLIT");
+        std::vector<float> first;
+        double t_split = 0;
+        for(size_t threads : {num_threads, (size_t)1, (size_t)3, (size_t)7}){
+            thread_pool_cpu_set_num_threads(threads);
+            t0 = std::chrono::steady_clock::now();
+            (layout == "nchw" ? naive_conv_wrw_nchw : naive_conv_wrw_nhwc)(input.data(), grad.data(), output.data(),
+                p.n, p.wi, p.hi, p.c, p.k, p.fx, p.fy, p.px, p.py, p.sx, p.sy, p.dx, p.dy, p.group);
+            if(first.empty()){
+                t_split = time_ms(t0);
+                first = grad;
+            }else if(memcmp(first.data(), grad.data(), weight_size * sizeof(float)) != 0){
+                printf("[%s] wrw split differs with %zu threads\n", layout.c_str(), threads);
+                ok = false;
+            }
+        }
+        thread_pool_cpu_set_num_threads(num_threads);
+        // a long fp32 sum is off by about 1e-6 in either order, so both are measured against fp64
+        std::vector<float> exact(weight_size);
+        for(size_t ik = 0; ik < p.k; ik++)
+            for(size_t ic = 0; ic < p.c; ic++){
+                double acc = 0;
+                for(size_t in = 0; in < p.n; in++)
+                    for(size_t i = 0; i < p.hi * p.wi; i++)
+                        acc += layout == "nchw" ? (double)input[(in * p.c + ic) * p.hi * p.wi + i] * output[(in * p.k + ik) * p.hi * p.wi + i]
+                                                : (double)input[(in * p.hi * p.wi + i) * p.c + ic] * output[(in * p.hi * p.wi + i) * p.k + ik];
+                exact[ik * p.c + ic] = (float)acc;
+            }
+        double nrms_unsplit = get_nrms(exact.data(), ref.data(), weight_size);
+        double nrms = get_nrms(exact.data(), first.data(), weight_size);
+        ok = ok && nrms < NRMS_TOLERANCE;
+        if(verbose || nrms >= NRMS_TOLERANCE)
+            printf("[%s] wrw split %zu, nrms:%.3e (unsplit %.3e), unsplit:%.1fms split:%.1fms (%.1fx) with %zu threads\n",
+                layout.c_str(), naive_conv_wrw_get_splits(layout == "nchw" ? weight_size : p.k, p.n * p.hi), nrms,
+                nrms_unsplit, t_unsplit, t_split, t_unsplit / t_split, num_threads);
+    }
+    return ok;
+}
+
+// the filter/stride specializations must give the same bits as the generic naive loop nest.
+// with verbose, time every specialization on a model sized shape
+static bool test_spec(bool verbose)
+{
+    bool ok = true;
+    int num_total = 0;
+    auto run = [&](const conv_2d_problem_t & p, const std::string & layout, int d, bool spec,
+                   float *in, float *wei, float *out){
+        bool nchw = layout == "nchw";
+        auto t0 = std::chrono::steady_clock::now();
+        if(d == 0 && spec)
+            nchw ? spec_conv_fwd_nchw(in, wei, out, CONV_ARGS) : spec_conv_fwd_nhwc(in, wei, out, CONV_ARGS);
+        else if(d == 0)
+            nchw ? naive_conv_fwd_nchw(in, wei, out, CONV_ARGS) : naive_conv_fwd_nhwc(in, wei, out, CONV_ARGS);
+        else if(spec)
+            spec_conv_bwd_nchw(in, wei, out, CONV_ARGS);
+        else
+            naive_conv_bwd_nchw(in, wei, out, CONV_ARGS);
+        return time_ms(t0);
+    };
+    auto check = [&](const conv_2d_problem_t & p, const std::string & layout, int d, bool print){
+        size_t ho = naive_conv_out_size(p.hi, p.py, p.dy, p.fy, p.sy);
+        size_t wo = naive_conv_out_size(p.wi, p.px, p.dx, p.fx, p.sx);
+        std::vector<float> input(p.n * p.c * p.hi * p.wi), weight(p.k * (p.c / p.group) * p.fy * p.fx);
+        std::vector<float> output(p.n * p.k * ho * wo);
+        gen_rand_vector(d == 0 ? input.data() : output.data(), d == 0 ? input.size() : output.size(), -1.0f, 1.0f);
+        gen_rand_vector(weight.data(), weight.size(), -0.5f, 0.5f);
+        std::vector<float> & result = d == 0 ? output : input;
+        double t_naive = run(p, layout, d, false, input.data(), weight.data(), output.data());
+        std::vector<float> ref = result;
+        double t_spec = run(p, layout, d, true, input.data(), weight.data(), output.data());
+        bool same = memcmp(ref.data(), result.data(), ref.size() * sizeof(float)) == 0;
+        if(print || !same)
+            printf("[%s] n:%zu c:%zu hi:%zu wi:%zu k:%zu fy:%zu fx:%zu py:%zu px:%zu sy:%zu sx:%zu g:%zu, spec %s %s, "
+                "naive:%.1fms spec:%.1fms (%.1fx)\n", layout.c_str(), p.n, p.c, p.hi, p.wi, p.k, p.fy, p.fx, p.py, p.px,
+                p.sy, p.sx, p.group, d == 0 ? "fwd" : "bwd", same ? "identical" : "differs", t_naive, t_spec, t_naive / t_spec);
+        ok = ok && same;
+        num_total++;
+    };
+
+    for(std::string layout : {"nchw", "nhwc"})
+    for(size_t group : {1, 2})
+    for(size_t k : {3, 9})
+    for(size_t hi : {5, 12})
+    for(size_t fy : {1, 3, 7})
+    for(size_t pad : {0, 1, 3})
+    for(size_t stride : {1, 2}){
+        conv_2d_problem_t p = {2, 5 * group, hi, hi + 3, k * group, fy, fy, pad, pad, stride, stride, 1, 1, group};
+        if(!spec_conv_cpu_applicable(p.fx, p.fy, p.sx, p.sy, p.dx, p.dy) || p.hi + 2 * p.py < p.fy)
+            continue;
+        check(p, layout, 0, false);
+        if(layout == "nchw" && fy == 1 && stride == 1 && pad == 0)
+            check(p, layout, 1, false);
+    }
+    printf("spec %d cases %s\n", num_total, ok ? "identical" : "differ");
+
+    if(verbose){
+        conv_2d_problem_t bench[] = {
+            {4, 256, 56, 56, 64, 1, 1, 0, 0, 1, 1, 1, 1, 1},
+            {4, 256, 56, 56, 128, 1, 1, 0, 0, 2, 2, 1, 1, 1},
+            {4, 64, 56, 56, 64, 3, 3, 1, 1, 1, 1, 1, 1, 1},
+            {4, 128, 56, 56, 128, 3, 3, 1, 1, 2, 2, 1, 1, 1},
+            {4, 3, 224, 224, 64, 7, 7, 3, 3, 2, 2, 1, 1, 1},
+        };
+        for(auto & p : bench){
+            for(std::string layout : {"nchw", "nhwc"})
+                check(p, layout, 0, true);
+            if(p.fx == 1 && p.sx == 1)
+                check(p, "nchw", 1, true);
+        }
+    }
+    return ok;
+}
+
+// the depthwise kernels against the generic naive loop nest, all directions and layouts. nchw fwd/bwd must be
+// bit identical, the rest within tolerance. with verbose, time mobilenet sized layers
+static bool test_depthwise(bool verbose)
+{
+    bool ok = true;
+    int num_total = 0;
+    auto run = [&](const conv_2d_problem_t & p, bool nchw, int d, bool depthwise,
+                   float *in, float *wei, float *out){
+        auto t0 = std::chrono::steady_clock::now();
+        if(depthwise){
+            bool done = d == 0 ? (nchw ? depthwise_conv_fwd_nchw(in, wei, out, CONV_ARGS) : depthwise_conv_fwd_nhwc(in, wei, out, CONV_ARGS)) :
+                        d == 1 ? (nchw ? depthwise_conv_bwd_nchw(in, wei, out, CONV_ARGS) : depthwise_conv_bwd_nhwc(in, wei, out, CONV_ARGS)) :
+                                 (nchw ? depthwise_conv_wrw_nchw(in, wei, out, CONV_ARGS) : depthwise_conv_wrw_nhwc(in, wei, out, CONV_ARGS));
+            assert(done);
+            (void)done;
+        }
+        else if(d == 0)
+            nchw ? naive_conv_fwd_nchw(in, wei, out, CONV_ARGS) : naive_conv_fwd_nhwc(in, wei, out, CONV_ARGS);
+        else if(d == 1)
+            nchw ? naive_conv_bwd_nchw(in, wei, out, CONV_ARGS) : naive_conv_bwd_nhwc(in, wei, out, CONV_ARGS);
+        else
+            nchw ? naive_conv_wrw_nchw(in, wei, out, CONV_ARGS) : naive_conv_wrw_nhwc(in, wei, out, CONV_ARGS);
+        return time_ms(t0);
+    };
+    auto wrw_fp64 = [](const conv_2d_problem_t & p, bool nchw, const std::vector<float> & input,
+                       const std::vector<float> & output){
+        size_t ho = naive_conv_out_size(p.hi, p.py, p.dy, p.fy, p.sy);
+        size_t wo = naive_conv_out_size(p.wi, p.px, p.dx, p.fx, p.sx);
+        size_t multiplier = p.k / p.group;
+        std::vector<float> exact(p.k * p.fy * p.fx);
+        for(size_t ik = 0; ik < p.k; ik++)
+            for(size_t iy = 0; iy < p.fy; iy++)
+                for(size_t ix = 0; ix < p.fx; ix++){
+                    size_t ic = ik / multiplier;
+                    double acc = 0;
+                    for(size_t in = 0; in < p.n; in++)
+                        for(size_t oh = 0; oh < ho; oh++)
+                            for(size_t ow = 0; ow < wo; ow++){
+                                size_t ih = oh * p.sy + iy * p.dy;
+                                size_t iw = ow * p.sx + ix * p.dx;
+                                if(ih < p.py || ih - p.py >= p.hi || iw < p.px || iw - p.px >= p.wi)
+                                    continue;
+                                ih -= p.py;
+                                iw -= p.px;
+                                acc += nchw ? (double)input[((in * p.c + ic) * p.hi + ih) * p.wi + iw] *
+                                                  output[((in * p.k + ik) * ho + oh) * wo + ow]
+                                            : (double)input[((in * p.hi + ih) * p.wi + iw) * p.c + ic] *
+                                                  output[((in * ho + oh) * wo + ow) * p.k + ik];
+                            }
+                    exact[(ik * p.fy + iy) * p.fx + ix] = (float)acc;
+                }
+        return exact;
+    };
+    auto check = [&](const conv_2d_problem_t & p, const std::string & layout, bool print){
+        const char *dir[] = {"fwd", "bwd", "wrw"};
+        bool nchw = layout == "nchw";
+        size_t ho = naive_conv_out_size(p.hi, p.py, p.dy, p.fy, p.sy);
+        size_t wo = naive_conv_out_size(p.wi, p.px, p.dx, p.fx, p.sx);
+        std::vector<float> input(p.n * p.c * p.hi * p.wi), weight(p.k * p.fy * p.fx), output(p.n * p.k * ho * wo);
+        gen_rand_vector(input.data(), input.size(), -1.0f, 1.0f);
+        gen_rand_vector(weight.data(), weight.size(), -0.5f, 0.5f);
+        gen_rand_vector(output.data(), output.size(), -1.0f, 1.0f);
+        for(int d = 0; d < 3; d++){
+            std::vector<float> & result = d == 0 ? output : d == 1 ? input : weight;
+            double t_naive = run(p, nchw, d, false, input.data(), weight.data(), output.data());
+            std::vector<float> ref = result;
+            double t_depthwise = run(p, nchw, d, true, input.data(), weight.data(), output.data());
+            bool exact = nchw && d != 2;
+            // a long fp32 sum is off by about 1e-6 in either order, so wrw is measured against fp64
+            if(d == 2)
+                ref = wrw_fp64(p, nchw, input, output);
+            double nrms = get_nrms(ref.data(), result.data(), ref.size());
+            bool valid = exact ? memcmp(ref.data(), result.data(), ref.size() * sizeof(float)) == 0 : nrms < NRMS_TOLERANCE;
+            if(print || !valid)
+                printf("[%s] n:%zu c:%zu hi:%zu wi:%zu k:%zu fy:%zu fx:%zu py:%zu px:%zu sy:%zu sx:%zu dy:%zu dx:%zu g:%zu, "
+                    "depthwise %s nrms:%.3e %s, naive:%.1fms depthwise:%.1fms (%.1fx)\n", layout.c_str(), p.n, p.c, p.hi, p.wi,
+                    p.k, p.fy, p.fx, p.py, p.px, p.sy, p.sx, p.dy, p.dx, p.group, dir[d], nrms, valid ? "valid" : "fail",
+                    t_naive, t_depthwise, t_naive / t_depthwise);
+            ok = ok && valid;
+            // restore what this direction overwrote, the next one reads it
+            if(d != 2)
+                result = ref;
+        }
+        num_total++;
+    };
+
+    for(std::string layout : {"nchw", "nhwc"})
+    for(size_t group : {3, 20})
+    for(size_t multiplier : {1, 2})
+    for(size_t fy : {1, 3, 5})
+    for(size_t stride : {1, 2, 3})
+    for(size_t dilation : {1, 2})
+    for(size_t pad : {0, 1, 4})
+    for(size_t hi : {4, 11}){
+        conv_2d_problem_t p = {2, group, hi, hi + 3, group * multiplier, fy, fy, pad, pad, stride, stride,
+                               dilation, dilation, group};
+        if(p.hi + 2 * p.py < p.dy * (p.fy - 1) + 1)
+            continue;
+        check(p, layout, false);
+    }
+    printf("depthwise %d cases %s\n", num_total, ok ? "valid" : "fail");
+
+    if(verbose){
+        conv_2d_problem_t bench[] = {
+            {8, 32, 112, 112, 32, 3, 3, 1, 1, 1, 1, 1, 1, 32},
+            {8, 144, 56, 56, 144, 3, 3, 1, 1, 2, 2, 1, 1, 144},
+            {8, 384, 14, 14, 384, 3, 3, 1, 1, 1, 1, 1, 1, 384},
+            {8, 960, 7, 7, 960, 5, 5, 2, 2, 1, 1, 1, 1, 960},
+        };
+        for(auto & p : bench)
+            for(std::string layout : {"nchw", "nhwc"})
+                check(p, layout, true);
+    }
+    return ok;
+}
+
+// the blocked 3d engine against the naive loop nest, all directions and layouts.
+// with verbose, time it on volumes where the naive loop nest takes seconds
+static bool test_3d(bool verbose)
+{
+    bool ok = true;
+    int num_total = 0;
+    auto check = [&](size_t n, size_t c, size_t k, size_t d, size_t h, size_t w, size_t f, size_t pad, size_t stride,
+                     size_t dilation, size_t group, const std::string & layout, bool print){
+        const char *dir[] = {"fwd", "bwd", "wrw"};
+        bool ncdhw = layout == "ncdhw";
+        // y gets the other dilation and no stride, so the dims differ
+        size_t fz = f, fy = f, fx = f, pz = pad, py = pad, px = pad + 1;
+        size_t sz = stride, sy = 1, sx = stride, dz = dilation, dy = 3 - dilation, dx = dilation;
+        if(d + 2 * pz < dz * (fz - 1) + 1 || h + 2 * py < dy * (fy - 1) + 1 || w + 2 * px < dx * (fx - 1) + 1)
+            return;
+        size_t od = naive_conv_out_size(d, pz, dz, fz, sz);
+        size_t oh = naive_conv_out_size(h, py, dy, fy, sy);
+        size_t ow = naive_conv_out_size(w, px, dx, fx, sx);
+        std::vector<float> input(n * c * d * h * w), weight(k * (c / group) * fz * fy * fx), output(n * k * od * oh * ow);
+        gen_rand_vector(input.data(), input.size(), -1.0f, 1.0f);
+        gen_rand_vector(weight.data(), weight.size(), -0.5f, 0.5f);
+        gen_rand_vector(output.data(), output.size(), -1.0f, 1.0f);
+#define CONV_3D_ARGS n, w, h, d, c, k, fx, fy, fz, px, py, pz, sx, sy, sz, dx, dy, dz, group
+        for(int i = 0; i < 3; i++){
+            std::vector<float> & result = i == 0 ? output : i == 1 ? input : weight;
+            auto t0 = std::chrono::steady_clock::now();
+            if(i == 0)
+                ncdhw ? naive_conv_fwd_ncdhw(input.data(), weight.data(), output.data(), CONV_3D_ARGS)
+                      : naive_conv_fwd_ndhwc(input.data(), weight.data(), output.data(), CONV_3D_ARGS);
+            else if(i == 1)
+                ncdhw ? naive_conv_bwd_ncdhw(input.data(), weight.data(), output.data(), CONV_3D_ARGS)
+                      : naive_conv_bwd_ndhwc(input.data(), weight.data(), output.data(), CONV_3D_ARGS);
+            else
+                ncdhw ? naive_conv_wrw_ncdhw(input.data(), weight.data(), output.data(), CONV_3D_ARGS)
+                      : naive_conv_wrw_ndhwc(input.data(), weight.data(), output.data(), CONV_3D_ARGS);
+            double t_naive = time_ms(t0);
+            std::vector<float> ref = result;
+            std::fill(result.begin(), result.end(), 7.0f);
+            t0 = std::chrono::steady_clock::now();
+            if(i == 0)
+                ncdhw ? conv_ref_cpu_fwd_ncdhw(input.data(), weight.data(), output.data(), CONV_3D_ARGS)
+                      : conv_ref_cpu_fwd_ndhwc(input.data(), weight.data(), output.data(), CONV_3D_ARGS);
+            else if(i == 1)
+                ncdhw ? conv_ref_cpu_bwd_ncdhw(input.data(), weight.data(), output.data(), CONV_3D_ARGS)
+                      : conv_ref_cpu_bwd_ndhwc(input.data(), weight.data(), output.data(), CONV_3D_ARGS);
+            else
+                ncdhw ? conv_ref_cpu_wrw_ncdhw(input.data(), weight.data(), output.data(), CONV_3D_ARGS)
+                      : conv_ref_cpu_wrw_ndhwc(input.data(), weight.data(), output.data(), CONV_3D_ARGS);
+            double t_blocked = time_ms(t0);
+            double nrms = get_nrms(ref.data(), result.data(), ref.size());
+            bool valid = nrms < NRMS_TOLERANCE;
+            if(print || !valid)
+                printf("[%s] n:%zu c:%zu d:%zu h:%zu w:%zu k:%zu f:%zu p:%zu s:%zu dl:%zu g:%zu, 3d %s nrms:%.3e %s, "
+                    "naive:%.1fms blocked:%.1fms (%.1fx)\n", layout.c_str(), n, c, d, h, w, k, f, pad, stride, dilation,
+                    group, dir[i], nrms, valid ? "valid" : "fail", t_naive, t_blocked, t_naive / t_blocked);
+            ok = ok && valid;
+            // the next direction reads what this one overwrote
+            if(i != 2)
+                result = ref;
+        }
+#undef CONV_3D_ARGS
+        num_total++;
+    };
+
+    for(std::string layout : {"ncdhw", "ndhwc"})
+    for(size_t group : {1, 2})
+    for(size_t c : {3, 17})
+    for(size_t f : {1, 3})
+    for(size_t pad : {0, 2})
+    for(size_t stride : {1, 2})
+    for(size_t dilation : {1, 2})
+        check(2, c * group, 5 * group, 4, 5, 7, f, pad, stride, dilation, group, layout, false);
+    printf("3d %d cases %s\n", num_total, ok ? "valid" : "fail");
+
+    if(verbose){
+        for(std::string layout : {"ncdhw", "ndhwc"}){
+            check(1, 32, 32, 32, 32, 32, 3, 1, 1, 1, 1, layout, true);
+            check(1, 16, 32, 48, 48, 48, 3, 1, 2, 1, 1, layout, true);
+        }
+    }
+    return ok;
+}
+
+// the parallel validation must take the decision of the serial loops, also with the tolerance right at the nrms
+static bool test_valid_vector(bool verbose)
+{
+    bool ok = true;
+    int cases = 0;
+    std::mt19937 rng(4321);
+    setenv("VALID_FLOAT", "0", 1);     // nan/inf then go through the sums instead of printing
+    for(size_t n : {(size_t)1, (size_t)1000, (size_t)3 * VALID_VECTOR_BLOCK + 5}){
+        std::vector<float> ref(n), pred(n);
+        gen_rand_vector(ref.data(), n, -1.0f, 1.0f);
+        for(float noise : {.0f, 1e-7f, 1e-5f}){
+            std::uniform_real_distribution<float> d(-noise, noise);
+            for(size_t i = 0; i < n; i++)
+                pred[i] = ref[i] * (1.0f + d(rng));
+            for(int special = 0; special < 3; special++){
+                std::vector<float> p = pred;
+                if(special)
+                    p[rng() % n] = special == 1 ? NAN : INFINITY;
+                double v = get_nrms(ref.data(), p.data(), n);
+                for(double tol : {v, nextafter(v, 1.0), nextafter(v, .0), v * (1 + 1e-13), v * (1 - 1e-13), 2 * v, v / 2, 1.5e-6}){
+                    cases++;
+                    if(valid_vector<float>(ref.data(), p.data(), n, tol) != valid_vector_impl_serial<float, float>(ref.data(), p.data(), n, tol)){
+                        printf("valid_vector fp32 n:%zu noise:%g special:%d tol:%.17g differs from the serial loop\n", n, noise, special, tol);
+                        ok = false;
+                    }
+                }
+            }
+            std::vector<bfloat16> ref_bf16(n), pred_bf16(n);
+            std::vector<int16_t> ref_s16(n), pred_s16(n);
+            for(size_t i = 0; i < n; i++){
+                ref_bf16[i] = bfloat16(ref[i]);
+                pred_bf16[i] = bfloat16(pred[i] * 64);
+                ref_s16[i] = (int16_t)(ref[i] * 1000);
+                pred_s16[i] = (int16_t)(pred[i] * 1000);
+            }
+            for(double tol : {1e-9, 8.2e-3, 1e-1}){
+                cases += 2;
+                if(valid_vector_native<bfloat16>(ref_bf16.data(), pred_bf16.data(), n, tol) !=
+                   valid_vector_impl_serial<bfloat16, bfloat16>(ref_bf16.data(), pred_bf16.data(), n, tol) ||
+                   valid_vector_native<int16_t>(ref_s16.data(), pred_s16.data(), n, tol) !=
+                   valid_vector_impl_serial<int16_t, int16_t>(ref_s16.data(), pred_s16.data(), n, tol)){
+                    printf("valid_vector bf16/s16 n:%zu noise:%g tol:%g differs from the serial loop\n", n, noise, tol);
+                    ok = false;
+                }
+            }
+        }
+        // int8/int4 against a float reference, with and without one flipped element
+        std::vector<float> ref_int(n);
+        std::vector<int8_t> pred_s8(n), pred_s4(n / 2 + 1);
+        for(size_t i = 0; i < n; i++){
+            ref_int[i] = (float)((int)(rng() % 256) - 128);
+            pred_s8[i] = (int8_t)(int32_t)ref_int[i];
+        }
+        for(size_t i = 0; i < n / 2; i++)
+            pred_s4[i] = (int8_t)((((int32_t)ref_int[2 * i + 1] & 0xf) << 4) + ((int32_t)ref_int[2 * i] & 0xf));
+        for(int flip = 0; flip < 2; flip++){
+            if(flip){
+                pred_s8[rng() % n] ^= 0x10;
+                if(n >= 2)
+                    pred_s4[rng() % (n / 2)] ^= 0x10;
+            }
+            cases += 3;
+            if(valid_vector<int8_t>(ref_int.data(), pred_s8.data(), n, 0) != valid_vector_int8_serial(ref_int.data(), pred_s8.data(), n) ||
+               valid_vector<int4x2_t>(ref_int.data(), (const int4x2_t *)pred_s4.data(), n, 0) !=
+               valid_vector_int4_serial(ref_int.data(), (const int4x2_t *)pred_s4.data(), n) ||
+               valid_vector_native<int8_t>(pred_s8.data(), pred_s8.data(), n, 0) != true){
+                printf("valid_vector int8/int4 n:%zu flip:%d differs from the serial loop\n", n, flip);
+                ok = false;
+            }
+        }
+    }
+    unsetenv("VALID_FLOAT");
+
+    if(verbose){
+        size_t n = (size_t)1 << 26;
+        std::vector<float> ref(n), pred(n);
+        gen_rand_vector(ref.data(), n, -1.0f, 1.0f);
+        for(size_t i = 0; i < n; i++)
+            pred[i] = ref[i] * (1.0f + 1e-7f * (float)((int)(i % 7) - 3));
+        auto t0 = std::chrono::steady_clock::now();
+        bool serial = valid_vector_impl_serial<float, float>(ref.data(), pred.data(), n, 1.5e-6);
+        double t_serial = time_ms(t0);
+        t0 = std::chrono::steady_clock::now();
+        bool parallel = valid_vector<float>(ref.data(), pred.data(), n, 1.5e-6);
+        double t_parallel = time_ms(t0);
+        printf("valid_vector fp32 n:%zu serial:%.1fms (%s) parallel:%.1fms (%s) (%.1fx)\n", n, t_serial, serial ? "y" : "n",
+               t_parallel, parallel ? "y" : "n", t_serial / t_parallel);
+    }
+    printf("valid_vector %d cases %s, simd:%s\n", cases, ok ? "identical" : "differ", simd_cpu_isa_name(simd_cpu_get_isa()));
+    return ok;
+}
+
+// the sampled reference must equal the full naive one at every sampled element, cover every k block and the borders,
+// and valid_vector_sampled must pass a correct result and catch a broken k block
+static bool test_sample(bool verbose)
+{
+    bool ok = true;
+    int num_total = 0;
+    const char *dir[] = {"fwd", "bwd", "wrw"};
+    auto run_full = [](const conv_2d_problem_t & p, bool nhwc, int d, float *in, float *wei, float *out){
+        if(d == 0)
+            nhwc ? naive_conv_fwd_nhwc(in, wei, out, CONV_ARGS) : naive_conv_fwd_nchw(in, wei, out, CONV_ARGS);
+        else if(d == 1)
+            nhwc ? naive_conv_bwd_nhwc(in, wei, out, CONV_ARGS) : naive_conv_bwd_nchw(in, wei, out, CONV_ARGS);
+        else
+            nhwc ? naive_conv_wrw_nhwc(in, wei, out, CONV_ARGS) : naive_conv_wrw_nchw(in, wei, out, CONV_ARGS);
+    };
+    auto run_sample = [](const conv_2d_problem_t & p, bool nhwc, int d, const float *in, const float *wei, const float *out,
+                         std::vector<size_t> *index, std::vector<float> *value, double rate){
+        if(d == 0)
+            conv_sample_cpu_fwd(nhwc, in, wei, index, value, CONV_ARGS, rate, 7);
+        else if(d == 1)
+            conv_sample_cpu_bwd(nhwc, wei, out, index, value, CONV_ARGS, rate, 7);
+        else
+            conv_sample_cpu_wrw(nhwc, in, out, index, value, CONV_ARGS, rate, 7);
+    };
+    auto gen_int = [](std::vector<float> & v){
+        gen_rand_vector(v.data(), v.size(), -3.0f, 3.0f);
+        for(float & e : v)
+            e = roundf(e);
+    };
+
+    for(std::string layout : {"nchw", "nhwc"})
+    for(size_t group : {1, 2})
+    for(size_t fy : {1, 3})
+    for(size_t pad : {0, 2})
+    for(size_t stride : {1, 2})
+    for(size_t dilation : {1, 2})
+    for(double rate : {0.05, 1.0}){
+        conv_2d_problem_t p = {3, 5 * group, 11, 13, 40 * group, fy, 3, pad, 1, stride, stride, dilation, 1, group};
+        bool nhwc = layout == "nhwc";
+        size_t ho = naive_conv_out_size(p.hi, p.py, p.dy, p.fy, p.sy);
+        size_t wo = naive_conv_out_size(p.wi, p.px, p.dx, p.fx, p.sx);
+        std::vector<float> input(p.n * p.c * p.hi * p.wi), weight(p.k * (p.c / p.group) * p.fy * p.fx), output(p.n * p.k * ho * wo);
+        gen_int(input);
+        gen_int(weight);
+        gen_int(output);
+        for(int d = 0; d < 3; d++){
+            std::vector<float> & result = d == 0 ? output : d == 1 ? input : weight;
+            std::vector<float> saved = result;
+            run_full(p, nhwc, d, input.data(), weight.data(), output.data());
+            std::vector<float> full = result;
+            result = saved;
+            std::vector<size_t> index;
+            std::vector<float> value;
+            run_sample(p, nhwc, d, input.data(), weight.data(), output.data(), &index, &value, rate);
+            num_total++;
+
+            bool valid = index.size() == value.size() && index.size() > 0 && std::is_sorted(index.begin(), index.end()) &&
+                         std::adjacent_find(index.begin(), index.end()) == index.end() && index.back() < full.size();
+            for(size_t i = 0; valid && i < index.size(); i++)
+                valid = value[i] == full[index[i]];
+            if(rate == 1.0)
+                valid = valid && index.size() == full.size();
+            // every k block (c block for bwd) is sampled
+            size_t channels = d == 1 ? p.c : p.k;
+            size_t spatial = d == 0 ? ho * wo : d == 1 ? p.hi * p.wi : p.fy * p.fx;
+            std::vector<int> block_seen((channels + CONV_SAMPLE_CPU_K_BLOCK - 1) / CONV_SAMPLE_CPU_K_BLOCK, 0);
+            bool corner_seen = false;
+            for(size_t i = 0; valid && i < index.size(); i++){
+                size_t ch = d == 2 ? index[i] / (spatial * (p.c / p.group)) : (nhwc ? index[i] % channels : index[i] / spatial % channels);
+                size_t pix = nhwc ? (d == 2 ? index[i] / (p.c / p.group) % spatial : index[i] / channels % spatial)
+                                  : index[i] % spatial;
+                block_seen[ch / CONV_SAMPLE_CPU_K_BLOCK] = 1;
+                corner_seen = corner_seen || pix == 0;
+            }
+            // the (0, 0) corner is a stratum of its own when it is a border along both h and w
+            bool corner_stratum = d == 0 ? p.py > 0 : d == 1 ? p.dy * (p.fy - 1) > p.py : p.fy > 1;
+            valid = valid && (corner_seen || !corner_stratum) && std::find(block_seen.begin(), block_seen.end(), 0) == block_seen.end();
+
+            // the validation passes a right result, and fails when one k block is off
+            if(valid){
+                valid = valid_vector_sampled(convert_cpu_fp32, index, value.data(), full.data(), NRMS_TOLERANCE);
+                std::vector<float> broken = full;
+                for(size_t i = 0; i < broken.size(); i++){
+                    size_t ch = d == 2 ? i / (spatial * (p.c / p.group)) : (nhwc ? i % channels : i / spatial % channels);
+                    if(ch / CONV_SAMPLE_CPU_K_BLOCK == 1)
+                        broken[i] += 64.0f;
+                }
+                if(channels > CONV_SAMPLE_CPU_K_BLOCK)
+                    valid = valid && !valid_vector_sampled(convert_cpu_fp32, index, value.data(), broken.data(), NRMS_TOLERANCE);
+                std::vector<uint16_t> full_bf16(full.size());
+                convert_cpu_narrow_f32(convert_cpu_bf16, full_bf16.data(), 0, full.data(), full.size());
+                valid = valid && valid_vector_sampled(convert_cpu_bf16, index, value.data(), full_bf16.data(), 8.2e-3);
+            }
+            if(!valid){
+                printf("[%s] n:%zu c:%zu hi:%zu wi:%zu k:%zu fy:%zu fx:%zu py:%zu px:%zu sy:%zu sx:%zu dy:%zu dx:%zu g:%zu, "
+                    "sample %s rate:%g, %zu samples fail\n", layout.c_str(), p.n, p.c, p.hi, p.wi, p.k, p.fy, p.fx, p.py, p.px,
+                    p.sy, p.sx, p.dy, p.dx, p.group, dir[d], rate, index.size());
+                ok = false;
+            }
+        }
+    }
+
+    if(verbose){
+        conv_2d_problem_t p = {32, 64, 56, 56, 64, 3, 3, 1, 1, 1, 1, 1, 1, 1};
+        size_t ho = naive_conv_out_size(p.hi, p.py, p.dy, p.fy, p.sy);
+        size_t wo = naive_conv_out_size(p.wi, p.px, p.dx, p.fx, p.sx);
+        std::vector<float> input(p.n * p.c * p.hi * p.wi), weight(p.k * p.c * p.fy * p.fx), output(p.n * p.k * ho * wo);
+        gen_rand_vector(input.data(), input.size(), -1.0f, 1.0f);
+        gen_rand_vector(weight.data(), weight.size(), -0.5f, 0.5f);
+        gen_rand_vector(output.data(), output.size(), -1.0f, 1.0f);
+        for(std::string layout : {"nchw", "nhwc"})
+        for(int d = 0; d < 3; d++){
+            std::vector<float> & result = d == 0 ? output : d == 1 ? input : weight;
+            std::vector<float> saved = result;
+            auto t0 = std::chrono::steady_clock::now();
+            run_full(p, layout == "nhwc", d, input.data(), weight.data(), output.data());
+            double t_full = time_ms(t0);
+            std::vector<float> full = result;
+            result = saved;
+            std::vector<size_t> index;
+            std::vector<float> value;
+            t0 = std::chrono::steady_clock::now();
+            run_sample(p, layout == "nhwc", d, input.data(), weight.data(), output.data(), &index, &value, 0.01);
+            double t_sample = time_ms(t0);
+            bool valid = valid_vector_sampled(convert_cpu_fp32, index, value.data(), full.data(), NRMS_TOLERANCE);
+            printf("[%s] n:%zu c:%zu hi:%zu wi:%zu k:%zu 3x3, sample %s rate:0.01 %zu of %zu %s, full:%.1fms sample:%.1fms (%.1fx)\n",
+                layout.c_str(), p.n, p.c, p.hi, p.wi, p.k, dir[d], index.size(), full.size(), valid ? "valid" : "fail",
+                t_full, t_sample, t_full / t_sample);
+            ok = ok && valid;
+        }
+    }
+    printf("sample %d cases valid\n", num_total);
+    return ok;
+}
+
+// streamed validation of fwd/bwd must pass the full native reference as the result, and catch one broken image
+static bool test_valid_stream(bool verbose)
+{
+    bool ok = true;
+    int cases = 0;
+    const char *dtype_name[] = {"fp32", "fp16", "bf16", "int8", "int4"};
+    const char *dir[] = {"fwd", "bwd"};
+    auto run_native = [](conv_ref_cpu_algo_t algo, convert_cpu_dtype_t dtype, bool nhwc, int d, const conv_2d_problem_t & p,
+                         size_t i_n, size_t cn, const uint8_t *in, const uint8_t *wei, uint8_t *out){
+        size_t ho = naive_conv_out_size(p.hi, p.py, p.dy, p.fy, p.sy);
+        size_t wo = naive_conv_out_size(p.wi, p.px, p.dx, p.fx, p.sx);
+        if(d == 0)
+            conv_native_cpu_fwd(algo, dtype, nhwc, in + convert_cpu_bytes(dtype, i_n * p.c * p.hi * p.wi), wei, out,
+                                cn, p.wi, p.hi, p.c, p.k, p.fx, p.fy, p.px, p.py, p.sx, p.sy, p.dx, p.dy, p.group);
+        else
+            conv_native_cpu_bwd(algo, dtype, nhwc, out, wei, in + convert_cpu_bytes(dtype, i_n * p.k * ho * wo),
+                                cn, p.wi, p.hi, p.c, p.k, p.fx, p.fy, p.px, p.py, p.sx, p.sy, p.dx, p.dy, p.group);
+    };
+
+    for(convert_cpu_dtype_t dtype : {convert_cpu_fp32, convert_cpu_fp16, convert_cpu_bf16, convert_cpu_int8, convert_cpu_int4})
+    for(std::string layout : {"nchw", "nhwc"})
+    for(int d = 0; d < 2; d++)
+    for(size_t n : {1, 7}){
+        conv_2d_problem_t p = {n, 6, 9, 7, 5, 3, 3, 1, 1, 1, 1, 1, 1, 1};     // odd images, int4 chunks of 2 images
+        bool nhwc = layout == "nhwc";
+        size_t ho = naive_conv_out_size(p.hi, p.py, p.dy, p.fy, p.sy);
+        size_t wo = naive_conv_out_size(p.wi, p.px, p.dx, p.fx, p.sx);
+        size_t in_image = d == 0 ? p.c * p.hi * p.wi : p.k * ho * wo;
+        size_t out_image = d == 0 ? p.k * ho * wo : p.c * p.hi * p.wi;
+        size_t wei_size = p.k * p.c * p.fy * p.fx;
+        std::vector<float> in32(n * in_image), wei32(wei_size);
+        if(convert_cpu_is_int(dtype)){
+            for(float & e : in32) e = (float)((int)(rand() % 7) - 3);
+            for(float & e : wei32) e = (float)((int)(rand() % 7) - 3);
+        }else{
+            gen_rand_vector(in32.data(), in32.size(), -1.0f, 1.0f);
+            gen_rand_vector(wei32.data(), wei32.size(), -0.5f, 0.5f);
+        }
+        std::vector<uint8_t> in(n * in_image * 4), wei(wei_size * 4), result(n * out_image * 4);
+        convert_cpu_narrow_f32(dtype, in.data(), 0, in32.data(), in32.size());
+        convert_cpu_narrow_f32(dtype, wei.data(), 0, wei32.data(), wei32.size());
+        conv_ref_cpu_algo_t algo = conv_ref_cpu_algo_naive;
+        run_native(algo, dtype, nhwc, d, p, 0, n, in.data(), wei.data(), result.data());
+
+        for(int broken = 0; broken < 2; broken++){
+            if(broken){
+                // the last image, its first element for integers, all of it for floats
+                size_t last = (n - 1) * out_image;
+                if(convert_cpu_is_int(dtype))
+                    result[convert_cpu_bytes(dtype, last)] ^= 0x1;
+                else{
+                    std::vector<float> img(out_image);
+                    convert_cpu_widen_f32(dtype, img.data(), result.data(), last, out_image);
+                    for(float & e : img)
+                        e = -e + 0.25f;
+                    convert_cpu_narrow_f32(dtype, result.data(), last, img.data(), out_image);
+                }
+            }
+            bool valid = valid_stream_cpu_images(dtype, n, out_image, 1e-2,
+                [&](size_t i_n, size_t cn, void *ref){
+                    run_native(algo, dtype, nhwc, d, p, i_n, cn, in.data(), wei.data(), (uint8_t *)ref);
+                },
+                [&](size_t i_n, size_t cn, void *pred){
+                    memcpy(pred, result.data() + convert_cpu_bytes(dtype, i_n * out_image), convert_cpu_bytes(dtype, cn * out_image));
+                });
+            cases++;
+            if(valid == (bool)broken){
+                printf("[%s] n:%zu %s %s broken:%d, valid_stream %s\n", layout.c_str(), n, dtype_name[dtype], dir[d], broken,
+                    valid ? "passes a wrong result" : "fails a right result");
+                ok = false;
+            }
+        }
+    }
+
+    if(verbose){
+        conv_2d_problem_t p = {32, 64, 56, 56, 64, 3, 3, 1, 1, 1, 1, 1, 1, 1};
+        size_t ho = naive_conv_out_size(p.hi, p.py, p.dy, p.fy, p.sy);
+        size_t wo = naive_conv_out_size(p.wi, p.px, p.dx, p.fx, p.sx);
+        size_t out_image = p.k * ho * wo;
+        std::vector<float> in(p.n * p.c * p.hi * p.wi), wei(p.k * p.c * p.fy * p.fx), result(p.n * out_image), ref(p.n * out_image);
+        gen_rand_vector(in.data(), in.size(), -1.0f, 1.0f);
+        gen_rand_vector(wei.data(), wei.size(), -0.5f, 0.5f);
+        conv_ref_cpu_algo_t algo = conv_ref_cpu_algo_naive;
+        run_native(algo, convert_cpu_fp32, false, 0, p, 0, p.n, (const uint8_t *)in.data(), (const uint8_t *)wei.data(), (uint8_t *)result.data());
+        auto t0 = std::chrono::steady_clock::now();
+        run_native(algo, convert_cpu_fp32, false, 0, p, 0, p.n, (const uint8_t *)in.data(), (const uint8_t *)wei.data(), (uint8_t *)ref.data());
+        std::vector<float> fetched(result);
+        bool full = valid_vector<float>(ref.data(), fetched.data(), ref.size(), NRMS_TOLERANCE);
+        double t_full = time_ms(t0);
+        t0 = std::chrono::steady_clock::now();
+        bool stream = valid_stream_cpu_images(convert_cpu_fp32, p.n, out_image, NRMS_TOLERANCE,
+            [&](size_t i_n, size_t cn, void *r){
+                run_native(algo, convert_cpu_fp32, false, 0, p, i_n, cn, (const uint8_t *)in.data(), (const uint8_t *)wei.data(), (uint8_t *)r);
+            },
+            [&](size_t i_n, size_t cn, void *pred){
+                memcpy(pred, result.data() + i_n * out_image, cn * out_image * sizeof(float));
+            });
+        double t_stream = time_ms(t0);
+        printf("valid_stream fwd n:%zu c:%zu hi:%zu wi:%zu k:%zu 3x3, full:%.1fms (%s) stream:%.1fms (%s)\n", p.n, p.c, p.hi, p.wi,
+            p.k, t_full, full ? "y" : "n", t_stream, stream ? "y" : "n");
+        ok = ok && full && stream;
+    }
+    printf("valid_stream %d cases valid\n", cases);
+    return ok;
+}
+
+// philox must match the reference answers on every isa, and rand_cpu_uniform must not depend on the thread count
+static bool test_rand(bool verbose)
+{
+    bool ok = true;
+    typedef void (*philox_t)(uint32_t *, uint64_t, size_t, uint32_t, uint64_t);
+    std::vector<std::pair<const char *, philox_t>> isa = {{"scalar", simd_cpu_philox_u32_scalar}};
+#if SIMD_CPU_X86
+    if(simd_cpu_get_isa() >= simd_cpu_isa_avx2)
+        isa.push_back({"avx2", simd_cpu_philox_u32_avx2});
+    if(simd_cpu_get_isa() >= simd_cpu_isa_avx512)
+        isa.push_back({"avx512", simd_cpu_philox_u32_avx512});
+#endif
+    // counter and key 0, the random123 known answer of philox4x32-10
+    const uint32_t kat[4] = {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8};
+    uint32_t out[4];
+    simd_cpu_philox_u32_scalar(out, 0, 1, 0, 0);
+    if(memcmp(out, kat, sizeof(out)) != 0){
+        printf("philox scalar 0x%08x 0x%08x 0x%08x 0x%08x, not the known answer\n", out[0], out[1], out[2], out[3]);
+        ok = false;
+    }
+    // every isa draws the same words, for counters across a 32 bit carry, and any count
+    for(auto & f : isa)
+    for(uint64_t ctr : {(uint64_t)0, (uint64_t)0xfffffff0ull, (uint64_t)123456789})
+    for(size_t cnt : {1, 7, 8, 16, 37}){
+        std::vector<uint32_t> ref(4 * cnt), got(4 * cnt, 0);
+        simd_cpu_philox_u32_scalar(ref.data(), ctr, cnt, 5, 0x0123456789abcdefull);
+        f.second(got.data(), ctr, cnt, 5, 0x0123456789abcdefull);
+        if(ref != got){
+            printf("philox %s ctr:%llu cnt:%zu differs from scalar\n", f.first, (unsigned long long)ctr, cnt);
+            ok = false;
+        }
+    }
+
+    size_t n = 100003;
+    size_t num_threads = thread_pool_cpu_get_num_threads();
+    std::vector<float> f_ref(n), f_got(n);
+    std::vector<int> i_ref(n), i_got(n);
+    thread_pool_cpu_set_num_threads(1);
+    rand_cpu_uniform<float, float>(f_ref.data(), n, -0.5f, 0.5f, 42, rand_cpu_tensor_weight);
+    rand_cpu_uniform<int, int>(i_ref.data(), n, -5, 5, 42, rand_cpu_tensor_input);
+    for(size_t t : {2, 3, 8}){
+        thread_pool_cpu_set_num_threads(t);
+        rand_cpu_uniform<float, float>(f_got.data(), n, -0.5f, 0.5f, 42, rand_cpu_tensor_weight);
+        rand_cpu_uniform<int, int>(i_got.data(), n, -5, 5, 42, rand_cpu_tensor_input);
+        if(f_ref != f_got || i_ref != i_got){
+            printf("rand_cpu_uniform with %zu threads differs from 1 thread\n", t);
+            ok = false;
+        }
+    }
+    thread_pool_cpu_set_num_threads(num_threads);
+    // the range, both int bounds hit, and another seed or tensor gives other data
+    bool in_range = std::all_of(f_ref.begin(), f_ref.end(), [](float v){ return v >= -0.5f && v <= 0.5f; }) &&
+                    *std::min_element(i_ref.begin(), i_ref.end()) == -5 && *std::max_element(i_ref.begin(), i_ref.end()) == 5;
+    rand_cpu_uniform<float, float>(f_got.data(), n, -0.5f, 0.5f, 43, rand_cpu_tensor_weight);
+    bool seed_differs = f_ref != f_got;
+    rand_cpu_uniform<float, float>(f_got.data(), n, -0.5f, 0.5f, 42, rand_cpu_tensor_output);
+    seed_differs = seed_differs && f_ref != f_got;
+    double mean = 0;
+    for(float v : f_ref)
+        mean += v;
+    mean /= n;
+    if(!in_range || !seed_differs || fabs(mean) > 0.01){
+        printf("rand_cpu_uniform in range:%d, other seed/tensor differs:%d, mean:%f\n", in_range, seed_differs, mean);
+        ok = false;
+    }
+
+    if(verbose){
+        size_t bn = (size_t)1 << 26;
+        std::vector<float> buf(bn);
+        auto t0 = std::chrono::steady_clock::now();
+        rand_cpu_uniform<float, float>(buf.data(), bn, 0.0f, 1.0f, 1, rand_cpu_tensor_input);
+        double t_philox = time_ms(t0);
+        t0 = std::chrono::steady_clock::now();
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> d(0.0f, 1.0f);
+        for(size_t i = 0; i < bn; i++)
+            buf[i] = d(rng);
+        double t_mt = time_ms(t0);
+        printf("rand n:%zu philox:%.1fms mt19937 serial:%.1fms (%.1fx)\n", bn, t_philox, t_mt, t_mt / t_philox);
+    }
+    printf("rand %s, simd:%s\n", ok ? "valid" : "fail", simd_cpu_isa_name(simd_cpu_get_isa()));
+    return ok;
+}
+
+// fused init, same bytes as the fp32 init followed by the conversion, which the driver used to do
+static bool test_rand_dtype(bool verbose)
+{
+    bool ok = true;
+    size_t n = 100002;      // even, tensor_copy<int4x2_t> drops an odd tail
+    std::vector<float> f32(n), f32_got(n);
+    for(convert_cpu_dtype_t dtype : {convert_cpu_fp32, convert_cpu_fp16, convert_cpu_bf16, convert_cpu_int8, convert_cpu_int4})
+    for(int is_int : {0, 1}){
+        std::vector<uint8_t> ref(convert_cpu_bytes(dtype, n)), got(ref.size()), got_no_f32(ref.size());
+        if(is_int){
+            rand_cpu_uniform<float, int>(f32.data(), n, -5, 5, 7, rand_cpu_tensor_output);
+            rand_cpu_uniform_dtype<int>(dtype, got.data(), f32_got.data(), n, -5, 5, 7, rand_cpu_tensor_output);
+            rand_cpu_uniform_dtype<int>(dtype, got_no_f32.data(), NULL, n, -5, 5, 7, rand_cpu_tensor_output);
+        }else{
+            rand_cpu_uniform<float, float>(f32.data(), n, -0.5f, 0.5f, 7, rand_cpu_tensor_output);
+            rand_cpu_uniform_dtype<float>(dtype, got.data(), f32_got.data(), n, -0.5f, 0.5f, 7, rand_cpu_tensor_output);
+            rand_cpu_uniform_dtype<float>(dtype, got_no_f32.data(), NULL, n, -0.5f, 0.5f, 7, rand_cpu_tensor_output);
+        }
+        if(dtype == convert_cpu_int8)
+            tensor_copy<int8_t, float>((int8_t *)ref.data(), f32.data(), n);
+        else if(dtype == convert_cpu_int4)
+            tensor_copy<int4x2_t, float>((int4x2_t *)ref.data(), f32.data(), n);
+        else
+            convert_cpu_narrow_f32(dtype, ref.data(), 0, f32.data(), n);
+        if(ref != got || ref != got_no_f32 || f32 != f32_got){
+            printf("rand_cpu_uniform_dtype dtype:%d int:%d differs from init and convert\n", (int)dtype, is_int);
+            ok = false;
+        }
+    }
+
+    if(verbose){
+        size_t bn = (size_t)1 << 26;
+        std::vector<float> buf(bn);
+        std::vector<uint16_t> buf16(bn);
+        auto t0 = std::chrono::steady_clock::now();
+        rand_cpu_uniform<float, float>(buf.data(), bn, 0.0f, 1.0f, 1, rand_cpu_tensor_input);
+        convert_cpu_narrow_f32(convert_cpu_fp16, buf16.data(), 0, buf.data(), bn);
+        double t_two_pass = time_ms(t0);
+        t0 = std::chrono::steady_clock::now();
+        rand_cpu_uniform_dtype<float>(convert_cpu_fp16, buf16.data(), NULL, bn, 0.0f, 1.0f, 1, rand_cpu_tensor_input);
+        double t_fused = time_ms(t0);
+        printf("rand fp16 n:%zu init+convert:%.1fms fused:%.1fms (%.1fx)\n", bn, t_two_pass, t_fused, t_two_pass / t_fused);
+    }
+    printf("rand dtype %s\n", ok ? "valid" : "fail");
+    return ok;
+}
+
+// blocked layout transforms against the loops of tensor_transpose.h, nhwc being nchwc with vector_c = c
+template<typename T>
+static bool test_transpose_type(size_t n, size_t c, size_t h, size_t w, size_t vector_c)
+{
+    size_t num = n * c * h * w;
+    std::vector<T> src(num), ref(num), got(num), back(num);
+    for(size_t i = 0; i < num; i++)
+        src[i] = (T)(i * 2654435761u >> 7);
+    bool ok = true;
+    auto check = [&](const char *name){
+        if(ref != got){
+            printf("transpose %s %zu byte n:%zu c:%zu h:%zu w:%zu vector_c:%zu differs\n", name, sizeof(T), n, c, h, w, vector_c);
+            ok = false;
+        }
+    };
+    tensor_transpose_nchw_2_nchwc<T *>(ref.data(), src.data(), n, c, h, w, vector_c);
+    transpose_cpu_nchw_2_nchwc(got.data(), src.data(), n, c, h, w, vector_c);
+    check("nchw_2_nchwc");
+    tensor_transpose_nchwc_2_nchw<T *>(ref.data(), src.data(), n, c, h, w, vector_c);
+    transpose_cpu_nchwc_2_nchw(got.data(), src.data(), n, c, h, w, vector_c);
+    check("nchwc_2_nchw");
+    tensor_transpose_nchw_2_chwnc<T *>(ref.data(), src.data(), n, c, h, w, vector_c);
+    transpose_cpu_nchw_2_chwnc(got.data(), src.data(), n, c, h, w, vector_c);
+    check("nchw_2_chwnc");
+    tensor_transpose_chwnc_2_nchw<T *>(ref.data(), src.data(), n, c, h, w, vector_c);
+    transpose_cpu_chwnc_2_nchw(got.data(), src.data(), n, c, h, w, vector_c);
+    check("chwnc_2_nchw");
+    tensor_transpose_nchw_2_nchwc<T *>(ref.data(), src.data(), n, c, h, w, c);
+    transpose_cpu_nchw_2_nhwc(got.data(), src.data(), n, c, h, w);
+    check("nchw_2_nhwc");
+    tensor_transpose_nchwc_2_nchw<T *>(ref.data(), src.data(), n, c, h, w, c);
+    transpose_cpu_nhwc_2_nchw(got.data(), src.data(), n, c, h, w);
+    check("nhwc_2_nchw");
+    return ok;
+}
+
+static bool test_transpose(bool verbose)
+{
+    int num_total = 0, num_fail = 0;
+    for(size_t n : {1, 3})
+    for(size_t vector_c : {1, 4, 8, 16})
+    for(size_t c_groups : {1, 3})
+    for(size_t h : {1, 7, 17})
+    for(size_t w : {1, 9, 70}){
+        size_t c = vector_c * c_groups;
+        num_total += 3;
+        num_fail += !test_transpose_type<uint32_t>(n, c, h, w, vector_c);
+        num_fail += !test_transpose_type<uint16_t>(n, c, h, w, vector_c);
+        num_fail += !test_transpose_type<uint8_t>(n, c, h, w, vector_c);
+    }
+
+    if(verbose){
+        size_t n = 8, c = 256, h = 56, w = 56, vector_c = 8, num = n * c * h * w;
+        std::vector<float> src(num), dst(num);
+        gen_rand_vector(src.data(), num, -1.0f, 1.0f);
+        auto t0 = std::chrono::steady_clock::now();
+        tensor_transpose_nchw_2_nchwc<float *>(dst.data(), src.data(), n, c, h, w, vector_c);
+        double t_loop = time_ms(t0);
+        t0 = std::chrono::steady_clock::now();
+        transpose_cpu_nchw_2_nchwc(dst.data(), src.data(), n, c, h, w, vector_c);
+        double t_blocked = time_ms(t0);
+        t0 = std::chrono::steady_clock::now();
+        tensor_transpose_nchw_2_nchwc<float *>(dst.data(), src.data(), n, c, h, w, c);
+        double t_loop_nhwc = time_ms(t0);
+        t0 = std::chrono::steady_clock::now();
+        transpose_cpu_nchw_2_nhwc(dst.data(), src.data(), n, c, h, w);
+        double t_blocked_nhwc = time_ms(t0);
+        printf("transpose n:%zu c:%zu h:%zu w:%zu, nchwc%zu loop:%.1fms blocked:%.1fms (%.1fx), nhwc loop:%.1fms blocked:%.1fms (%.1fx)\n",
+               n, c, h, w, vector_c, t_loop, t_blocked, t_loop / t_blocked, t_loop_nhwc, t_blocked_nhwc, t_loop_nhwc / t_blocked_nhwc);
+    }
+    printf("transpose %d of %d cases valid\n", num_total - num_fail, num_total);
+    return num_fail == 0;
+}
+
+// the loops of the host reference in test/tensor_reorder, for any rank: src in order, dst index from the dst strides
+template<typename T>
+static void naive_tensor_reorder(T *dst, const T *src, size_t ndim, const size_t *dims, const int *order)
+{
+    size_t total = 1, idx[TENSOR_REORDER_CPU_MAX_DIMS] = {0}, dst_stride[TENSOR_REORDER_CPU_MAX_DIMS];
+    for(size_t j = ndim; j > 0; j--){
+        dst_stride[order[j - 1]] = total;
+        total *= dims[order[j - 1]];
+    }
+    size_t i_dst = 0;
+    for(size_t i = 0; i < total; i++){
+        dst[i_dst] = src[i];
+        for(size_t a = ndim; a > 0; a--){
+            i_dst += dst_stride[a - 1];
+            if(++idx[a - 1] < dims[a - 1])
+                break;
+            i_dst -= dims[a - 1] * dst_stride[a - 1];
+            idx[a - 1] = 0;
+        }
+    }
+}
+
+template<typename T>
+static bool test_tensor_reorder_type(size_t ndim, const size_t *dims, const int *order)
+{
+    size_t total = 1;
+    for(size_t a = 0; a < ndim; a++)
+        total *= dims[a];
+    std::vector<T> src(total), ref(total), got(total);
+    for(size_t i = 0; i < total; i++)
+        src[i] = (T)(i * 2654435761u >> 5);
+    naive_tensor_reorder(ref.data(), src.data(), ndim, dims, order);
+    tensor_reorder_cpu_run(got.data(), src.data(), ndim, dims, order);
+    if(ref != got){
+        printf("tensor_reorder %zu byte dims:", sizeof(T));
+        for(size_t a = 0; a < ndim; a++)
+            printf("%zu%s", dims[a], a + 1 < ndim ? "x" : "");
+        printf(" order:");
+        for(size_t a = 0; a < ndim; a++)
+            printf("%d", order[a]);
+        printf(" differs\n");
+        return false;
+    }
+    return true;
+}
+
+static bool test_tensor_reorder(bool verbose)
+{
+    int num_total = 0, num_fail = 0;
+    std::vector<std::vector<size_t>> shapes = {{2, 3, 5, 7}, {1, 16, 9, 8}, {3, 8, 1, 70}, {4, 65, 17, 1}, {2, 4, 33, 40}};
+    int order[4] = {0, 1, 2, 3};
+    do{
+        for(auto & dims : shapes){
+            num_total += 3;
+            num_fail += !test_tensor_reorder_type<uint32_t>(4, dims.data(), order);
+            num_fail += !test_tensor_reorder_type<uint16_t>(4, dims.data(), order);
+            num_fail += !test_tensor_reorder_type<uint8_t>(4, dims.data(), order);
+        }
+    }while(std::next_permutation(order, order + 4));
+    // higher rank and the compile time orders
+    {
+        const size_t dims[5] = {2, 3, 8, 5, 9};
+        const int order5[5] = {4, 0, 2, 1, 3};
+        num_total++;
+        num_fail += !test_tensor_reorder_type<float>(5, dims, order5);
+        std::vector<float> src(2 * 16 * 9 * 8), ref(src.size()), got(src.size());
+        for(size_t i = 0; i < src.size(); i++)
+            src[i] = (float)i;
+        const size_t dims4[4] = {2, 16, 9, 8};
+        const int r0231[4] = {0, 2, 3, 1}, r1302[4] = {1, 3, 0, 2};
+        naive_tensor_reorder(ref.data(), src.data(), 4, dims4, r0231);
+        tensor_reorder_cpu<float, tensor_reorder_cpu_order<0, 2, 3, 1>>(got.data(), src.data(), 2, 16, 9, 8);
+        num_total++;
+        num_fail += ref != got;
+        naive_tensor_reorder(ref.data(), src.data(), 4, dims4, r1302);
+        tensor_reorder_cpu<float, tensor_reorder_cpu_order<1, 3, 0, 2>>(got.data(), src.data(), dims4);
+        num_total++;
+        num_fail += ref != got;
+    }
+
+    if(verbose){
+        const size_t dims[4] = {8, 256, 56, 56};
+        size_t total = dims[0] * dims[1] * dims[2] * dims[3];
+        std::vector<float> src(total), dst(total);
+        gen_rand_vector(src.data(), total, -1.0f, 1.0f);
+        tensor_reorder_cpu_run(dst.data(), src.data(), 4, dims, order);
+        double t_naive = 0, t_engine = 0, worst = 1e30, best = 0;
+        do{
+            auto t0 = std::chrono::steady_clock::now();
+            naive_tensor_reorder(dst.data(), src.data(), 4, dims, order);
+            double tn = time_ms(t0);
+            t0 = std::chrono::steady_clock::now();
+            tensor_reorder_cpu_run(dst.data(), src.data(), 4, dims, order);
+            double te = time_ms(t0);
+            t_naive += tn;
+            t_engine += te;
+            worst = std::min(worst, tn / te);
+            best = std::max(best, tn / te);
+        }while(std::next_permutation(order, order + 4));
+        printf("tensor_reorder 24 orders of 8x256x56x56 fp32, naive:%.1fms engine:%.1fms (%.1fx, per order %.1fx to %.1fx)\n",
+               t_naive, t_engine, t_naive / t_engine, worst, best);
+    }
+    printf("tensor_reorder %d of %d cases valid\n", num_total - num_fail, num_total);
+    return num_fail == 0;
+}
+
+int main()
+{
+    // timings of the faster host paths against naive, set CPU_CONV_REF_BENCH=1 to run them
+    bool bench = env_get_int("CPU_CONV_REF_BENCH", 0);
+    int num_fail = 0;
+    int num_total = 0;
+    for(const char *tile : {"4", "2"})
+    for(std::string layout : {"nchw", "nhwc"}){
+        setenv("IGEMM_CPU_WINOGRAD_TILE", tile, 1);
+        for(size_t group : {1, 2})
+        for(size_t c : {4, 18})
+        for(size_t k : {4, 10})
+        for(size_t hi : {7, 12})
+        for(size_t fy : {1, 3, 5})
+        for(size_t fx : {1, 3, 5})
+        for(size_t pad : {0, 1})
+        for(size_t stride : {1, 2})
+        for(size_t dilation : {1, 2}){
+            conv_2d_problem_t p = {2, c * group, hi, hi + 3, k * group, fy, fx, pad, pad + (fx > 1 ? 1 : 0),
+                                   stride, stride, dilation, 3 - dilation, group};
+            if(p.hi + 2 * p.py < p.dy * (p.fy - 1) + 1 || p.wi + 2 * p.px < p.dx * (p.fx - 1) + 1)
+                continue;
+            num_total++;
+            if(!test_one(p, layout, false))
+                num_fail++;
+        }
+    }
+    printf("%d of %d cases valid\n", num_total - num_fail, num_total);
+
+    if(!test_convert())
+        num_fail++;
+    if(!test_wrw_split(bench))
+        num_fail++;
+    if(!test_spec(bench))
+        num_fail++;
+    if(!test_depthwise(bench))
+        num_fail++;
+    if(!test_3d(bench))
+        num_fail++;
+    if(!test_valid_vector(bench))
+        num_fail++;
+    if(!test_sample(bench))
+        num_fail++;
+    if(!test_valid_stream(bench))
+        num_fail++;
+    if(!test_rand(bench))
+        num_fail++;
+    if(!test_rand_dtype(bench))
+        num_fail++;
+    if(!test_transpose(bench))
+        num_fail++;
+    if(!test_tensor_reorder(bench))
+        num_fail++;
+    int num_native_fail = 0;
+    int num_native_total = 0;
+    for(convert_cpu_dtype_t dtype : {convert_cpu_fp16, convert_cpu_bf16, convert_cpu_int8, convert_cpu_int4})
+    for(std::string layout : {"nchw", "nhwc"})
+    for(size_t group : {1, 2})
+    for(size_t c : {3, 8})
+    for(size_t fy : {1, 3})
+    for(size_t pad : {0, 1})
+    for(size_t stride : {1, 2})
+    for(size_t dilation : {1, 2}){
+        conv_2d_problem_t p = {3, c * group, 9, 11, 5 * group, fy, 3, pad, 1, stride, stride, dilation, 1, group};
+        num_native_total++;
+        if(!test_native(p, layout, dtype))
+            num_native_fail++;
+    }
+    printf("%d of %d native cases valid\n", num_native_total - num_native_fail, num_native_total);
+    num_fail += num_native_fail;
+
+    // auto lowers large shapes that winograd/fft do not take to gemm, exact callers and depthwise stay direct
+    {
+        auto select = [](const char *direction, const conv_2d_problem_t &p, bool need_exact){
+            return conv_ref_cpu_select(direction, p.n, p.wi, p.hi, p.c, p.k, p.fx, p.fy, p.px, p.py, p.sx, p.sy, p.dx, p.dy, p.group, need_exact);
+        };
+        conv_2d_problem_t dilated = {4, 64, 28, 28, 64, 3, 3, 2, 2, 1, 1, 2, 2, 1};
+        conv_2d_problem_t pointwise = {8, 512, 7, 7, 2048, 1, 1, 0, 0, 1, 1, 1, 1, 1};
+        conv_2d_problem_t tiny = {1, 4, 5, 5, 4, 1, 1, 0, 0, 1, 1, 1, 1, 1};
+        conv_2d_problem_t depthwise = {4, 64, 28, 28, 64, 3, 3, 1, 1, 2, 2, 1, 1, 64};
+        bool ok = select("fwd", dilated, false) == conv_ref_cpu_algo_gemm &&
+                  select("wrw", dilated, false) == conv_ref_cpu_algo_gemm &&
+                  select("bwd", pointwise, false) == conv_ref_cpu_algo_gemm &&
+                  select("fwd", pointwise, true) == conv_ref_cpu_algo_naive &&
+                  select("fwd", tiny, false) == conv_ref_cpu_algo_naive &&
+                  select("fwd", depthwise, false) == conv_ref_cpu_algo_naive;
+        setenv("IGEMM_CPU_CONV_ALGO", "gemmm", 1);
+        ok = ok && select("fwd", dilated, false) == conv_ref_cpu_algo_gemm && select("fwd", tiny, false) == conv_ref_cpu_algo_naive;
+        unsetenv("IGEMM_CPU_CONV_ALGO");
+        printf("auto select %s\n", ok ? "valid" : "not valid");
+        num_fail += !ok;
+    }
+
+    // timing on a few larger shapes
+    if(bench){
+        unsetenv("IGEMM_CPU_WINOGRAD_TILE");
+        conv_2d_problem_t bench[] = {
+            {4, 64, 56, 56, 64, 3, 3, 1, 1, 1, 1, 1, 1, 1},
+            {4, 256, 14, 14, 256, 3, 3, 1, 1, 1, 1, 1, 1, 1},
+            {8, 512, 7, 7, 512, 3, 3, 1, 1, 1, 1, 1, 1, 1},
+            {8, 512, 7, 7, 2048, 1, 1, 0, 0, 1, 1, 1, 1, 1},
+            {4, 32, 56, 56, 32, 5, 5, 2, 2, 1, 1, 1, 1, 1},
+            {2, 16, 112, 112, 16, 7, 7, 3, 3, 1, 1, 1, 1, 1},
+            {4, 64, 28, 28, 64, 3, 3, 2, 2, 1, 1, 2, 2, 1},
+        };
+        for(auto & p : bench){
+            printf("auto selects fwd:%s bwd:%s wrw:%s\n",
+                conv_ref_cpu_algo_name(conv_ref_cpu_select("fwd", p.n, p.wi, p.hi, p.c, p.k, p.fx, p.fy, p.px, p.py, p.sx, p.sy, p.dx, p.dy, p.group, false)),
+                conv_ref_cpu_algo_name(conv_ref_cpu_select("bwd", p.n, p.wi, p.hi, p.c, p.k, p.fx, p.fy, p.px, p.py, p.sx, p.sy, p.dx, p.dy, p.group, false)),
+                conv_ref_cpu_algo_name(conv_ref_cpu_select("wrw", p.n, p.wi, p.hi, p.c, p.k, p.fx, p.fy, p.px, p.py, p.sx, p.sy, p.dx, p.dy, p.group, false)));
+            for(std::string layout : {"nchw", "nhwc"})
+                if(!test_one(p, layout, true))
+                    num_fail++;
+        }
+    }
+    return num_fail == 0 ? 0 : 1;
+}
@@ -0,0 +1,7 @@
+#!/bin/sh
+# to launch from top of generator
+rm -rf out
+mkdir out
+
+/opt/rocm/hip/bin/hipcc -Idriver -std=c++14 -O2 test/find_db/test_find_db.cpp -o out/test_find_db.exe || exit 1
+./out/test_find_db.exe
@@ -0,0 +1,225 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include "find_db_cpu.h"
+
+static inline int env_get_int(const char *var_name, int default_int) {
+    char *v = getenv(var_name);
+    int r = default_int;
+    if (v)
+        r = atoi(v);
+    return r;
+}
+
+static double time_ms(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static find_db_cpu_key_t test_find_db_key(int i)
+{
+    find_db_cpu_key_t key;
+    find_db_cpu_key_init(&key, i % 3 == 0 ? "fwd" : (i % 3 == 1 ? "bwd" : "wrw"), i % 2 ? "NHWC" : "NCHW",
+                        i % 2 ? "NHWC" : "NCHW", i % 2 ? "NHWC" : "NCHW", i % 4 == 0 ? 1 : 0, "gfx90a:sramecc+:xnack-", 110);
+    key.n = 1 + i % 7; key.c = 64 * (1 + i / 7); key.hi = 56; key.wi = 56 + i % 5; key.k = 128;
+    key.y = 3; key.x = 3; key.pad_h = key.pad_w = 1; key.stride_h = key.stride_w = 1 + i % 2;
+    key.dilation_h = key.dilation_w = 1; key.group = 1;
+    return key;
+}
+
+static bool test_find_db(bool verbose)
+{
+    int num_total = 0, num_fail = 0;
+    std::string path = "/tmp/test_find_db_" + std::to_string(getpid()) + ".bin";
+    unlink(path.c_str());
+
+    auto make_record = [](int i, int version){
+        find_db_cpu_record_t record;
+        memset(&record, 0, sizeof(record));
+        record.key = test_find_db_key(i);
+        std::vector<find_db_cpu_entry_t> candidates;
+        for(int j = 0; j < 6; j++){
+            find_db_cpu_entry_t e;
+            find_db_cpu_set_str(e.kernel_name, FIND_DB_CPU_NAME_LEN,
+                                ("igemm_kernel_" + std::to_string(i) + "_" + std::to_string(j) + "_v" + std::to_string(version)).c_str());
+            e.gks = j % 3;
+            e.tile_h = e.tile_w = 0;
+            e.duration_ms = 1.0f + (float)((j * 5 + i) % 6);   // distinct, not in j order
+            e.gflops = 1000.0f / e.duration_ms;
+            candidates.push_back(e);
+        }
+        find_db_cpu_rank(&record, candidates);
+        return record;
+    };
+    auto record_equal = [](const find_db_cpu_record_t *a, const find_db_cpu_record_t *b){
+        return a && b && memcmp(a, b, sizeof(find_db_cpu_record_t)) == 0;
+    };
+
+    find_db_cpu_t db;
+    find_db_cpu_key_t probe = test_find_db_key(0);
+    num_total++;
+    num_fail += !(find_db_cpu_open(&db, path.c_str()) && db.num_records == 0 && find_db_cpu_find(&db, &probe) == nullptr);
+    find_db_cpu_close(&db);
+
+    // ranking keeps the FIND_DB_CPU_TOP fastest, fastest first
+    {
+        find_db_cpu_record_t r = make_record(1, 0);
+        bool ok = r.num_entries == FIND_DB_CPU_TOP;
+        for(int j = 0; j < r.num_entries; j++)
+            ok = ok && r.entries[j].duration_ms == 1.0f + j;
+        num_total++;
+        num_fail += !ok;
+    }
+
+    // stored in a shuffled order, every record found back after reopen
+    const int num_records = 60;
+    std::vector<int> ids(num_records);
+    for(int i = 0; i < num_records; i++)
+        ids[i] = i;
+    std::shuffle(ids.begin(), ids.end(), std::mt19937(7));
+    for(int i : ids){
+        find_db_cpu_record_t r = make_record(i, 0);
+        num_total++;
+        num_fail += !find_db_cpu_store(path.c_str(), &r);
+    }
+    find_db_cpu_open(&db, path.c_str());
+    num_total++;
+    num_fail += db.num_records != num_records;
+    for(int i = 0; i < num_records; i++){
+        find_db_cpu_record_t r = make_record(i, 0);
+        num_total++;
+        num_fail += !record_equal(find_db_cpu_find(&db, &r.key), &r);
+    }
+    // any field of the signature is part of the key
+    {
+        find_db_cpu_key_t k = test_find_db_key(5);
+        k.num_cu = 120;
+        find_db_cpu_key_t k2 = test_find_db_key(5);
+        find_db_cpu_set_str(k2.arch, sizeof(k2.arch), "gfx908");
+        find_db_cpu_key_t k3 = test_find_db_key(5);
+        k3.dilation_w = 2;
+        find_db_cpu_key_t k4 = test_find_db_key(5);
+        k4.data_type = 5;
+        num_total++;
+        num_fail += find_db_cpu_find(&db, &k) || find_db_cpu_find(&db, &k2) || find_db_cpu_find(&db, &k3) || find_db_cpu_find(&db, &k4);
+        num_total++;
+        num_fail += strcmp(test_find_db_key(5).arch, "gfx90a") != 0;
+    }
+    find_db_cpu_close(&db);
+
+    // a retune replaces the record in place
+    {
+        find_db_cpu_record_t r = make_record(17, 1);
+        find_db_cpu_store(path.c_str(), &r);
+        find_db_cpu_open(&db, path.c_str());
+        num_total++;
+        num_fail += !(db.num_records == num_records && record_equal(find_db_cpu_find(&db, &r.key), &r));
+        find_db_cpu_record_t r0 = make_record(16, 0);
+        num_total++;
+        num_fail += !record_equal(find_db_cpu_find(&db, &r0.key), &r0);
+        find_db_cpu_close(&db);
+    }
+
+    // a partial sweep merges into the stored record, a re-run kernel takes its new timing
+    {
+        find_db_cpu_record_t stored = make_record(17, 1);
+        find_db_cpu_record_t partial;
+        memset(&partial, 0, sizeof(partial));
+        partial.key = stored.key;
+        std::vector<find_db_cpu_entry_t> candidates(2);
+        find_db_cpu_set_str(candidates[0].kernel_name, FIND_DB_CPU_NAME_LEN, "igemm_kernel_partial");
+        candidates[0].gks = 0;
+        candidates[0].duration_ms = 2.5f;
+        candidates[1] = stored.entries[0];
+        candidates[1].duration_ms = 10.0f;
+        find_db_cpu_rank(&partial, candidates);
+        find_db_cpu_store(path.c_str(), &partial, true);
+        find_db_cpu_open(&db, path.c_str());
+        const find_db_cpu_record_t *r = find_db_cpu_find(&db, &stored.key);
+        const float expect[FIND_DB_CPU_TOP] = {2.0f, 2.5f, 3.0f, 4.0f};
+        bool ok = r && db.num_records == num_records && r->num_entries == FIND_DB_CPU_TOP;
+        for(int j = 0; ok && j < FIND_DB_CPU_TOP; j++)
+            ok = r->entries[j].duration_ms == expect[j];
+        ok = ok && strcmp(r->entries[1].kernel_name, "igemm_kernel_partial") == 0;
+        num_total++;
+        num_fail += !ok;
+        find_db_cpu_close(&db);
+
+        // merging a key that is not stored yet is a plain insert
+        find_db_cpu_record_t fresh = make_record(num_records + 1, 0);
+        find_db_cpu_store(path.c_str(), &fresh, true);
+        find_db_cpu_open(&db, path.c_str());
+        num_total++;
+        num_fail += !(db.num_records == num_records + 1 && record_equal(find_db_cpu_find(&db, &fresh.key), &fresh));
+        find_db_cpu_close(&db);
+    }
+
+    if(verbose){
+        find_db_cpu_open(&db, path.c_str());
+        const int iters = 100000;
+        int found = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for(int it = 0; it < iters; it++){
+            find_db_cpu_key_t k = test_find_db_key(it % (2 * num_records));
+            found += find_db_cpu_find(&db, &k) != nullptr;
+        }
+        printf("find_db %d lookups in %d records, %.3fus each (%d hits)\n", iters, num_records, time_ms(t0) * 1000.0 / iters, found);
+        find_db_cpu_close(&db);
+    }
+
+    // a file that is not a db is rejected, then rewritten by the next store
+    {
+        FILE *fp = fopen(path.c_str(), "wb");
+        fprintf(fp, "bench_model.csv is not a find-db\n");
+        fclose(fp);
+        num_total++;
+        num_fail += find_db_cpu_open(&db, path.c_str());
+        find_db_cpu_close(&db);
+        find_db_cpu_record_t r = make_record(3, 0);
+        find_db_cpu_store(path.c_str(), &r);
+        num_total++;
+        num_fail += !(find_db_cpu_open(&db, path.c_str()) && db.num_records == 1 && record_equal(find_db_cpu_find(&db, &r.key), &r));
+        find_db_cpu_close(&db);
+    }
+
+    unlink(path.c_str());
+    unlink((path + ".lock").c_str());
+    printf("find_db %d of %d cases valid\n", num_total - num_fail, num_total);
+    return num_fail == 0;
+}
+
+int main()
+{
+    return test_find_db(env_get_int("FIND_DB_BENCH", 0)) ? 0 : 1;
+}
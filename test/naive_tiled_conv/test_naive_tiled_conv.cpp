@@ -16,7 +16,7 @@
 #include <cmath>
 #include <iostream>
 
-// #define NAIVE_CONV_THREADED
+#define NAIVE_CONV_THREADED
 #include "naive_conv.h"
 #include "naive_tiled_conv.h"
 
@@ -327,32 +327,70 @@ public:
             std::cout << ", tx:"<<tx<<", ty:"<<ty<<","<<std::flush;
 
             if(precision == "fp32"){
-                if(layout == "nchw"){
-                    float *host_output_tiled = (float *)malloc(n * k * ho * wo * sizeof(float));
-                    memset(host_output_tiled, 0, n * k * ho * wo * sizeof(float));
-                    memset(host_output, 0, n * k * ho * wo * sizeof(float));
-                    //gen_rand_vector<float, float>(host_input, n * c * hi * wi, 0.0, 1.0);
-                    //gen_rand_vector<float, float>(host_weight, g * (k/g) * (c/g) * fy * fx, -0.5, 0.5);
-
-                    gen_rand_vector<float, int>(host_input, n * c * hi * wi, -5, 5);
-                    gen_rand_vector<float, int>(host_weight, g * (k/g) * (c/g) * fy * fx, -5, 5);
-
+                // integer data, so every summation order is exact and all directions compare bitwise
+                size_t input_size = n * c * hi * wi;
+                size_t weight_size = g * (k/g) * (c/g) * fy * fx;
+                size_t output_size = n * k * ho * wo;
+                float *host_input_tiled = (float *)malloc(input_size * sizeof(float));
+                float *host_weight_tiled = (float *)malloc(weight_size * sizeof(float));
+                float *host_output_tiled = (float *)malloc(output_size * sizeof(float));
+                bool nchw = layout == "nchw";
+
+                gen_rand_vector<float, int>(host_input, input_size, -5, 5);
+                gen_rand_vector<float, int>(host_weight, weight_size, -5, 5);
+                memset(host_output_tiled, 0, output_size * sizeof(float));
+                memset(host_output, 0, output_size * sizeof(float));
+
+                if(nchw){
                     naive_conv_fwd_nchw(host_input, host_weight, host_output, n, wi, hi, c, k, fx, fy,
                                        px, py, sx, sy, dx, dy, g);
                     naive_tiled_conv_fwd_nchw(host_input, host_weight, host_output_tiled, n, wi, hi, c, k, fx, fy,
                                        px, py, sx, sy, dx, dy, g, tx, ty);
+                }else{
+                    naive_conv_fwd_nhwc(host_input, host_weight, host_output, n, wi, hi, c, k, fx, fy,
+                                       px, py, sx, sy, dx, dy, g);
+                    naive_tiled_conv_fwd_nhwc(host_input, host_weight, host_output_tiled, n, wi, hi, c, k, fx, fy,
+                                       px, py, sx, sy, dx, dy, g, tx, ty);
+                }
+                is_valid = valid_vector_exact(host_output, host_output_tiled, output_size);
+                std::cout<<" fwd:"<<(is_valid?"y":"n");
 
-                    is_valid = valid_vector_exact(host_output, host_output_tiled, n * k * ho * wo);
+                // a small output gradient, so the wrw sums stay exact too
+                gen_rand_vector<float, int>(host_output, output_size, -5, 5);
+                if(nchw){
+                    naive_conv_bwd_nchw(host_input, host_weight, host_output, n, wi, hi, c, k, fx, fy,
+                                       px, py, sx, sy, dx, dy, g);
+                    naive_tiled_conv_bwd_nchw(host_input_tiled, host_weight, host_output, n, wi, hi, c, k, fx, fy,
+                                       px, py, sx, sy, dx, dy, g, tx, ty);
+                }else{
+                    naive_conv_bwd_nhwc(host_input, host_weight, host_output, n, wi, hi, c, k, fx, fy,
+                                       px, py, sx, sy, dx, dy, g);
+                    naive_tiled_conv_bwd_nhwc(host_input_tiled, host_weight, host_output, n, wi, hi, c, k, fx, fy,
+                                       px, py, sx, sy, dx, dy, g, tx, ty);
+                }
+                bool is_valid_bwd = valid_vector_exact(host_input, host_input_tiled, input_size);
+                std::cout<<" bwd:"<<(is_valid_bwd?"y":"n");
 
-                    std::cout<<" valid:"<<(is_valid?"y":"n");
-                    std::cout<<std::endl;
-                    std::cout << std::flush;
-                    free(host_output_tiled);
-                    assert(is_valid);
-                }else if(layout == "nhwc") {
-                   
-                    
+                if(nchw){
+                    naive_conv_wrw_nchw(host_input, host_weight, host_output, n, wi, hi, c, k, fx, fy,
+                                       px, py, sx, sy, dx, dy, g);
+                    naive_tiled_conv_wrw_nchw(host_input, host_weight_tiled, host_output, n, wi, hi, c, k, fx, fy,
+                                       px, py, sx, sy, dx, dy, g, tx, ty);
+                }else{
+                    naive_conv_wrw_nhwc(host_input, host_weight, host_output, n, wi, hi, c, k, fx, fy,
+                                       px, py, sx, sy, dx, dy, g);
+                    naive_tiled_conv_wrw_nhwc(host_input, host_weight_tiled, host_output, n, wi, hi, c, k, fx, fy,
+                                       px, py, sx, sy, dx, dy, g, tx, ty);
                 }
+                bool is_valid_wrw = valid_vector_exact(host_weight, host_weight_tiled, weight_size);
+                std::cout<<" wrw:"<<(is_valid_wrw?"y":"n");
+
+                std::cout<<std::endl;
+                std::cout << std::flush;
+                free(host_input_tiled);
+                free(host_weight_tiled);
+                free(host_output_tiled);
+                assert(is_valid && is_valid_bwd && is_valid_wrw);
             }
 
             free(host_input);
@@ -367,4 +405,5 @@ public:
 int main(){
     test_conv_t test_conv;
     test_conv.run_2d("nchw", "fp32");
+    test_conv.run_2d("nhwc", "fp32");
 }
\ No newline at end of file
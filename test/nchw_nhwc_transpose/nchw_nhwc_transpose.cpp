@@ -16,6 +16,7 @@
 #include <cmath>
 #include <iostream>
 #include "gpu_nchw_nhwc_transpose.h"
+#include "transpose_cpu.h"
 
 #define HIP_CALL(call)                                                         \
     do {                                                                       \
@@ -187,36 +188,17 @@ static inline bool valid_vector_binary(int8_t *ref, int8_t *pred, size_t bytes)
     return err == 0;
 }
 
+// host reference, blocked and multithreaded, see transpose_cpu.h
 template<typename T>
 void cpu_nchw2nhwc(T * dst, T * src, uint64_t N, uint64_t C, uint64_t H, uint64_t W)
 {
-    for(uint64_t i_n = 0; i_n < N; i_n++){
-        for(uint64_t i_h = 0; i_h < H; i_h++){
-            for(uint64_t i_w = 0; i_w < W; i_w++){
-                for(uint64_t i_c =0 ; i_c < C; i_c++){
-                    uint64_t idx_nhwc = i_n * H * W * C + i_h * W * C + i_w * C + i_c;
-                    uint64_t idx_nchw = i_n * C * H * W + i_c * H * W + i_h * W + i_w;
-                    dst[idx_nhwc] = src[idx_nchw];
-                }
-            }
-        }
-    }
+    transpose_cpu_nchw_2_nhwc(dst, src, N, C, H, W);
 }
 
 template<typename T>
 void cpu_nhwc2nchw(T * dst, T * src, uint64_t N, uint64_t C, uint64_t H, uint64_t W)
 {
-    for(uint64_t i_n = 0; i_n < N; i_n++){
-        for(uint64_t i_c =0 ; i_c < C; i_c++){
-            for(uint64_t i_h = 0; i_h < H; i_h++){
-                for(uint64_t i_w = 0; i_w < W; i_w++){
-                    uint64_t idx_nhwc = i_n * H * W * C + i_h * W * C + i_w * C + i_c;
-                    uint64_t idx_nchw = i_n * C * H * W + i_c * H * W + i_h * W + i_w;
-                    dst[idx_nchw] = src[idx_nhwc];
-                }
-            }
-        }
-    }
+    transpose_cpu_nhwc_2_nchw(dst, src, N, C, H, W);
 }
 
 #define WARMUP 3
@@ -41,6 +41,7 @@
 #include <iostream>
 #include "gpu_tensor_reorder.h"
 #include "sequence.hpp"
+#include "tensor_reorder_cpu.h"
 
 
 #ifndef HIP_CALL
@@ -215,49 +216,12 @@ static inline bool valid_vector_binary(int8_t *ref, int8_t *pred, size_t bytes)
     return err == 0;
 }
 
+// host reference, see tensor_reorder_cpu.h
 template<typename T,
          typename dst_order>
 void cpu_tensor_reorder(T * dst, T * src, uint64_t dim_0, uint64_t dim_1, uint64_t dim_2, uint64_t dim_3)
 {
-    constexpr auto dorder = dst_order{};
-    const uint64_t src_dim[4] = {dim_0, dim_1, dim_2, dim_3};
-    const uint64_t dst_dim[4] = {src_dim[dorder.at(0)], src_dim[dorder.at(1)], src_dim[dorder.at(2)], src_dim[dorder.at(3)]};
-    
-    const uint64_t src_stride[4]   ={src_dim[1] * src_dim[2] * src_dim[3], 
-                                     src_dim[2] * src_dim[3], 
-                                     src_dim[3],
-                                     1 };
-    const uint64_t dst_stride[4]  = {dst_dim[1] * dst_dim[2] * dst_dim[3], 
-                                     dst_dim[2] * dst_dim[3], 
-                                     dst_dim[3],
-                                     1 };
-
-    uint64_t itr_src_dim[4]  = {0, 0, 0, 0};
-    uint64_t itr_dst_dim[4] = {0, 0, 0, 0};
-
-    for(itr_src_dim[0] = 0; itr_src_dim[0] < src_dim[0]; itr_src_dim[0]++){
-        for(itr_src_dim[1] = 0; itr_src_dim[1] < src_dim[1]; itr_src_dim[1]++){
-            for(itr_src_dim[2] = 0; itr_src_dim[2] < src_dim[2]; itr_src_dim[2]++){
-                for(itr_src_dim[3] = 0; itr_src_dim[3] < src_dim[3]; itr_src_dim[3]++){
-                    itr_dst_dim[0] = itr_src_dim[dorder.at(0)];
-                    itr_dst_dim[1] = itr_src_dim[dorder.at(1)];
-                    itr_dst_dim[2] = itr_src_dim[dorder.at(2)];
-                    itr_dst_dim[3] = itr_src_dim[dorder.at(3)];
-
-                    uint64_t idx_src =   itr_src_dim[0] * src_stride[0] +
-                                         itr_src_dim[1] * src_stride[1] +
-                                         itr_src_dim[2] * src_stride[2] +
-                                         itr_src_dim[3] * src_stride[3] ;
-                    uint64_t idx_dst =   itr_dst_dim[0] * dst_stride[0] + 
-                                         itr_dst_dim[1] * dst_stride[1] +
-                                         itr_dst_dim[2] * dst_stride[2] +
-                                         itr_dst_dim[3] * dst_stride[3] ;
-                    
-                    dst[idx_dst] = src[idx_src]; 
-                }
-            }
-        }
-    }
+    tensor_reorder_cpu<T, dst_order>(dst, src, dim_0, dim_1, dim_2, dim_3);
 }
 
 //compile time for_loop